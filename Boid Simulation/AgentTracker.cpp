@@ -0,0 +1,235 @@
+#include "stdafx.h"
+#include "agentTracker.h"
+
+//readbacks in flight, the gather of a step is skipped if none of them is complete
+#define TRACKER_READBACKS 3
+
+AgentTracker::AgentTracker(CLHelper* clHlpr, unsigned int n, unsigned int comp, float y, float yV){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	queue = clHelper->getCmdQueue();
+	devices = clHelper->getDevices();
+
+	num = n;
+	components = comp;
+	yPos = y;
+	yVel = yV;
+	current = 0;
+	probesDirty = false;
+	probeCapacity = 1;
+	generation = 0;
+	sequence = 0;
+	nextReadback = 0;
+
+	readbacks.resize(TRACKER_READBACKS);
+	for (size_t i = 0; i < readbacks.size(); i++){
+		readbacks[i].generation = 0;
+		readbacks[i].sequence = 0;
+	}
+
+	//before the first step every agent is in the slot of its id
+	std::vector<unsigned int> identity(num > 0 ? num : 1);
+	for (unsigned int i = 0; i < identity.size(); i++)
+		identity[i] = i;
+	size_t size = identity.size() * sizeof(unsigned int);
+	std::vector<unsigned char> alive(identity.size(), 1);
+
+	try
+	{
+		cl_agentId[0] = clHelper->createBuffer(CL_MEM_READ_WRITE, size, NULL, &err);
+		cl_agentId[1] = clHelper->createBuffer(CL_MEM_READ_WRITE, size, NULL, &err);
+		cl_agentSlot = clHelper->createBuffer(CL_MEM_READ_WRITE, size, NULL, &err);
+		cl_alive = clHelper->createBuffer(CL_MEM_READ_ONLY, alive.size() * sizeof(unsigned char), NULL, &err);
+		cl_probeIds = clHelper->createBuffer(CL_MEM_READ_ONLY, probeCapacity * sizeof(unsigned int), NULL, &err);
+		cl_probes = clHelper->createBuffer(CL_MEM_WRITE_ONLY, 2 * probeCapacity * sizeof(Vec4), NULL, &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueWriteBuffer(cl_agentId[0], CL_TRUE, 0, size, identity.data());
+	err = queue.enqueueWriteBuffer(cl_agentSlot, CL_TRUE, 0, size, identity.data());
+	err = queue.enqueueWriteBuffer(cl_alive, CL_TRUE, 0, alive.size() * sizeof(unsigned char), alive.data());
+
+	loadProgram(kernel_path + "agentTracker_kernel.cl");
+
+	try
+	{
+		kernel_permuteAgents = cl::Kernel(program, "permuteAgents", &err);
+		kernel_gatherProbes = cl::Kernel(program, "gatherProbes", &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+AgentTracker::~AgentTracker(){
+	//pending readbacks write into the host buffers
+	queue.finish();
+}
+
+void AgentTracker::permute(const cl::Buffer &gridIndex){
+	try
+	{
+		err = kernel_permuteAgents.setArg(0, gridIndex);
+		err = kernel_permuteAgents.setArg(1, cl_agentId[current]);
+		err = kernel_permuteAgents.setArg(2, cl_agentId[1 - current]);
+		err = kernel_permuteAgents.setArg(3, cl_agentSlot);
+		err = kernel_permuteAgents.setArg(4, num);
+		err = queue.enqueueNDRangeKernel(kernel_permuteAgents, cl::NullRange, cl::NDRange(num), cl::NullRange);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+	current = 1 - current;
+}
+
+const cl::Buffer &AgentTracker::getAgentIds(){
+	return cl_agentId[current];
+}
+
+void AgentTracker::setAlive(const cl::Buffer &alive){
+	cl_alive = alive;
+}
+
+void AgentTracker::gather(const cl::Memory &pos, const cl::Memory &vel){
+	if (probesDirty){
+		probesDirty = false;
+		if (probeIds.size() > probeCapacity){
+			probeCapacity = probeIds.size();
+			try
+			{
+				cl_probeIds = clHelper->createBuffer(CL_MEM_READ_ONLY, probeCapacity * sizeof(unsigned int), NULL, &err);
+				cl_probes = clHelper->createBuffer(CL_MEM_WRITE_ONLY, 2 * probeCapacity * sizeof(Vec4), NULL, &err);
+			}
+			catch (cl::Error er) {
+				clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+			}
+		}
+		//blocking, setProbes may change the ids before a non blocking write is done
+		if (!probeIds.empty())
+			err = queue.enqueueWriteBuffer(cl_probeIds, CL_TRUE, 0, probeIds.size() * sizeof(unsigned int), probeIds.data());
+	}
+
+	if (probeIds.empty())
+		return;
+
+	//the host has not caught up with the device, no readback is free
+	readback_t &readback = readbacks[nextReadback];
+	if (readback.sequence != 0 && !isComplete(readback))
+		return;
+
+	unsigned int count = (unsigned int)probeIds.size();
+	readback.ids = probeIds;
+	readback.data.resize(2 * count);
+	readback.generation = generation;
+	readback.sequence = ++sequence;
+
+	try
+	{
+		err = kernel_gatherProbes.setArg(0, cl_probeIds);
+		err = kernel_gatherProbes.setArg(1, cl_agentSlot);
+		err = kernel_gatherProbes.setArg(2, pos);
+		err = kernel_gatherProbes.setArg(3, vel);
+		err = kernel_gatherProbes.setArg(4, cl_alive);
+		err = kernel_gatherProbes.setArg(5, cl_probes);
+		err = kernel_gatherProbes.setArg(6, components);
+		err = kernel_gatherProbes.setArg(7, yPos);
+		err = kernel_gatherProbes.setArg(8, yVel);
+		err = kernel_gatherProbes.setArg(9, count);
+		err = queue.enqueueNDRangeKernel(kernel_gatherProbes, cl::NullRange, cl::NDRange(count), cl::NullRange);
+		err = queue.enqueueReadBuffer(cl_probes, CL_FALSE, 0, 2 * count * sizeof(Vec4), readback.data.data(), NULL, &readback.event);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		readback.sequence = 0;
+	}
+	nextReadback = (nextReadback + 1) % TRACKER_READBACKS;
+}
+
+void AgentTracker::setProbes(const std::vector<unsigned int> &ids){
+	std::vector<unsigned int> valid;
+	valid.reserve(ids.size());
+	for (size_t i = 0; i < ids.size(); i++)
+		if (ids[i] < num)
+			valid.push_back(ids[i]);
+
+	if (valid == probeIds)
+		return;
+	probeIds.swap(valid);
+	probesDirty = true;
+	generation++;
+}
+
+bool AgentTracker::getProbes(std::vector<unsigned int>* ids, std::vector<Vec4>* pos, std::vector<Vec4>* vel, std::vector<bool>* alive){
+	int newest = -1;
+	for (int i = 0; i < (int)readbacks.size(); i++){
+		const readback_t &readback = readbacks[i];
+		if (readback.sequence == 0 || readback.generation != generation || !isComplete(readback))
+			continue;
+		if (newest < 0 || readback.sequence > readbacks[newest].sequence)
+			newest = i;
+	}
+	if (newest < 0)
+		return false;
+
+	const readback_t &readback = readbacks[newest];
+	size_t count = readback.ids.size();
+	*ids = readback.ids;
+	pos->resize(count);
+	vel->resize(count);
+	alive->resize(count);
+	for (size_t i = 0; i < count; i++){
+		(*pos)[i] = readback.data[2 * i];
+		(*vel)[i] = readback.data[2 * i + 1];
+		//the w of the position carries the alive flag
+		(*alive)[i] = (*pos)[i].w != 0.0f;
+		(*pos)[i].w = 0.0f;
+	}
+	return true;
+}
+
+bool AgentTracker::isComplete(const readback_t &readback){
+	return readback.event() != NULL && readback.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE;
+}
+
+void AgentTracker::loadProgram(const std::string &filename){
+	std::string kernelSource;
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + filename);
+		throw(errno);
+	}
+
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		program = cl::Program(context, source);
+	}
+	catch (cl::Error er)
+	{
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	try
+	{
+		err = program.build(devices);
+	}
+	catch (cl::Error er) {
+		clHelper->log("program build: " + clHelper->oclErrorString(er.err()));
+		clHelper->log("\n----------------------buildLog start--------------------\n");
+		std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+		clHelper->log(buildLog);
+		clHelper->log("\n----------------------buildLog end--------------------\n");
+	}
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _AGENTTRACKER_H_
+#define _AGENTTRACKER_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "tracer.h"
+#include "vectorTypes.h"
+
+/*
+	Position and velocity of a set of agents by their original id, although the grid models
+	reorder the agents every step. The id of the agent in every slot and the inverse, the slot
+	of every id, are kept on the device and permuted together with the agents
+	(kernels/agentTracker_kernel.cl). The probed agents are gathered into a buffer of two float4
+	per agent, which is read back without waiting; the host gets the newest completed readback.
+	Models with a live population hand over its alive mask, the probes of despawned agents
+	report the stale state of their slot and are flagged dead.
+*/
+class AgentTracker
+{
+public:
+	// components of the position and velocity buffers are 4 or 2, the missing y of the 2D
+	// models is filled in with yPos and yVel
+	AgentTracker(CLHelper* clHlpr, unsigned int num, unsigned int components = 4, float yPos = 0.0f, float yVel = 0.0f);
+	~AgentTracker();
+
+	// the model moved the agent of slot gridIndex[i] into slot i, enqueue the same move of the ids
+	void permute(const cl::Buffer &gridIndex);
+	// id of the agent in every slot after the last permute
+	const cl::Buffer &getAgentIds();
+	// alive mask of the slots (kernels/population_kernel.cl), without one every agent is alive
+	void setAlive(const cl::Buffer &alive);
+	// copy the probed agents out of the newest position and velocity buffers and start their
+	// readback, the buffers have to be acquired
+	void gather(const cl::Memory &pos, const cl::Memory &vel);
+
+	// agents to probe from the next gather on, ids not below num are ignored
+	void setProbes(const std::vector<unsigned int> &ids);
+	// the newest completed readback of the current probes, false if there is none yet. alive
+	// tells per probe whether the agent lives, pos and vel of a dead one are meaningless
+	bool getProbes(std::vector<unsigned int>* ids, std::vector<Vec4>* pos, std::vector<Vec4>* vel, std::vector<bool>* alive);
+
+private:
+	typedef struct{
+		std::vector<unsigned int> ids;
+		std::vector<Vec4> data;
+		cl::Event event;
+		unsigned int generation;
+		// order of the readbacks, 0 before the first one
+		unsigned int sequence;
+	} readback_t;
+
+	void loadProgram(const std::string &filename);
+	// true if the readback is on the host
+	static bool isComplete(const readback_t &readback);
+
+	CLHelper* clHelper;
+	cl::Context context;
+	TracedQueue queue;
+	std::vector<cl::Device> devices;
+	cl::Program program;
+	cl_int err;
+
+	cl::Kernel kernel_permuteAgents;
+	cl::Kernel kernel_gatherProbes;
+
+	// id of the agent in every slot, double buffered
+	cl::Buffer cl_agentId[2];
+	// slot of every id
+	cl::Buffer cl_agentSlot;
+	cl::Buffer cl_alive;
+	cl::Buffer cl_probeIds;
+	cl::Buffer cl_probes;
+
+	unsigned int num;
+	unsigned int components;
+	float yPos;
+	float yVel;
+	unsigned int current;
+
+	std::vector<unsigned int> probeIds;
+	// probeIds changed and are not on the device yet
+	bool probesDirty;
+	// probes the device buffers are allocated for
+	size_t probeCapacity;
+	// counts the changes of probeIds, readbacks of older probes are not returned
+	unsigned int generation;
+
+	std::vector<readback_t> readbacks;
+	unsigned int sequence;
+	unsigned int nextReadback;
+};
+
+#endif
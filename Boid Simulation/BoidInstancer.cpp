@@ -0,0 +1,186 @@
+#include "stdafx.h"
+#include "boidInstancer.h"
+
+//work group size of shaders/boidCull.c.glsl
+#define CULL_GROUP_SIZE 256
+//bytes of one instance, position, direction and color
+#define INSTANCE_SIZE (3 * sizeof(Vec4))
+
+BoidInstancer::BoidInstancer(){
+	cullShader = new Shader("boidCull.c.glsl");
+	triShader = new Shader("boidInst.v.glsl", "boidTri.f.glsl");
+	pointShader = new Shader("boidInstPoint.v.glsl", "boidTri.f.glsl");
+
+	glGenBuffers(1, &instanceBuffer);
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, 8 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	//one instance per boid, the glyph corners and the point come from gl_VertexID
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (GLuint i = 0; i < 3; i++){
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, INSTANCE_SIZE, (const GLvoid*)(i * sizeof(Vec4)));
+		glVertexAttribDivisor(i, 1);
+		glEnableVertexAttribArray(i);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	capacity = 0;
+	viewProjection = glm::mat4(1.0f);
+	memset(planes, 0, sizeof(planes));
+	countFence = NULL;
+	nearCount = 0;
+	farCount = 0;
+}
+
+BoidInstancer::~BoidInstancer(){
+	delete cullShader;
+	delete triShader;
+	delete pointShader;
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteVertexArrays(1, &vao);
+	if (countFence != NULL)
+		glDeleteSync(countFence);
+}
+
+bool BoidInstancer::isSupported(){
+	return GLEW_VERSION_4_3 ? true : false;
+}
+
+void BoidInstancer::setView(const glm::mat4 &vp){
+	viewProjection = vp;
+
+	//left, right, bottom, top, near and far plane from the rows of the matrix
+	for (int p = 0; p < 6; p++){
+		int row = p / 2;
+		float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		for (int c = 0; c < 4; c++)
+			planes[p][c] = vp[c][3] + sign * vp[c][row];
+
+		float length = sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+		if (length > 0.0f){
+			for (int c = 0; c < 4; c++)
+				planes[p][c] /= length;
+		}
+	}
+}
+
+void BoidInstancer::draw(stream_t pos, stream_t vel, stream_t color, stream_t group, unsigned int components, int count, float extrapolate, Shader* modelShader){
+	if (count <= 0 || pos.buffer == 0 || vel.buffer == 0)
+		return;
+
+	if (count > capacity){
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, count * INSTANCE_SIZE, NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		capacity = count;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	//the counts of an earlier frame, only read once the GPU is done with it
+	if (countFence != NULL && glClientWaitSync(countFence, 0, 0) != GL_TIMEOUT_EXPIRED){
+		GLuint commands[8];
+		glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+		nearCount = commands[1];
+		farCount = commands[5];
+		glDeleteSync(countFence);
+		countFence = NULL;
+	}
+
+	//six vertices per glyph and one per point, the instance counts are filled in by the cull pass
+	GLuint commands[8] = { 6, 0, 0, 0, 1, 0, 0, 0 };
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+
+	GLuint id = cullShader->id();
+	cullShader->bind();
+
+	bindStream("posAccess", 0, pos, sizeof(float), components * sizeof(float));
+	bindStream("velAccess", 1, vel, sizeof(float), components * sizeof(float));
+	bindStream("colorAccess", 2, color, sizeof(float), sizeof(Vec4));
+	bindStream("groupAccess", 3, group, sizeof(unsigned char), sizeof(unsigned char));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, commandBuffer);
+
+	float yPlane = 0.0f;
+	GLint loc = glGetUniformLocation(modelShader->id(), "y_plane");
+	if (loc >= 0)
+		glGetUniformfv(modelShader->id(), loc, &yPlane);
+
+	//the group colors can change at runtime, they are taken from the model every frame
+	std::vector<Vec4> groupColor(NUM_GROUPS_MAX, BOID_COLOR);
+	for (int i = 0; i < NUM_GROUPS_MAX && group.buffer != 0; i++){
+		std::string name = "groupColor[" + std::to_string(i) + "]";
+		loc = glGetUniformLocation(modelShader->id(), name.c_str());
+		if (loc >= 0)
+			glGetUniformfv(modelShader->id(), loc, &groupColor[i].x);
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	Vec4 boidColor = BOID_COLOR;
+
+	glUniform1ui(glGetUniformLocation(id, "numBoids"), count);
+	glUniform1ui(glGetUniformLocation(id, "components"), components);
+	glUniform1f(glGetUniformLocation(id, "yPlane"), yPlane);
+	glUniform1i(glGetUniformLocation(id, "colorMode"), color.buffer != 0 ? 0 : (group.buffer != 0 ? 1 : 2));
+	glUniform4fv(glGetUniformLocation(id, "boidColor"), 1, &boidColor.x);
+	glUniform4fv(glGetUniformLocation(id, "groupColor"), NUM_GROUPS_MAX, &groupColor[0].x);
+	glUniformMatrix4fv(glGetUniformLocation(id, "m_transform"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+	glUniform4fv(glGetUniformLocation(id, "planes"), 6, &planes[0][0]);
+	glUniform2f(glGetUniformLocation(id, "viewportSize"), (float)viewport[2], (float)viewport[3]);
+	glUniform1f(glGetUniformLocation(id, "lodPixels"), INSTANCE_LOD_PIXELS);
+	glUniform1f(glGetUniformLocation(id, "extrapolate"), extrapolate);
+
+	glUniform1i(glGetUniformLocation(id, "finalize"), 0);
+	glDispatchCompute((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	//the points start behind the last glyph
+	glUniform1i(glGetUniformLocation(id, "finalize"), 1);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+	for (GLuint i = 0; i < 6; i++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+	cullShader->unbind();
+
+	glBindVertexArray(vao);
+
+	triShader->bind();
+	glUniformMatrix4fv(glGetUniformLocation(triShader->id(), "m_transform"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+	glDrawArraysIndirect(GL_TRIANGLES, (const GLvoid*)0);
+
+	pointShader->bind();
+	glUniformMatrix4fv(glGetUniformLocation(pointShader->id(), "m_transform"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+	glUniform1f(glGetUniformLocation(pointShader->id(), "pointSize"), INSTANCE_POINT_SIZE);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glDrawArraysIndirect(GL_POINTS, (const GLvoid*)(4 * sizeof(GLuint)));
+	glDisable(GL_PROGRAM_POINT_SIZE);
+	pointShader->unbind();
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (countFence == NULL)
+		countFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+unsigned int BoidInstancer::getNearCount(){
+	return nearCount;
+}
+
+unsigned int BoidInstancer::getFarCount(){
+	return farCount;
+}
+
+void BoidInstancer::bindStream(const char* name, GLuint binding, stream_t stream, GLuint unitSize, GLuint tightSize){
+	GLuint stride = stream.stride != 0 ? stream.stride : tightSize;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, stream.buffer);
+	glUniform2ui(glGetUniformLocation(cullShader->id(), name), stride / unitSize, stream.offset / unitSize);
+}
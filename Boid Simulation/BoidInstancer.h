@@ -0,0 +1,73 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _BOIDINSTANCER_H_
+#define _BOIDINSTANCER_H_
+
+#include "stdafx.h"
+#include "shader.h"
+#include "simParam.h"
+#include "vectorTypes.h"
+
+/*
+	Instanced boid rendering without the geometry shader. A compute pass (shaders/boidCull.c.glsl)
+	reads the buffers of a boid model, drops the boids outside the view frustum and sorts the others
+	into two tiers: triangle glyphs near the camera and points far away. It writes one instance per
+	boid and the instance counts into an indirect draw buffer, so the CPU never reads the counts
+	back before drawing. Needs OpenGL 4.3.
+*/
+class BoidInstancer
+{
+public:
+	// one attribute of the boid model, buffer 0 if the model does not have it
+	typedef struct{
+		GLuint buffer;
+		// in bytes
+		GLuint stride;
+		GLuint offset;
+	} stream_t;
+
+	BoidInstancer();
+	~BoidInstancer();
+
+	// true if the GL context has compute shaders and indirect draws with a base instance
+	static bool isSupported();
+
+	// camera of the next frames, the boids are drawn with the identity model matrix
+	void setView(const glm::mat4 &viewProjection);
+
+	// cull and draw count boids. components is 2 for the 2D models, 4 otherwise. yPlane and the
+	// group colors are read from the uniforms of modelShader
+	void draw(stream_t pos, stream_t vel, stream_t color, stream_t group, unsigned int components, int count, float extrapolate, Shader* modelShader);
+
+	// boids drawn as glyphs and as points in the last frame the GPU finished
+	unsigned int getNearCount();
+	unsigned int getFarCount();
+
+private:
+	// bind the buffer of stream and set the uniform name to its stride and offset in units of unitSize
+	void bindStream(const char* name, GLuint binding, stream_t stream, GLuint unitSize, GLuint tightSize);
+
+	Shader* cullShader;
+	Shader* triShader;
+	Shader* pointShader;
+
+	GLuint instanceBuffer;
+	GLuint commandBuffer;
+	GLuint vao;
+	int capacity;
+
+	glm::mat4 viewProjection;
+	float planes[6][4];
+
+	// counts of a finished frame, read without waiting for the GPU
+	GLsync countFence;
+	unsigned int nearCount;
+	unsigned int farCount;
+};
+
+#endif
@@ -15,6 +15,11 @@
 #include "vectorTypes.h"
 #include "shader.h"
 #include "renderable.h"
+#include "flowField.h"
+#include "tracer.h"
+#include "agentTracker.h"
+#include "spatialQuery.h"
+#include "population.h"
 
 /*
 	Simulation parameters used in OpenCL kernels
@@ -36,9 +41,33 @@ typedef struct simParams_t{
 
 	float maxVel;				// maximum velocity 
 	float maxVelCor;			// maximum correction velocity
+	float factorSDF;			// repulsion of the obstacle mesh (SH obstacle model)
+	float sdfRange;				// distance from the mesh where its repulsion starts
 
 } simParams_t;
 
+/*
+	Attributes shared by all boids of a group, every boid only carries its group id.
+	Same layout as group_t in the kernels.
+*/
+typedef struct group_t{
+	Vec4 goal;					// goal of the group, w is the flow field id where flow fields are used
+	Vec4 color;					// color of the group members
+	float wPath;				// weight of the path to the goal
+	float wSeparation;			// weight of separation
+	float maxVel;				// maximum velocity of the group members
+	float pad;
+} group_t;
+
+/*
+	Kernel source of a program of a model, rebuilt by LiveTuning when it changes.
+	shOrder > 0 puts the SH basis of that order in front of the source (CLHelper::getSHBasisSource).
+*/
+typedef struct program_t{
+	std::string file;
+	unsigned int shOrder;
+} program_t;
+
 /*
 	Virtual base class for boids, implements interface Renderable.
 */
@@ -48,8 +77,17 @@ public:
 	simParams_t simParams;
 	CLHelper* clHelper;
 
-	BoidModel(CLHelper* clHlpr) { clHelper = clHlpr; };
-	virtual ~BoidModel() {};
+	BoidModel(CLHelper* clHlpr) {
+		clHelper = clHlpr; tracker = NULL; spatialQuery = NULL; population = NULL;
+
+		//the histograms are shared by all models, the metrics hand out the same ones again
+		static const char* stageNames[STAGE_COUNT] = { "hash", "sort", "reorder", "simulate", "reduce", "sh" };
+		Metrics &metrics = Metrics::getInstance();
+		for (int i = 0; i < STAGE_COUNT; i++)
+			stageHistograms[i] = metrics.histogram("boids_stage_seconds", "Duration of the stages of a simulation step, device time except for the sort", "stage=\"" + std::string(stageNames[i]) + "\"");
+		sortPasses = metrics.counter("boids_sort_passes_total", "Kernel launches of the bitonic sort");
+	};
+	virtual ~BoidModel() { delete tracker; delete spatialQuery; delete population; };
 
 	/* Execute all simulation steps for the boid model
 	dt - delta time */
@@ -73,13 +111,164 @@ public:
 	/* Returns std::vector with pointers to text which is used to display text in the interface */
 	virtual std::vector<const char*> getSimTimeDescriptions() = 0;
 
-	/* Get position data of a specific Boid, boidIndex passed in may be changed to new Index after reordering */
-	virtual void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel) = 0;
+	/* Boids whose position and velocity are gathered after every step, by their index at creation */
+	void setProbes(const std::vector<unsigned int> &ids){
+		if (tracker != NULL)
+			tracker->setProbes(ids);
+	};
+
+	/* Position and velocity of the probed boids from the newest completed readback, a few steps old at most,
+	alive is false for despawned boids. Returns false if there is no readback of the current probes yet */
+	bool getProbes(std::vector<unsigned int>* ids, std::vector<Vec4>* pos, std::vector<Vec4>* vel, std::vector<bool>* alive){
+		return tracker != NULL && tracker->getProbes(ids, pos, vel, alive);
+	};
+
+	/* Queue a batch of radius or k nearest queries for the next step.
+	Returns the ticket of the batch, 0 for models without a grid */
+	unsigned int submitRadiusQuery(const std::vector<Vec4> &points, float radius){
+		return spatialQuery != NULL ? spatialQuery->submitRadius(points, radius) : 0;
+	};
+	unsigned int submitNearestQuery(const std::vector<Vec4> &points, unsigned int k){
+		return spatialQuery != NULL ? spatialQuery->submitNearest(points, k) : 0;
+	};
+
+	/* Result of a query batch, false until it arrived on the host two steps after its run */
+	bool getQueryResult(unsigned int ticket, SpatialQuery::result_t* result){
+		return spatialQuery != NULL && spatialQuery->getResult(ticket, result);
+	};
+
+	/* Boids the buffers of the model hold, 0 for models without a live population */
+	unsigned int getCapacity(){
+		return population != NULL ? population->getCapacity() : 0;
+	};
+
+	/* Keep about live boids, the others are despawned at random at the end of the next step */
+	void despawnTo(unsigned int live){
+		if (population != NULL)
+			population->despawnTo(live);
+	};
+
+	/* Spawn count boids from the emitter at the end of the next step, as many as there is room for */
+	void spawn(const emitter_t &emitter, unsigned int count){
+		if (population != NULL)
+			population->spawn(emitter, count);
+	};
+
+	/* Emitters spawning and sink boxes (min, max pairs) despawning boids every step */
+	void setSources(const std::vector<emitter_t> &emitters, const std::vector<Vec4> &sinks){
+		if (population != NULL){
+			population->setEmitters(emitters);
+			population->setSinks(sinks);
+		}
+	};
+
+	/* Programs the model is built from, their sources are watched for changes */
+	std::vector<program_t> getPrograms(){
+		return programs;
+	};
+
+	/* Swap in a rebuilt program between two steps. All kernels are created again, the buffers and the boids stay */
+	void reloadProgram(unsigned int index, cl::Program program){
+		if (index >= programTargets.size())
+			return;
+		*programTargets[index] = program;
+		loadKernel();
+		log("reloaded program " + programs[index].file);
+	};
+
+	/* Weights and maximum velocities tuned while the model runs, written to the device before the next step */
+	void tuneSimParams(const simParams_t &tuned){
+		simParams.wSeparation = tuned.wSeparation;
+		simParams.wAlignment = tuned.wAlignment;
+		simParams.wCohesion = tuned.wCohesion;
+		simParams.wOwn = tuned.wOwn;
+		simParams.wPath = tuned.wPath;
+		simParams.maxVel = tuned.maxVel;
+		simParams.maxVelCor = tuned.maxVelCor;
+		loadSimParams();
+	};
+
+	/* Queue the query benchmark, the throughput of every query type is written to the log */
+	void benchmarkQueries(){
+		if (spatialQuery != NULL)
+			spatialQuery->benchmark();
+	};
+
+	/* Replace goal, color and weights of one group, ignored by models without groups */
+	virtual void setGroup(unsigned int id, group_t group) {};
+
+	/* Region of interest for the level of detail tiers, ignored by models without tiers.
+	viewProjection - camera matrix, cells outside its frustum or LOD_DISTANCE away from eye are coarse
+	boxes - min, max pairs which always run the full rules */
+	virtual void setRegionOfInterest(const glm::mat4 &viewProjection, glm::vec3 eye, const std::vector<Vec4> &boxes) {};
+
+	/* Cells with boids and boids in the fullest cell after the last step, reads the grid back.
+	Returns false for models without a grid */
+	virtual bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount) { return false; };
 
 	/* Helper method to write to the log file */
 	inline void log(std::string entry){
 		clHelper->log(entry);
 	};
+
+protected:
+	/* Stages of a step, in the order of the times on the overlay */
+	enum stage_t { STAGE_HASH, STAGE_SORT, STAGE_REORDER, STAGE_SIMULATE, STAGE_REDUCE, STAGE_SH, STAGE_COUNT };
+
+	/* Latency histogram per stage and the launches of the bitonic sort, recorded by the models
+	whether tracing is on or not */
+	Metrics::Histogram* stageHistograms[STAGE_COUNT];
+	Metrics::Counter* sortPasses;
+
+	/* Ids and slots of the boids through the reordering and the probes, created by the models */
+	AgentTracker* tracker;
+	/* Radius and nearest queries on the grid, created by the models with a grid */
+	SpatialQuery* spatialQuery;
+	/* Alive mask and live count of the models with a grid, the others always run all boids */
+	Population* population;
+	/* Sources of the programs and the members their kernels are created from, same order */
+	std::vector<program_t> programs;
+	std::vector<cl::Program*> programTargets;
+
+	/* Watch the source of a program, target is the member loadKernel creates the kernels from */
+	void watchProgram(cl::Program* target, const std::string &file, unsigned int shOrder = 0){
+		program_t program;
+		program.file = file;
+		program.shOrder = shOrder;
+		programs.push_back(program);
+		programTargets.push_back(target);
+	};
+
+	/* Duration of a stage of the step in us, recorded at the end of the stage */
+	void recordStage(stage_t stage, double us){
+		stageHistograms[stage]->record(us);
+	};
+
+	/* Create the kernels from the programs, again after a program was reloaded */
+	virtual void loadKernel() {};
+
+	/* Write simParams to the device */
+	virtual void loadSimParams() {};
+
+	/* Occupancy from the index of the first and behind the last boid of every cell, empty cells have equal indices */
+	bool readCellOccupancy(TracedQueue &queue, const cl::Buffer &start, const cl::Buffer &end, unsigned int* occupied, unsigned int* maxCount){
+		//the cell behind the grid holds the dead boids
+		size_t numCells = simParams.numCells;
+		std::vector<unsigned int> first(numCells), behind(numCells);
+		queue.enqueueReadBuffer(start, CL_TRUE, 0, numCells * sizeof(unsigned int), first.data());
+		queue.enqueueReadBuffer(end, CL_TRUE, 0, numCells * sizeof(unsigned int), behind.data());
+
+		*occupied = 0;
+		*maxCount = 0;
+		for (size_t i = 0; i < numCells; i++){
+			if (behind[i] <= first[i])
+				continue;
+			(*occupied)++;
+			if (behind[i] - first[i] > *maxCount)
+				*maxCount = behind[i] - first[i];
+		}
+		return true;
+	};
 };
 
 /*
@@ -99,7 +288,6 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
 
 	// Inheritate from Renderable
 	void render();
@@ -126,6 +314,9 @@ private:
 	vel - vector of Vec4 which contains boid velocities */
 	void loadData();
 
+	/* Write the simulation parameters to the openCL device */
+	void loadSimParams();
+
 	// helper is used to switch between input and output position buffer
 	int helper = 0;
 	GLuint pos_vbo[1];
@@ -150,7 +341,7 @@ private:
 	Shader* shader;
 
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program program;
 	std::vector<cl::Device> devices;
 	cl::Kernel kernel;
@@ -187,7 +378,7 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
 	
 	// override Renderable
 	void render();
@@ -212,6 +403,9 @@ private:
 	vel - vector of Vec4 with velocity data for boids */
 	void loadData(std::vector<Vec4> vel);
 
+	/* write the simulation parameters to the device */
+	void loadSimParams();
+
 	/* bitonic sort for key-value pairs (NVIDIA implementation)
 	-d_DstKey Destination for output keys
 	-d_DstVal Destination for output value
@@ -249,7 +443,7 @@ private:
 	long times[4];
 
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -310,7 +504,7 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
 
 	// override Renderable
 	void render();
@@ -319,10 +513,11 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
 	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel);
 	void loadData();
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
 	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel);
 
@@ -352,7 +547,7 @@ private:
 	long times[6];
 
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -400,7 +595,7 @@ private:
 	Shader* shader;
 };
 
-/* Currently exactly the same as BoidModelGrid. Velocity on Y axis is set to 0. */
+/* BoidModelGrid in the x/z plane. Positions and velocities are float2, neighbours come from the 9 surrounding cells. */
 class BoidModelGrid_2D : public BoidModel
 {
 public:
@@ -412,7 +607,7 @@ public:
 	GLuint getPosVAO();
 	int getNumBoid();
 	long getSimulationTime();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
 
 	void render();
 	Shader* getShader();
@@ -423,10 +618,11 @@ public:
 private:
 	cl::Program loadProgram(const std::string &filename);
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel);
-	void loadData(std::vector<Vec4> vel);
+	void createBuffer(std::vector<float2> pos, std::vector<float2> vel);
+	void loadData(std::vector<float2> vel);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel);
+	void createVboBindShader(std::vector<float2> pos, std::vector<float2> vel);
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
@@ -446,7 +642,7 @@ private:
 	long times[4];
 
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -484,7 +680,7 @@ private:
 	Shader* shader;
 };
 
-/* Currently exactly the same as BoidModelSH. Velocity on Y axis is set to 0.*/
+/* BoidModelSH in the x/z plane. Positions and velocities are float2, directions are projected on circular harmonics.*/
 class BoidModelSH_2D : public BoidModel
 {
 public:
@@ -497,7 +693,7 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
 
 	void render();
 	Shader* getShader();
@@ -507,10 +703,11 @@ public:
 private:
 	cl::Program loadProgram(const std::string &filename);
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel);
+	void createBuffer(std::vector<float2> pos, std::vector<float2> vel);
 	void loadData();
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel);
+	void createVboBindShader(std::vector<float2> pos, std::vector<float2> vel);
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
@@ -537,7 +734,7 @@ private:
 	long times[6];
 
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -584,7 +781,8 @@ private:
 class BoidModelSHWay1 : public BoidModel
 {
 public:
-	BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP);
+	//shLookup selects the SH basis lookup table instead of the analytic evaluation in useSH
+	BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP, bool shLookup = SH_BASIS_LOOKUP);
 	~BoidModelSHWay1();
 
 	// override from super class BoidModel
@@ -595,7 +793,8 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
+	void setGroup(unsigned int id, group_t group);
 
 	// override from interface Renderable
 	void render();
@@ -604,24 +803,41 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	//load and build a program, header is put in front of the kernel source (e.g. SH basis)
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color);
-	void loadData(std::vector<Vec4> goal);
+	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal);
+	void loadData(std::vector<group_t> groups);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color);
+	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group);
+	//project the SH coefficients of all cells (useList false) or of the dirty cells only, device time in us
+	double evalSH(unsigned int numGroups, bool useList);
+	//full projection of all cells to measure the error of the lazily updated field
+	void validateSH();
+	//refresh the per cell far field correction (all cells every k-th step or 1/k of them per step)
+	long farFieldSH();
+	//evaluate the far field of all cells into a scratch buffer and compare it to the cached one
+	void validateFarField();
+	//fill the SH basis lookup table and estimate its angular error against the analytic basis
+	void buildSHLookup();
+	//time the far field of all cells with the analytic basis and with the lookup table into
+	//scratch buffers and log both
+	void timeSHBasis();
+	//flow fields for the goals of the group table, writes the flow field ids into goal.w
+	void buildFlowField();
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
 	int helper = 0;
 	GLuint pos_vbo[1];
 	GLuint vel_vbo[1];
-	GLuint color_vbo[1];
+	GLuint group_vbo[1];
 	GLuint pos_vao[1];
 
 	GLuint vel_vbo_out[1];
 	GLuint pos_vbo_out[1];
-	GLuint color_vbo_out[1];
+	GLuint group_vbo_out[1];
 	GLuint pos_vao_out[1];
 	int num;
 
@@ -638,8 +854,53 @@ private:
 	std::string stringSumTime;
 	long times[6];
 
+	// string of the fraction of cells projected again in the last step
+	std::string stringDirtyCells;
+	// string of the error of the lazy SH field compared to a full projection
+	std::string stringSHError;
+	// number of cells projected again in the last step
+	unsigned int numDirtyCells = 0;
+	// maximum coefficient error of the last validation
+	float shErrorMax = 0.0f;
+	// number of steps done, used for the validation interval
+	unsigned int stepCount = 0;
+
+	// string of the far field refresh time
+	std::string stringFarFieldTime;
+	// string of the error of the cached far field against a full evaluation
+	std::string stringFarFieldChange;
+	// number of steps done, used for the far field interval
+	unsigned int farFieldStep = 0;
+	// steps since the last far field validation
+	unsigned int farFieldValidateStep = 0;
+	// time of the last far field refresh
+	long timeFarField = 0;
+	// maximum error of a cached cell correction at the last validation and the summed error
+	// relative to the summed magnitude of the full correction
+	float farFieldErrorMax = 0.0f;
+	float farFieldErrorRel = 0.0f;
+
+	// string of the SH basis mode and its angular error
+	std::string stringSHBasis;
+	// SH basis from the lookup table instead of analytic evaluation
+	bool useSHLookup;
+	// angular error of the lookup table directions in degrees (maximum and mean over all offsets)
+	float shLookupAngleMax = 0.0f;
+	float shLookupAngleMean = 0.0f;
+	// far field time of all cells in ms with the analytic basis [0] and the lookup table [1]
+	float shBasisTime[2];
+	// both SH bases were timed after the first projection
+	bool shBasisTimed;
+
+	// string of the flow field state and build time
+	std::string stringFlowField;
+	// flow fields of the distinct goals, agents steer by goal id and cell
+	FlowField* flowField;
+	// host copy of the group table, a changed goal rebuilds the flow fields
+	std::vector<group_t> groupTable;
+
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -660,6 +921,14 @@ private:
 	cl::Kernel kernel_evalSH;
 	//extra step to apply SH to boid simulation
 	cl::Kernel kernel_useSH;
+	//compare cell signatures and collect the cells which have to be projected again
+	cl::Kernel kernel_markDirtySH;
+	//difference between cached and fully projected coefficients
+	cl::Kernel kernel_compareSH;
+	//per cell far field correction from the SH coefficients of all cells
+	cl::Kernel kernel_farFieldSH;
+	//SH basis per relative cell offset
+	cl::Kernel kernel_buildSHLookup;
 
 	cl::Event event;
 	cl::Event eventSim;
@@ -668,8 +937,8 @@ private:
 	std::vector<cl::Memory> cl_pos_vbos_out;
 	std::vector<cl::Memory> cl_vel_vbos;
 	std::vector<cl::Memory> cl_vel_vbos_out;
-	std::vector<cl::Memory> cl_color_vbos;
-	std::vector<cl::Memory> cl_color_vbos_out;
+	std::vector<cl::Memory> cl_group_vbos;
+	std::vector<cl::Memory> cl_group_vbos_out;
 
 	cl::Buffer cl_shEvalX;
 	cl::Buffer cl_shEvalY;
@@ -677,8 +946,13 @@ private:
 	cl::Buffer cl_coef0X;
 	cl::Buffer cl_coef0Y;
 	cl::Buffer cl_coef0Z;
-	cl::Buffer cl_goal_in;
+	cl::Buffer cl_groups;
+	// own goal per boid of the paper scenarios, reordered with the boids like the group ids. One
+	// unused entry if the groups share the goal of their table entry
+	cl::Buffer cl_goal;
 	cl::Buffer cl_goal_out;
+	// the boids seek the goal in cl_goal instead of the goal of their group
+	cl_uint goalPerBoid;
 	cl::Buffer cl_range;
 	cl::Buffer cl_gridHash_unsorted;
 	cl::Buffer cl_gridHash_sorted;
@@ -690,6 +964,28 @@ private:
 	// sum of velocities
 	cl::Buffer cl_sumVel;
 
+	// cell signature of the last projection (boid count and velocity sum)
+	cl::Buffer cl_sigCount;
+	cl::Buffer cl_sigVel;
+	// compacted list of cells which have to be projected again and its length
+	cl::Buffer cl_dirtyList;
+	cl::Buffer cl_dirtyCount;
+	// lazy field copy and per cell error for the validation against a full projection
+	cl::Buffer cl_shEvalRefX;
+	cl::Buffer cl_shEvalRefY;
+	cl::Buffer cl_shEvalRefZ;
+	cl::Buffer cl_coef0RefX;
+	cl::Buffer cl_coef0RefY;
+	cl::Buffer cl_coef0RefZ;
+	cl::Buffer cl_shError;
+	// cached far field correction per cell and its change at the last refresh
+	cl::Buffer cl_shCor;
+	cl::Buffer cl_farFieldChange;
+	// full far field evaluation of the validation
+	cl::Buffer cl_shCorRef;
+	// SH basis lookup table indexed by relative cell offset
+	cl::Buffer cl_shLookup;
+
 	cl_int err;
 
 	std::vector<std::string> attribName;
@@ -703,7 +999,7 @@ private:
 class BoidModelSHWay2 : public BoidModel
 {
 public:
-	BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP);
+	BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP);
 	~BoidModelSHWay2();
 
 	//inherited from super class BoidModel
@@ -714,7 +1010,9 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
+	void setGroup(unsigned int id, group_t group);
+	void setRegionOfInterest(const glm::mat4 &viewProjection, glm::vec3 eye, const std::vector<Vec4> &boxes);
 
 	//inherited from interface Renderable
 	void render();
@@ -723,24 +1021,38 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color);
-	void loadData(std::vector<Vec4> goal);
+	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal);
+	void loadData(std::vector<group_t> groups);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color);
+	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group);
+	//sum up the per boid SH coefficients of every cell and group channel for useSHCells,
+	//returns the time in ms
+	float aggregateSH(unsigned int numChannels);
+	//run the per boid useSH kernel into scratch buffers and compare it to the cell aggregated result,
+	//then the cell aggregated kernel with a single channel to measure the cost of the group channels
+	void validateCellSH(float dt);
+	//count the boids slower than SH_WAY2_CONGESTION_SPEED * maxVel in vel into congested[slot],
+	//read back without waiting and taken over by a later call once it arrived
+	void countCongested(cl::Memory vel, unsigned int slot);
+	//level of detail tier of every cell from the region of interest
+	void assignLOD();
+	//move the boids of coarse cells with the mean velocity of their cell, returns the time in ms
+	float simulateCoarse();
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
 	int helper = 0;
 	GLuint pos_vbo[1];
 	GLuint vel_vbo[1];
-	GLuint color_vbo[1];
+	GLuint group_vbo[1];
 	GLuint pos_vao[1];
 
 	GLuint vel_vbo_out[1];
 	GLuint pos_vbo_out[1];
-	GLuint color_vbo_out[1];
+	GLuint group_vbo_out[1];
 	GLuint pos_vao_out[1];
 	int num;
 
@@ -757,8 +1069,54 @@ private:
 	std::string stringSumTime;
 	long times[6];
 
+	//string of the cell aggregation time and throughput
+	std::string stringCellTime;
+	//string of the per boid reference time and the deviation of the aggregated result
+	std::string stringCellDeviation;
+	//time of the aggregation and of useSH (cell aggregated / per boid reference) in ms
+	float timeAggregate = 0.0f;
+	float timeCells = 0.0f;
+	float timeReference = 0.0f;
+	//deviation of the resulting velocities against the per boid kernel (mean and maximum)
+	float deviationMean = 0.0f;
+	float deviationMax = 0.0f;
+	//number of steps done, used for the validation interval
+	unsigned int stepCount = 0;
+
+	//SH channels per cell, boids of group g use channel min(g, shChannels - 1)
+	unsigned int shChannels;
+	//string of the cost of the group channels against a single channel
+	std::string stringGroupChannels;
+	//string of the congested boids
+	std::string stringCongestion;
+	//aggregation and cell kernel time with a single channel in ms
+	float timeAggregateSingle = 0.0f;
+	float timeCellsSingle = 0.0f;
+	//congested boids of a recent step [0] and of a recent validation with a single channel [1]
+	unsigned int congested[2];
+	unsigned int congestedRead[2];
+	cl::Event congestedEvent[2];
+
+	//region of interest, the camera matrix and eye of the last frame and the boxes (min, max pairs)
+	cl_float16 roiViewProjection;
+	cl_float4 roiEye;
+	std::vector<Vec4> roiBoxes;
+	//false until the first region of interest is set, all cells run the full rules until then
+	bool roiValid = false;
+	//number of boids per tier at the last assignment (full, coarse)
+	unsigned int tierCount[2];
+	//time of the full rules, of the coarse tier and of the last assignment in ms
+	float timeTierFull = 0.0f;
+	float timeTierCoarse = 0.0f;
+	float timeAssignLOD = 0.0f;
+	//number of steps done, used for the tier update interval
+	unsigned int lodStepCount = 0;
+	//strings of the tier population and time
+	std::string stringLODTiers;
+	std::string stringLODAssign;
+
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -779,6 +1137,20 @@ private:
 	cl::Kernel kernel_evalSH;
 	//extra step to apply SH to boid simulation
 	cl::Kernel kernel_useSH;
+	//per cell sum of the SH coefficients
+	cl::Kernel kernel_aggregateSH;
+	//per boid useSH as reference for the cell aggregated version
+	cl::Kernel kernel_useSHRef;
+	//per boid velocity difference between the two
+	cl::Kernel kernel_compareVel;
+	//number of slow boids
+	cl::Kernel kernel_countCongested;
+	//level of detail tier per cell
+	cl::Kernel kernel_assignLOD;
+	//mean velocity of the coarse cells
+	cl::Kernel kernel_cellMeanVelocity;
+	//boids of coarse cells
+	cl::Kernel kernel_simulateCoarse;
 
 	cl::Event event;
 	cl::Event eventSim;
@@ -787,8 +1159,8 @@ private:
 	std::vector<cl::Memory> cl_pos_vbos_out;
 	std::vector<cl::Memory> cl_vel_vbos;
 	std::vector<cl::Memory> cl_vel_vbos_out;
-	std::vector<cl::Memory> cl_color_vbos;
-	std::vector<cl::Memory> cl_color_vbos_out;
+	std::vector<cl::Memory> cl_group_vbos;
+	std::vector<cl::Memory> cl_group_vbos_out;
 
 	cl::Buffer cl_shEvalX;
 	cl::Buffer cl_shEvalY;
@@ -796,8 +1168,13 @@ private:
 	cl::Buffer cl_coef0X;
 	cl::Buffer cl_coef0Y;
 	cl::Buffer cl_coef0Z;
-	cl::Buffer cl_goal_in;
+	cl::Buffer cl_groups;
+	//own goal per boid of the paper scenarios, reordered with the boids like the group ids. One
+	//unused entry if the groups share the goal of their table entry
+	cl::Buffer cl_goal;
 	cl::Buffer cl_goal_out;
+	//the boids seek the goal in cl_goal instead of the goal of their group
+	cl_uint goalPerBoid;
 	cl::Buffer cl_range;
 	cl::Buffer cl_gridHash_unsorted;
 	cl::Buffer cl_gridHash_sorted;
@@ -808,6 +1185,25 @@ private:
 	cl::Buffer cl_gridEndIndex;
 	//sum of velocities
 	cl::Buffer cl_sumVel;
+	//per cell and group channel sum of the SH coefficients and mean boid position (w = number of boids)
+	cl::Buffer cl_cellSHX;
+	cl::Buffer cl_cellSHY;
+	cl::Buffer cl_cellSHZ;
+	cl::Buffer cl_cellC0X;
+	cl::Buffer cl_cellC0Y;
+	cl::Buffer cl_cellC0Z;
+	cl::Buffer cl_cellPos;
+	//output of the reference kernel
+	cl::Buffer cl_velRef;
+	cl::Buffer cl_posRef;
+	cl::Buffer cl_deviation;
+	cl::Buffer cl_congested;
+	//level of detail tier per cell (0 = full, 1 = coarse), boids per tier and mean velocity per cell
+	cl::Buffer cl_cellTier;
+	cl::Buffer cl_tierCount;
+	cl::Buffer cl_cellMeanVel;
+	//region of interest boxes, LOD_MAX_BOXES min, max pairs
+	cl::Buffer cl_roiBoxes;
 
 	cl_int err;
 
@@ -830,7 +1226,14 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
+
+	/* Register the obstacle points [first, first + count) as one rigid obstacle, returns its id */
+	unsigned int addObstacle(unsigned int first, unsigned int count);
+
+	/* Place obstacle id with transform relative to its initial placement, the obstacle field
+	is updated for the moved points only at the next simulation step */
+	void setObstacleTransform(unsigned int id, glm::mat4 transform);
 
 	//inherited from interface Renderable
 	void render();
@@ -839,13 +1242,36 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
 	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal);
 	void loadData(std::vector<Vec4> goal);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
 	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel);
 	void createAndLoadObstacleSH(std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
+	//signed distance field of the OBJ mesh objFile on the obstacle field nodes ("" = no mesh)
+	void loadObstacleSDF(const std::string &objFile);
+	//bake the repulsion of all obstacles into the per node obstacle field
+	void bakeObstacleField();
+	//re-project the moved obstacles and update the obstacle field by their difference
+	void updateMovedObstacles();
+	//mark the cells of the obstacles at their current placement, flow fields are built again if they changed
+	void updateBlockedCells();
+
+	//rigid obstacle made of the SH obstacle points [first, first + count)
+	typedef struct{
+		unsigned int first;
+		unsigned int count;
+		glm::mat4 transform;
+		//placement the obstacle field was built with
+		glm::mat4 fieldTransform;
+		bool moved;
+	} obstacle_t;
+
+	//field nodes within OBSTACLE_UPDATE_RANGE cells of the old and new placement of an obstacle,
+	//false if there are none
+	bool obstacleNodeBox(const obstacle_t &obstacle, cl_uint4* boxMin, cl_uint4* boxSize);
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
@@ -872,8 +1298,40 @@ private:
 	std::string stringSumTime;
 	long times[6];
 
+	//string of the time of the last obstacle field bake
+	std::string stringBakeTime;
+	//number of SH obstacle points
+	unsigned int numObstacle = 0;
+	//obstacles changed since the last bake
+	bool obstacleFieldDirty = false;
+	//time of the last obstacle field bake
+	long timeBake = 0;
+	//rigid obstacles which can be moved by setObstacleTransform
+	std::vector<obstacle_t> obstacles;
+	//1 if a mesh distance field is baked into the obstacle field
+	unsigned int useSDF = 0;
+	//incremental field updates since the last full bake
+	unsigned int updatesSinceBake = 0;
+	//string of the last incremental obstacle update
+	std::string stringUpdateTime;
+	//time of the last incremental obstacle update
+	long timeUpdate = 0;
+	//number of obstacle points moved in the last update
+	unsigned int numMovedPoints = 0;
+
+	//string of the flow field state and build time
+	std::string stringFlowField;
+	//flow fields of the distinct goals around the blocked cells
+	FlowField* flowField;
+	//initial placement of the obstacle points
+	std::vector<Vec4> posObstHost;
+	//cells inside the mesh obstacle (empty without mesh)
+	std::vector<unsigned char> sdfBlockedCells;
+	//cells blocked by obstacles in the current flow fields
+	std::vector<unsigned char> blockedCells;
+
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -896,6 +1354,12 @@ private:
 	cl::Kernel kernel_useSH;
 	//kernel to create SH representation of obstacles
 	cl::Kernel kernel_obstacle;
+	//kernel to bake the obstacle repulsion into a field sampled per boid
+	cl::Kernel kernel_bakeObstacleField;
+	//kernel to place obstacle points and correction vectors with the obstacle transform
+	cl::Kernel kernel_transformObstacle;
+	//kernel to move the repulsion of moved obstacle points in the baked field
+	cl::Kernel kernel_updateObstacleField;
 
 	cl::Event event;
 	cl::Event eventSim;
@@ -922,6 +1386,21 @@ private:
 	cl::Buffer cl_startCor;
 	cl::Buffer cl_endCor;
 	cl::Buffer cl_posObst;
+	//baked obstacle repulsion, (gridSize * OBSTACLE_FIELD_RES + 1) nodes per axis
+	cl::Buffer cl_obstField;
+	//gradient and signed distance of the mesh obstacles per field node
+	cl::Buffer cl_obstSDF;
+	//initial placement of the obstacle points and correction vectors
+	cl::Buffer cl_corLocal;
+	cl::Buffer cl_posObstLocal;
+	//SH coefficients and positions of the obstacle points before they were moved
+	cl::Buffer cl_shEvalOldX;
+	cl::Buffer cl_shEvalOldY;
+	cl::Buffer cl_shEvalOldZ;
+	cl::Buffer cl_coef0OldX;
+	cl::Buffer cl_coef0OldY;
+	cl::Buffer cl_coef0OldZ;
+	cl::Buffer cl_posObstOld;
 
 	cl::Buffer cl_goal_in;
 	cl::Buffer cl_goal_out;
@@ -948,7 +1427,7 @@ private:
 class BoidModelSHCombined : public BoidModel
 {
 public:
-	BoidModelSHCombined(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
+	BoidModelSHCombined(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
 	~BoidModelSHCombined();
 
 	//inherited from super class BoidModel
@@ -959,7 +1438,8 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
+	void setGroup(unsigned int id, group_t group);
 
 	//inherited from interface Renderable
 	void render();
@@ -968,25 +1448,28 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color);
-	void loadData(std::vector<Vec4> goal);
+	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal);
+	void loadData(std::vector<group_t> groups);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color);
+	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group);
 	void createAndLoadObstacleSH(std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
+	//assign the goal ids of the groups and solve the flow fields of their goals
+	void buildFlowField();
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
 	int helper = 0;
 	GLuint pos_vbo[1];
 	GLuint vel_vbo[1];
-	GLuint color_vbo[1];
+	GLuint group_vbo[1];
 	GLuint pos_vao[1];
 
 	GLuint vel_vbo_out[1];
 	GLuint pos_vbo_out[1];
-	GLuint color_vbo_out[1];
+	GLuint group_vbo_out[1];
 	GLuint pos_vao_out[1];
 	int num;
 
@@ -1003,8 +1486,17 @@ private:
 	std::string stringSumTime;
 	long times[6];
 
+	//string of the flow field state and build time
+	std::string stringFlowField;
+	//flow fields of the distinct goals, agents steer by goal id and cell
+	FlowField* flowField;
+	//host copy of the group table, a changed goal rebuilds the flow fields
+	std::vector<group_t> groupTable;
+	//cells with an obstacle point, one entry per cell
+	std::vector<unsigned char> blockedCells;
+
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -1035,8 +1527,8 @@ private:
 	std::vector<cl::Memory> cl_pos_vbos_out;
 	std::vector<cl::Memory> cl_vel_vbos;
 	std::vector<cl::Memory> cl_vel_vbos_out;
-	std::vector<cl::Memory> cl_color_vbos;
-	std::vector<cl::Memory> cl_color_vbos_out;
+	std::vector<cl::Memory> cl_group_vbos;
+	std::vector<cl::Memory> cl_group_vbos_out;
 
 	cl::Buffer cl_shEvalX;
 	cl::Buffer cl_shEvalY;
@@ -1056,8 +1548,13 @@ private:
 	cl::Buffer cl_endCor;
 	cl::Buffer cl_posObst;
 
-	cl::Buffer cl_goal_in;
+	cl::Buffer cl_groups;
+	//own goal per boid of the paper scenarios, reordered with the boids like the group ids. One
+	//unused entry if the groups share the goal of their table entry
+	cl::Buffer cl_goal;
 	cl::Buffer cl_goal_out;
+	//the boids seek the goal in cl_goal instead of the goal of their group
+	cl_uint goalPerBoid;
 	cl::Buffer cl_range;
 	cl::Buffer cl_gridHash_unsorted;
 	cl::Buffer cl_gridHash_sorted;
@@ -1081,7 +1578,7 @@ private:
 class BoidModelSHObstacleTunnel : public BoidModel
 {
 public:
-	BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
+	BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
 	~BoidModelSHObstacleTunnel();
 
 	//inherited from super class BoidModel
@@ -1092,7 +1589,8 @@ public:
 	int getNumBoid();
 	long getSimulationTime();
 	std::vector<const char*> getSimTimeDescriptions();
-	void getFollowedBoid(unsigned int* boidIndex, Vec4 *pos, Vec4 *vel);
+	bool getCellOccupancy(unsigned int* occupied, unsigned int* maxCount);
+	void setGroup(unsigned int id, group_t group);
 
 	//inherited from interface Renderable
 	void render();
@@ -1101,25 +1599,28 @@ public:
 	void unbindShader();
 
 private:
-	cl::Program loadProgram(const std::string &filename);
+	cl::Program loadProgram(const std::string &filename, const std::string &header = "");
 	void loadKernel();
-	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color);
-	void loadData(std::vector<Vec4> goal);
+	void createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal);
+	void loadData(std::vector<group_t> groups);
+	void loadSimParams();
 	void bitonicSort(cl::Buffer d_DstKey, cl::Buffer d_DstVal, cl::Buffer d_SrcKey, cl::Buffer d_SrcVal, unsigned int batch, unsigned int arrayLength, unsigned int dir);
-	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color);
+	void createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group);
 	void createAndLoadObstacleSH(std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst);
+	//assign the goal ids of the groups and solve the flow fields of their goals
+	void buildFlowField();
 
 	static cl_uint factorRadix2(cl_uint& log2L, cl_uint L);
 
 	int helper = 0;
 	GLuint pos_vbo[1];
 	GLuint vel_vbo[1];
-	GLuint color_vbo[1];
+	GLuint group_vbo[1];
 	GLuint pos_vao[1];
 
 	GLuint vel_vbo_out[1];
 	GLuint pos_vbo_out[1];
-	GLuint color_vbo_out[1];
+	GLuint group_vbo_out[1];
 	GLuint pos_vao_out[1];
 	int num;
 
@@ -1136,8 +1637,17 @@ private:
 	std::string stringSumTime;
 	long times[6];
 
+	//string of the flow field state and build time
+	std::string stringFlowField;
+	//flow fields of the distinct goals, agents steer by goal id and cell
+	FlowField* flowField;
+	//host copy of the group table, a changed goal rebuilds the flow fields
+	std::vector<group_t> groupTable;
+	//cells with an obstacle point, one entry per cell
+	std::vector<unsigned char> blockedCells;
+
 	cl::Context context;
-	cl::CommandQueue queue;
+	TracedQueue queue;
 	cl::Program programBoid;
 	cl::Program programBitonic;
 	std::vector<cl::Device> devices;
@@ -1168,8 +1678,8 @@ private:
 	std::vector<cl::Memory> cl_pos_vbos_out;
 	std::vector<cl::Memory> cl_vel_vbos;
 	std::vector<cl::Memory> cl_vel_vbos_out;
-	std::vector<cl::Memory> cl_color_vbos;
-	std::vector<cl::Memory> cl_color_vbos_out;
+	std::vector<cl::Memory> cl_group_vbos;
+	std::vector<cl::Memory> cl_group_vbos_out;
 
 	cl::Buffer cl_shEvalX;
 	cl::Buffer cl_shEvalY;
@@ -1189,8 +1699,13 @@ private:
 	cl::Buffer cl_endCor;
 	cl::Buffer cl_posObst;
 
-	cl::Buffer cl_goal_in;
+	cl::Buffer cl_groups;
+	//own goal per boid of the paper scenarios, reordered with the boids like the group ids. One
+	//unused entry if the groups share the goal of their table entry
+	cl::Buffer cl_goal;
 	cl::Buffer cl_goal_out;
+	//the boids seek the goal in cl_goal instead of the goal of their group
+	cl_uint goalPerBoid;
 	cl::Buffer cl_range;
 	cl::Buffer cl_gridHash_unsorted;
 	cl::Buffer cl_gridHash_sorted;
@@ -28,8 +28,15 @@ BoidModelGrid::BoidModelGrid(CLHelper* clHlpr, std::vector<Vec4> pos, std::vecto
 
 	programBoid    = loadProgram(kernel_path + "boidModelGrid_kernel_v3.cl");
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "boidModelGrid_kernel_v3.cl");
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -46,7 +53,7 @@ BoidModelGrid::~BoidModelGrid(){
 void BoidModelGrid::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);	//draw boids as points
+	glDrawArrays(GL_POINTS, 0, getNumBoid());	//draw boids as points
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -82,6 +89,8 @@ void BoidModelGrid::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	//get time for outputs
@@ -89,6 +98,7 @@ void BoidModelGrid::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//unsigned int E[NUM_BOIDS];
 	//queue.enqueueReadBuffer(cl_gridHash_unsorted, CL_TRUE, 0, (size_t)(NUM_BOIDS * sizeof(unsigned int)), &E);
@@ -100,26 +110,26 @@ void BoidModelGrid::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 
@@ -149,6 +159,9 @@ void BoidModelGrid::simulate(float dt){
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 	queue.finish();
 	/*
 	unsigned int F[8000];
@@ -164,6 +177,7 @@ void BoidModelGrid::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 
 	//do the simulation dance
@@ -204,6 +218,7 @@ void BoidModelGrid::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -215,6 +230,12 @@ void BoidModelGrid::simulate(float dt){
 	queue.finish();*/
 
 
+	tracker->gather(cl_pos_vbos[0], cl_vel_vbos[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(cl_pos_out, cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state, they take part from the next sort on
+	population->update(cl_pos_vbos[0], cl_vel_vbos[0], dt);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos, NULL, &event);
@@ -233,7 +254,7 @@ GLuint BoidModelGrid::getPosVAO(){
 }
 
 int BoidModelGrid::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
@@ -311,7 +332,8 @@ void BoidModelGrid::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel){
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 
 	createVboBindShader(pos, vel);
 	// create OpenCL buffer from GL VBO
@@ -319,19 +341,19 @@ void BoidModelGrid::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel){
 	
 	//create the OpenCL only arrays
 	try{
-		cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-		cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-
-		cl_pos_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_velocities_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+		cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+
+		cl_pos_out = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_velocities_out = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -384,6 +406,10 @@ void BoidModelGrid::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4>
 	log("GL VBO Buffer created");
 }
 
+void BoidModelGrid::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
 void BoidModelGrid::loadData(std::vector<Vec4> vel){
 	num = (int)vel.size(); 
 	size_t array_size_fp4 = num * sizeof(Vec4);
@@ -419,7 +445,7 @@ void BoidModelGrid::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -440,6 +466,7 @@ void BoidModelGrid::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -458,6 +485,7 @@ void BoidModelGrid::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -487,6 +515,7 @@ void BoidModelGrid::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -513,6 +542,7 @@ void BoidModelGrid::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
@@ -520,7 +550,9 @@ void BoidModelGrid::bitonicSort(
 		}
 	}
 
-	times[1] = (long)GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelGrid::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -550,12 +582,12 @@ std::vector<const char*> BoidModelGrid::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -572,37 +604,8 @@ std::vector<const char*> BoidModelGrid::getSimTimeDescriptions(){
 	return simTimeDisc;
 }
 
-void BoidModelGrid::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-
-	size_t size = sizeof(unsigned int) * num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish(); 
-
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
-
-
-
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4) * *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*vel).set(v.x, v.y, v.z, 0.0);
-
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*pos).set(p.x, p.y, p.z, 0.0);
+bool BoidModelGrid::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
 }
 
 
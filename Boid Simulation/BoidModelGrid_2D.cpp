@@ -23,18 +23,29 @@ BoidModelGrid_2D::BoidModelGrid_2D(CLHelper* clHlpr, std::vector<Vec4> pos, std:
 
 	Y_AxisFixed = CELL_SIZE_Y / 4;
 
+	//only the x/z plane is simulated, y is added by the vertex shader
+	std::vector<float2> pos2D(pos.size());
+	std::vector<float2> vel2D(vel.size());
+
 	for (int i = 0; i < pos.size(); i++){
-		pos[i].y = Y_AxisFixed;
-		vel[i].y = 0.0f;
+		pos2D[i] = make_float2(pos[i].x, pos[i].z);
+		vel2D[i] = make_float2(vel[i].x, vel[i].z);
 	}
 
-	createBuffer(pos, vel);
-	loadData(vel);
+	createBuffer(pos2D, vel2D);
+	loadData(vel2D);
 
-	programBoid    = loadProgram(kernel_path + "BoidModelGrid_2D_kernel_v2.cl");
+	programBoid    = loadProgram(kernel_path + "BoidModelGrid_2D_kernel_v3.cl");
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "BoidModelGrid_2D_kernel_v3.cl");
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num, 2, Y_AxisFixed, -10.0f);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin, 2);
+	population = new Population(clHelper, num, simParams.numCells, 2, Y_AxisFixed);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -52,7 +63,7 @@ BoidModelGrid_2D::~BoidModelGrid_2D(){
 void BoidModelGrid_2D::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -89,12 +100,15 @@ void BoidModelGrid_2D::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//unsigned int E[NUM_BOIDS];
 	//queue.enqueueReadBuffer(cl_gridHash_unsorted, CL_TRUE, 0, (size_t)(NUM_BOIDS * sizeof(unsigned int)), &E);
@@ -106,26 +120,26 @@ void BoidModelGrid_2D::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -150,6 +164,9 @@ void BoidModelGrid_2D::simulate(float dt){
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	/*
 	unsigned int F[8000];
@@ -164,6 +181,7 @@ void BoidModelGrid_2D::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -173,11 +191,8 @@ void BoidModelGrid_2D::simulate(float dt){
 		err = kernel_simulate.setArg(3, cl_vel_vbos[0]);
 		err = kernel_simulate.setArg(4, cl_gridStartIndex);
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
-		err = kernel_simulate.setArg(6, cl::__local(sizeof(cl_float4)*(LOCAL_SIZE_VEC4)));
-		err = kernel_simulate.setArg(7, cl::__local(sizeof(cl_float4)*(LOCAL_SIZE_VEC4)));
-		err = kernel_simulate.setArg(8, cl_simParams);
-		err = kernel_simulate.setArg(9, cl_range);
-		err = kernel_simulate.setArg(10, dt);
+		err = kernel_simulate.setArg(6, cl_simParams);
+		err = kernel_simulate.setArg(7, dt);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -192,13 +207,14 @@ void BoidModelGrid_2D::simulate(float dt){
 	queue.finish();*/
 
 	int localWorkSize = LOCAL_PREF;
-	int globalWorkSize = LOCAL_PREF * (simParams.numCells);
+	int globalWorkSize = num;
 	err = queue.enqueueNDRangeKernel(kernel_simulate, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &eventSim);
 
 	eventSim.wait();
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -209,6 +225,12 @@ void BoidModelGrid_2D::simulate(float dt){
 	queue.enqueueReadBuffer(cl_velocities_out, CL_TRUE, 0, (size_t)num * sizeof(Vec4), C.data());
 	queue.finish();*/
 	//printf("%d %d %d\n", C[0], C[512], C[1023]);
+	tracker->gather(cl_pos_vbos[0], cl_vel_vbos[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(cl_pos_out, cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state, they take part from the next sort on
+	population->update(cl_pos_vbos[0], cl_vel_vbos[0], dt);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos, NULL, &event);
@@ -221,7 +243,7 @@ GLuint BoidModelGrid_2D::getPosVBO(){
 }
 
 GLuint BoidModelGrid_2D::getVelVBO(){
-	return pos_vbo[0];
+	return vel_vbo[0];
 }
 
 GLuint BoidModelGrid_2D::getPosVAO(){
@@ -229,7 +251,7 @@ GLuint BoidModelGrid_2D::getPosVAO(){
 }
 
 int BoidModelGrid_2D::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
@@ -302,37 +324,38 @@ void BoidModelGrid_2D::loadKernel(){
 
 }
 
-void BoidModelGrid_2D::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel){
+void BoidModelGrid_2D::createBuffer(std::vector<float2> pos, std::vector<float2> vel){
 	log("Create buffer for usage");
 
-	size_t array_size_fp4 = num * sizeof(Vec4);
+	size_t array_size_fp2 = num * sizeof(float2);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 
 	createVboBindShader(pos, vel);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
 
 	//create the OpenCL only arrays
 	try{
-		cl_pos_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_velocities_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_pos_out = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp2, NULL, &err);
+		cl_velocities_out = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp2, NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 }
 
-void BoidModelGrid_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel){
+void BoidModelGrid_2D::createVboBindShader(std::vector<float2> pos, std::vector<float2> vel){
 	std::vector<Vec4> newDataColor(num);
 
 	for (int i = 0; i < num; i++){
@@ -340,12 +363,16 @@ void BoidModelGrid_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Ve
 	}
 
 	GLuint id[1];
-	size_t array_size = num * sizeof(Vec4);
+	size_t array_size = num * sizeof(float2);
 
-	shader = new Shader("boidTri.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
-	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
+	shader = new Shader("boidTri2D.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
+	GLint vertLoc = glGetAttribLocation(shader->id(), "coord2d");
 	GLint colorLoc = glGetAttribLocation(shader->id(), "color");
-	GLint velLoc = glGetAttribLocation(shader->id(), "vel3d");
+	GLint velLoc = glGetAttribLocation(shader->id(), "vel2d");
+
+	shader->bind();
+	glUniform1f(glGetUniformLocation(shader->id(), "y_plane"), Y_AxisFixed);
+	shader->unbind();
 
 	//------VBO 1--------- (in)
 	glGenVertexArrays(1, &pos_vao[0]); // Create our Vertex Array Object  
@@ -356,12 +383,12 @@ void BoidModelGrid_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Ve
 	//std::vector<Vec4> test(num);
 	//glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vec4)* num, test.data());
 
-	glVertexAttribPointer(vertLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
+	glVertexAttribPointer(vertLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
 	glEnableVertexAttribArray(vertLoc);
 
 	vel_vbo[0] = clHelper->createVBO(&vel[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
+	glVertexAttribPointer(velLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
 	glGenBuffers(1, &id[0]);
@@ -377,11 +404,15 @@ void BoidModelGrid_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Ve
 	log("GL VBO Buffer created");
 }
 
-void BoidModelGrid_2D::loadData(std::vector<Vec4> vel){
+void BoidModelGrid_2D::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
+void BoidModelGrid_2D::loadData(std::vector<float2> vel){
 	num = (int)vel.size();
-	size_t array_size_fp4 = num * sizeof(Vec4);
+	size_t array_size_fp2 = num * sizeof(float2);
 
-	err = queue.enqueueWriteBuffer(cl_velocities_out, CL_TRUE, 0, array_size_fp4, &vel[0], NULL, &event);
+	err = queue.enqueueWriteBuffer(cl_velocities_out, CL_TRUE, 0, array_size_fp2, &vel[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
 	queue.finish();
 }
@@ -412,7 +443,7 @@ void BoidModelGrid_2D::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -433,6 +464,7 @@ void BoidModelGrid_2D::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -451,6 +483,7 @@ void BoidModelGrid_2D::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -480,6 +513,7 @@ void BoidModelGrid_2D::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -506,6 +540,7 @@ void BoidModelGrid_2D::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
@@ -513,7 +548,9 @@ void BoidModelGrid_2D::bitonicSort(
 		}
 	}
 
-	times[1] = (long)GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelGrid_2D::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -543,12 +580,12 @@ std::vector<const char*> BoidModelGrid_2D::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -565,36 +602,8 @@ std::vector<const char*> BoidModelGrid_2D::getSimTimeDescriptions(){
 	return simTimeDisc;
 }
 
-void BoidModelGrid_2D::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
-
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
-
-
-
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*vel).set(v.x, v.y - 10.f, v.z, 0.0);
-
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*pos).set(p.x, p.y, p.z, 0.0);
+bool BoidModelGrid_2D::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
 }
 
 
@@ -26,11 +26,18 @@ BoidModelSH::BoidModelSH(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Ve
 	createBuffer(pos, vel);
 	loadData();
 
-	programBoid = loadProgram("boidModelSH_kernel_v1.cl");
+	programBoid = loadProgram("boidModelSH_kernel_v1.cl", clHelper->getSHBasisSource(SH_ORDER_SH));
 	//std::string path = kernel_path + "bitonic_sort.cl";
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, "boidModelSH_kernel_v1.cl", SH_ORDER_SH);
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -48,7 +55,7 @@ BoidModelSH::~BoidModelSH(){
 void BoidModelSH::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -93,12 +100,15 @@ void BoidModelSH::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -106,26 +116,26 @@ void BoidModelSH::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -165,6 +175,9 @@ void BoidModelSH::simulate(float dt){
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	
 	unsigned int F[8000];
@@ -180,6 +193,7 @@ void BoidModelSH::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -207,6 +221,7 @@ void BoidModelSH::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[4] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REDUCE, (endTime - startTime) / 1000.0);
 
 //	std::vector<Vec4> C(simParams.numCells);
 //	queue.enqueueReadBuffer(cl_sumVel, CL_TRUE, 0, (size_t)simParams.numCells * sizeof(Vec4), C.data());
@@ -259,6 +274,7 @@ void BoidModelSH::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -295,6 +311,7 @@ void BoidModelSH::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -306,6 +323,12 @@ void BoidModelSH::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state, they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
@@ -335,22 +358,23 @@ GLuint BoidModelSH::getPosVAO(){
 }
 
 int BoidModelSH::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
 
-cl::Program BoidModelSH::loadProgram(const std::string &filename){
+cl::Program BoidModelSH::loadProgram(const std::string &filename, const std::string &header){
 	log("load program");
-	std::string kernelSource;
+	std::string kernelSource = header;
+	size_t headerSize = header.size();
 
 	std::ifstream in(filename/*.c_str()*/, std::ios::in | std::ios::binary);
 	if (in)
 	{
 		in.seekg(0, std::ios::end);
-		kernelSource.resize(in.tellg());
+		kernelSource.resize(headerSize + (size_t)in.tellg());
 		in.seekg(0, std::ios::beg);
-		in.read(&kernelSource[0], kernelSource.size());
+		in.read(&kernelSource[headerSize], kernelSource.size() - headerSize);
 		in.close();
 	}
 	else
@@ -415,28 +439,29 @@ void BoidModelSH::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel){
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
 
 	createVboBindShader(pos, vel);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
 
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 	//create the OpenCL only arrays
 	try
 	{
-	cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-	cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-	cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-	cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-	cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-	cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-	cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-	cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-	cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+	cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+	cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+	cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+	cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+	cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+	cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+	cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+	cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+	cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -516,6 +541,10 @@ void BoidModelSH::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> v
 	log("GL VBO Buffer created");
 }
 
+void BoidModelSH::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
 void BoidModelSH::loadData(){
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
 	queue.finish();
@@ -547,7 +576,7 @@ void BoidModelSH::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -568,6 +597,7 @@ void BoidModelSH::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -586,6 +616,7 @@ void BoidModelSH::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -615,6 +646,7 @@ void BoidModelSH::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -641,13 +673,16 @@ void BoidModelSH::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSH::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -681,12 +716,12 @@ std::vector<const char*> BoidModelSH::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -713,36 +748,8 @@ std::vector<const char*> BoidModelSH::getSimTimeDescriptions(){
 	return simTimeDisc;
 }
 
-void BoidModelSH::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
-
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
-
-
-
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*vel).set(v.x, v.y, v.z, 0.0);
-
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*pos).set(p.x, p.y, p.z, 0.0);
+bool BoidModelSH::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
 }
 
 
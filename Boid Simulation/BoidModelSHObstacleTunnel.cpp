@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "boidModel.h"
 
-BoidModelSHObstacleTunnel::BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst) : BoidModel(clHlpr)
+BoidModelSHObstacleTunnel::BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst) : BoidModel(clHlpr)
 {
-	simTimeDisc = std::vector<const char*>(10);
+	simTimeDisc = std::vector<const char*>(11);
 	simTimeDisc[0] = "SH obstacle avoidance";
 	simTimeDisc[1] = "OpenCL Simulation Times:";
 	simTimeDisc[2] = "";
@@ -14,6 +14,7 @@ BoidModelSHObstacleTunnel::BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vect
 	simTimeDisc[7] = "";
 	simTimeDisc[8] = "";
 	simTimeDisc[9] = "";
+	simTimeDisc[10] = "";
 
 	context = clHelper->getContext();
 	queue = clHelper->getCmdQueue();
@@ -22,17 +23,40 @@ BoidModelSHObstacleTunnel::BoidModelSHObstacleTunnel(CLHelper* clHlpr, std::vect
 	simParams = *simP;
 
 	num = simParams.numBodies;
+	goalPerBoid = goal.empty() ? 0 : 1;
 
-	createBuffer(pos, vel, goal, color);
-	loadData(goal);
+	//cells with an obstacle point are blocked for the flow fields, the obstacles do not move
+	blockedCells = std::vector<unsigned char>(simParams.numCells, 0);
+	for (size_t i = 0; i < posObst.size(); i++){
+		int x = (int)floor((posObst[i].x - simParams.worldOrigin.x) / simParams.cellSize.x);
+		int y = (int)floor((posObst[i].y - simParams.worldOrigin.y) / simParams.cellSize.y);
+		int z = (int)floor((posObst[i].z - simParams.worldOrigin.z) / simParams.cellSize.z);
 
-	programBoid    = loadProgram(kernel_path + "BoidModelSHObstacleTunnel_kernel_v1.cl");
+		if (x >= 0 && x < (int)simParams.gridSize.x && y >= 0 && y < (int)simParams.gridSize.y && z >= 0 && z < (int)simParams.gridSize.z)
+			blockedCells[x + simParams.gridSize.x * z + simParams.gridSize.x * simParams.gridSize.z * y] = 1;
+	}
+
+	groupTable = groups;
+	flowField = NULL;
+	buildFlowField();
+
+	createBuffer(pos, vel, group, goal);
+	loadData(groupTable);
+
+	programBoid    = loadProgram(kernel_path + "BoidModelSHObstacleTunnel_kernel_v1.cl", clHelper->getSHBasisSource(SH_ORDER_SH_TUNNEL));
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "BoidModelSHObstacleTunnel_kernel_v1.cl", SH_ORDER_SH_TUNNEL);
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
 
 	createAndLoadObstacleSH(cor, start, end, posObst);
 
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -45,12 +69,13 @@ BoidModelSHObstacleTunnel::~BoidModelSHObstacleTunnel(){
 	glDeleteVertexArrays(1, pos_vao);
 
 	delete shader;
+	delete flowField;
 }
 
 void BoidModelSHObstacleTunnel::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -72,8 +97,8 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	err = queue.enqueueAcquireGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos_out, NULL, &event);
 	queue.finish();
 
 	//Get grid hash value for every boid
@@ -97,12 +122,15 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -110,26 +138,26 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -149,40 +177,45 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos_out[0]);	//vel out ordered
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos[0]);		//pos in unordered
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos[0]);		//vel in unordered
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal_out);
 		}
 		else {
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos_out[0]);	//pos in
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_findGridEdgeAndReorder.setArg(2, cl_pos_vbos[0]);		//pos out
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal_out);
 		}
 
 		err = kernel_findGridEdgeAndReorder.setArg(0, cl_gridStartIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(1, cl_gridEndIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(4, cl_gridHash_sorted);
 		err = kernel_findGridEdgeAndReorder.setArg(5, cl_gridIndex_sorted);
-		err = kernel_findGridEdgeAndReorder.setArg(12, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
-		err = kernel_findGridEdgeAndReorder.setArg(13, num);
+		err = kernel_findGridEdgeAndReorder.setArg(10, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
+		err = kernel_findGridEdgeAndReorder.setArg(11, num);
+		err = kernel_findGridEdgeAndReorder.setArg(14, goalPerBoid);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -212,6 +245,7 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[4] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REDUCE, (endTime - startTime) / 1000.0);
 
 	//		std::vector<Vec4> C(2 * simParams.numCells);
 	//		queue.enqueueReadBuffer(cl_shEval, CL_TRUE, 0, (size_t)2 * simParams.numCells * sizeof(Vec4), C.data());
@@ -224,21 +258,26 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 			err = kernel_simulate.setArg(1, cl_pos_vbos[0]);		//pos out
 			err = kernel_simulate.setArg(2, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_simulate.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_simulate.setArg(6, cl_goal_out);
+			err = kernel_simulate.setArg(6, cl_group_vbos[0]);		//group ids
+			err = kernel_simulate.setArg(12, cl_goal);		//goals
 		}
 		else{
 			err = kernel_simulate.setArg(1, cl_pos_vbos_out[0]);	//pos out
 			err = kernel_simulate.setArg(0, cl_pos_vbos[0]);		//pos in
 			err = kernel_simulate.setArg(3, cl_vel_vbos_out[0]);	//vel out
 			err = kernel_simulate.setArg(2, cl_vel_vbos[0]);		//vel in
-			err = kernel_simulate.setArg(6, cl_goal_in);
+			err = kernel_simulate.setArg(6, cl_group_vbos_out[0]);	//group ids
+			err = kernel_simulate.setArg(12, cl_goal_out);	//goals
 		}
 
 		err = kernel_simulate.setArg(4, cl_gridStartIndex);
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
 		err = kernel_simulate.setArg(7, cl_simParams);
 		err = kernel_simulate.setArg(8, cl_range);
-		err = kernel_simulate.setArg(9, dt);
+		err = kernel_simulate.setArg(9, flowField->getFlowDir());
+		err = kernel_simulate.setArg(10, cl_groups);
+		err = kernel_simulate.setArg(11, dt);
+		err = kernel_simulate.setArg(13, goalPerBoid);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -264,6 +303,7 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
 	unsigned int numObst = 208;
 
 	try
@@ -287,9 +327,9 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 		err = kernel_useSH.setArg(5, cl_shEvalY);
 		err = kernel_useSH.setArg(6, cl_shEvalZ);
 		err = kernel_useSH.setArg(7, cl_simParams);
-		err = kernel_useSH.setArg(10, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(11, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(12, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(13, cl_coef0X);
 		err = kernel_useSH.setArg(14, cl_coef0Y);
 		err = kernel_useSH.setArg(15, cl_coef0Z);
@@ -320,6 +360,7 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -331,13 +372,20 @@ void BoidModelSHObstacleTunnel::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state (useSH output, group ids and goals of the reorder), they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt,
+		counter ? &cl_group_vbos[0] : &cl_group_vbos_out[0], goalPerBoid ? (counter ? &cl_goal : &cl_goal_out) : NULL);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos_out, NULL, &event);
 }
 
 GLuint BoidModelSHObstacleTunnel::getPosVBO(){
@@ -362,22 +410,23 @@ GLuint BoidModelSHObstacleTunnel::getPosVAO(){
 }
 
 int BoidModelSHObstacleTunnel::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
 
-cl::Program BoidModelSHObstacleTunnel::loadProgram(const std::string &filename){
+cl::Program BoidModelSHObstacleTunnel::loadProgram(const std::string &filename, const std::string &header){
 	log("load program");
-	std::string kernelSource;
+	std::string kernelSource = header;
+	size_t headerSize = header.size();
 
 	std::ifstream in(filename, std::ios::in | std::ios::binary);
 	if (in)
 	{
 		in.seekg(0, std::ios::end);
-		kernelSource.resize(in.tellg());
+		kernelSource.resize(headerSize + (size_t)in.tellg());
 		in.seekg(0, std::ios::beg);
-		in.read(&kernelSource[0], kernelSource.size());
+		in.read(&kernelSource[headerSize], kernelSource.size() - headerSize);
 		in.close();
 	}
 	else
@@ -443,54 +492,62 @@ void BoidModelSHObstacleTunnel::loadKernel(){
 
 }
 
-void BoidModelSHObstacleTunnel::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color){
+void BoidModelSHObstacleTunnel::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal){
 	log("Create buffer for usage");
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
-	size_t array_size_fp8 = 2 * num * sizeof(Vec4);
+	size_t array_size_fp8 = num * CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL);
 	size_t array_size_fp = num * sizeof(float);
 
-	createVboBindShader(pos, vel, color);
+	createVboBindShader(pos, vel, group);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
 
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 
-	cl_color_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo[0], &err));
-	cl_color_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo_out[0], &err));
+	cl_group_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo[0], &err));
+	cl_group_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo_out[0], &err));
 	//create the OpenCL only arrays
 	try
 	{
-		cl_coef0X = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Y = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Z = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_goal_in = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_goal_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-		cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_coef0X = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Y = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Z = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_groups = clHelper->createBuffer(CL_MEM_READ_ONLY, NUM_GROUPS_MAX * sizeof(group_t), NULL, &err);
+		cl_goal = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_goal_out = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
+
+	//both buffers hold the goals, the first reorder reads either of them
+	if (goalPerBoid){
+		err = queue.enqueueWriteBuffer(cl_goal, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+		err = queue.enqueueWriteBuffer(cl_goal_out, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+	}
 }
 
 void BoidModelSHObstacleTunnel::createAndLoadObstacleSH(std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst){
-	size_t array_size_fp8 = 2 * posObst.size() * sizeof(Vec4);
+	size_t array_size_fp8 = posObst.size() * CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL);
 	size_t array_size_fp = posObst.size() * sizeof(float);
 	size_t array_size_index = start.size() * sizeof(unsigned int);
 	size_t array_size_cor = cor.size() * sizeof(Vec4);
@@ -498,16 +555,16 @@ void BoidModelSHObstacleTunnel::createAndLoadObstacleSH(std::vector<Vec4> cor, s
 
 	try
 	{
-		cl_coef0OX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0OY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0OZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalOX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalOY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalOZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_startCor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_index, NULL, &err);
-		cl_endCor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_index, NULL, &err);
-		cl_posObst = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_pos, NULL, &err);
-		cl_cor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_cor, NULL, &err);
+		cl_coef0OX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalOX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_startCor = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_index, NULL, &err);
+		cl_endCor = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_index, NULL, &err);
+		cl_posObst = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_pos, NULL, &err);
+		cl_cor = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_cor, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -546,13 +603,13 @@ void BoidModelSHObstacleTunnel::createAndLoadObstacleSH(std::vector<Vec4> cor, s
 	queue.finish();
 
 	std::vector<Vec4> Y(2 * 208);
-	queue.enqueueReadBuffer(cl_shEvalOX, CL_TRUE, 0, (size_t)2 * 208 * sizeof(Vec4), Y.data());
+	queue.enqueueReadBuffer(cl_shEvalOX, CL_TRUE, 0, (size_t)208 * CLHelper::getSHVecSize(SH_ORDER_SH_TUNNEL), Y.data());
 	queue.finish();
 
 
 }
 
-void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color){
+void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group){
 	std::vector<Vec4> newDataColor(num);
 
 	for (int i = 0; i < num; i++){
@@ -563,9 +620,9 @@ void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::
 	size_t array_size = num * sizeof(Vec4);
 
 	//create shader
-	shader = new Shader("boidTri.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
+	shader = new Shader("boidTriGroup.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
 	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
-	GLint colorLoc = glGetAttribLocation(shader->id(), "color");
+	GLint groupLoc = glGetAttribLocation(shader->id(), "group");
 	GLint velLoc = glGetAttribLocation(shader->id(), "vel3d");
 
 	//------VBO 1--------- (in)
@@ -585,10 +642,10 @@ void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
@@ -610,10 +667,10 @@ void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo_out[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo_out[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
@@ -621,12 +678,23 @@ void BoidModelSHObstacleTunnel::createVboBindShader(std::vector<Vec4> pos, std::
 	log("GL VBO Buffer created");
 }
 
-void BoidModelSHObstacleTunnel::loadData(std::vector<Vec4> goal){
-	num = (int)goal.size();
-	size_t array_size_fp4 = num * sizeof(Vec4);
+void BoidModelSHObstacleTunnel::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
 
-	err = queue.enqueueWriteBuffer(cl_goal_in, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+void BoidModelSHObstacleTunnel::loadData(std::vector<group_t> groups){
+	err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, 0, groups.size() * sizeof(group_t), &groups[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+
+	//group colors are uniforms of the shader, the group id attribute selects one of them
+	std::vector<Vec4> groupColor(NUM_GROUPS_MAX, BOID_COLOR);
+	for (size_t i = 0; i < groups.size() && i < NUM_GROUPS_MAX; i++)
+		groupColor[i] = groups[i].color;
+
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), "groupColor"), NUM_GROUPS_MAX, &groupColor[0].x);
+	shader->unbind();
+
 	queue.finish();
 }
 
@@ -656,7 +724,7 @@ void BoidModelSHObstacleTunnel::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -677,6 +745,7 @@ void BoidModelSHObstacleTunnel::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -695,6 +764,7 @@ void BoidModelSHObstacleTunnel::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -724,6 +794,7 @@ void BoidModelSHObstacleTunnel::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -750,13 +821,16 @@ void BoidModelSHObstacleTunnel::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSHObstacleTunnel::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -790,12 +864,12 @@ std::vector<const char*> BoidModelSHObstacleTunnel::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -819,39 +893,65 @@ std::vector<const char*> BoidModelSHObstacleTunnel::getSimTimeDescriptions(){
 	stringSHTime = strstream.str();
 	simTimeDisc[9] = stringSHTime.c_str();
 
+	strstream.str(std::string());
+	if (flowField->getNumGoals() > 0)
+		strstream << "Flow fields: " << flowField->getNumGoals() << " goals, build " << flowField->getBuildTime() << "ms (" << flowField->getIterations() << " steps)";
+	else
+		strstream << "Flow fields: off (straight path to the goal)";
+	stringFlowField = strstream.str();
+	simTimeDisc[10] = stringFlowField.c_str();
+
 	return simTimeDisc;
 }
 
-void BoidModelSHObstacleTunnel::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
+bool BoidModelSHObstacleTunnel::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
+}
 
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
+void BoidModelSHObstacleTunnel::setGroup(unsigned int id, group_t group){
+	if (id >= NUM_GROUPS_MAX)
+		return;
 
+	//a group behind the table gets the goal of the new group until it is set itself
+	bool added = id >= groupTable.size();
+	if (added)
+		groupTable.resize(id + 1, group);
 
+	Vec4 goal = groupTable[id].goal;
+	groupTable[id] = group;
 
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//a moved goal needs new flow fields, the flow field ids of all groups may change. The group
+	//ids of the boids stay untouched
+	if (goal.x != group.goal.x || goal.y != group.goal.y || goal.z != group.goal.z || added){
+		buildFlowField();
+		err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, 0, groupTable.size() * sizeof(group_t), &groupTable[0], NULL, &event);
+	}
+	else{
+		groupTable[id].goal.w = goal.w;
+		err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, id * sizeof(group_t), sizeof(group_t), &groupTable[id], NULL, &event);
+	}
 
-	(*vel).set(v.x, v.y, v.z, 0.0);
+	std::string name = "groupColor[" + std::to_string(id) + "]";
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), name.c_str()), 1, &group.color.x);
+	shader->unbind();
+}
 
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+void BoidModelSHObstacleTunnel::buildFlowField(){
+	std::vector<Vec4> goal(groupTable.size());
+	for (size_t i = 0; i < groupTable.size(); i++)
+		goal[i] = groupTable[i].goal;
 
-	(*pos).set(p.x, p.y, p.z, 0.0);
-}
+	//boids with their own goals walk the straight path, the groups need no flow fields
+	std::vector<Vec4> flowGoals = FlowField::assignGoalIds(&goal, goalPerBoid ? 0 : FLOW_FIELD_MAX_GOALS);
+	for (size_t i = 0; i < groupTable.size(); i++)
+		groupTable[i].goal.w = goal[i].w;
 
+	//the program of the flow fields is built once, later goals only solve the fields again
+	if (flowField == NULL)
+		flowField = new FlowField(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin, flowGoals);
+	else
+		flowField->setGoals(flowGoals);
 
+	flowField->build(blockedCells);
+}
@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "boidModel.h"
 
-BoidModelSHWay2::BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP) : BoidModel(clHlpr)
+BoidModelSHWay2::BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP) : BoidModel(clHlpr)
 {
-	simTimeDisc = std::vector<const char*>(10);
+	simTimeDisc = std::vector<const char*>(16);
 	simTimeDisc[0] = "Boid Model SH way following 2";
 	simTimeDisc[1] = "OpenCL Simulation Times:";
 	simTimeDisc[2] = "";
@@ -14,6 +14,12 @@ BoidModelSHWay2::BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::v
 	simTimeDisc[7] = "";
 	simTimeDisc[8] = "";
 	simTimeDisc[9] = "";
+	simTimeDisc[10] = "";
+	simTimeDisc[11] = "";
+	simTimeDisc[12] = "";
+	simTimeDisc[13] = "";
+	simTimeDisc[14] = "";
+	simTimeDisc[15] = "";
 
 	context = clHelper->getContext();
 	queue = clHelper->getCmdQueue();
@@ -22,14 +28,26 @@ BoidModelSHWay2::BoidModelSHWay2(CLHelper* clHlpr, std::vector<Vec4> pos, std::v
 	simParams = *simP;
 
 	num = simParams.numBodies;
+	goalPerBoid = goal.empty() ? 0 : 1;
+	shChannels = SH_WAY2_GROUP_CHANNELS < 1 ? 1 : (SH_WAY2_GROUP_CHANNELS > NUM_GROUPS_MAX ? NUM_GROUPS_MAX : SH_WAY2_GROUP_CHANNELS);
+	congested[0] = congested[1] = 0;
+	tierCount[0] = num;
+	tierCount[1] = 0;
 
-	createBuffer(pos, vel, goal, color);
-	loadData(goal);
+	createBuffer(pos, vel, group, goal);
+	loadData(groups);
 
-	programBoid    = loadProgram(kernel_path + "BoidModelSHWay2_kernel_v1.cl");
+	programBoid    = loadProgram(kernel_path + "BoidModelSHWay2_kernel_v1.cl", clHelper->getSHBasisSource(SH_ORDER_SH_WAY2));
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "BoidModelSHWay2_kernel_v1.cl", SH_ORDER_SH_WAY2);
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -42,12 +60,15 @@ BoidModelSHWay2::~BoidModelSHWay2(){
 	glDeleteVertexArrays(1, pos_vao);
 
 	delete shader;
+
+	//pending congestion readbacks write into congestedRead
+	queue.finish();
 }
 
 void BoidModelSHWay2::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -69,8 +90,8 @@ void BoidModelSHWay2::simulate(float dt){
 	err = queue.enqueueAcquireGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos_out, NULL, &event);
 	queue.finish();
 
 	//Get grid hash value for every boid
@@ -94,12 +115,15 @@ void BoidModelSHWay2::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -107,26 +131,26 @@ void BoidModelSHWay2::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -146,40 +170,51 @@ void BoidModelSHWay2::simulate(float dt){
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos_out[0]);	//vel out ordered
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos[0]);		//pos in unordered
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos[0]);		//vel in unordered
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal_out);
 		}
 		else {
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos_out[0]);	//pos in
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_findGridEdgeAndReorder.setArg(2, cl_pos_vbos[0]);		//pos out
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal_out);
 		}
 
 		err = kernel_findGridEdgeAndReorder.setArg(0, cl_gridStartIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(1, cl_gridEndIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(4, cl_gridHash_sorted);
 		err = kernel_findGridEdgeAndReorder.setArg(5, cl_gridIndex_sorted);
-		err = kernel_findGridEdgeAndReorder.setArg(12, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
-		err = kernel_findGridEdgeAndReorder.setArg(13, num);
+		err = kernel_findGridEdgeAndReorder.setArg(10, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
+		err = kernel_findGridEdgeAndReorder.setArg(11, num);
+		err = kernel_findGridEdgeAndReorder.setArg(14, goalPerBoid);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
+
+#if LOD_TIERS
+	//cells only change their tier every few steps, boids moving into another cell take its tier at once
+	if (roiValid && lodStepCount++ % LOD_UPDATE_INTERVAL == 0)
+		assignLOD();
+#endif
 
 	try
 	{
@@ -209,6 +244,7 @@ void BoidModelSHWay2::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[4] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REDUCE, (endTime - startTime) / 1000.0);
 
 	//		std::vector<Vec4> C(2 * simParams.numCells);
 	//		queue.enqueueReadBuffer(cl_shEval, CL_TRUE, 0, (size_t)2 * simParams.numCells * sizeof(Vec4), C.data());
@@ -221,21 +257,26 @@ void BoidModelSHWay2::simulate(float dt){
 			err = kernel_simulate.setArg(1, cl_pos_vbos[0]);		//pos out
 			err = kernel_simulate.setArg(2, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_simulate.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_simulate.setArg(6, cl_goal_out);
+			err = kernel_simulate.setArg(6, cl_group_vbos[0]);		//group ids
+			err = kernel_simulate.setArg(12, cl_goal);		//goals
 		}
 		else{
 			err = kernel_simulate.setArg(1, cl_pos_vbos_out[0]);	//pos out
 			err = kernel_simulate.setArg(0, cl_pos_vbos[0]);		//pos in
 			err = kernel_simulate.setArg(3, cl_vel_vbos_out[0]);	//vel out
 			err = kernel_simulate.setArg(2, cl_vel_vbos[0]);		//vel in
-			err = kernel_simulate.setArg(6, cl_goal_in);
+			err = kernel_simulate.setArg(6, cl_group_vbos_out[0]);	//group ids
+			err = kernel_simulate.setArg(12, cl_goal_out);	//goals
 		}
 
 		err = kernel_simulate.setArg(4, cl_gridStartIndex);
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
 		err = kernel_simulate.setArg(7, cl_simParams);
 		err = kernel_simulate.setArg(8, cl_range);
-		err = kernel_simulate.setArg(9, dt);
+		err = kernel_simulate.setArg(9, cl_groups);
+		err = kernel_simulate.setArg(10, cl_cellTier);
+		err = kernel_simulate.setArg(11, dt);
+		err = kernel_simulate.setArg(13, goalPerBoid);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -259,6 +300,12 @@ void BoidModelSHWay2::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
+	timeTierFull = (endTime - startTime) / 1000000.0f;
+
+#if LOD_TIERS
+	timeTierCoarse = simulateCoarse();
+#endif
 
 	try
 	{
@@ -281,9 +328,9 @@ void BoidModelSHWay2::simulate(float dt){
 		err = kernel_useSH.setArg(5, cl_shEvalY);
 		err = kernel_useSH.setArg(6, cl_shEvalZ);
 		err = kernel_useSH.setArg(7, cl_simParams);
-		err = kernel_useSH.setArg(10, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(11, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(12, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(13, cl_coef0X);
 		err = kernel_useSH.setArg(14, cl_coef0Y);
 		err = kernel_useSH.setArg(15, cl_coef0Z);
@@ -291,13 +338,39 @@ void BoidModelSHWay2::simulate(float dt){
 		err = kernel_useSH.setArg(17, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(18, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(19, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
+#if USE_SH_FOR_PATH && SH_WAY2_CELL_AGGREGATE
+		err = kernel_useSH.setArg(20, cl_cellSHX);
+		err = kernel_useSH.setArg(21, cl_cellSHY);
+		err = kernel_useSH.setArg(22, cl_cellSHZ);
+		err = kernel_useSH.setArg(23, cl_cellC0X);
+		err = kernel_useSH.setArg(24, cl_cellC0Y);
+		err = kernel_useSH.setArg(25, cl_cellC0Z);
+		err = kernel_useSH.setArg(26, cl_cellPos);
+		err = kernel_useSH.setArg(27, counter ? cl_group_vbos[0] : cl_group_vbos_out[0]);
+		err = kernel_useSH.setArg(28, shChannels);
+		err = kernel_useSH.setArg(29, SH_WAY2_WEIGHT_OWN_GROUP);
+		err = kernel_useSH.setArg(30, SH_WAY2_WEIGHT_OTHER_GROUP);
+		err = kernel_useSH.setArg(31, dt);
+#elif USE_SH_FOR_PATH
+		err = kernel_useSH.setArg(20, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(21, counter ? cl_group_vbos[0] : cl_group_vbos_out[0]);
+		err = kernel_useSH.setArg(22, shChannels);
+		err = kernel_useSH.setArg(23, SH_WAY2_WEIGHT_OWN_GROUP);
+		err = kernel_useSH.setArg(24, SH_WAY2_WEIGHT_OTHER_GROUP);
+		err = kernel_useSH.setArg(25, dt);
+#else
 		err = kernel_useSH.setArg(20, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(21, dt);
+#endif
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
+#if USE_SH_FOR_PATH && SH_WAY2_CELL_AGGREGATE
+	timeAggregate = aggregateSH(shChannels);
+#endif
+
 	localWorkSize = LOCAL_PREF;
 	globalWorkSize = simParams.numBodies;
 	err = queue.enqueueNDRangeKernel(kernel_useSH, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &event);
@@ -307,6 +380,19 @@ void BoidModelSHWay2::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
+
+#if USE_SH_FOR_PATH && SH_WAY2_CELL_AGGREGATE
+	timeCells = (endTime - startTime) / 1000000.0f;
+
+	#if SH_WAY2_VALIDATE_INTERVAL > 0
+	if (stepCount++ % SH_WAY2_VALIDATE_INTERVAL == 0)
+		validateCellSH(dt);
+	#endif
+#endif
+#if USE_SH_FOR_PATH
+	countCongested(counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], 0);
+#endif
 
 	/*
 	unsigned int A[8000];
@@ -318,13 +404,310 @@ void BoidModelSHWay2::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state (useSH output, group ids and goals of the reorder), they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt,
+		counter ? &cl_group_vbos[0] : &cl_group_vbos_out[0], goalPerBoid ? (counter ? &cl_goal : &cl_goal_out) : NULL);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos_out, NULL, &event);
+}
+
+float BoidModelSHWay2::aggregateSH(unsigned int numChannels){
+	cl_ulong startTime, endTime;
+
+	try
+	{
+		err = kernel_aggregateSH.setArg(0, cl_gridStartIndex);
+		err = kernel_aggregateSH.setArg(1, cl_gridEndIndex);
+		if (counter)
+			err = kernel_aggregateSH.setArg(2, cl_pos_vbos[0]);
+		else
+			err = kernel_aggregateSH.setArg(2, cl_pos_vbos_out[0]);
+		err = kernel_aggregateSH.setArg(3, cl_shEvalX);
+		err = kernel_aggregateSH.setArg(4, cl_shEvalY);
+		err = kernel_aggregateSH.setArg(5, cl_shEvalZ);
+		err = kernel_aggregateSH.setArg(6, cl_coef0X);
+		err = kernel_aggregateSH.setArg(7, cl_coef0Y);
+		err = kernel_aggregateSH.setArg(8, cl_coef0Z);
+		err = kernel_aggregateSH.setArg(9, cl_cellSHX);
+		err = kernel_aggregateSH.setArg(10, cl_cellSHY);
+		err = kernel_aggregateSH.setArg(11, cl_cellSHZ);
+		err = kernel_aggregateSH.setArg(12, cl_cellC0X);
+		err = kernel_aggregateSH.setArg(13, cl_cellC0Y);
+		err = kernel_aggregateSH.setArg(14, cl_cellC0Z);
+		err = kernel_aggregateSH.setArg(15, cl_cellPos);
+		err = kernel_aggregateSH.setArg(16, simParams.numCells);
+		if (counter)
+			err = kernel_aggregateSH.setArg(17, cl_group_vbos[0]);
+		else
+			err = kernel_aggregateSH.setArg(17, cl_group_vbos_out[0]);
+		err = kernel_aggregateSH.setArg(18, numChannels);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int globalWorkSize = ((simParams.numCells * numChannels + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_aggregateSH, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	return (endTime - startTime) / 1000000.0f;
+}
+
+void BoidModelSHWay2::validateCellSH(float dt){
+	cl_ulong startTime, endTime;
+
+	//same input as the cell aggregated kernel, output goes to the scratch buffers
+	try
+	{
+		if (counter){
+			err = kernel_useSHRef.setArg(0, cl_vel_vbos[0]);
+			err = kernel_useSHRef.setArg(8, cl_pos_vbos[0]);
+		}
+		else {
+			err = kernel_useSHRef.setArg(0, cl_vel_vbos_out[0]);
+			err = kernel_useSHRef.setArg(8, cl_pos_vbos_out[0]);
+		}
+
+		err = kernel_useSHRef.setArg(1, cl_velRef);
+		err = kernel_useSHRef.setArg(2, cl_gridStartIndex);
+		err = kernel_useSHRef.setArg(3, cl_gridEndIndex);
+		err = kernel_useSHRef.setArg(4, cl_shEvalX);
+		err = kernel_useSHRef.setArg(5, cl_shEvalY);
+		err = kernel_useSHRef.setArg(6, cl_shEvalZ);
+		err = kernel_useSHRef.setArg(7, cl_simParams);
+		err = kernel_useSHRef.setArg(9, cl_posRef);
+		err = kernel_useSHRef.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY2)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(13, cl_coef0X);
+		err = kernel_useSHRef.setArg(14, cl_coef0Y);
+		err = kernel_useSHRef.setArg(15, cl_coef0Z);
+		err = kernel_useSHRef.setArg(16, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(17, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(18, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(19, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(20, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
+		err = kernel_useSHRef.setArg(21, counter ? cl_group_vbos[0] : cl_group_vbos_out[0]);
+		err = kernel_useSHRef.setArg(22, shChannels);
+		err = kernel_useSHRef.setArg(23, SH_WAY2_WEIGHT_OWN_GROUP);
+		err = kernel_useSHRef.setArg(24, SH_WAY2_WEIGHT_OTHER_GROUP);
+		err = kernel_useSHRef.setArg(25, dt);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_useSHRef, cl::NullRange, cl::NDRange(simParams.numBodies), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	timeReference = (endTime - startTime) / 1000000.0f;
+
+	try
+	{
+		if (counter)
+			err = kernel_compareVel.setArg(0, cl_vel_vbos_out[0]);
+		else
+			err = kernel_compareVel.setArg(0, cl_vel_vbos[0]);
+
+		err = kernel_compareVel.setArg(1, cl_velRef);
+		err = kernel_compareVel.setArg(2, cl_deviation);
+		err = kernel_compareVel.setArg(3, simParams.numBodies);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_compareVel, cl::NullRange, cl::NDRange(simParams.numBodies), cl::NullRange, NULL, &event);
+	queue.finish();
+
+	std::vector<float> deviation(simParams.numBodies);
+	queue.enqueueReadBuffer(cl_deviation, CL_TRUE, 0, simParams.numBodies * sizeof(float), deviation.data());
+
+	deviationMean = 0.0f;
+	deviationMax = 0.0f;
+	for (unsigned int i = 0; i < simParams.numBodies; i++){
+		deviationMean += deviation[i];
+		if (deviation[i] > deviationMax)
+			deviationMax = deviation[i];
+	}
+	deviationMean /= simParams.numBodies;
+
+	//the cell buffers are used up for this step, the next step aggregates them again
+	timeAggregateSingle = aggregateSH(1);
+
+	//same step with all groups in one channel into the scratch buffers, args are set again every step
+	try
+	{
+		err = kernel_useSH.setArg(1, cl_velRef);
+		err = kernel_useSH.setArg(9, cl_posRef);
+		err = kernel_useSH.setArg(28, (unsigned int)1);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_useSH, cl::NullRange, cl::NDRange(simParams.numBodies), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	timeCellsSingle = (endTime - startTime) / 1000000.0f;
+
+	countCongested(cl_velRef, 1);
+}
+
+void BoidModelSHWay2::setRegionOfInterest(const glm::mat4 &viewProjection, glm::vec3 eye, const std::vector<Vec4> &boxes){
+	memcpy(roiViewProjection.s, glm::value_ptr(viewProjection), sizeof(cl_float16));
+	roiEye.s[0] = eye.x;
+	roiEye.s[1] = eye.y;
+	roiEye.s[2] = eye.z;
+	roiEye.s[3] = 0.0f;
+
+	//two entries per box, the boxes beyond LOD_MAX_BOXES are ignored
+	size_t numEntries = boxes.size() & ~(size_t)1;
+	if (numEntries > 2 * LOD_MAX_BOXES)
+		numEntries = 2 * LOD_MAX_BOXES;
+	roiBoxes.assign(boxes.begin(), boxes.begin() + numEntries);
+
+	if (!roiBoxes.empty())
+		err = queue.enqueueWriteBuffer(cl_roiBoxes, CL_TRUE, 0, roiBoxes.size() * sizeof(Vec4), &roiBoxes[0]);
+
+	roiValid = true;
+}
+
+void BoidModelSHWay2::assignLOD(){
+	cl_ulong startTime, endTime;
+	unsigned int zero[2] = { 0, 0 };
+	err = queue.enqueueWriteBuffer(cl_tierCount, CL_FALSE, 0, 2 * sizeof(unsigned int), zero);
+
+	try
+	{
+		err = kernel_assignLOD.setArg(0, cl_gridStartIndex);
+		err = kernel_assignLOD.setArg(1, cl_gridEndIndex);
+		err = kernel_assignLOD.setArg(2, cl_simParams);
+		err = kernel_assignLOD.setArg(3, roiViewProjection);
+		err = kernel_assignLOD.setArg(4, roiEye);
+		err = kernel_assignLOD.setArg(5, LOD_DISTANCE);
+		err = kernel_assignLOD.setArg(6, (unsigned int)LOD_DENSE_COUNT);
+		err = kernel_assignLOD.setArg(7, cl_roiBoxes);
+		err = kernel_assignLOD.setArg(8, (unsigned int)(roiBoxes.size() / 2));
+		err = kernel_assignLOD.setArg(9, cl_cellTier);
+		err = kernel_assignLOD.setArg(10, cl_tierCount);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int globalWorkSize = ((simParams.numCells + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_assignLOD, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+	err = queue.enqueueReadBuffer(cl_tierCount, CL_TRUE, 0, 2 * sizeof(unsigned int), tierCount);
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	timeAssignLOD = (endTime - startTime) / 1000000.0f;
+}
+
+float BoidModelSHWay2::simulateCoarse(){
+	cl_ulong startTime, endTime;
+	float time = 0.0f;
+
+	//no tiers assigned yet, every cell is full. Once assigned the pass always runs: a boid which
+	//moved into a coarse cell empty at the last assignment is skipped by simulate
+	if (!roiValid)
+		return time;
+
+	try
+	{
+		if (counter){
+			err = kernel_cellMeanVelocity.setArg(0, cl_vel_vbos_out[0]);
+			err = kernel_simulateCoarse.setArg(0, cl_pos_vbos_out[0]);	//pos in
+			err = kernel_simulateCoarse.setArg(1, cl_pos_vbos[0]);		//pos out
+			err = kernel_simulateCoarse.setArg(2, cl_vel_vbos[0]);		//vel out
+			err = kernel_simulateCoarse.setArg(3, cl_group_vbos[0]);	//group ids
+		}
+		else{
+			err = kernel_cellMeanVelocity.setArg(0, cl_vel_vbos[0]);
+			err = kernel_simulateCoarse.setArg(0, cl_pos_vbos[0]);		//pos in
+			err = kernel_simulateCoarse.setArg(1, cl_pos_vbos_out[0]);	//pos out
+			err = kernel_simulateCoarse.setArg(2, cl_vel_vbos_out[0]);	//vel out
+			err = kernel_simulateCoarse.setArg(3, cl_group_vbos_out[0]);	//group ids
+		}
+
+		err = kernel_cellMeanVelocity.setArg(1, cl_gridStartIndex);
+		err = kernel_cellMeanVelocity.setArg(2, cl_gridEndIndex);
+		err = kernel_cellMeanVelocity.setArg(3, cl_cellTier);
+		err = kernel_cellMeanVelocity.setArg(4, cl_cellMeanVel);
+		err = kernel_cellMeanVelocity.setArg(5, simParams.numCells);
+
+		err = kernel_simulateCoarse.setArg(4, cl_simParams);
+		err = kernel_simulateCoarse.setArg(5, cl_groups);
+		err = kernel_simulateCoarse.setArg(6, cl_cellTier);
+		err = kernel_simulateCoarse.setArg(7, cl_cellMeanVel);
+		err = kernel_simulateCoarse.setArg(8, simParams.numBodies);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int globalWorkSize = ((simParams.numCells + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_cellMeanVelocity, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	time += (endTime - startTime) / 1000000.0f;
+
+	globalWorkSize = ((simParams.numBodies + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_simulateCoarse, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	time += (endTime - startTime) / 1000000.0f;
+
+	return time;
+}
+
+void BoidModelSHWay2::countCongested(cl::Memory vel, unsigned int slot){
+	//the count of an earlier step arrived, until then no new count is started
+	if (congestedEvent[slot]() != NULL){
+		if (congestedEvent[slot].getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
+			return;
+		congested[slot] = congestedRead[slot];
+		congestedEvent[slot] = cl::Event();
+	}
+
+	//the write is not blocking, its source has to outlive it
+	static const unsigned int zero = 0;
+	err = queue.enqueueWriteBuffer(cl_congested, CL_FALSE, slot * sizeof(unsigned int), sizeof(unsigned int), &zero);
+
+	try
+	{
+		err = kernel_countCongested.setArg(0, vel);
+		err = kernel_countCongested.setArg(1, cl_congested);
+		err = kernel_countCongested.setArg(2, SH_WAY2_CONGESTION_SPEED * simParams.maxVel);
+		err = kernel_countCongested.setArg(3, simParams.numBodies);
+		err = kernel_countCongested.setArg(4, slot);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_countCongested, cl::NullRange, cl::NDRange(((simParams.numBodies + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF), cl::NDRange(LOCAL_PREF));
+	err = queue.enqueueReadBuffer(cl_congested, CL_FALSE, slot * sizeof(unsigned int), sizeof(unsigned int), &congestedRead[slot], NULL, &congestedEvent[slot]);
 }
 
 GLuint BoidModelSHWay2::getPosVBO(){
@@ -349,22 +732,23 @@ GLuint BoidModelSHWay2::getPosVAO(){
 }
 
 int BoidModelSHWay2::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
 
-cl::Program BoidModelSHWay2::loadProgram(const std::string &filename){
+cl::Program BoidModelSHWay2::loadProgram(const std::string &filename, const std::string &header){
 	log("load program");
-	std::string kernelSource;
+	std::string kernelSource = header;
+	size_t headerSize = header.size();
 
 	std::ifstream in(filename, std::ios::in | std::ios::binary);
 	if (in)
 	{
 		in.seekg(0, std::ios::end);
-		kernelSource.resize(in.tellg());
+		kernelSource.resize(headerSize + (size_t)in.tellg());
 		in.seekg(0, std::ios::beg);
-		in.read(&kernelSource[0], kernelSource.size());
+		in.read(&kernelSource[headerSize], kernelSource.size() - headerSize);
 		in.close();
 	}
 	else
@@ -410,6 +794,9 @@ void BoidModelSHWay2::loadKernel(){
 		kernel_getGridHash = cl::Kernel(programBoid, "getGridHash", &err);
 		kernel_findGridEdgeAndReorder = cl::Kernel(programBoid, "findGridEdgeAndReorder", &err);
 		kernel_simulate = cl::Kernel(programBoid, "simulate", &err);
+		kernel_assignLOD = cl::Kernel(programBoid, "assignLOD", &err);
+		kernel_cellMeanVelocity = cl::Kernel(programBoid, "cellMeanVelocity", &err);
+		kernel_simulateCoarse = cl::Kernel(programBoid, "simulateCoarse", &err);
 		kernel_bitonicSortLocal = cl::Kernel(programBitonic, "bitonicSortLocal", &err);
 		kernel_bitonicSortLocal1 = cl::Kernel(programBitonic, "bitonicSortLocal1", &err);
 		kernel_bitonicMergeGlobal = cl::Kernel(programBitonic, "bitonicMergeGlobal", &err);
@@ -417,8 +804,15 @@ void BoidModelSHWay2::loadKernel(){
 		kernel_memSet = cl::Kernel(programBoid, "memSet", &err);
 		kernel_evalSH = cl::Kernel(programBoid, "evalSH", &err);
 
-#if USE_SH_FOR_PATH
+#if USE_SH_FOR_PATH && SH_WAY2_CELL_AGGREGATE
+		kernel_useSH = cl::Kernel(programBoid, "useSHCells", &err);
+		kernel_aggregateSH = cl::Kernel(programBoid, "aggregateSH", &err);
+		kernel_useSHRef = cl::Kernel(programBoid, "useSH", &err);
+		kernel_compareVel = cl::Kernel(programBoid, "compareVel", &err);
+		kernel_countCongested = cl::Kernel(programBoid, "countCongested", &err);
+#elif USE_SH_FOR_PATH
 		kernel_useSH = cl::Kernel(programBoid, "useSH", &err);
+		kernel_countCongested = cl::Kernel(programBoid, "countCongested", &err);
 #else
 		kernel_useSH = cl::Kernel(programBoid, "dontUseSH", &err);
 #endif
@@ -429,53 +823,76 @@ void BoidModelSHWay2::loadKernel(){
 
 }
 
-void BoidModelSHWay2::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color){
+void BoidModelSHWay2::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal){
 	log("Create buffer for usage");
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
-	size_t array_size_fp8 = 2 * num * sizeof(Vec4);
+	size_t array_size_fp8 = num * CLHelper::getSHVecSize(SH_ORDER_SH_WAY2);
 	size_t array_size_fp = num * sizeof(float);
 
-	createVboBindShader(pos, vel, color);
+	createVboBindShader(pos, vel, group);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
 
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 
-	cl_color_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo[0], &err));
-	cl_color_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo_out[0], &err));
+	cl_group_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo[0], &err));
+	cl_group_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo_out[0], &err));
 	//create the OpenCL only arrays
 	try
 	{
-		cl_coef0X = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Y = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Z = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_goal_in = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_goal_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-		cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_coef0X = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Y = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Z = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_groups = clHelper->createBuffer(CL_MEM_READ_ONLY, NUM_GROUPS_MAX * sizeof(group_t), NULL, &err);
+		cl_goal = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_goal_out = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_cellSHX = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * CLHelper::getSHVecSize(SH_ORDER_SH_WAY2), NULL, &err);
+		cl_cellSHY = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * CLHelper::getSHVecSize(SH_ORDER_SH_WAY2), NULL, &err);
+		cl_cellSHZ = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * CLHelper::getSHVecSize(SH_ORDER_SH_WAY2), NULL, &err);
+		cl_cellC0X = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * sizeof(float), NULL, &err);
+		cl_cellC0Y = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * sizeof(float), NULL, &err);
+		cl_cellC0Z = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * shChannels * sizeof(float), NULL, &err);
+		cl_cellPos = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells * shChannels, NULL, &err);
+		cl_velRef = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_posRef = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_deviation = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_congested = clHelper->createBuffer(CL_MEM_READ_WRITE, 2 * sizeof(unsigned int), NULL, &err);
+		cl_cellTier = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * sizeof(unsigned char), NULL, &err);
+		cl_tierCount = clHelper->createBuffer(CL_MEM_READ_WRITE, 2 * sizeof(unsigned int), NULL, &err);
+		cl_cellMeanVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_roiBoxes = clHelper->createBuffer(CL_MEM_READ_ONLY, 2 * LOD_MAX_BOXES * sizeof(Vec4), NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
+
+	//both buffers hold the goals, the first reorder reads either of them
+	if (goalPerBoid){
+		err = queue.enqueueWriteBuffer(cl_goal, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+		err = queue.enqueueWriteBuffer(cl_goal_out, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+	}
 }
 
-void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color){
+void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group){
 	std::vector<Vec4> newDataColor(num);
 
 	for (int i = 0; i < num; i++){
@@ -486,9 +903,9 @@ void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	size_t array_size = num * sizeof(Vec4);
 
 	//create shader
-	shader = new Shader("boidTri.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
+	shader = new Shader("boidTriGroup.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
 	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
-	GLint colorLoc = glGetAttribLocation(shader->id(), "color");
+	GLint groupLoc = glGetAttribLocation(shader->id(), "group");
 	GLint velLoc = glGetAttribLocation(shader->id(), "vel3d");
 
 	//------VBO 1--------- (in)
@@ -508,10 +925,10 @@ void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
@@ -533,10 +950,10 @@ void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo_out[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo_out[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
@@ -544,12 +961,27 @@ void BoidModelSHWay2::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	log("GL VBO Buffer created");
 }
 
-void BoidModelSHWay2::loadData(std::vector<Vec4> goal){
-	num = (int)goal.size();
-	size_t array_size_fp4 = num * sizeof(Vec4);
+void BoidModelSHWay2::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
 
-	err = queue.enqueueWriteBuffer(cl_goal_in, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+void BoidModelSHWay2::loadData(std::vector<group_t> groups){
+	err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, 0, groups.size() * sizeof(group_t), &groups[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+
+	//every cell runs the full rules until the first region of interest is set
+	std::vector<unsigned char> cellTier(simParams.numCells, 0);
+	err = queue.enqueueWriteBuffer(cl_cellTier, CL_TRUE, 0, simParams.numCells * sizeof(unsigned char), &cellTier[0], NULL, &event);
+
+	//group colors are uniforms of the shader, the group id attribute selects one of them
+	std::vector<Vec4> groupColor(NUM_GROUPS_MAX, BOID_COLOR);
+	for (size_t i = 0; i < groups.size() && i < NUM_GROUPS_MAX; i++)
+		groupColor[i] = groups[i].color;
+
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), "groupColor"), NUM_GROUPS_MAX, &groupColor[0].x);
+	shader->unbind();
+
 	queue.finish();
 }
 
@@ -579,7 +1011,7 @@ void BoidModelSHWay2::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -600,6 +1032,7 @@ void BoidModelSHWay2::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -618,6 +1051,7 @@ void BoidModelSHWay2::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -647,6 +1081,7 @@ void BoidModelSHWay2::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -673,13 +1108,16 @@ void BoidModelSHWay2::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSHWay2::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -713,12 +1151,12 @@ std::vector<const char*> BoidModelSHWay2::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -742,39 +1180,63 @@ std::vector<const char*> BoidModelSHWay2::getSimTimeDescriptions(){
 	stringSHTime = strstream.str();
 	simTimeDisc[9] = stringSHTime.c_str();
 
-	return simTimeDisc;
-}
+#if USE_SH_FOR_PATH && SH_WAY2_CELL_AGGREGATE
+	strstream.str(std::string());
+	strstream << "SH cell aggregation: " << timeAggregate << "ms, ";
+	if (timeCells + timeAggregate > 0.0f)
+		strstream << (int)(num / (timeCells + timeAggregate)) << " boids/ms";
+	stringCellTime = strstream.str();
+	simTimeDisc[10] = stringCellTime.c_str();
 
-void BoidModelSHWay2::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
+	strstream.str(std::string());
+	strstream << "Per boid SH: " << timeReference << "ms, dev. mean/max: " << deviationMean << "/" << deviationMax;
+	stringCellDeviation = strstream.str();
+	simTimeDisc[11] = stringCellDeviation.c_str();
 
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
+	strstream.str(std::string());
+	strstream << "SH group channels: " << shChannels << ", extra cost " << (timeAggregate + timeCells) - (timeAggregateSingle + timeCellsSingle) << "ms (1 channel: " << timeAggregateSingle + timeCellsSingle << "ms)";
+	stringGroupChannels = strstream.str();
+	simTimeDisc[12] = stringGroupChannels.c_str();
+#endif
+#if USE_SH_FOR_PATH
+	strstream.str(std::string());
+	strstream << "Congested boids: " << congested[0] << " (" << 100.0f * congested[0] / num << "%)";
+#if SH_WAY2_CELL_AGGREGATE
+	strstream << ", 1 channel: " << congested[1];
+#endif
+	stringCongestion = strstream.str();
+	simTimeDisc[13] = stringCongestion.c_str();
+#endif
+#if LOD_TIERS
+	strstream.str(std::string());
+	strstream << "LOD full: " << tierCount[0] << " boids " << timeTierFull << "ms, coarse: " << tierCount[1] << " boids " << timeTierCoarse << "ms";
+	stringLODTiers = strstream.str();
+	simTimeDisc[14] = stringLODTiers.c_str();
 
+	strstream.str(std::string());
+	strstream << "LOD assignment: " << timeAssignLOD << "ms every " << LOD_UPDATE_INTERVAL << " steps";
+	stringLODAssign = strstream.str();
+	simTimeDisc[15] = stringLODAssign.c_str();
+#endif
 
+	return simTimeDisc;
+}
 
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+bool BoidModelSHWay2::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
+}
 
-	(*vel).set(v.x, v.y, v.z, 0.0);
+void BoidModelSHWay2::setGroup(unsigned int id, group_t group){
+	if (id >= NUM_GROUPS_MAX)
+		return;
 
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//one entry of the table, the group ids of the boids stay untouched
+	err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, id * sizeof(group_t), sizeof(group_t), &group, NULL, &event);
 
-	(*pos).set(p.x, p.y, p.z, 0.0);
+	std::string name = "groupColor[" + std::to_string(id) + "]";
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), name.c_str()), 1, &group.color.x);
+	shader->unbind();
 }
 
 
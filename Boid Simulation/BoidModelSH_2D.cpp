@@ -24,18 +24,29 @@ BoidModelSH_2D::BoidModelSH_2D(CLHelper* clHlpr, std::vector<Vec4> pos, std::vec
 	num = simParams.numBodies;
 	Y_AxisFixed = CELL_SIZE_Y / 2;
 
+	//only the x/z plane is simulated, y is added by the vertex shader
+	std::vector<float2> pos2D(pos.size());
+	std::vector<float2> vel2D(vel.size());
+
 	for (int i = 0; i < pos.size(); i++){
-		pos[i].y = Y_AxisFixed;
-		vel[i].y = 0.0f;
+		pos2D[i] = make_float2(pos[i].x, pos[i].z);
+		vel2D[i] = make_float2(vel[i].x, vel[i].z);
 	}
 
-	createBuffer(pos, vel);
+	createBuffer(pos2D, vel2D);
 	loadData();
 
-	programBoid    = loadProgram(kernel_path + "boidModelSH_2D_kernel_v1.cl");
+	programBoid    = loadProgram(kernel_path + "boidModelSH_2D_kernel_v2.cl");
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "boidModelSH_2D_kernel_v2.cl");
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num, 2, Y_AxisFixed, -10.0f);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin, 2);
+	population = new Population(clHelper, num, simParams.numCells, 2, Y_AxisFixed);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -53,7 +64,7 @@ BoidModelSH_2D::~BoidModelSH_2D(){
 void BoidModelSH_2D::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -98,12 +109,15 @@ void BoidModelSH_2D::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -111,26 +125,26 @@ void BoidModelSH_2D::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -170,21 +184,16 @@ void BoidModelSH_2D::simulate(float dt){
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
-
-
-	unsigned int F[8000];
-	queue.enqueueReadBuffer(cl_gridStartIndex, CL_TRUE, 0, (size_t)(8000 * sizeof(unsigned int)), &F);
-	queue.finish();
-
-	unsigned int G[8000];
-	queue.enqueueReadBuffer(cl_gridEndIndex, CL_TRUE, 0, (size_t)(8000 * sizeof(unsigned int)), &G);
-	queue.finish();
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -196,7 +205,7 @@ void BoidModelSH_2D::simulate(float dt){
 		err = kernel_sumVelSH.setArg(1, cl_gridStartIndex);
 		err = kernel_sumVelSH.setArg(2, cl_gridEndIndex);
 		err = kernel_sumVelSH.setArg(3, cl_sumVel);
-		err = kernel_sumVelSH.setArg(4, cl::__local(sizeof(cl_float4)*(2 * LOCAL_PREF)));
+		err = kernel_sumVelSH.setArg(4, simParams.numCells);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -205,13 +214,14 @@ void BoidModelSH_2D::simulate(float dt){
 
 
 	int localWorkSize = LOCAL_PREF;
-	int globalWorkSize = LOCAL_PREF * (simParams.numCells);
+	int globalWorkSize = ((simParams.numCells + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
 	err = queue.enqueueNDRangeKernel(kernel_sumVelSH, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &event);
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[4] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REDUCE, (endTime - startTime) / 1000.0);
 
 	//	std::vector<Vec4> C(simParams.numCells);
 	//	queue.enqueueReadBuffer(cl_sumVel, CL_TRUE, 0, (size_t)simParams.numCells * sizeof(Vec4), C.data());
@@ -234,11 +244,7 @@ void BoidModelSH_2D::simulate(float dt){
 
 		err = kernel_simulate.setArg(4, cl_gridStartIndex);
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
-		err = kernel_simulate.setArg(6, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
-		err = kernel_simulate.setArg(7, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
-		err = kernel_simulate.setArg(8, cl_simParams);
-		err = kernel_simulate.setArg(9, cl_range);
-		err = kernel_simulate.setArg(10, dt);
+		err = kernel_simulate.setArg(6, cl_simParams);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -257,13 +263,14 @@ void BoidModelSH_2D::simulate(float dt){
 	queue.finish();
 
 	localWorkSize = LOCAL_PREF;
-	globalWorkSize = LOCAL_PREF * (simParams.numCells);
+	globalWorkSize = num;
 	err = queue.enqueueNDRangeKernel(kernel_simulate, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &eventSim);
 
 	eventSim.wait();
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -284,9 +291,8 @@ void BoidModelSH_2D::simulate(float dt){
 		err = kernel_useSH.setArg(3, cl_gridEndIndex);
 		err = kernel_useSH.setArg(4, cl_sumVel);
 		err = kernel_useSH.setArg(5, cl_simParams);
-		err = kernel_useSH.setArg(8, cl::__local(sizeof(cl_float4)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(9, Y_AxisFixed);
-		err = kernel_useSH.setArg(10, dt);
+		err = kernel_useSH.setArg(8, cl::__local(sizeof(cl_float2)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(9, dt);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -301,6 +307,7 @@ void BoidModelSH_2D::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -312,6 +319,12 @@ void BoidModelSH_2D::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state, they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
@@ -342,7 +355,7 @@ GLuint BoidModelSH_2D::getPosVAO(){
 }
 
 int BoidModelSH_2D::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
@@ -417,40 +430,40 @@ void BoidModelSH_2D::loadKernel(){
 
 }
 
-void BoidModelSH_2D::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel){
+void BoidModelSH_2D::createBuffer(std::vector<float2> pos, std::vector<float2> vel){
 	log("Create buffer for usage");
 
-	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
-	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
+	size_t array_size_fp2_cells = simParams.numCells * sizeof(float2);
 
 	createVboBindShader(pos, vel);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 
 	//create the OpenCL only arrays
 	try
 	{
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-		cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp2_cells, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 }
 
-void BoidModelSH_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel){
+void BoidModelSH_2D::createVboBindShader(std::vector<float2> pos, std::vector<float2> vel){
 	std::vector<Vec4> newDataColor(num);
 
 	for (int i = 0; i < num; i++){
@@ -458,13 +471,17 @@ void BoidModelSH_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4
 	}
 
 	GLuint id[1];
-	size_t array_size = num * sizeof(Vec4);
+	size_t array_size = num * sizeof(float2);
 
 	//create shader
-	shader = new Shader("boidTri.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
-	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
+	shader = new Shader("boidTri2D.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
+	GLint vertLoc = glGetAttribLocation(shader->id(), "coord2d");
 	GLint colorLoc = glGetAttribLocation(shader->id(), "color");
-	GLint velLoc = glGetAttribLocation(shader->id(), "vel3d");
+	GLint velLoc = glGetAttribLocation(shader->id(), "vel2d");
+
+	shader->bind();
+	glUniform1f(glGetUniformLocation(shader->id(), "y_plane"), Y_AxisFixed);
+	shader->unbind();
 
 	//------VBO 1--------- (in)
 	glGenVertexArrays(1, &pos_vao[0]); // Create our Vertex Array Object  
@@ -475,12 +492,12 @@ void BoidModelSH_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4
 	//std::vector<Vec4> test(num);
 	//glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vec4)* num, test.data());
 
-	glVertexAttribPointer(vertLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
+	glVertexAttribPointer(vertLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
 	glEnableVertexAttribArray(vertLoc);
 
 	vel_vbo[0] = clHelper->createVBO(&vel[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
+	glVertexAttribPointer(velLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
 	glGenBuffers(1, &id[0]);
@@ -502,12 +519,12 @@ void BoidModelSH_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4
 	//std::vector<Vec4> test(num);
 	//glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vec4)* num, test.data());
 
-	glVertexAttribPointer(vertLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
+	glVertexAttribPointer(vertLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer
 	glEnableVertexAttribArray(vertLoc);
 
 	vel_vbo_out[0] = clHelper->createVBO(&vel[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
+	glVertexAttribPointer(velLoc, 2, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
 	glGenBuffers(1, &id[0]);
@@ -523,6 +540,10 @@ void BoidModelSH_2D::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4
 	log("GL VBO Buffer created");
 }
 
+void BoidModelSH_2D::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
 void BoidModelSH_2D::loadData(){
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
 	queue.finish();
@@ -554,7 +575,7 @@ void BoidModelSH_2D::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -575,6 +596,7 @@ void BoidModelSH_2D::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -593,6 +615,7 @@ void BoidModelSH_2D::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -622,6 +645,7 @@ void BoidModelSH_2D::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -648,13 +672,16 @@ void BoidModelSH_2D::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSH_2D::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -688,12 +715,12 @@ std::vector<const char*> BoidModelSH_2D::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -721,36 +748,8 @@ std::vector<const char*> BoidModelSH_2D::getSimTimeDescriptions(){
 }
 
 
-void BoidModelSH_2D::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
-
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
-
-
-
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*vel).set(v.x, v.y - 10.f, v.z, 0.0);
-
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*pos).set(p.x, p.y, p.z, 0.0);
+bool BoidModelSH_2D::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
 }
 
 
@@ -22,8 +22,10 @@ BoidModelSimple::BoidModelSimple(CLHelper* clHlpr, std::vector<Vec4> pos, std::v
 	loadData();
 
 	loadProgram(kernel_path + "boidModelSimple_kernel_v2.cl");
+	watchProgram(&program, kernel_path + "boidModelSimple_kernel_v2.cl");
 
 	loadKernel();
+	tracker = new AgentTracker(clHelper, num);
 	log("setup complete - simulation is runable");
 }
 
@@ -150,14 +152,14 @@ void BoidModelSimple::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel)
 	// create OpenCL buffer from GL VBO
 	try
 	{
-		cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-		cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_out_vbo[0], &err));
+		cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+		cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_out_vbo[0], &err));
 
 		//create the OpenCL only arrays
-		cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-		cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_out_vbo[0], &err));
+		cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+		cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_out_vbo[0], &err));
 
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -223,6 +225,10 @@ void BoidModelSimple::loadKernel(){
 }
 
 
+void BoidModelSimple::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
 void BoidModelSimple::loadData(){
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
 	queue.finish();
@@ -276,6 +282,8 @@ void BoidModelSimple::simulate(float dt){
 	queue.finish();
 
 
+	tracker->gather(helper % 2 == 0 ? cl_pos_vbos_out[0] : cl_pos_vbos[0], helper % 2 == 0 ? cl_vel_vbos_out[0] : cl_vel_vbos[0]);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
@@ -322,21 +330,3 @@ std::vector<const char*> BoidModelSimple::getSimTimeDescriptions(){
 	simTimeDisc[4] = stringSimTime.c_str();
 	return simTimeDisc;
 }
-
-void BoidModelSimple::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*vel).set(v.x, v.y, v.z, 0.0);
-
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	(*pos).set(p.x, p.y, p.z, 0.0);
-}
@@ -8,6 +8,7 @@
 CLHelper::CLHelper(LogFile* logF){
 	deviceUsed = 0;
 	logFile = logF;
+	deviceMemory = Metrics::getInstance().gauge("boids_device_memory_bytes", "Bytes of the OpenCL buffers alive, including the ones shared with OpenGL");
 	log("Starting to create context");
 
 	/*get Available platforms and log information*/
@@ -48,6 +49,26 @@ CLHelper::CLHelper(LogFile* logF){
 	}
 }
 
+bool CLHelper::sharesWithCurrentGL(){
+	cl_context_properties cprops[] =
+	{
+		CL_GL_CONTEXT_KHR, (cl_context_properties)wglGetCurrentContext(),
+		CL_WGL_HDC_KHR, (cl_context_properties)wglGetCurrentDC(),
+		CL_CONTEXT_PLATFORM, (cl_context_properties)(platformList[0])(),
+		0
+	};
+
+	//extension function, only reachable through the platform
+	clGetGLContextInfoKHR_fn getGLContextInfo = (clGetGLContextInfoKHR_fn)clGetExtensionFunctionAddressForPlatform(platformList[0](), "clGetGLContextInfoKHR");
+	if (getGLContextInfo == NULL)
+		return false;
+
+	cl_device_id device = NULL;
+	if (getGLContextInfo(cprops, CL_CURRENT_DEVICE_FOR_GL_CONTEXT_KHR, sizeof(cl_device_id), &device, NULL) != CL_SUCCESS)
+		return false;
+	return device == devices[deviceUsed]();
+}
+
 cl::Context CLHelper::getContext(){
 	return context;
 }
@@ -61,6 +82,31 @@ std::vector<cl::Device> CLHelper::getDevices(){
 }
 
 
+cl::Buffer CLHelper::createBuffer(cl_mem_flags flags, size_t size, void* host, cl_int* err){
+	cl::Buffer buffer(context, flags, size, host, err);
+	trackMemory(buffer);
+	return buffer;
+}
+
+cl::BufferGL CLHelper::createBufferGL(cl_mem_flags flags, GLuint vbo, cl_int* err){
+	cl::BufferGL buffer(context, flags, vbo, err);
+	trackMemory(buffer);
+	return buffer;
+}
+
+void CLHelper::trackMemory(cl::Memory &memory){
+	//the callback gets the gauge and the size, the helper may be gone when a buffer is released
+	std::pair<Metrics::Gauge*, size_t>* tracked = new std::pair<Metrics::Gauge*, size_t>(deviceMemory, memory.getInfo<CL_MEM_SIZE>());
+	deviceMemory->add((long long)tracked->second);
+	memory.setDestructorCallback(&CLHelper::memoryReleased, tracked);
+}
+
+void CL_CALLBACK CLHelper::memoryReleased(cl_mem memory, void* userData){
+	std::pair<Metrics::Gauge*, size_t>* tracked = (std::pair<Metrics::Gauge*, size_t>*)userData;
+	tracked->first->add(-(long long)tracked->second);
+	delete tracked;
+}
+
 GLuint CLHelper::createVBO(const void* data, size_t dataSize, GLenum target, GLenum usage)
 {
 	GLuint id = 0; // 0 is reserved, glGenBuffersARB() will return non-zero id if success
@@ -217,4 +263,40 @@ std::string CLHelper::oclErrorString(cl_int error) const{
 	const int index = -error;
 
 	return std::string((index >= 0 && index < errorCount) ? errorString[index] : "");
+}
+
+std::string CLHelper::getSHBasisSource(unsigned int order){
+	std::string source;
+	std::string filename = kernel_path + "sh_basis.cl";
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		source.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&source[0], source.size());
+		in.close();
+	}
+	else
+	{
+		log("could not open " + filename);
+		throw(errno);
+	}
+
+	std::stringstream strstream;
+	strstream << "#define SH_ORDER " << order << "\n";
+
+	return strstream.str() + source + "\n";
+}
+
+size_t CLHelper::getSHVecSize(unsigned int order){
+	switch (order){
+	case 1:
+		return sizeof(cl_float);
+	case 2:
+		return sizeof(cl_float4);
+	default:
+		return sizeof(cl_float8);
+	}
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 #include "stdafx.h"
 #include "logFile.h"
+#include "metrics.h"
 
 /*
 	OpenCL helper class for context, queue and query for a device.
@@ -30,15 +31,43 @@ public:
 	*/
 	GLuint createVBO(const void* data, size_t dataSize, GLenum target, GLenum usage);
 
+	/*
+		Buffers on the context of the helper. Their size counts towards the device memory
+		gauge of the metrics until OpenCL releases them.
+	*/
+	cl::Buffer createBuffer(cl_mem_flags flags, size_t size, void* host = NULL, cl_int* err = NULL);
+	cl::BufferGL createBufferGL(cl_mem_flags flags, GLuint vbo, cl_int* err = NULL);
+
+	/*
+		True if the GL context current on the calling thread is served by the device of the CL context.
+		The CL context is created with the window context; GL objects acquired while another context
+		of the same share group is current are only safe if that context runs on the same device.
+	*/
+	bool sharesWithCurrentGL();
+
 	std::string getPlatformInformation();
 	std::string getDeviceInformation();
 	std::string oclErrorString(cl_int error) const;
 
+	/*
+		Source of the SH basis (kernels/sh_basis.cl) for band order L = 1..3.
+		Has to be put in front of kernel sources which use SHEval / SHDot.
+	*/
+	std::string getSHBasisSource(unsigned int order);
+	//size of one cell entry of the non constant SH coefficients for band order L
+	static size_t getSHVecSize(unsigned int order);
+
+	//entries starting with ERROR are logged with the error level
 	inline void log(std::string entry){
-		logFile->writeLog(entry);
+		LogFile::level_t level = entry.compare(0, 5, "ERROR") == 0 ? LogFile::LOG_ERROR : LogFile::LOG_INFO;
+		logFile->writeLog(std::move(entry), level);
 	}
 
 private:
+	// add the size of memory to the gauge and take it off again when it is released
+	void trackMemory(cl::Memory &memory);
+	static void CL_CALLBACK memoryReleased(cl_mem memory, void* userData);
+
 	cl::Context context;
 	cl::CommandQueue queue;
 	cl::Program program;
@@ -50,6 +79,7 @@ private:
 	cl_int err;
 
 	LogFile* logFile;
+	Metrics::Gauge* deviceMemory;
 };
 
 #endif
\ No newline at end of file
@@ -57,6 +57,7 @@ Column::Column(bool visible, float cellSizeX, float cellSizeY, float cellSizeZ,
 
 	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
 	GLint colorLoc = glGetUniformLocation(shader->id(), "color");
+	translationLoc = glGetUniformLocation(shader->id(), "translation");
 
 	glGenVertexArrays(1, &columnAttributeObject[0]); // Create our Vertex Array Object  
 	glBindVertexArray(columnAttributeObject[0]); // Bind our Vertex Array Object so we can use it  
@@ -71,14 +72,24 @@ Column::Column(bool visible, float cellSizeX, float cellSizeY, float cellSizeZ,
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
 
+	translation = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+
 	shader->bind();
 	glUniform4fv(colorLoc, 1, colorColumn);
+	glUniform4f(translationLoc, 0.0f, 0.0f, 0.0f, 0.0f);
 	shader->unbind();
 }
 
 void Column::render(){
 	if (visibility){
+		Vec4 t;
+		{
+			std::lock_guard<std::mutex> lock(translationMutex);
+			t = translation;
+		}
+
 		shader->bind();
+		glUniform4f(translationLoc, t.x, t.y, t.z, 0.0f);
 		glBindVertexArray(columnAttributeObject[0]);
 		glDrawArrays(GL_QUADS, 0, vertexNum);
 		glBindVertexArray(0);
@@ -106,6 +117,12 @@ void Column::setVisibility(bool visible){
 	visibility = visible;
 }
 
+void Column::setTranslation(float x, float y, float z){
+	//no GL here, the simulation thread moves the column from a context of its own
+	std::lock_guard<std::mutex> lock(translationMutex);
+	translation = Vec4(x, y, z, 0.0f);
+}
+
 /*
 void Column::getObstacleForce(std::vector<Vec4>* cor, std::vector<unsigned int>* start, std::vector<unsigned int>* end, std::vector<Vec4>* posObstacle){
 	float x = 8.f;
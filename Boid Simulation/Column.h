@@ -40,6 +40,12 @@ private:
 	unsigned int h;
 	float lHeight;
 
+	// location of the translation uniform
+	GLint translationLoc;
+	// translation set by the simulation thread, the uniform is written by render in the window context
+	std::mutex translationMutex;
+	Vec4 translation;
+
 public:
 	// create world box with cell size * grid size on each axis. A line is drawn at every position where pos = factor * gridSize * cellSize per axis.
 	Column(bool visible, float cellSizeX, float cellSizeY, float cellSizeZ, int posX, int posY, int posZ, int hH);
@@ -50,6 +56,8 @@ public:
 	void unbindShader();
 	// make the cube visible/invisible
 	void setVisibility(bool visibile);
+	// move the column by x, y, z relative to its initial placement, drawn so from the next render on
+	void setTranslation(float x, float y, float z);
 	void getObstacleForce(std::vector<Vec4>* cor, std::vector<unsigned int>* start, std::vector<unsigned int>* end, std::vector<Vec4>* posObstacle, unsigned int offset);
 };
 
@@ -0,0 +1,230 @@
+#include "stdafx.h"
+#include "flowField.h"
+
+//wavefront steps enqueued between two checks whether the fields still change
+#define FLOW_FIELD_SWEEPS 8
+
+FlowField::FlowField(CLHelper* clHlpr, uint3 gSize, float3 cSize, float3 wOrigin, std::vector<Vec4> goals){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	queue = clHelper->getCmdQueue();
+	devices = clHelper->getDevices();
+
+	gridSize.s[0] = gSize.x;
+	gridSize.s[1] = gSize.y;
+	gridSize.s[2] = gSize.z;
+	gridSize.s[3] = 0;
+	cellSize = cSize;
+	worldOrigin = wOrigin;
+	numCells = gSize.x * gSize.y * gSize.z;
+	numGoals = 0;
+	goalCapacity = 0;
+	timeBuild = 0;
+	iterations = 0;
+
+	try
+	{
+		cl_blocked = clHelper->createBuffer(CL_MEM_READ_ONLY, numCells * sizeof(unsigned char), NULL, &err);
+		cl_changed = clHelper->createBuffer(CL_MEM_READ_WRITE, sizeof(unsigned int), NULL, &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	setGoals(goals);
+}
+
+FlowField::~FlowField(){
+
+}
+
+void FlowField::setGoals(const std::vector<Vec4> &goals){
+	numGoals = (unsigned int)goals.size();
+
+	//cell of every goal, clamped into the grid
+	std::vector<unsigned int> goalCell(numGoals > 0 ? numGoals : 1, 0);
+	for (unsigned int i = 0; i < numGoals; i++){
+		int x = (int)floor((goals[i].x - worldOrigin.x) / cellSize.x);
+		int y = (int)floor((goals[i].y - worldOrigin.y) / cellSize.y);
+		int z = (int)floor((goals[i].z - worldOrigin.z) / cellSize.z);
+		x = x < 0 ? 0 : (x >= (int)gridSize.s[0] ? gridSize.s[0] - 1 : x);
+		y = y < 0 ? 0 : (y >= (int)gridSize.s[1] ? gridSize.s[1] - 1 : y);
+		z = z < 0 ? 0 : (z >= (int)gridSize.s[2] ? gridSize.s[2] - 1 : z);
+		goalCell[i] = x + gridSize.s[0] * z + gridSize.s[0] * gridSize.s[2] * y;
+	}
+
+	//the buffers only grow, fewer goals use the front of them
+	unsigned int capacity = numGoals > 0 ? numGoals : 1;
+	if (capacity > goalCapacity){
+		goalCapacity = capacity;
+		try
+		{
+			cl_goalCell = clHelper->createBuffer(CL_MEM_READ_ONLY, goalCapacity * sizeof(unsigned int), NULL, &err);
+			cl_dist = clHelper->createBuffer(CL_MEM_READ_WRITE, (size_t)goalCapacity * numCells * sizeof(unsigned int), NULL, &err);
+			cl_flowDir = clHelper->createBuffer(CL_MEM_READ_WRITE, (size_t)goalCapacity * numCells * sizeof(Vec4), NULL, &err);
+		}
+		catch (cl::Error er) {
+			clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		}
+	}
+
+	err = queue.enqueueWriteBuffer(cl_goalCell, CL_TRUE, 0, goalCell.size() * sizeof(unsigned int), &goalCell[0]);
+
+	//without goals the agents use the straight path, the first entry must not steer
+	if (numGoals == 0){
+		Vec4 zero(0.0f, 0.0f, 0.0f, 0.0f);
+		err = queue.enqueueWriteBuffer(cl_flowDir, CL_TRUE, 0, sizeof(Vec4), &zero);
+		return;
+	}
+
+	//the program is built once with the first goals and kept for all later ones
+	if (program() != NULL)
+		return;
+
+	loadProgram(kernel_path + "flowField_kernel.cl");
+
+	try
+	{
+		kernel_initFlowField = cl::Kernel(program, "initFlowField", &err);
+		kernel_relaxFlowField = cl::Kernel(program, "relaxFlowField", &err);
+		kernel_flowDirection = cl::Kernel(program, "flowDirection", &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+void FlowField::build(const std::vector<unsigned char> &blocked){
+	if (numGoals == 0)
+		return;
+
+	unsigned long long timeNow = GetTickCount64();
+	unsigned int globalWorkSize = numGoals * numCells;
+	unsigned int changed = 1;
+
+	err = queue.enqueueWriteBuffer(cl_blocked, CL_TRUE, 0, numCells * sizeof(unsigned char), &blocked[0]);
+
+	try
+	{
+		err = kernel_initFlowField.setArg(0, cl_goalCell);
+		err = kernel_initFlowField.setArg(1, cl_blocked);
+		err = kernel_initFlowField.setArg(2, cl_dist);
+		err = kernel_initFlowField.setArg(3, gridSize);
+
+		err = kernel_relaxFlowField.setArg(0, cl_blocked);
+		err = kernel_relaxFlowField.setArg(1, cl_dist);
+		err = kernel_relaxFlowField.setArg(2, gridSize);
+		err = kernel_relaxFlowField.setArg(3, cl_changed);
+
+		err = kernel_flowDirection.setArg(0, cl_blocked);
+		err = kernel_flowDirection.setArg(1, cl_dist);
+		err = kernel_flowDirection.setArg(2, gridSize);
+		err = kernel_flowDirection.setArg(3, cl_flowDir);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_initFlowField, cl::NullRange, cl::NDRange(globalWorkSize), cl::NullRange);
+
+	//a wavefront moves one cell per step, numCells steps reach every cell in the worst case
+	for (iterations = 0; changed && iterations < numCells; iterations += FLOW_FIELD_SWEEPS){
+		changed = 0;
+		err = queue.enqueueWriteBuffer(cl_changed, CL_FALSE, 0, sizeof(unsigned int), &changed);
+
+		for (unsigned int i = 0; i < FLOW_FIELD_SWEEPS; i++)
+			err = queue.enqueueNDRangeKernel(kernel_relaxFlowField, cl::NullRange, cl::NDRange(globalWorkSize), cl::NullRange);
+
+		err = queue.enqueueReadBuffer(cl_changed, CL_TRUE, 0, sizeof(unsigned int), &changed);
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_flowDirection, cl::NullRange, cl::NDRange(globalWorkSize), cl::NullRange);
+	queue.finish();
+
+	timeBuild = (long)(GetTickCount64() - timeNow);
+}
+
+cl::Buffer FlowField::getFlowDir(){
+	return cl_flowDir;
+}
+
+unsigned int FlowField::getNumGoals(){
+	return numGoals;
+}
+
+long FlowField::getBuildTime(){
+	return timeBuild;
+}
+
+unsigned int FlowField::getIterations(){
+	return iterations;
+}
+
+std::vector<Vec4> FlowField::assignGoalIds(std::vector<Vec4>* goal, unsigned int maxGoals){
+	std::vector<Vec4> goals;
+
+	for (size_t i = 0; i < goal->size(); i++){
+		Vec4* g = &(*goal)[i];
+		size_t id = 0;
+		while (id < goals.size() && (goals[id].x != g->x || goals[id].y != g->y || goals[id].z != g->z))
+			id++;
+
+		if (id == goals.size()){
+			//every agent has its own goal, flow fields would cost more than they save
+			if (goals.size() == maxGoals){
+				goals.clear();
+				break;
+			}
+			goals.push_back(Vec4(g->x, g->y, g->z, 0.0f));
+		}
+		g->w = (float)id;
+	}
+
+	if (goals.empty()){
+		for (size_t i = 0; i < goal->size(); i++)
+			(*goal)[i].w = -1.0f;
+	}
+
+	return goals;
+}
+
+void FlowField::loadProgram(const std::string &filename){
+	std::string kernelSource;
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + filename);
+		throw(errno);
+	}
+
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		program = cl::Program(context, source);
+	}
+	catch (cl::Error er)
+	{
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	try
+	{
+		err = program.build(devices);
+	}
+	catch (cl::Error er) {
+		clHelper->log("program build: " + clHelper->oclErrorString(er.err()));
+		clHelper->log("\n----------------------buildLog start--------------------\n");
+		std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+		clHelper->log(buildLog);
+		clHelper->log("\n----------------------buildLog end--------------------\n");
+	}
+}
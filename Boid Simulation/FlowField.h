@@ -0,0 +1,78 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _FLOWFIELD_H_
+#define _FLOWFIELD_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "tracer.h"
+#include "vector_types.h"
+#include "vectorTypes.h"
+
+/*
+	Navigation flow fields for goal seeking, one per distinct goal. Every cell of the grid
+	holds the direction along the shortest path around blocked cells to the goal, built on
+	the device by wavefront relaxation (kernels/flowField_kernel.cl). Agents carry the id
+	of their goal in goal.w and look up their direction by goal id and cell.
+*/
+class FlowField
+{
+public:
+	FlowField(CLHelper* clHlpr, uint3 gridSize, float3 cellSize, float3 worldOrigin, std::vector<Vec4> goals);
+	~FlowField();
+
+	// new distinct goals, the fields are solved with the next build. Program and buffers are
+	// kept, the buffers grow if there are more goals than before
+	void setGoals(const std::vector<Vec4> &goals);
+	// build all fields again, blocked has one entry per cell (1 = obstacle)
+	void build(const std::vector<unsigned char> &blocked);
+
+	// direction per goal and cell (numGoals * numCells float4), one zero entry without goals
+	cl::Buffer getFlowDir();
+	unsigned int getNumGoals();
+	// time of the last build in ms
+	long getBuildTime();
+	// wavefront steps of the last build
+	unsigned int getIterations();
+
+	// write the goal id into w of every goal and return the distinct goals. If there are more
+	// than maxGoals no flow fields are used, all ids are -1 (straight path to the goal)
+	static std::vector<Vec4> assignGoalIds(std::vector<Vec4>* goal, unsigned int maxGoals);
+
+private:
+	void loadProgram(const std::string &filename);
+
+	CLHelper* clHelper;
+	cl::Context context;
+	TracedQueue queue;
+	std::vector<cl::Device> devices;
+	cl::Program program;
+	cl_int err;
+
+	cl::Kernel kernel_initFlowField;
+	cl::Kernel kernel_relaxFlowField;
+	cl::Kernel kernel_flowDirection;
+
+	cl::Buffer cl_goalCell;
+	cl::Buffer cl_blocked;
+	cl::Buffer cl_dist;
+	cl::Buffer cl_changed;
+	cl::Buffer cl_flowDir;
+
+	cl_uint4 gridSize;
+	float3 cellSize;
+	float3 worldOrigin;
+	unsigned int numCells;
+	unsigned int numGoals;
+	// goals the buffers have room for
+	unsigned int goalCapacity;
+	long timeBuild;
+	unsigned int iterations;
+};
+
+#endif
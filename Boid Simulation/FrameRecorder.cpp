@@ -0,0 +1,290 @@
+#include "stdafx.h"
+#include "frameRecorder.h"
+
+//largest block of uncompressed deflate data
+#define PNG_STORED_BLOCK 65535
+
+static unsigned int crcTable[256];
+
+static void createCrcTable(){
+	for (unsigned int n = 0; n < 256; n++){
+		unsigned int v = n;
+		for (int k = 0; k < 8; k++)
+			v = (v & 1) ? 0xedb88320u ^ (v >> 1) : v >> 1;
+		crcTable[n] = v;
+	}
+}
+
+static unsigned int crc(const unsigned char* data, size_t length, unsigned int c){
+	for (size_t i = 0; i < length; i++)
+		c = crcTable[(c ^ data[i]) & 0xff] ^ (c >> 8);
+	return c;
+}
+
+static void putBigEndian(std::vector<unsigned char> &out, unsigned int v){
+	out.push_back((v >> 24) & 0xff);
+	out.push_back((v >> 16) & 0xff);
+	out.push_back((v >> 8) & 0xff);
+	out.push_back(v & 0xff);
+}
+
+static void writeChunk(std::ofstream &file, const char* type, const std::vector<unsigned char> &data){
+	std::vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc(&chunk[4], chunk.size() - 4, 0xffffffffu) ^ 0xffffffffu);
+	file.write((const char*)&chunk[0], chunk.size());
+}
+
+FrameRecorder::FrameRecorder(const options_t &opts){
+	options = opts;
+	framesCaptured = 0;
+	framesRetrieved = 0;
+	framesSkipped = 0;
+	framesWritten = 0;
+	stopping = false;
+	//filled before the writer threads use it
+	createCrcTable();
+
+	CreateDirectory(options.dir.c_str(), NULL);
+
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, options.width, options.height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	ready = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!ready)
+		fprintf(stderr, "Error: offscreen framebuffer of %dx%d is not complete\n", options.width, options.height);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(RECORD_PBO_COUNT, pbo);
+	for (int i = 0; i < RECORD_PBO_COUNT; i++){
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, options.width * options.height * 4, NULL, GL_STREAM_READ);
+		pboFence[i] = NULL;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	for (int i = 0; i < RECORD_WRITER_THREADS; i++)
+		writers.push_back(std::thread(&FrameRecorder::writerLoop, this));
+}
+
+FrameRecorder::~FrameRecorder(){
+	while (framesRetrieved < framesCaptured){
+		if (!retrieve(true)){
+			fprintf(stderr, "Error: read back of the last %u recorded frames did not finish, they are lost\n", framesCaptured - framesRetrieved);
+			break;
+		}
+	}
+	if (framesSkipped > 0)
+		fprintf(stderr, "%u of %u frames were skipped\n", framesSkipped, framesCaptured + framesSkipped);
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+	for (size_t i = 0; i < writers.size(); i++)
+		writers[i].join();
+
+	glDeleteBuffers(RECORD_PBO_COUNT, pbo);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+}
+
+void FrameRecorder::bind(){
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void FrameRecorder::capture(){
+	int slot = framesCaptured % RECORD_PBO_COUNT;
+
+	//the ring is full, the oldest frame has to leave it first. If it does not, its PBO is still
+	//being written and its fence still pending, neither may be reused and this frame is skipped
+	if (framesCaptured - framesRetrieved == RECORD_PBO_COUNT && !retrieve(true)){
+		framesSkipped++;
+		fprintf(stderr, "Error: read back of recorded frame %u timed out, skipping a frame\n", framesRetrieved);
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+	//with a PBO bound glReadPixels only enqueues the copy
+	glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	pboFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	framesCaptured++;
+
+	//all frames the GPU is done with go to the writers
+	while (framesRetrieved < framesCaptured && retrieve(false));
+}
+
+void FrameRecorder::present(int windowWidth, int windowHeight){
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (options.headless)
+		return;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBlitFramebuffer(0, 0, options.width, options.height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+bool FrameRecorder::isDone(){
+	return options.frames > 0 && framesCaptured >= options.frames;
+}
+
+bool FrameRecorder::isReady(){
+	return ready;
+}
+
+unsigned int FrameRecorder::getFramesCaptured(){
+	return framesCaptured;
+}
+
+unsigned int FrameRecorder::getFramesWritten(){
+	return framesWritten;
+}
+
+unsigned int FrameRecorder::getFramesSkipped(){
+	return framesSkipped;
+}
+
+bool FrameRecorder::retrieve(bool wait){
+	int slot = framesRetrieved % RECORD_PBO_COUNT;
+	GLenum state = glClientWaitSync(pboFence[slot], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+	if (state == GL_TIMEOUT_EXPIRED || state == GL_WAIT_FAILED)
+		return false;
+
+	glDeleteSync(pboFence[slot]);
+	pboFence[slot] = NULL;
+
+	job_t job;
+	job.frame = framesRetrieved;
+	job.pixels.resize(options.width * options.height * 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+	if (mapped != NULL){
+		memcpy(&job.pixels[0], mapped, job.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	framesRetrieved++;
+
+	//the writers are behind, waiting here keeps the memory of the queue bounded
+	std::unique_lock<std::mutex> lock(jobMutex);
+	jobTaken.wait(lock, [this]{ return jobs.size() < RECORD_MAX_QUEUE; });
+	jobs.push_back(std::move(job));
+	lock.unlock();
+	jobAdded.notify_one();
+
+	return true;
+}
+
+void FrameRecorder::writerLoop(){
+	while (true){
+		job_t job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobAdded.wait(lock, [this]{ return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		jobTaken.notify_one();
+
+		//GL rows start at the bottom, the images start at the top. The alpha channel is dropped
+		std::vector<unsigned char> rgb(options.width * options.height * 3);
+		for (int y = 0; y < options.height; y++){
+			const unsigned char* src = &job.pixels[(options.height - 1 - y) * options.width * 4];
+			unsigned char* dst = &rgb[y * options.width * 3];
+			for (int x = 0; x < options.width; x++){
+				dst[3 * x] = src[4 * x];
+				dst[3 * x + 1] = src[4 * x + 1];
+				dst[3 * x + 2] = src[4 * x + 2];
+			}
+		}
+
+		char name[32];
+		sprintf_s(name, sizeof(name), "\\frame_%06u.%s", job.frame, options.png ? "png" : "ppm");
+		if (options.png)
+			writePNG(options.dir + name, rgb);
+		else
+			writePPM(options.dir + name, rgb);
+
+		framesWritten++;
+	}
+}
+
+void FrameRecorder::writePNG(const std::string &fileName, const std::vector<unsigned char> &rgb){
+	std::ofstream file(fileName, std::ios::out | std::ios::binary);
+	const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	file.write((const char*)signature, 8);
+
+	std::vector<unsigned char> header;
+	putBigEndian(header, options.width);
+	putBigEndian(header, options.height);
+	//8 bit RGB, deflate, no interlacing
+	const unsigned char format[5] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), format, format + 5);
+	writeChunk(file, "IHDR", header);
+
+	//every row starts with filter type 0
+	size_t rowSize = options.width * 3;
+	std::vector<unsigned char> raw;
+	raw.reserve((rowSize + 1) * options.height);
+	for (int y = 0; y < options.height; y++){
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb.begin() + y * rowSize, rgb.begin() + (y + 1) * rowSize);
+	}
+
+	//zlib stream of stored (uncompressed) blocks, the writers spend their time on I/O instead of compression
+	std::vector<unsigned char> data;
+	data.reserve(raw.size() + raw.size() / PNG_STORED_BLOCK * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	unsigned int a = 1, b = 0;
+	for (size_t offset = 0; offset < raw.size(); offset += PNG_STORED_BLOCK){
+		size_t length = raw.size() - offset;
+		if (length > PNG_STORED_BLOCK)
+			length = PNG_STORED_BLOCK;
+
+		data.push_back(offset + length == raw.size() ? 1 : 0);
+		data.push_back(length & 0xff);
+		data.push_back((length >> 8) & 0xff);
+		data.push_back(~length & 0xff);
+		data.push_back((~length >> 8) & 0xff);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+
+		for (size_t i = offset; i < offset + length; i++){
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	putBigEndian(data, (b << 16) | a);
+	writeChunk(file, "IDAT", data);
+
+	writeChunk(file, "IEND", std::vector<unsigned char>());
+}
+
+void FrameRecorder::writePPM(const std::string &fileName, const std::vector<unsigned char> &rgb){
+	std::ofstream file(fileName, std::ios::out | std::ios::binary);
+	file << "P6\n" << options.width << " " << options.height << "\n255\n";
+	file.write((const char*)&rgb[0], rgb.size());
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _FRAMERECORDER_H_
+#define _FRAMERECORDER_H_
+
+#include "stdafx.h"
+#include "simParam.h"
+
+/*
+	Records the rendered frames into an image sequence. The frames are drawn into an offscreen
+	framebuffer of any size and read back through a ring of pixel buffer objects, a frame is
+	mapped RECORD_PBO_COUNT frames after glReadPixels so the render loop does not wait for the
+	GPU. Writer threads flip and encode the frames (PNG or binary PPM) and write them to disk.
+
+	Recording runs where the simulation runs: Win32 with an OpenGL 3.2 driver whose context the
+	CL device shares. The window of GLUT always provides that wgl context, headless only hides
+	it, there is no EGL or OSMesa context. A software GL driver has no CL device to share with,
+	so the program refuses to record there (GFX::initOpenGL, Simulation::start) instead of
+	writing empty frames.
+*/
+class FrameRecorder
+{
+public:
+	typedef struct{
+		// directory of the image sequence, created if it does not exist
+		std::string dir;
+		int width;
+		int height;
+		// frames to record before the program quits, 0 = until the window is closed
+		unsigned int frames;
+		// PNG if true, binary PPM otherwise
+		bool png;
+		// hide the window, the frames are only written to disk. The window still provides the context
+		bool headless;
+	} options_t;
+
+	FrameRecorder(const options_t &options);
+	// writes the frames still in flight and waits for the writer threads
+	~FrameRecorder();
+
+	// draw the next frame into the offscreen framebuffer
+	void bind();
+	// start the read back of the frame drawn since bind, hand finished read backs to the writers.
+	// The frame is skipped if the ring is full and its oldest read back does not finish in time
+	void capture();
+	// show the frame scaled into the window, nothing in headless mode
+	void present(int windowWidth, int windowHeight);
+	// all frames are recorded
+	bool isDone();
+	// the offscreen framebuffer of the requested size is complete
+	bool isReady();
+
+	unsigned int getFramesCaptured();
+	unsigned int getFramesWritten();
+	unsigned int getFramesSkipped();
+
+private:
+	typedef struct{
+		unsigned int frame;
+		std::vector<unsigned char> pixels;
+	} job_t;
+
+	// map the PBO of the oldest frame in flight and queue it, wait for the GPU if wait is set
+	bool retrieve(bool wait);
+	void writerLoop();
+	void writePNG(const std::string &fileName, const std::vector<unsigned char> &rgb);
+	void writePPM(const std::string &fileName, const std::vector<unsigned char> &rgb);
+
+	options_t options;
+
+	GLuint fbo;
+	bool ready;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+
+	GLuint pbo[RECORD_PBO_COUNT];
+	GLsync pboFence[RECORD_PBO_COUNT];
+	// frames read into the PBOs and frames mapped and queued
+	unsigned int framesCaptured;
+	unsigned int framesRetrieved;
+	// frames drawn but not recorded because no PBO was free
+	unsigned int framesSkipped;
+
+	std::vector<std::thread> writers;
+	std::deque<job_t> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobAdded;
+	std::condition_variable jobTaken;
+	bool stopping;
+	std::atomic<unsigned int> framesWritten;
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "stdafx.h"
+#include "liveTuning.h"
+
+//tunable field of the simulation parameters by its name, NULL for other names
+static float* tunable(simParams_t* params, const std::string &name){
+	if (name == "wSeparation")
+		return &params->wSeparation;
+	if (name == "wAlignment")
+		return &params->wAlignment;
+	if (name == "wCohesion")
+		return &params->wCohesion;
+	if (name == "wOwn")
+		return &params->wOwn;
+	if (name == "wPath")
+		return &params->wPath;
+	if (name == "maxVel")
+		return &params->maxVel;
+	if (name == "maxVelCor")
+		return &params->maxVelCor;
+	return NULL;
+}
+
+LiveTuning::LiveTuning(CLHelper* clHlpr){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	devices = clHelper->getDevices();
+
+	generation = 0;
+	paramsTime = 0;
+	pending = false;
+	running = false;
+
+	Metrics &metrics = Metrics::getInstance();
+	reloads = metrics.counter("boids_kernel_reloads_total", "Programs rebuilt from a changed source and swapped in", "result=\"ok\"");
+	failedReloads = metrics.counter("boids_kernel_reloads_total", "Programs rebuilt from a changed source and swapped in", "result=\"failed\"");
+}
+
+LiveTuning::~LiveTuning(){
+	stop();
+}
+
+void LiveTuning::start(){
+	if (running)
+		return;
+
+	running = true;
+	watcher = std::thread(&LiveTuning::watchLoop, this);
+	clHelper->log("live tuning of the kernel sources and " + std::string(LIVE_PARAMS_FILE));
+}
+
+void LiveTuning::stop(){
+	if (!running)
+		return;
+
+	running = false;
+	watcher.join();
+}
+
+void LiveTuning::watch(const std::vector<program_t> &watched){
+	std::lock_guard<std::mutex> lock(mutex);
+	programs = watched;
+	programTimes.resize(programs.size());
+	for (size_t i = 0; i < programs.size(); i++)
+		programTimes[i] = modified(programs[i].file);
+
+	//builds of the old model do not fit the kernels of the new one
+	generation++;
+	builds.clear();
+}
+
+void LiveTuning::apply(BoidModel* model, simParams_t* simParams){
+	if (!pending.load(std::memory_order_relaxed) || !pending.exchange(false))
+		return;
+
+	std::vector<build_t> built;
+	std::vector<std::pair<std::string, float> > changed;
+	unsigned int current;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		built.swap(builds);
+		changed.swap(params);
+		current = generation;
+	}
+
+	for (size_t i = 0; i < built.size(); i++){
+		if (built[i].generation != current)
+			continue;
+		model->reloadProgram(built[i].index, built[i].program);
+		reloads->add();
+	}
+
+	if (changed.empty())
+		return;
+
+	std::ostringstream entry;
+	entry << "live params:";
+	for (size_t i = 0; i < changed.size(); i++){
+		*tunable(simParams, changed[i].first) = changed[i].second;
+		entry << " " << changed[i].first << "=" << changed[i].second;
+	}
+	model->tuneSimParams(*simParams);
+	clHelper->log(entry.str());
+}
+
+void LiveTuning::watchLoop(){
+	std::string shBasisFile = kernel_path + "sh_basis.cl";
+	unsigned long long shBasisTime = modified(shBasisFile);
+
+	while (running){
+		std::this_thread::sleep_for(std::chrono::milliseconds(LIVE_TUNING_POLL_MS));
+
+		unsigned long long paramsNow = modified(LIVE_PARAMS_FILE);
+		if (paramsNow != 0 && paramsNow != paramsTime){
+			paramsTime = paramsNow;
+			readParams();
+		}
+
+		std::vector<program_t> watched;
+		std::vector<unsigned long long> times;
+		unsigned int watchedGeneration;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			watched = programs;
+			times = programTimes;
+			watchedGeneration = generation;
+		}
+
+		//the SH basis is put in front of the sources of the SH programs
+		unsigned long long shBasisNow = modified(shBasisFile);
+		bool shBasisChanged = shBasisNow != 0 && shBasisNow != shBasisTime;
+		shBasisTime = shBasisNow;
+
+		for (unsigned int i = 0; i < watched.size() && running; i++){
+			unsigned long long now = modified(watched[i].file);
+			//an editor may replace the file, it is built once it is back
+			if (now == 0 || (now == times[i] && !(shBasisChanged && watched[i].shOrder > 0)))
+				continue;
+
+			{
+				//a source which does not build is tried again after its next change
+				std::lock_guard<std::mutex> lock(mutex);
+				if (generation != watchedGeneration)
+					break;
+				programTimes[i] = now;
+			}
+
+			cl::Program program;
+			if (!build(watched[i], &program)){
+				failedReloads->add();
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (generation != watchedGeneration)
+				break;
+			build_t built;
+			built.generation = watchedGeneration;
+			built.index = i;
+			built.program = program;
+			builds.push_back(built);
+			pending = true;
+		}
+	}
+}
+
+bool LiveTuning::build(const program_t &program, cl::Program* built){
+	std::string kernelSource;
+
+	std::ifstream in(program.file, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + program.file);
+		return false;
+	}
+
+	if (program.shOrder > 0){
+		try
+		{
+			kernelSource = clHelper->getSHBasisSource(program.shOrder) + kernelSource;
+		}
+		catch (int){
+			return false;
+		}
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		*built = cl::Program(context, source);
+		built->build(devices);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: rebuild of " + program.file + " failed, the old kernels stay: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		if (er.err() == CL_BUILD_PROGRAM_FAILURE){
+			clHelper->log("\n----------------------buildLog start--------------------\n");
+			std::string buildLog = built->getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+			clHelper->log(buildLog);
+			clHelper->log("\n----------------------buildLog end--------------------\n");
+		}
+		return false;
+	}
+
+	long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	clHelper->log("rebuilt " + program.file + " in " + std::to_string(ms) + " ms");
+	return true;
+}
+
+void LiveTuning::readParams(){
+	std::ifstream in(LIVE_PARAMS_FILE);
+	if (!in)
+		return;
+
+	std::vector<std::pair<std::string, float> > read;
+	simParams_t names;
+	std::string line;
+	while (std::getline(in, line)){
+		std::istringstream fields(line.substr(0, line.find('#')));
+		std::string name;
+		float value;
+		if (!(fields >> name))
+			continue;
+		if (!(fields >> value) || tunable(&names, name) == NULL){
+			clHelper->log("live params: ignored line \"" + line + "\"");
+			continue;
+		}
+		read.push_back(std::make_pair(name, value));
+	}
+
+	if (read.empty())
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	params.insert(params.end(), read.begin(), read.end());
+	pending = true;
+}
+
+unsigned long long LiveTuning::modified(const std::string &file){
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(file.c_str(), GetFileExInfoStandard, &data))
+		return 0;
+	return ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
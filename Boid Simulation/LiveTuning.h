@@ -0,0 +1,83 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _LIVETUNING_H_
+#define _LIVETUNING_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "simParam.h"
+#include "boidModel.h"
+#include "metrics.h"
+
+/*
+	Tuning of the running model without a restart. A thread of its own polls the kernel sources
+	of the model and the parameter file LIVE_PARAMS_FILE every LIVE_TUNING_POLL_MS. A changed
+	source is built on that thread while the simulation goes on with the old kernels; a program
+	which does not build is logged with its build log and dropped. Rebuilt programs and changed
+	parameters are handed over in apply between two steps, where the kernels are swapped and
+	cl_simParams is written while all buffers stay.
+
+	The parameter file has one "name value" per line, # starts a comment. The names are the
+	tunable fields of simParams_t: wSeparation, wAlignment, wCohesion, wOwn, wPath, maxVel and
+	maxVelCor. The file is applied when it changes and once at the start.
+*/
+class LiveTuning
+{
+public:
+	LiveTuning(CLHelper* clHlpr);
+	~LiveTuning();
+
+	// start and stop the watching thread
+	void start();
+	void stop();
+
+	// programs of a new model, changes of their sources from now on are rebuilt
+	void watch(const std::vector<program_t> &watched);
+	// between two steps: swap in the rebuilt programs and write the changed parameters. simParams
+	// are the parameters of the simulation, tuned values are kept there for restarts of the model
+	void apply(BoidModel* model, simParams_t* simParams);
+
+private:
+	typedef struct{
+		unsigned int generation;
+		unsigned int index;
+		cl::Program program;
+	} build_t;
+
+	void watchLoop();
+	// build the program from its current source, false if it does not build
+	bool build(const program_t &program, cl::Program* built);
+	// read the parameter file into params
+	void readParams();
+	// last write time of a file, 0 if it does not exist
+	static unsigned long long modified(const std::string &file);
+
+	CLHelper* clHelper;
+	cl::Context context;
+	std::vector<cl::Device> devices;
+
+	// guards the watched programs, the builds and the parameters
+	std::mutex mutex;
+	std::vector<program_t> programs;
+	std::vector<unsigned long long> programTimes;
+	// counts the models watched, builds for an older model are dropped
+	unsigned int generation;
+	std::vector<build_t> builds;
+	std::vector<std::pair<std::string, float> > params;
+	unsigned long long paramsTime;
+	// builds or parameters wait for apply
+	std::atomic<bool> pending;
+
+	std::thread watcher;
+	std::atomic<bool> running;
+
+	Metrics::Counter* reloads;
+	Metrics::Counter* failedReloads;
+};
+
+#endif
@@ -1,22 +1,177 @@
 #include "stdafx.h"
 #include "logFile.h"
 #include "simParam.h"
+#include <iomanip>
+
+static long long ticksNow(){
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
 
 LogFile::LogFile(std::string logFileName){
 	createLogDir();
 	fileName = std::string(LOG_PATH_WIN);
-	fileName += "\\" + logFileName + getTimeStamp(true) + ".txt";
+	fileName += "\\" + logFileName + getTimeStamp(true);
+	fileName += LOG_FORMAT == FORMAT_JSON ? ".jsonl" : (LOG_FORMAT == FORMAT_BINARY ? ".bin" : ".txt");
 
 	std::cout << "\n" << fileName.data() << std::endl;
+
+	ring = new slot_t[LOG_RING_SIZE];
+	for (size_t i = 0; i < LOG_RING_SIZE; i++)
+		ring[i].sequence = i;
+	head = 0;
+	tail = 0;
+	dropped = 0;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	tickFrequency = (double)frequency.QuadPart;
+	ticksStart = ticksNow();
+	timeStart = time(0);
+
+	file.open(fileName, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+	running = true;
+	flusher = std::thread(&LogFile::flushLoop, this);
 }
 
 LogFile::~LogFile(){
+	close();
+	delete[] ring;
+}
+
+void LogFile::writeLog(std::string entry, level_t level){
+	if (level < LOG_LEVEL)
+		return;
+
+	long long ticks = ticksNow();
+	size_t pos = head.load(std::memory_order_relaxed);
+	slot_t* slot;
+
+	//claim the slot at pos, another producer may take it first
+	while (true){
+		slot = &ring[pos & (LOG_RING_SIZE - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+		if (diff == 0){
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0){
+			//the flusher has not written the slot of the last round yet
+			dropped++;
+			return;
+		}
+		else
+			pos = head.load(std::memory_order_relaxed);
+	}
+
+	slot->ticks = ticks;
+	slot->level = level;
+	slot->entry = std::move(entry);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void LogFile::close(){
+	if (!running)
+		return;
+
+	running = false;
+	flusher.join();
+	file.close();
+}
+
+void LogFile::flushLoop(){
+	while (running){
+		flush();
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL));
+	}
+	flush();
+}
+
+void LogFile::flush(){
+	bool written = false;
+
+	while (true){
+		slot_t* slot = &ring[tail & (LOG_RING_SIZE - 1)];
+		if (slot->sequence.load(std::memory_order_acquire) != tail + 1)
+			break;
+
+		writeEntry((slot->ticks - ticksStart) / tickFrequency, slot->level, slot->entry);
+		slot->entry.clear();
+		slot->sequence.store(tail + LOG_RING_SIZE, std::memory_order_release);
+		tail++;
+		written = true;
+	}
+
+	unsigned int lost = dropped.exchange(0);
+	if (lost > 0){
+		std::stringstream strstream;
+		strstream << lost << " log entries dropped, the log buffer was full";
+		writeEntry((ticksNow() - ticksStart) / tickFrequency, LOG_WARNING, strstream.str());
+		written = true;
+	}
+
+	if (written)
+		file.flush();
+}
 
+void LogFile::writeEntry(double seconds, level_t level, const std::string &entry){
+	if (LOG_FORMAT == FORMAT_BINARY){
+		unsigned char lvl = (unsigned char)level;
+		unsigned int length = (unsigned int)entry.size();
+		file.write((const char*)&seconds, sizeof(double));
+		file.write((const char*)&lvl, sizeof(unsigned char));
+		file.write((const char*)&length, sizeof(unsigned int));
+		file.write(entry.data(), length);
+		return;
+	}
+
+	if (LOG_FORMAT == FORMAT_JSON){
+		file << "{\"t\":" << std::fixed << std::setprecision(6) << seconds << ",\"level\":\"" << levelName(level) << "\",\"msg\":\"";
+		for (size_t i = 0; i < entry.size(); i++){
+			unsigned char c = entry[i];
+			if (c == '"' || c == '\\')
+				file << '\\' << c;
+			else if (c == '\n')
+				file << "\\n";
+			else if (c == '\r')
+				file << "\\r";
+			else if (c == '\t')
+				file << "\\t";
+			else if (c < 0x20){
+				char escaped[8];
+				sprintf_s(escaped, sizeof(escaped), "\\u%04x", c);
+				file << escaped;
+			}
+			else
+				file << c;
+		}
+		file << "\"}\n";
+		return;
+	}
+
+	//wall clock of the entry and the exact time since the start of the log
+	char output[64];
+	time_t t = timeStart + (time_t)seconds;
+	struct tm t_struct;
+	localtime_s(&t_struct, &t);
+	strftime(output, sizeof(output), "%Y-%m-%d %X", &t_struct);
+	file << output << " +" << std::fixed << std::setprecision(6) << seconds << " " << levelName(level) << ": " << entry << "\n";
 }
 
-void LogFile::writeLog(const std::string &entry){
-	std::ofstream logFile(fileName, std::ios_base::out | std::ios_base::app);
-	logFile << getTimeStamp(false).data() << ": " << entry.data() << std::endl;
+const char* LogFile::levelName(level_t level){
+	switch (level){
+	case LOG_DEBUG:
+		return "DEBUG";
+	case LOG_WARNING:
+		return "WARNING";
+	case LOG_ERROR:
+		return "ERROR";
+	default:
+		return "INFO";
+	}
 }
 
 
@@ -46,4 +201,3 @@ bool LogFile::createLogDir(){
 
 	return true;
 }
-
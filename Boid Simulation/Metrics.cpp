@@ -0,0 +1,284 @@
+#include "stdafx.h"
+#include "metrics.h"
+#include <algorithm>
+
+#define METRICS_SUB_BUCKETS (1ull << METRICS_SUB_BITS)
+//exported histogram buckets from 2^10 ns (about 1 us) to 2^34 ns (about 17 s)
+#define METRICS_EXPORT_FIRST_BIT 10
+#define METRICS_EXPORT_LAST_BIT 34
+
+Metrics* Metrics::pInstance = NULL;
+
+Metrics::Histogram::Histogram(){
+	for (size_t i = 0; i < sizeof(buckets) / sizeof(buckets[0]); i++)
+		buckets[i] = 0;
+	sum = 0;
+}
+
+void Metrics::Histogram::record(double us){
+	unsigned long long ns = us > 0.0 ? (unsigned long long)(us * 1000.0) : 0;
+	//a bucket holds the values above its start up to its end, the end is inclusive like le
+	buckets[bucketIndex(ns > 0 ? ns - 1 : 0)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(ns, std::memory_order_relaxed);
+}
+
+unsigned int Metrics::Histogram::bucketIndex(unsigned long long ns){
+	if (ns >= (1ull << METRICS_MAX_BITS))
+		ns = (1ull << METRICS_MAX_BITS) - 1;
+
+	//small values have a bucket each, above that the top METRICS_SUB_BITS + 1 bits select the bucket
+	unsigned int msb = 0;
+	while ((ns >> msb) > 1)
+		msb++;
+	if (msb < METRICS_SUB_BITS)
+		return (unsigned int)ns;
+
+	unsigned int shift = msb - METRICS_SUB_BITS;
+	return (unsigned int)(((shift + 1) << METRICS_SUB_BITS) + (ns >> shift) - METRICS_SUB_BUCKETS);
+}
+
+unsigned long long Metrics::Histogram::bucketEnd(unsigned int index){
+	if (index < METRICS_SUB_BUCKETS)
+		return index + 1;
+
+	unsigned int shift = (index >> METRICS_SUB_BITS) - 1;
+	unsigned long long mantissa = (index & (METRICS_SUB_BUCKETS - 1)) + METRICS_SUB_BUCKETS;
+	return (mantissa + 1) << shift;
+}
+
+unsigned long long Metrics::Histogram::quantile(double q){
+	unsigned long long total = getCount();
+	if (total == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long)ceil(q * total);
+	unsigned long long counted = 0;
+	unsigned int last = sizeof(buckets) / sizeof(buckets[0]) - 1;
+	for (unsigned int i = 0; i < last; i++){
+		counted += buckets[i].load(std::memory_order_relaxed);
+		if (counted >= rank)
+			return bucketEnd(i);
+	}
+	return bucketEnd(last);
+}
+
+unsigned long long Metrics::Histogram::countAtMost(unsigned long long ns){
+	unsigned long long counted = 0;
+	unsigned int end = ns > 0 ? bucketIndex(ns - 1) + 1 : 0;
+	for (unsigned int i = 0; i < end; i++)
+		counted += buckets[i].load(std::memory_order_relaxed);
+	return counted;
+}
+
+unsigned long long Metrics::Histogram::getCount(){
+	unsigned long long counted = 0;
+	for (size_t i = 0; i < sizeof(buckets) / sizeof(buckets[0]); i++)
+		counted += buckets[i].load(std::memory_order_relaxed);
+	return counted;
+}
+
+unsigned long long Metrics::Histogram::getSum(){
+	return sum.load(std::memory_order_relaxed);
+}
+
+Metrics::Metrics(){
+	sample = true;
+	running = false;
+	listener = INVALID_SOCKET;
+}
+
+Metrics::Counter* Metrics::counter(const std::string &name, const std::string &help, const std::string &labels){
+	return (Counter*)find(name, help, labels, TYPE_COUNTER);
+}
+
+Metrics::Gauge* Metrics::gauge(const std::string &name, const std::string &help, const std::string &labels){
+	return (Gauge*)find(name, help, labels, TYPE_GAUGE);
+}
+
+Metrics::Histogram* Metrics::histogram(const std::string &name, const std::string &help, const std::string &labels){
+	return (Histogram*)find(name, help, labels, TYPE_HISTOGRAM);
+}
+
+void* Metrics::find(const std::string &name, const std::string &help, const std::string &labels, type_t type){
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].name == name && entries[i].labels == labels)
+			return entries[i].metric;
+
+	//metrics live as long as the program, the pointers stay valid
+	entry_t entry;
+	entry.name = name;
+	entry.help = help;
+	entry.labels = labels;
+	entry.type = type;
+	if (type == TYPE_COUNTER)
+		entry.metric = new Counter();
+	else if (type == TYPE_GAUGE)
+		entry.metric = new Gauge();
+	else
+		entry.metric = new Histogram();
+	entries.push_back(entry);
+	return entry.metric;
+}
+
+bool Metrics::sampleRequested(){
+	return sample.load(std::memory_order_relaxed) && sample.exchange(false);
+}
+
+static std::string withLabel(const std::string &labels, const std::string &label){
+	if (labels.empty())
+		return label.empty() ? "" : "{" + label + "}";
+	return "{" + labels + (label.empty() ? "" : "," + label) + "}";
+}
+
+std::string Metrics::expose(){
+	std::vector<entry_t> exposed;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exposed = entries;
+	}
+
+	std::ostringstream out;
+	out.precision(10);
+	std::vector<std::string> written;
+	for (size_t i = 0; i < exposed.size(); i++){
+		//one family per name, its label sets are written together
+		const std::string &name = exposed[i].name;
+		if (std::find(written.begin(), written.end(), name) != written.end())
+			continue;
+		written.push_back(name);
+
+		const char* type = exposed[i].type == TYPE_COUNTER ? "counter" : (exposed[i].type == TYPE_GAUGE ? "gauge" : "histogram");
+		out << "# HELP " << name << " " << exposed[i].help << "\n";
+		out << "# TYPE " << name << " " << type << "\n";
+
+		for (size_t j = i; j < exposed.size(); j++){
+			const entry_t &entry = exposed[j];
+			if (entry.name != name)
+				continue;
+
+			if (entry.type == TYPE_COUNTER)
+				out << name << withLabel(entry.labels, "") << " " << ((Counter*)entry.metric)->get() << "\n";
+			else if (entry.type == TYPE_GAUGE)
+				out << name << withLabel(entry.labels, "") << " " << ((Gauge*)entry.metric)->get() << "\n";
+			else{
+				Histogram* histogram = (Histogram*)entry.metric;
+				unsigned long long total = histogram->getCount();
+				for (int bit = METRICS_EXPORT_FIRST_BIT; bit <= METRICS_EXPORT_LAST_BIT; bit++){
+					std::ostringstream le;
+					le.precision(12);
+					le << "le=\"" << (double)(1ull << bit) * 1e-9 << "\"";
+					out << name << "_bucket" << withLabel(entry.labels, le.str()) << " " << histogram->countAtMost(1ull << bit) << "\n";
+				}
+				out << name << "_bucket" << withLabel(entry.labels, "le=\"+Inf\"") << " " << total << "\n";
+				out << name << "_sum" << withLabel(entry.labels, "") << " " << histogram->getSum() * 1e-9 << "\n";
+				out << name << "_count" << withLabel(entry.labels, "") << " " << total << "\n";
+			}
+		}
+
+		//quantiles from the fine buckets as a gauge family next to the histogram
+		if (exposed[i].type != TYPE_HISTOGRAM)
+			continue;
+		const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+		out << "# HELP " << name << "_quantile " << exposed[i].help << ", upper bucket edge of the quantile\n";
+		out << "# TYPE " << name << "_quantile gauge\n";
+		for (size_t j = i; j < exposed.size(); j++){
+			if (exposed[j].name != name)
+				continue;
+			for (int q = 0; q < 4; q++){
+				std::ostringstream label;
+				label << "quantile=\"" << quantiles[q] << "\"";
+				out << name << "_quantile" << withLabel(exposed[j].labels, label.str()) << " " << ((Histogram*)exposed[j].metric)->quantile(quantiles[q]) * 1e-9 << "\n";
+			}
+		}
+	}
+	return out.str();
+}
+
+bool Metrics::start(){
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return false;
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(METRICS_PORT);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == INVALID_SOCKET || bind(listener, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(listener, 4) == SOCKET_ERROR){
+		if (listener != INVALID_SOCKET)
+			closesocket(listener);
+		listener = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+
+	running = true;
+	server = std::thread(&Metrics::serveLoop, this);
+	return true;
+}
+
+void Metrics::stop(){
+	if (!running)
+		return;
+
+	running = false;
+	server.join();
+	closesocket(listener);
+	listener = INVALID_SOCKET;
+	WSACleanup();
+}
+
+void Metrics::serveLoop(){
+	while (running){
+		//wake up now and then to see whether the endpoint is stopped
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listener, &readable);
+		timeval timeout = { 0, 100000 };
+		if (select(0, &readable, NULL, NULL, &timeout) <= 0)
+			continue;
+
+		SOCKET client = accept(listener, NULL, NULL);
+		if (client == INVALID_SOCKET)
+			continue;
+
+		//a scrape is one GET per connection, only its request line is of interest
+		DWORD receiveTimeout = 1000;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&receiveTimeout, sizeof(receiveTimeout));
+		char request[1024];
+		int length = 0;
+		request[0] = 0;
+		while (length < (int)sizeof(request) - 1){
+			int received = recv(client, request + length, sizeof(request) - 1 - length, 0);
+			if (received <= 0)
+				break;
+			length += received;
+			request[length] = 0;
+			if (strstr(request, "\r\n\r\n") != NULL)
+				break;
+		}
+
+		std::string status = "404 Not Found";
+		std::string body = "metrics are served on /metrics\n";
+		if (strncmp(request, "GET /metrics", 12) == 0){
+			status = "200 OK";
+			body = expose();
+			//the next scrape gets the grid counts of a step after this one
+			sample = true;
+		}
+
+		std::ostringstream response;
+		response << "HTTP/1.1 " << status << "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+		std::string data = response.str();
+		for (size_t sent = 0; sent < data.size();){
+			int n = send(client, data.c_str() + sent, (int)(data.size() - sent), 0);
+			if (n <= 0)
+				break;
+			sent += n;
+		}
+		closesocket(client);
+	}
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "stdafx.h"
+#include "simParam.h"
+
+/*
+	Registry of live metrics, served in the Prometheus text format on
+	http://127.0.0.1:METRICS_PORT/metrics by a thread of its own. Metrics are registered once by
+	name and labels and then updated through the returned pointer with relaxed atomics, so
+	recording never takes a lock.
+
+	Histograms are log-linear (HDR style): 2^METRICS_SUB_BITS buckets per power of two of the
+	value in ns, which bounds the relative error of the quantiles by 2^-METRICS_SUB_BITS. The
+	scrape exports power of two buckets from 1 us and the 0.5 / 0.9 / 0.99 / 0.999 quantiles.
+*/
+class Metrics
+{
+public:
+	class Counter
+	{
+	public:
+		Counter() : value(0) {}
+		void add(unsigned long long n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+		unsigned long long get() { return value.load(std::memory_order_relaxed); }
+	private:
+		std::atomic<unsigned long long> value;
+	};
+
+	class Gauge
+	{
+	public:
+		Gauge() : value(0) {}
+		void set(long long v) { value.store(v, std::memory_order_relaxed); }
+		void add(long long n) { value.fetch_add(n, std::memory_order_relaxed); }
+		long long get() { return value.load(std::memory_order_relaxed); }
+	private:
+		std::atomic<long long> value;
+	};
+
+	class Histogram
+	{
+	public:
+		Histogram();
+		// add a duration in us
+		void record(double us);
+		// value in ns the fraction q of the recorded values is at most, an upper bucket edge
+		unsigned long long quantile(double q);
+		// recorded values of at most ns (le), ns has to be a power of two
+		unsigned long long countAtMost(unsigned long long ns);
+		// recorded values, the sum of the buckets
+		unsigned long long getCount();
+		// sum of the recorded values in ns
+		unsigned long long getSum();
+
+	private:
+		static unsigned int bucketIndex(unsigned long long ns);
+		// last value in ns of the bucket
+		static unsigned long long bucketEnd(unsigned int index);
+
+		std::atomic<unsigned long long> buckets[(METRICS_MAX_BITS - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS];
+		std::atomic<unsigned long long> sum;
+	};
+
+	static inline Metrics &getInstance() {
+		if (NULL == pInstance) { pInstance = new Metrics(); }
+		return *pInstance;
+	}
+
+	// the metric of name and labels (name="value",...), created on the first call
+	Counter* counter(const std::string &name, const std::string &help, const std::string &labels = "");
+	Gauge* gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+	Histogram* histogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+	// a scrape wants values which are expensive to get, cleared by the call
+	bool sampleRequested();
+
+	// start and stop the endpoint, false if the port can not be bound
+	bool start();
+	void stop();
+
+	// all metrics in the Prometheus text format
+	std::string expose();
+
+private:
+	enum type_t { TYPE_COUNTER, TYPE_GAUGE, TYPE_HISTOGRAM };
+
+	typedef struct{
+		std::string name;
+		std::string help;
+		std::string labels;
+		type_t type;
+		void* metric;
+	} entry_t;
+
+	Metrics();
+	static Metrics* pInstance;
+
+	void* find(const std::string &name, const std::string &help, const std::string &labels, type_t type);
+	void serveLoop();
+
+	// guards the entries, not the values
+	std::mutex mutex;
+	std::vector<entry_t> entries;
+	std::atomic<bool> sample;
+
+	std::thread server;
+	std::atomic<bool> running;
+	SOCKET listener;
+};
+
+#endif
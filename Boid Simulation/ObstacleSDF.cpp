@@ -0,0 +1,261 @@
+#include "stdafx.h"
+#include "obstacleSDF.h"
+
+//version of the binary cache format
+#define SDF_CACHE_VERSION 1
+
+ObstacleSDF::ObstacleSDF(CLHelper* clHlpr, const std::string &objFile, float3 worldOrigin, float3 cellSize, uint3 gridSize, unsigned int res){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	queue = clHelper->getCmdQueue();
+	devices = clHelper->getDevices();
+	valid = false;
+
+	memcpy(header.magic, "BSDF", 4);
+	header.version = SDF_CACHE_VERSION;
+	header.res = res;
+	header.gridSize = gridSize;
+	header.worldOrigin = worldOrigin;
+	header.cellSize = cellSize;
+
+	std::string source;
+	std::ifstream in(objFile, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		source.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&source[0], source.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + objFile);
+		return;
+	}
+
+	header.objHash = hash(source);
+
+	std::string cacheFile = objFile + ".sdf";
+	if (readCache(cacheFile)){
+		clHelper->log("obstacle SDF loaded from " + cacheFile);
+		valid = true;
+		return;
+	}
+
+	if (!loadObj(source)){
+		clHelper->log("no triangles in " + objFile);
+		return;
+	}
+
+	unsigned long long timeNow = GetTickCount64();
+	if (!voxelize()){
+		clHelper->log("obstacle SDF of " + objFile + " could not be voxelized");
+		return;
+	}
+
+	std::stringstream strstream;
+	strstream << "obstacle SDF voxelized from " << indices.size() / 3 << " triangles in " << GetTickCount64() - timeNow << "ms";
+	clHelper->log(strstream.str());
+
+	writeCache(cacheFile);
+	valid = true;
+}
+
+ObstacleSDF::~ObstacleSDF(){
+
+}
+
+bool ObstacleSDF::isValid(){
+	return valid;
+}
+
+std::vector<Vec4> ObstacleSDF::getNodes(){
+	return nodes;
+}
+
+bool ObstacleSDF::loadObj(const std::string &source){
+	std::istringstream stream(source);
+	std::string line;
+
+	while (std::getline(stream, line)){
+		std::istringstream lineStream(line);
+		std::string type;
+		lineStream >> type;
+
+		if (type == "v"){
+			glm::vec3 v;
+			lineStream >> v.x >> v.y >> v.z;
+			vertices.push_back(v);
+		}
+		else if (type == "f"){
+			//vertex index is the part in front of the first '/', negative indices are relative to the end
+			std::vector<unsigned int> face;
+			std::string token;
+			while (lineStream >> token){
+				int index = atoi(token.substr(0, token.find('/')).c_str());
+				if (index < 0)
+					index += (int)vertices.size() + 1;
+				if (index < 1 || index >(int)vertices.size())
+					return false;
+				face.push_back(index - 1);
+			}
+
+			for (size_t i = 2; i < face.size(); i++){
+				indices.push_back(face[0]);
+				indices.push_back(face[i - 1]);
+				indices.push_back(face[i]);
+			}
+		}
+	}
+
+	return indices.size() > 0;
+}
+
+bool ObstacleSDF::voxelize(){
+	cl_uint4 nodeCount;
+	nodeCount.s[0] = header.gridSize.x * header.res + 1;
+	nodeCount.s[1] = header.gridSize.y * header.res + 1;
+	nodeCount.s[2] = header.gridSize.z * header.res + 1;
+	nodeCount.s[3] = 0;
+	cl_float4 origin = { header.worldOrigin.x, header.worldOrigin.y, header.worldOrigin.z, 0.0f };
+	cl_float4 spacing = { header.cellSize.x / header.res, header.cellSize.y / header.res, header.cellSize.z / header.res, 0.0f };
+	unsigned int numNodes = nodeCount.s[0] * nodeCount.s[1] * nodeCount.s[2];
+	unsigned int numTris = (unsigned int)indices.size() / 3;
+
+	//three corners per triangle
+	std::vector<Vec4> tri(indices.size());
+	for (size_t i = 0; i < indices.size(); i++){
+		glm::vec3 v = vertices[indices[i]];
+		tri[i] = Vec4(v.x, v.y, v.z, 0.0f);
+	}
+
+	if (!loadProgram(kernel_path + "obstacleSDF_kernel.cl"))
+		return false;
+
+	cl::Buffer cl_tri;
+	cl::Buffer cl_dist;
+	cl::Buffer cl_nodes;
+	unsigned int globalWorkSize = ((numNodes + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	nodes.resize(numNodes);
+
+	try
+	{
+		kernel_sdfDistance = cl::Kernel(program, "sdfDistance", &err);
+		kernel_sdfGradient = cl::Kernel(program, "sdfGradient", &err);
+
+		cl_tri = clHelper->createBuffer(CL_MEM_READ_ONLY, tri.size() * sizeof(Vec4), NULL, &err);
+		cl_dist = clHelper->createBuffer(CL_MEM_READ_WRITE, numNodes * sizeof(float), NULL, &err);
+		cl_nodes = clHelper->createBuffer(CL_MEM_WRITE_ONLY, numNodes * sizeof(Vec4), NULL, &err);
+		err = queue.enqueueWriteBuffer(cl_tri, CL_TRUE, 0, tri.size() * sizeof(Vec4), &tri[0]);
+
+		err = kernel_sdfDistance.setArg(0, cl_tri);
+		err = kernel_sdfDistance.setArg(1, numTris);
+		err = kernel_sdfDistance.setArg(2, nodeCount);
+		err = kernel_sdfDistance.setArg(3, origin);
+		err = kernel_sdfDistance.setArg(4, spacing);
+		err = kernel_sdfDistance.setArg(5, cl_dist);
+		err = kernel_sdfDistance.setArg(6, cl::__local(3 * sizeof(Vec4) * LOCAL_PREF));
+
+		err = kernel_sdfGradient.setArg(0, cl_dist);
+		err = kernel_sdfGradient.setArg(1, nodeCount);
+		err = kernel_sdfGradient.setArg(2, spacing);
+		err = kernel_sdfGradient.setArg(3, cl_nodes);
+
+		err = queue.enqueueNDRangeKernel(kernel_sdfDistance, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF));
+		err = queue.enqueueNDRangeKernel(kernel_sdfGradient, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF));
+		err = queue.enqueueReadBuffer(cl_nodes, CL_TRUE, 0, numNodes * sizeof(Vec4), &nodes[0]);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		return false;
+	}
+
+	return true;
+}
+
+bool ObstacleSDF::loadProgram(const std::string &filename){
+	std::string kernelSource;
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + filename);
+		return false;
+	}
+
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		program = cl::Program(context, source);
+	}
+	catch (cl::Error er)
+	{
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		return false;
+	}
+
+	try
+	{
+		err = program.build(devices);
+	}
+	catch (cl::Error er) {
+		clHelper->log("program build: " + clHelper->oclErrorString(er.err()));
+		clHelper->log("\n----------------------buildLog start--------------------\n");
+		std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+		clHelper->log(buildLog);
+		clHelper->log("\n----------------------buildLog end--------------------\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool ObstacleSDF::readCache(const std::string &filename){
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (!in)
+		return false;
+
+	sdfHeader_t fileHeader;
+	in.read((char*)&fileHeader, sizeof(sdfHeader_t));
+
+	//the cache is only used for the same mesh on the same grid
+	if (!in || memcmp(&fileHeader, &header, sizeof(sdfHeader_t)) != 0){
+		clHelper->log("obstacle SDF cache " + filename + " is outdated");
+		return false;
+	}
+
+	unsigned int numNodes = (header.gridSize.x * header.res + 1) * (header.gridSize.y * header.res + 1) * (header.gridSize.z * header.res + 1);
+	nodes.resize(numNodes);
+	in.read((char*)&nodes[0], numNodes * sizeof(Vec4));
+
+	return !in.fail();
+}
+
+void ObstacleSDF::writeCache(const std::string &filename){
+	std::ofstream out(filename, std::ios::out | std::ios::binary);
+	if (!out){
+		clHelper->log("could not write " + filename);
+		return;
+	}
+
+	out.write((const char*)&header, sizeof(sdfHeader_t));
+	out.write((const char*)&nodes[0], nodes.size() * sizeof(Vec4));
+}
+
+unsigned int ObstacleSDF::hash(const std::string &source){
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < source.size(); i++){
+		h ^= (unsigned char)source[i];
+		h *= 16777619u;
+	}
+	return h;
+}
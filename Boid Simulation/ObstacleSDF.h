@@ -0,0 +1,79 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _OBSTACLESDF_H_
+#define _OBSTACLESDF_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "simParam.h"
+#include "tracer.h"
+#include "vector_types.h"
+#include "vectorTypes.h"
+
+/*
+	Signed distance field of a closed triangle mesh (OBJ) on the nodes of the simulation grid.
+	The field has gridSize * res + 1 nodes per axis with the same layout as the baked obstacle
+	field (x + nx * (z + nz * y)). Every node holds the normalized gradient in xyz and the signed
+	distance in w (negative inside the mesh). The voxelization runs on the device
+	(kernels/obstacleSDF_kernel.cl) and is cached next to the OBJ file.
+*/
+class ObstacleSDF
+{
+public:
+	// load the field of objFile from the cache or voxelize the mesh and write the cache
+	ObstacleSDF(CLHelper* clHlpr, const std::string &objFile, float3 worldOrigin, float3 cellSize, uint3 gridSize, unsigned int res);
+	~ObstacleSDF();
+
+	// true if the field could be loaded or voxelized
+	bool isValid();
+	// gradient and signed distance per node
+	std::vector<Vec4> getNodes();
+
+private:
+	// header of the binary cache file, followed by the nodes as Vec4
+	typedef struct{
+		char magic[4];
+		unsigned int version;
+		unsigned int objHash;
+		unsigned int res;
+		uint3 gridSize;
+		float3 worldOrigin;
+		float3 cellSize;
+	} sdfHeader_t;
+
+	CLHelper* clHelper;
+	cl::Context context;
+	TracedQueue queue;
+	std::vector<cl::Device> devices;
+	cl::Program program;
+	cl_int err;
+
+	cl::Kernel kernel_sdfDistance;
+	cl::Kernel kernel_sdfGradient;
+
+	std::vector<Vec4> nodes;
+	sdfHeader_t header;
+	bool valid;
+
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+
+	// read vertices and faces of the OBJ, polygons are split into triangle fans
+	bool loadObj(const std::string &source);
+	// signed distance at every node and the gradient by central differences, false if the kernels fail
+	bool voxelize();
+	// false if the program does not build
+	bool loadProgram(const std::string &filename);
+	bool readCache(const std::string &filename);
+	void writeCache(const std::string &filename);
+
+	// FNV-1a hash of the OBJ source to detect a changed mesh
+	static unsigned int hash(const std::string &source);
+};
+
+#endif
@@ -2,6 +2,13 @@
 #include "overlayText.h"
 #include "gfx.h"
 
+//maximum number of characters drawn per frame
+#define TEXT_MAX_GLYPHS 4096
+//six vertices (two triangles) per character
+#define TEXT_REGION_SIZE (TEXT_MAX_GLYPHS * 6)
+//width of the glyph atlas in pixels
+#define ATLAS_WIDTH 512
+
 OverlayText::OverlayText(){
 	shaderText = new Shader("text.v.glsl", "text.f.glsl");
 	shaderBox = new Shader("box.v.glsl", "box.f.glsl");
@@ -9,12 +16,42 @@ OverlayText::OverlayText(){
 	loadFont();
 	createText();
 
-	glGenBuffers(1, &vbo);
-
 	colorTextLoc = glGetUniformLocation(shaderText->id(), "color");
 	texTextLoc = glGetUniformLocation(shaderText->id(), "tex");
 	coordTextLoc = glGetAttribLocation(shaderText->id(), "coord");
 
+	atlasTex = 0;
+	atlasFontSize = 0;
+	createAtlas();
+
+	lineNext = 0;
+	region = 0;
+	for (int i = 0; i < 3; i++)
+		regionFence[i] = NULL;
+
+	glGenVertexArrays(1, &textVAO);
+	glBindVertexArray(textVAO);
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	//mapped once for the lifetime of the overlay where the context supports it
+	GLsizeiptr size = 3 * TEXT_REGION_SIZE * sizeof(point);
+	mappedVertices = NULL;
+	if (GLEW_ARB_buffer_storage){
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		mappedVertices = (point*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+
+	glVertexAttribPointer(coordTextLoc, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(coordTextLoc);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
 	colorBoxLoc = glGetUniformLocation(shaderBox->id(), "color");
 	coordBoxLoc = glGetAttribLocation(shaderBox->id(), "coord");
 	viewBoxLoc = glGetUniformLocation(shaderBox->id(), "m_transform");
@@ -23,7 +60,19 @@ OverlayText::OverlayText(){
 }
 
 OverlayText::~OverlayText(){
+	for (int i = 0; i < 3; i++){
+		if (regionFence[i] != NULL)
+			glDeleteSync(regionFence[i]);
+	}
 
+	if (mappedVertices != NULL){
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &vbo);
+	glDeleteVertexArrays(1, &textVAO);
+	glDeleteTextures(1, &atlasTex);
 }
 
 int OverlayText::loadFont(){
@@ -296,70 +345,158 @@ void OverlayText::createText(){
 	textExtended2[10] = "Quit                       [ESC/Q]";
 }
 
-void OverlayText::renderText(std::vector<const char*> textVector, float xBegin, float yBegin, float sx, float sy){
-	const char *p;
+void OverlayText::createAtlas(){
 	FT_GlyphSlot g = face->glyph;
-	/* Create a texture that will be used to hold one "glyph" */
-	GLuint tex;
-	GLfloat black[4] = { .0f, .0f, .0f, .8f };
+	FT_Set_Pixel_Sizes(face, 0, fontSize);
 
-	shaderText->bind();
+	//place the glyphs in rows, a row is as high as its highest glyph
+	int x = 0, y = 0, rowHeight = 0;
+	for (int c = 0; c < 128; c++){
+		memset(&glyphs[c], 0, sizeof(glyph));
+		if (c < 32 || FT_Load_Char(face, c, FT_LOAD_RENDER))
+			continue;
+
+		if (x + (int)g->bitmap.width + 1 > ATLAS_WIDTH){
+			x = 0;
+			y += rowHeight + 1;
+			rowHeight = 0;
+		}
 
-	FT_Set_Pixel_Sizes(face, 0, fontSize);
-	glUniform4fv(colorTextLoc, 1, black);
+		glyphs[c].left = (GLfloat)g->bitmap_left;
+		glyphs[c].top = (GLfloat)g->bitmap_top;
+		glyphs[c].width = (GLfloat)g->bitmap.width;
+		glyphs[c].rows = (GLfloat)g->bitmap.rows;
+		glyphs[c].advance = (GLfloat)(g->advance.x >> 6);
+		glyphs[c].s0 = (GLfloat)x;
+		glyphs[c].t0 = (GLfloat)y;
+
+		x += g->bitmap.width + 1;
+		if ((int)g->bitmap.rows > rowHeight)
+			rowHeight = g->bitmap.rows;
+	}
+	int atlasHeight = y + rowHeight;
+
+	if (atlasTex == 0)
+		glGenTextures(1, &atlasTex);
 
 	glActiveTexture(GL_TEXTURE0);
-	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_2D, tex);
-	glUniform1i(texTextLoc, 0);
+	glBindTexture(GL_TEXTURE_2D, atlasTex);
 	/* We require 1 byte alignment when uploading texture data */
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, atlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, NULL);
 	/* Clamping to edges is important to prevent artifacts when scaling */
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	/* Linear filtering usually looks best for text */
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	/* Set up the VBO for our vertex data */
-	glEnableVertexAttribArray(coordTextLoc);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glVertexAttribPointer(coordTextLoc, 4, GL_FLOAT, GL_FALSE, 0, 0);
 
+	//upload every glyph into its place and turn the places into texture coordinates
+	for (int c = 32; c < 128; c++){
+		glyph* gm = &glyphs[c];
+		if (gm->width > 0 && gm->rows > 0 && !FT_Load_Char(face, c, FT_LOAD_RENDER))
+			glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint)gm->s0, (GLint)gm->t0, g->bitmap.width, g->bitmap.rows, GL_ALPHA, GL_UNSIGNED_BYTE, g->bitmap.buffer);
+
+		gm->s1 = (gm->s0 + gm->width) / ATLAS_WIDTH;
+		gm->t1 = (gm->t0 + gm->rows) / atlasHeight;
+		gm->s0 /= ATLAS_WIDTH;
+		gm->t0 /= atlasHeight;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	atlasFontSize = fontSize;
+	//the cached lines use the metrics of the old size
+	lines.clear();
+}
+
+void OverlayText::renderText(std::vector<const char*> textVector, float xBegin, float yBegin, float sx, float sy){
 	for (int i = 0; i < textVector.size(); i++){
 		float y = yBegin - i * fontSize * lineSpacing * sy;
-		float x = xBegin;
 		const char* text = textVector[i];
-		/* Loop through all characters */
-		for (p = text; *p; p++) {
-			/* Try to load and render the character */
-			if (FT_Load_Char(face, *p, FT_LOAD_RENDER))
-				continue;
-			/* Upload the "bitmap", which contains an 8-bit grayscale image, as an alpha texture */
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, g->bitmap.width, g->bitmap.rows, 0, GL_ALPHA, GL_UNSIGNED_BYTE, g->bitmap.buffer);
-			/* Calculate the vertex and texture coordinates */
-			float x2 = x + g->bitmap_left * sx;
-			float y2 = -y - g->bitmap_top * sy;
-			float w = g->bitmap.width * sx;
-			float h = g->bitmap.rows * sy;
-			point box[4] = {
-				{ x2, -y2, 0, 0 },
-				{ x2 + w, -y2, 1, 0 },
-				{ x2, -y2 - h, 0, 1 },
-				{ x2 + w, -y2 - h, 1, 1 },
-			};
-			/* Draw the character on the screen */
-			glBufferData(GL_ARRAY_BUFFER, sizeof box, box, GL_DYNAMIC_DRAW);
-			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-			/* Advance the cursor to the start of the next character */
-			x += (g->advance.x >> 6) * sx;
-			y += (g->advance.y >> 6) * sy;
+
+		if (lineNext == lines.size())
+			lines.push_back(line());
+		line* l = &lines[lineNext++];
+
+		if (l->text != text){
+			l->text = text;
+			l->vertices.clear();
+
+			float x = 0.0f;
+			for (const char* p = text; *p; p++) {
+				glyph* gm = &glyphs[(unsigned char)*p & 127];
+				/* Calculate the vertex and texture coordinates */
+				float x2 = x + gm->left;
+				float y2 = gm->top;
+				float w = gm->width;
+				float h = gm->rows;
+				if (w > 0 && h > 0){
+					point box[6] = {
+						{ x2, y2, gm->s0, gm->t0 },
+						{ x2 + w, y2, gm->s1, gm->t0 },
+						{ x2, y2 - h, gm->s0, gm->t1 },
+						{ x2 + w, y2, gm->s1, gm->t0 },
+						{ x2, y2 - h, gm->s0, gm->t1 },
+						{ x2 + w, y2 - h, gm->s1, gm->t1 },
+					};
+					l->vertices.insert(l->vertices.end(), box, box + 6);
+				}
+				/* Advance the cursor to the start of the next character */
+				x += gm->advance;
+			}
+		}
+
+		for (size_t v = 0; v < l->vertices.size() && frameVertices.size() < TEXT_REGION_SIZE; v++){
+			point pt = l->vertices[v];
+			pt.x = xBegin + pt.x * sx;
+			pt.y = y + pt.y * sy;
+			frameVertices.push_back(pt);
 		}
 	}
+}
 
-	glDisableVertexAttribArray(coordTextLoc);
-	glDeleteTextures(1, &tex);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	shaderText->unbind();
+void OverlayText::flushText(){
+	GLfloat black[4] = { .0f, .0f, .0f, .8f };
+	GLsizei count = (GLsizei)frameVertices.size();
+
+	//the region was last drawn three frames ago, usually done long since
+	if (regionFence[region] != NULL){
+		glClientWaitSync(regionFence[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(regionFence[region]);
+		regionFence[region] = NULL;
+	}
+
+	GLint first = region * TEXT_REGION_SIZE;
+	if (count > 0){
+		if (mappedVertices != NULL){
+			memcpy(mappedVertices + first, &frameVertices[0], count * sizeof(point));
+		}
+		else
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(point), count * sizeof(point), &frameVertices[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		shaderText->bind();
+		glUniform4fv(colorTextLoc, 1, black);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, atlasTex);
+		glUniform1i(texTextLoc, 0);
+
+		glBindVertexArray(textVAO);
+		glDrawArrays(GL_TRIANGLES, first, count);
+		glBindVertexArray(0);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		shaderText->unbind();
+
+		regionFence[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % 3;
+	}
+
+	frameVertices.clear();
+	lineNext = 0;
 }
 
 void OverlayText::render(){
@@ -378,6 +515,10 @@ void OverlayText::render(){
 	const std::string numBoids = strstream.str();
 	textSimple[1] = numBoids.c_str();
 
+	if (atlasFontSize != fontSize)
+		createAtlas();
+
+	//the boxes are drawn first, the text of all boxes follows with one draw call
 	changeBoxTopBottom(sy, sx);
 	drawBox(boxBottomVAO[0]);
 	renderText(textSimple, -1 + 8 * sx, 1 - windowHeight * sy + 28 * sy, sx, sy);
@@ -396,11 +537,16 @@ void OverlayText::render(){
 		renderText(textExtended2, -1 + (windowWidth + 1400)  * sx / 6, 1 - (windowHeight + 75) * sy / 4, sx, sy);
 		break;
 	case DISPLAY_TIME:
-		changeBox(Simulation::getInstance().getSimTimeDescriptions().size(), sy, sx, 940);
-		drawBox(boxVAO[0]);
-		renderText(Simulation::getInstance().getSimTimeDescriptions(), -1 + (windowWidth + 15)  * sx / 4, 1 - (windowHeight + 75) * sy / 4, sx, sy);
+		{
+			std::vector<const char*> timeText = Simulation::getInstance().getSimTimeDescriptions();
+			changeBox(timeText.size(), sy, sx, 940);
+			drawBox(boxVAO[0]);
+			renderText(timeText, -1 + (windowWidth + 15)  * sx / 4, 1 - (windowHeight + 75) * sy / 4, sx, sy);
+		}
 		break;
 	}
+
+	flushText();
 }
 
 void OverlayText::bindShader(){
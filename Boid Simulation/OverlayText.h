@@ -27,8 +27,12 @@ class OverlayText : public Renderable {
 		const char* fontFilename = "FreeSans.otf";
 		//load the bitmap of font
 		int loadFont();
-		//Render every line of text starting at position x, y. sx and sy are variables that scale the position to the current window size
+		//rasterize the printable ASCII characters at fontSize into one texture
+		void createAtlas();
+		//Add every line of text starting at position x, y to the text of this frame. sx and sy are variables that scale the position to the current window size
 		void renderText(std::vector<const char*> textVector, float x, float y, float sx, float sy);
+		//draw all text of this frame with one draw call
+		void flushText();
 		//create text for overlay
 		void createText();
 		//create a box for better visibility of text
@@ -62,7 +66,37 @@ class OverlayText : public Renderable {
 			GLfloat t;
 		};
 
-		GLuint vbo;
+		//metrics of a glyph in pixels and its place in the atlas
+		struct glyph {
+			GLfloat left;
+			GLfloat top;
+			GLfloat width;
+			GLfloat rows;
+			GLfloat advance;
+			GLfloat s0, t0, s1, t1;
+		};
+
+		//glyph quads of one line relative to the start of its baseline in pixels, laid out again only if the text changes
+		struct line {
+			std::string text;
+			std::vector<point> vertices;
+		};
+
+		glyph glyphs[128];
+		GLuint atlasTex;
+		GLuint atlasFontSize;
+
+		std::vector<line> lines;
+		//next line of the cache, the lines are used in the same order every frame
+		unsigned int lineNext;
+		//vertices of this frame in window coordinates
+		std::vector<point> frameVertices;
+
+		//the text VBO holds three regions, the region of a frame is written again once its fence is passed
+		GLuint vbo, textVAO;
+		point* mappedVertices;
+		unsigned int region;
+		GLsync regionFence[3];
 		GLuint boxVBO[1], boxVAO[1];
 		GLuint boxExtVBO[1], boxExtVAO[1];
 		GLuint boxTopVBO[1], boxTopVAO[1];
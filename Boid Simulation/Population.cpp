@@ -0,0 +1,263 @@
+#include "stdafx.h"
+#include "population.h"
+
+Population::Population(CLHelper* clHlpr, unsigned int cap, unsigned int cells, unsigned int comp, float y){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	queue = clHelper->getCmdQueue();
+	devices = clHelper->getDevices();
+
+	capacity = cap;
+	numCells = cells;
+	components = comp;
+	yPos = y;
+	seed = 1;
+	live = capacity;
+	liveRead = capacity;
+	numSinks = 0;
+	sinksDirty = false;
+	keep = capacity;
+
+	//the model starts with all agents it was created with
+	std::vector<unsigned char> alive(capacity > 0 ? capacity : 1, 1);
+	try
+	{
+		cl_alive = clHelper->createBuffer(CL_MEM_READ_WRITE, alive.size() * sizeof(unsigned char), NULL, &err);
+		cl_live = clHelper->createBuffer(CL_MEM_READ_WRITE, sizeof(unsigned int), NULL, &err);
+		cl_sinks = clHelper->createBuffer(CL_MEM_READ_ONLY, 2 * sizeof(Vec4), NULL, &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueWriteBuffer(cl_alive, CL_TRUE, 0, alive.size() * sizeof(unsigned char), alive.data());
+	err = queue.enqueueWriteBuffer(cl_live, CL_TRUE, 0, sizeof(unsigned int), &capacity);
+
+	loadProgram(kernel_path + "population_kernel.cl");
+
+	try
+	{
+		kernel_markDead = cl::Kernel(program, "markDead", &err);
+		kernel_updateAlive = cl::Kernel(program, "updateAlive", &err);
+		kernel_despawnSinks = cl::Kernel(program, "despawnSinks", &err);
+		kernel_despawnRandom = cl::Kernel(program, "despawnRandom", &err);
+		kernel_spawn = cl::Kernel(program, "spawn", &err);
+		kernel_commitSpawn = cl::Kernel(program, "commitSpawn", &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+Population::~Population(){
+	//a pending readback writes into liveRead
+	queue.finish();
+}
+
+void Population::markDead(const cl::Buffer &gridHash){
+	try
+	{
+		err = kernel_markDead.setArg(0, gridHash);
+		err = kernel_markDead.setArg(1, cl_alive);
+		err = kernel_markDead.setArg(2, numCells);
+		err = kernel_markDead.setArg(3, capacity);
+		err = queue.enqueueNDRangeKernel(kernel_markDead, cl::NullRange, cl::NDRange(capacity), cl::NullRange);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+void Population::compact(const cl::Buffer &sortedHash){
+	//the count of an earlier step arrived
+	if (liveEvent() != NULL && liveEvent.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE){
+		live = liveRead;
+		liveEvent = cl::Event();
+	}
+
+	try
+	{
+		err = kernel_updateAlive.setArg(0, sortedHash);
+		err = kernel_updateAlive.setArg(1, cl_alive);
+		err = kernel_updateAlive.setArg(2, cl_live);
+		err = kernel_updateAlive.setArg(3, numCells);
+		err = kernel_updateAlive.setArg(4, capacity);
+		err = queue.enqueueNDRangeKernel(kernel_updateAlive, cl::NullRange, cl::NDRange(capacity), cl::NullRange);
+
+		if (liveEvent() == NULL)
+			err = queue.enqueueReadBuffer(cl_live, CL_FALSE, 0, sizeof(unsigned int), &liveRead, NULL, &liveEvent);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+void Population::update(const cl::Memory &pos, const cl::Memory &vel, float dt, const cl::Memory* group, const cl::Memory* goal){
+	try
+	{
+		if (sinksDirty){
+			sinksDirty = false;
+			numSinks = (unsigned int)(sinks.size() / 2);
+			if (numSinks > 0){
+				cl_sinks = clHelper->createBuffer(CL_MEM_READ_ONLY, 2 * numSinks * sizeof(Vec4), NULL, &err);
+				err = queue.enqueueWriteBuffer(cl_sinks, CL_TRUE, 0, 2 * numSinks * sizeof(Vec4), sinks.data());
+			}
+		}
+
+		if (numSinks > 0){
+			err = kernel_despawnSinks.setArg(0, pos);
+			err = kernel_despawnSinks.setArg(1, cl_alive);
+			err = kernel_despawnSinks.setArg(2, cl_sinks);
+			err = kernel_despawnSinks.setArg(3, numSinks);
+			err = kernel_despawnSinks.setArg(4, components);
+			err = kernel_despawnSinks.setArg(5, yPos);
+			err = kernel_despawnSinks.setArg(6, capacity);
+			err = queue.enqueueNDRangeKernel(kernel_despawnSinks, cl::NullRange, cl::NDRange(capacity), cl::NullRange);
+		}
+
+		//every living agent dies with the fraction of the live count to drop
+		unsigned int current = live;
+		if (keep < current){
+			unsigned int threshold = (unsigned int)((1.0 - (double)keep / current) * 0x1000000);
+			err = kernel_despawnRandom.setArg(0, cl_alive);
+			err = kernel_despawnRandom.setArg(1, threshold);
+			err = kernel_despawnRandom.setArg(2, seed++);
+			err = kernel_despawnRandom.setArg(3, capacity);
+			err = queue.enqueueNDRangeKernel(kernel_despawnRandom, cl::NullRange, cl::NDRange(capacity), cl::NullRange);
+		}
+		keep = capacity;
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	for (size_t i = 0; i < emitters.size(); i++){
+		emitted[i] += emitters[i].rate * dt;
+		unsigned int count = (unsigned int)emitted[i];
+		emitted[i] -= count;
+		if (count > 0)
+			enqueueSpawn(pos, vel, group, goal, emitters[i], count);
+	}
+
+	for (size_t i = 0; i < spawns.size(); i++)
+		enqueueSpawn(pos, vel, group, goal, spawns[i].emitter, spawns[i].count);
+	spawns.clear();
+}
+
+void Population::enqueueSpawn(const cl::Memory &pos, const cl::Memory &vel, const cl::Memory* group, const cl::Memory* goal, const emitter_t &emitter, unsigned int count){
+	cl_float4 boxMin = { { emitter.boxMin.x, emitter.boxMin.y, emitter.boxMin.z, 0.0f } };
+	cl_float4 boxMax = { { emitter.boxMax.x, emitter.boxMax.y, emitter.boxMax.z, 0.0f } };
+	cl_float4 velocity = { { emitter.velocity.x, emitter.velocity.y, emitter.velocity.z, 0.0f } };
+	cl_float4 goalPos = { { emitter.goal.x, emitter.goal.y, emitter.goal.z, emitter.goal.w } };
+	count = count < capacity ? count : capacity;
+
+	try
+	{
+		err = kernel_spawn.setArg(0, pos);
+		err = kernel_spawn.setArg(1, vel);
+		err = kernel_spawn.setArg(2, cl_alive);
+		err = kernel_spawn.setArg(3, cl_live);
+		err = kernel_spawn.setArg(4, boxMin);
+		err = kernel_spawn.setArg(5, boxMax);
+		err = kernel_spawn.setArg(6, velocity);
+		err = kernel_spawn.setArg(7, emitter.jitter);
+		err = kernel_spawn.setArg(8, count);
+		err = kernel_spawn.setArg(9, seed++);
+		err = kernel_spawn.setArg(10, components);
+		err = kernel_spawn.setArg(11, capacity);
+		//a NULL buffer for the models without groups or goals per agent
+		if (group != NULL)
+			err = kernel_spawn.setArg(12, *group);
+		else
+			err = kernel_spawn.setArg(12, sizeof(cl_mem), NULL);
+		if (goal != NULL)
+			err = kernel_spawn.setArg(13, *goal);
+		else
+			err = kernel_spawn.setArg(13, sizeof(cl_mem), NULL);
+		err = kernel_spawn.setArg(14, (unsigned int)emitter.group);
+		err = kernel_spawn.setArg(15, goalPos);
+		err = queue.enqueueNDRangeKernel(kernel_spawn, cl::NullRange, cl::NDRange(count), cl::NullRange);
+
+		err = kernel_commitSpawn.setArg(0, cl_live);
+		err = kernel_commitSpawn.setArg(1, count);
+		err = kernel_commitSpawn.setArg(2, capacity);
+		err = queue.enqueueNDRangeKernel(kernel_commitSpawn, cl::NullRange, cl::NDRange(1), cl::NullRange);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+unsigned int Population::getLive(){
+	return live;
+}
+
+unsigned int Population::getCapacity(){
+	return capacity;
+}
+
+const cl::Buffer &Population::getAlive(){
+	return cl_alive;
+}
+
+void Population::despawnTo(unsigned int n){
+	keep = n < keep ? n : keep;
+}
+
+void Population::spawn(const emitter_t &emitter, unsigned int count){
+	spawn_t request;
+	request.emitter = emitter;
+	request.count = count;
+	spawns.push_back(request);
+}
+
+void Population::setEmitters(const std::vector<emitter_t> &e){
+	emitters = e;
+	emitted.assign(emitters.size(), 0.0f);
+}
+
+void Population::setSinks(const std::vector<Vec4> &s){
+	sinks = s;
+	sinksDirty = true;
+}
+
+void Population::loadProgram(const std::string &filename){
+	std::string kernelSource;
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + filename);
+		throw(errno);
+	}
+
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		program = cl::Program(context, source);
+	}
+	catch (cl::Error er)
+	{
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	try
+	{
+		err = program.build(devices);
+	}
+	catch (cl::Error er) {
+		clHelper->log("program build: " + clHelper->oclErrorString(er.err()));
+		clHelper->log("\n----------------------buildLog start--------------------\n");
+		std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+		clHelper->log(buildLog);
+		clHelper->log("\n----------------------buildLog end--------------------\n");
+	}
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _POPULATION_H_
+#define _POPULATION_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "tracer.h"
+#include "vectorTypes.h"
+
+/*
+	Source of new agents: a box they appear in uniformly, their velocity and a random part of
+	the velocity of length jitter. rate is in agents per second. New agents of the models with
+	groups join group, and goal if the model keeps a goal per agent.
+*/
+typedef struct emitter_t{
+	Vec4 boxMin;
+	Vec4 boxMax;
+	Vec4 velocity;
+	float jitter;
+	float rate;
+	unsigned char group;
+	Vec4 goal;
+} emitter_t;
+
+/*
+	Agents of a grid model which take part in the simulation, out of the capacity its buffers
+	were created with (kernels/population_kernel.cl). An alive mask in slot order is kept on the
+	device. Dead agents are hashed behind the last cell, so the sort and reorder of the step
+	compact the living agents into the front slots; spawning fills the slots behind them. Only
+	the changed agents are written, all others keep their state.
+
+	A spawned agent takes over the slot of a dead one and with it its id. Group and goal of the
+	slot are written from the emitter where the model has them.
+*/
+class Population
+{
+public:
+	// components of the positions are 4 or 2, the missing y of the 2D models is yPos
+	Population(CLHelper* clHlpr, unsigned int capacity, unsigned int numCells, unsigned int components = 4, float yPos = 0.0f);
+	~Population();
+
+	// after the grid hash of the step: dead agents go into the cell behind the grid
+	void markDead(const cl::Buffer &gridHash);
+	// after the reorder: alive mask and live count of the sorted order
+	void compact(const cl::Buffer &sortedHash);
+	// at the end of the step on the newest positions and velocities: sinks, despawns and
+	// spawns which are due, dt is the time step. group ids (uchar) and goals (float4) of the
+	// step, NULL for models without them
+	void update(const cl::Memory &pos, const cl::Memory &vel, float dt, const cl::Memory* group = NULL, const cl::Memory* goal = NULL);
+
+	// living agents as of a recent step
+	unsigned int getLive();
+	unsigned int getCapacity();
+	// alive mask in the sorted order of the step, one uchar per slot
+	const cl::Buffer &getAlive();
+
+	// despawn agents at random over the whole population at the end of the next step, about
+	// live of the living agents are kept
+	void despawnTo(unsigned int live);
+	// count new agents from the emitter at the end of the next step, as far as there is room
+	void spawn(const emitter_t &emitter, unsigned int count);
+	// emitters spawning every step, sinks as min, max box pairs despawning every step
+	void setEmitters(const std::vector<emitter_t> &emitters);
+	void setSinks(const std::vector<Vec4> &sinks);
+
+private:
+	typedef struct{
+		emitter_t emitter;
+		unsigned int count;
+	} spawn_t;
+
+	void enqueueSpawn(const cl::Memory &pos, const cl::Memory &vel, const cl::Memory* group, const cl::Memory* goal, const emitter_t &emitter, unsigned int count);
+	void loadProgram(const std::string &filename);
+
+	CLHelper* clHelper;
+	cl::Context context;
+	TracedQueue queue;
+	std::vector<cl::Device> devices;
+	cl::Program program;
+	cl_int err;
+
+	cl::Kernel kernel_markDead;
+	cl::Kernel kernel_updateAlive;
+	cl::Kernel kernel_despawnSinks;
+	cl::Kernel kernel_despawnRandom;
+	cl::Kernel kernel_spawn;
+	cl::Kernel kernel_commitSpawn;
+
+	cl::Buffer cl_alive;
+	cl::Buffer cl_live;
+	cl::Buffer cl_sinks;
+
+	unsigned int capacity;
+	unsigned int numCells;
+	unsigned int components;
+	float yPos;
+	unsigned int seed;
+
+	// live count read back without waiting, taken over once it arrived
+	std::atomic<unsigned int> live;
+	unsigned int liveRead;
+	cl::Event liveEvent;
+
+	std::vector<emitter_t> emitters;
+	// fractional agents of the emitters not spawned yet
+	std::vector<float> emitted;
+	unsigned int numSinks;
+	bool sinksDirty;
+	std::vector<Vec4> sinks;
+	std::vector<spawn_t> spawns;
+	// living agents to keep at the next update, capacity if there is no despawn
+	unsigned int keep;
+};
+
+#endif
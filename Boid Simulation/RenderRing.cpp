@@ -0,0 +1,380 @@
+#include "stdafx.h"
+#include "renderRing.h"
+
+//high resolution time in ms
+static double timeMs(){
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return 1000.0 * (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+RenderRing::RenderRing(CLHelper* clHlpr){
+	clHelper = clHlpr;
+	model = NULL;
+
+	//with cl_khr_gl_event GL waits for the release of the CL queue itself
+	std::string extensions = clHelper->getDevices()[0].getInfo<CL_DEVICE_EXTENSIONS>();
+	glEvent = extensions.find("cl_khr_gl_event") != std::string::npos;
+
+	for (int i = 0; i < 3; i++){
+		slots[i].vao = 0;
+		slots[i].copied = NULL;
+		slots[i].drawn = NULL;
+		slots[i].count = 0;
+		slots[i].timeState = 0.0;
+	}
+
+	writeSlot = 0;
+	readySlot = 1;
+	renderSlot = 2;
+	fresh = false;
+	layoutRequest = 0;
+	timeRender = 0.0;
+	timePublish = 0.0f;
+	timeAcquire = 0.0f;
+	timeDraw = 0.0f;
+
+	instancer = NULL;
+	if (INSTANCED_RENDERING && BoidInstancer::isSupported())
+		instancer = new BoidInstancer();
+	else
+		clHelper->log("instanced rendering is not available, the boids are drawn with the geometry shader");
+
+	glGenQueries(1, &drawQuery);
+	drawQueryPending = false;
+}
+
+RenderRing::~RenderRing(){
+	for (int i = 0; i < 3; i++){
+		if (!slots[i].buffers.empty())
+			glDeleteBuffers((GLsizei)slots[i].buffers.size(), &slots[i].buffers[0]);
+		if (slots[i].vao != 0)
+			glDeleteVertexArrays(1, &slots[i].vao);
+		if (slots[i].copied != NULL)
+			glDeleteSync(slots[i].copied);
+		if (slots[i].drawn != NULL)
+			glDeleteSync(slots[i].drawn);
+	}
+
+	delete instancer;
+	glDeleteQueries(1, &drawQuery);
+}
+
+void RenderRing::reset(BoidModel* boidModel){
+	std::lock_guard<std::mutex> lock(ringMutex);
+
+	model = boidModel;
+	fresh = false;
+	for (int i = 0; i < 3; i++)
+		slots[i].count = 0;
+
+	//a new model may reuse the names of the VAOs of the old one
+	layouts.clear();
+	layoutRequest = 0;
+	captureLayout(model->getPosVAO());
+}
+
+void RenderRing::publish(double timeState){
+	double timeStart = timeMs();
+	GLuint vao = model->getPosVAO();
+	layout_t layout;
+	bool found = false;
+
+	{
+		std::lock_guard<std::mutex> lock(ringMutex);
+		for (size_t i = 0; i < layouts.size() && !found; i++){
+			if (layouts[i].vao == vao){
+				layout = layouts[i];
+				found = true;
+			}
+		}
+
+		//the render thread reads the layout of this VAO with the next frame, this state is not drawn
+		if (!found){
+			layoutRequest = vao;
+			return;
+		}
+	}
+
+	//without cl_khr_gl_event the release of the VBOs has to be finished before GL reads them
+	if (!glEvent)
+		clHelper->getCmdQueue().finish();
+
+	slot_t* slot = &slots[writeSlot];
+
+	//the GPU must not overwrite the copies before the last frame drawn from them is done
+	if (slot->drawn != NULL){
+		glWaitSync(slot->drawn, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(slot->drawn);
+		slot->drawn = NULL;
+	}
+	if (slot->copied != NULL){
+		glDeleteSync(slot->copied);
+		slot->copied = NULL;
+	}
+
+	if (slot->buffers.size() < layout.buffers.size()){
+		size_t first = slot->buffers.size();
+		slot->buffers.resize(layout.buffers.size());
+		slot->bufferSize.resize(layout.buffers.size(), 0);
+		glGenBuffers((GLsizei)(slot->buffers.size() - first), &slot->buffers[first]);
+	}
+
+	for (size_t i = 0; i < layout.buffers.size(); i++){
+		GLint size;
+		glBindBuffer(GL_COPY_READ_BUFFER, layout.buffers[i]);
+		glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffers[i]);
+		if (slot->bufferSize[i] != size){
+			//the cull shader reads the group ids of the copies as whole words
+			glBufferData(GL_COPY_WRITE_BUFFER, (size + 3) & ~3, NULL, GL_STREAM_COPY);
+			slot->bufferSize[i] = size;
+		}
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	slot->attribs = layout.attribs;
+	slot->pos = layout.pos;
+	slot->vel = layout.vel;
+	slot->color = layout.color;
+	slot->group = layout.group;
+	slot->count = model->getNumBoid();
+	slot->timeState = timeState;
+	slot->copied = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	//the fence has to reach the GPU before the render thread waits on it
+	glFlush();
+
+	std::lock_guard<std::mutex> lock(ringMutex);
+	int slotPublished = writeSlot;
+	writeSlot = readySlot;
+	readySlot = slotPublished;
+	fresh = true;
+	timePublish = (float)(timeMs() - timeStart);
+}
+
+void RenderRing::setRenderTime(double timeNow){
+	timeRender = timeNow;
+}
+
+void RenderRing::setView(const glm::mat4 &viewProjection){
+	if (instancer != NULL)
+		instancer->setView(viewProjection);
+}
+
+void RenderRing::render(){
+	double timeStart = timeMs();
+	bool changed = false;
+
+	{
+		std::lock_guard<std::mutex> lock(ringMutex);
+		if (layoutRequest != 0){
+			captureLayout(layoutRequest);
+			layoutRequest = 0;
+		}
+
+		if (fresh){
+			int slotTaken = renderSlot;
+			renderSlot = readySlot;
+			readySlot = slotTaken;
+			fresh = false;
+			changed = true;
+		}
+	}
+
+	slot_t* slot = &slots[renderSlot];
+	if (model == NULL || slot->count == 0)
+		return;
+
+	if (slot->vao == 0){
+		glGenVertexArrays(1, &slot->vao);
+		changed = true;
+	}
+
+	//the VAO of the slot points to the copies of this publish
+	if (changed){
+		glWaitSync(slot->copied, 0, GL_TIMEOUT_IGNORED);
+
+		GLint maxAttribs;
+		glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttribs);
+
+		glBindVertexArray(slot->vao);
+		for (GLint i = 0; i < maxAttribs; i++)
+			glDisableVertexAttribArray(i);
+
+		for (size_t i = 0; i < slot->attribs.size(); i++){
+			attrib_t a = slot->attribs[i];
+			glBindBuffer(GL_ARRAY_BUFFER, slot->buffers[a.buffer]);
+			glVertexAttribPointer(a.index, a.size, a.type, a.normalized, a.stride, (const GLvoid*)a.offset);
+			glEnableVertexAttribArray(a.index);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+	timeAcquire = (float)(timeMs() - timeStart);
+
+	//the draw time of an earlier frame, only read once the GPU is done with it
+	if (drawQueryPending){
+		GLint available;
+		glGetQueryObjectiv(drawQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available){
+			GLuint64 elapsed;
+			glGetQueryObjectui64v(drawQuery, GL_QUERY_RESULT, &elapsed);
+			timeDraw = elapsed / 1000000.0f;
+			drawQueryPending = false;
+		}
+	}
+	bool measure = !drawQueryPending;
+	if (measure)
+		glBeginQuery(GL_TIME_ELAPSED, drawQuery);
+
+	//the state is up to a few steps old, the boids are drawn moved on by their velocity
+	float extrapolate = (float)(timeRender - slot->timeState);
+	if (extrapolate < 0.0f)
+		extrapolate = 0.0f;
+
+	if (instancer != NULL && slot->pos >= 0 && slot->vel >= 0){
+		unsigned int components = slot->attribs[slot->pos].size == 2 ? 2 : 4;
+		instancer->draw(stream(slot, slot->pos), stream(slot, slot->vel), stream(slot, slot->color), stream(slot, slot->group), components, slot->count, extrapolate, model->getShader());
+	}
+	else
+	{
+		model->bindShader();
+		GLint loc = glGetUniformLocation(model->getShader()->id(), "extrapolate");
+		if (loc >= 0)
+			glUniform1f(loc, extrapolate);
+
+		glBindVertexArray(slot->vao);
+		glDrawArrays(GL_POINTS, 0, slot->count);
+		glBindVertexArray(0);
+		model->unbindShader();
+	}
+
+	if (measure){
+		glEndQuery(GL_TIME_ELAPSED);
+		drawQueryPending = true;
+	}
+
+	if (slot->drawn != NULL)
+		glDeleteSync(slot->drawn);
+	slot->drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+}
+
+Shader* RenderRing::getShader(){
+	return model->getShader();
+}
+
+void RenderRing::bindShader(){
+	model->bindShader();
+}
+
+void RenderRing::unbindShader(){
+	model->unbindShader();
+}
+
+float RenderRing::getPublishTime(){
+	return timePublish;
+}
+
+float RenderRing::getAcquireTime(){
+	return timeAcquire;
+}
+
+bool RenderRing::hasGLEvent(){
+	return glEvent;
+}
+
+float RenderRing::getDrawTime(){
+	return timeDraw;
+}
+
+BoidInstancer* RenderRing::getInstancer(){
+	return instancer;
+}
+
+BoidInstancer::stream_t RenderRing::stream(slot_t* slot, int a){
+	BoidInstancer::stream_t s;
+	s.buffer = 0;
+	s.stride = 0;
+	s.offset = 0;
+
+	if (a >= 0){
+		s.buffer = slot->buffers[slot->attribs[a].buffer];
+		s.stride = slot->attribs[a].stride;
+		s.offset = (GLuint)slot->attribs[a].offset;
+	}
+	return s;
+}
+
+void RenderRing::captureLayout(GLuint vao){
+	layout_t layout;
+	layout.vao = vao;
+	layout.pos = -1;
+	layout.vel = -1;
+	layout.color = -1;
+	layout.group = -1;
+
+	//the attributes are told apart by their names in the shader of the model
+	GLuint program = model->getShader()->id();
+	GLint posLoc = glGetAttribLocation(program, "coord3d");
+	GLint velLoc = glGetAttribLocation(program, "vel3d");
+	if (posLoc < 0){
+		posLoc = glGetAttribLocation(program, "coord2d");
+		velLoc = glGetAttribLocation(program, "vel2d");
+	}
+	GLint colorLoc = glGetAttribLocation(program, "color");
+	GLint groupLoc = glGetAttribLocation(program, "group");
+
+	GLint maxAttribs;
+	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttribs);
+	glBindVertexArray(vao);
+
+	for (GLint i = 0; i < maxAttribs; i++){
+		GLint enabled, buffer, size, type, normalized, stride;
+		GLvoid* pointer;
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+		if (!enabled || buffer == 0)
+			continue;
+
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+		glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+
+		//attributes reading the same buffer share its copy
+		unsigned int b = 0;
+		while (b < layout.buffers.size() && layout.buffers[b] != (GLuint)buffer)
+			b++;
+		if (b == layout.buffers.size())
+			layout.buffers.push_back(buffer);
+
+		attrib_t a;
+		a.index = i;
+		a.size = size;
+		a.type = type;
+		a.normalized = (GLboolean)normalized;
+		a.stride = stride;
+		a.offset = (GLintptr)pointer;
+		a.buffer = b;
+
+		int n = (int)layout.attribs.size();
+		if (i == posLoc)
+			layout.pos = n;
+		else if (i == velLoc)
+			layout.vel = n;
+		else if (i == colorLoc)
+			layout.color = n;
+		else if (i == groupLoc)
+			layout.group = n;
+		layout.attribs.push_back(a);
+	}
+
+	glBindVertexArray(0);
+	layouts.push_back(layout);
+}
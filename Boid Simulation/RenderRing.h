@@ -0,0 +1,127 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _RENDERRING_H_
+#define _RENDERRING_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "boidModel.h"
+#include "renderable.h"
+#include "boidInstancer.h"
+
+/*
+	Ring of three copies of the buffers a boid model draws from. The simulation thread copies the
+	buffers of the latest state into the write slot and publishes it, the render thread draws the
+	newest published slot while the next state is simulated. GL sync objects order the copies against
+	the draw calls on the GPU, neither thread waits for the other. The attribute layout is read from
+	the VAOs of the model, VAOs are not shared between contexts so this happens on the render thread.
+	With INSTANCED_RENDERING the slots are drawn by a BoidInstancer instead of the geometry shader.
+*/
+class RenderRing : public Renderable
+{
+public:
+	RenderRing(CLHelper* clHlpr);
+	~RenderRing();
+
+	// start over with a new model, called on the render thread while no simulation step runs
+	void reset(BoidModel* boidModel);
+	// simulation thread: copy the buffers of the current state into the write slot and publish it,
+	// timeState is the real time in seconds the state belongs to
+	void publish(double timeState);
+	// render thread: real time in seconds of the frame, the boids are moved on by their velocity up to it
+	void setRenderTime(double timeNow);
+	// render thread: camera of the next frames for the culling of the instanced rendering
+	void setView(const glm::mat4 &viewProjection);
+
+	// override Renderable
+	void render();
+	Shader* getShader();
+	void bindShader();
+	void unbindShader();
+
+	// time of the last publish in ms (wait for the CL queue and the GPU copies)
+	float getPublishTime();
+	// time the render thread needed to take the newest slot in ms
+	float getAcquireTime();
+	// true if the CL queue is synchronized implicitly by cl_khr_gl_event
+	bool hasGLEvent();
+	// GPU time of drawing the boids in ms, measured a few frames late
+	float getDrawTime();
+	// the boids are drawn instanced, NULL if the geometry shader of the model is used
+	BoidInstancer* getInstancer();
+
+private:
+	typedef struct{
+		GLuint index;
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride;
+		GLintptr offset;
+		// index into the buffers of the layout and of the slots
+		unsigned int buffer;
+	} attrib_t;
+
+	// attributes of one VAO of the model and the buffers they read
+	typedef struct{
+		GLuint vao;
+		std::vector<GLuint> buffers;
+		std::vector<attrib_t> attribs;
+		// index into attribs of position, velocity, color and group id, -1 if the model has none
+		int pos, vel, color, group;
+	} layout_t;
+
+	typedef struct{
+		std::vector<GLuint> buffers;
+		std::vector<GLint> bufferSize;
+		std::vector<attrib_t> attribs;
+		int pos, vel, color, group;
+		// VAO of the render context
+		GLuint vao;
+		// the copies of publish are done, waited for before drawing
+		GLsync copied;
+		// the draw calls of the slot are done, waited for before the next copy
+		GLsync drawn;
+		int count;
+		double timeState;
+	} slot_t;
+
+	// read the attributes of vao, render thread only
+	void captureLayout(GLuint vao);
+	// the attribute a of the slot as a stream of the instancer
+	BoidInstancer::stream_t stream(slot_t* slot, int a);
+
+	CLHelper* clHelper;
+	BoidModel* model;
+	bool glEvent;
+
+	slot_t slots[3];
+	// slot written by the simulation, newest published slot and the slot drawn
+	int writeSlot;
+	int readySlot;
+	int renderSlot;
+	// readySlot holds a state which was not drawn yet
+	bool fresh;
+
+	std::vector<layout_t> layouts;
+	// VAO of the model the simulation thread needs the layout of, 0 if none
+	GLuint layoutRequest;
+	std::mutex ringMutex;
+
+	BoidInstancer* instancer;
+	// elapsed time of the draw calls, read once the GPU is done with them
+	GLuint drawQuery;
+	bool drawQueryPending;
+
+	double timeRender;
+	float timePublish;
+	float timeAcquire;
+	float timeDraw;
+};
+
+#endif
@@ -1,13 +1,18 @@
 #include "stdafx.h"
 #include "shader.h"
+#include "simParam.h"
 
 #define GL_GEOMETRY_SHADER 0x8DD9
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
 
 using namespace std; // Include the standard namespace
 
 /**
 textFileRead loads in a standard text file from a given filename and
-then returns it as a string.
+then returns it as a string. The limits shared with the host code are
+defined right behind the #version line.
 */
 static string textFileRead(const char *fileName) {
 	string fileString = string(); // A string for storing the file contents
@@ -19,6 +24,8 @@ static string textFileRead(const char *fileName) {
 			getline(file, line); // Get the current line
 			fileString.append(line); // Append the line to our file string
 			fileString.append("\n"); // Appand a new line character
+			if (line.find("#version") != string::npos) // Nothing but comments may come before #version
+				fileString.append("#define NUM_GROUPS_MAX " + to_string(NUM_GROUPS_MAX) + "\n");
 		}
 		file.close(); // Close the file
 	}
@@ -92,6 +99,16 @@ Shader::Shader(const char *vsFile, const char *fsFile, const char *gsFile){
 	init_withGeo(_vsFile.c_str(), _fsFile.c_str(), _gsFile.c_str());
 }
 
+/**
+  Constructor for a Shader object with a single compute shader, needs OpenGL 4.3.
+*/
+Shader::Shader(const char *csFile){
+	inited = false;
+
+	std::string _csFile = shader_path + csFile;
+	init_compute(_csFile.c_str());
+}
+
 /**
 init will take a vertex shader file and fragment shader file, and then attempt to create a valid
 shader program from these. It will also check for any shader compilation issues along the way.
@@ -101,6 +118,7 @@ void Shader::init(const char *vsFile, const char *fsFile) {
 		return;
 
 	hasGeo = false;
+	isCompute = false;
 	inited = true; // Mark that we have initialized the shader
 
 	shader_vp = glCreateShader(GL_VERTEX_SHADER); // Create a vertex shader
@@ -138,6 +156,7 @@ void Shader::init_withGeo(const char *vsFile, const char *fsFile, const char *gs
 		return;
 
 	hasGeo = true;
+	isCompute = false;
 	inited = true; // Mark that we have initialized the shader
 
 	shader_vp = glCreateShader(GL_VERTEX_SHADER); // Create a vertex shader
@@ -178,11 +197,42 @@ void Shader::init_withGeo(const char *vsFile, const char *fsFile, const char *gs
 	validateProgram(shader_id); // Validate the shader program
 }
 
+void Shader::init_compute(const char *csFile){
+	if (inited) // If we have already initialized the shader
+		return;
+
+	hasGeo = false;
+	isCompute = true;
+	inited = true; // Mark that we have initialized the shader
+
+	shader_cp = glCreateShader(GL_COMPUTE_SHADER); // Create a compute shader
+
+	string csText = textFileRead(csFile); // Read in the compute shader
+	const char *computeText = csText.c_str();
+
+	glShaderSource(shader_cp, 1, &computeText, 0); // Set the source for the compute shader to the loaded text
+	glCompileShader(shader_cp); // Compile the compute shader
+	validateShader(shader_cp, csFile); // Validate the compute shader
+
+	shader_id = glCreateProgram(); // Create a GLSL program
+	glAttachShader(shader_id, shader_cp); // Attach the compute shader to the program
+
+	glLinkProgram(shader_id); // Link the compute shader in the program
+	validateProgram(shader_id); // Validate the shader program
+}
+
 /**
 Deconstructor for the Shader object which cleans up by detaching the shaders, deleting them
 and finally deleting the GLSL program.
 */
 Shader::~Shader() {
+	if (isCompute){
+		glDetachShader(shader_id, shader_cp);
+		glDeleteShader(shader_cp);
+		glDeleteProgram(shader_id);
+		return;
+	}
+
 	glDetachShader(shader_id, shader_fp); // Detach the fragment shader
 	glDetachShader(shader_id, shader_vp); // Detach the vertex shader
 
@@ -8,10 +8,12 @@ public:
 	Shader(); // Default constructor
 	Shader(const char *vsFile, const char *fsFile); // Constructor for creating a shader from two shader filenames
 	Shader(const char *vsFile, const char *fsFile, const char *gsFile); //Constructor with additional geometry shader
+	Shader(const char *csFile); //Constructor for a compute shader program
 	~Shader(); // Deconstructor for cleaning up
 
 	void init(const char *vsFile, const char *fsFile); // Initialize our shader file if we have to
 	void init_withGeo(const char *vsFile, const char *fsFile, const char *gsFile);
+	void init_compute(const char *csFile);
 
 	void bind(); // Bind our GLSL shader program
 	void unbind(); // Unbind our GLSL shader program
@@ -23,8 +25,10 @@ private:
 	unsigned int shader_vp; // The vertex shader identifier
 	unsigned int shader_fp; // The fragment shader identifier
 	unsigned int shader_gp;
+	unsigned int shader_cp; // The compute shader identifier
 
 	bool hasGeo;
+	bool isCompute;
 	bool inited; // Whether or not we have initialized the shader
 };
 #endif
\ No newline at end of file
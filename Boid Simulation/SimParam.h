@@ -12,11 +12,171 @@
 #define USE_SH_FOR_PATH TRUE
 #define USE_LOOKAHEAD FALSE
 
+//lazy update of the per cell SH coefficients of the wayfinding model
+//a cell is only projected again if its boid count changed or its velocity sum
+//moved more than LAZY_SH_TOLERANCE * count since the last projection
+#define LAZY_SH_UPDATE TRUE
+#define LAZY_SH_TOLERANCE 0.5f
+//every n-th step a full projection is done to measure the error of the cached field (0 = off)
+#define LAZY_SH_VALIDATE_INTERVAL 60
+
+//multi-rate SH far field of the wayfinding model
+//0 - far field is evaluated per boid in every step
+//k - per cell far field correction is refreshed every k steps, near field rules run every step
+#define SH_FAR_FIELD_INTERVAL 4
+//refresh 1/k of the cells every step instead of all cells every k-th step
+#define SH_FAR_FIELD_ROUND_ROBIN TRUE
+//every n-th step the cached far field is compared to a full evaluation of all cells, on the
+//step before a refresh cycle ends when the cache is oldest (0 = off)
+#define SH_FAR_FIELD_VALIDATE_INTERVAL 120
+
+//SH band order (1-3) of the SH models, all evaluate the basis of kernels/sh_basis.cl
+//order L keeps L*L coefficients per cell or agent and velocity component, L = 2 halves the bandwidth
+#define SH_ORDER_SH 3
+#define SH_ORDER_SH_WAY1 3
+#define SH_ORDER_SH_WAY2 3
+#define SH_ORDER_SH_OBSTACLE 3
+#define SH_ORDER_SH_COMBINED 3
+#define SH_ORDER_SH_TUNNEL 3
+
+//goal seeking of the SH way following 1, SH obstacle, combined and tunnel models along flow fields,
+//one per distinct goal. With more distinct goals (e.g. every agent its own) agents walk the straight
+//path (0 = off)
+#define FLOW_FIELD_MAX_GOALS 8
+
+//size of the group table (goal, color, weights, max velocity) of the way following, combined and
+//tunnel models, every boid carries a one byte group id. Also the size of groupColor in the shaders,
+//the shader sources get it as a #define
+#define NUM_GROUPS_MAX 8
+
+//nodes per cell edge of the baked obstacle field of the SH obstacle model
+#define OBSTACLE_FIELD_RES 4
+//OBJ mesh (world coordinates) voxelized into a signed distance field and baked into the obstacle
+//field of the SH obstacle model, cached as <mesh>.sdf next to it ("" = no mesh)
+#define OBSTACLE_MESH ""
+//repulsion of the mesh along its distance field gradient, it starts at distance SDF_RANGE_SH_OBSTACLE
+//and grows quadratically towards the surface (simParams.factorSDF, simParams.sdfRange)
+#define FACTOR_SDF_SH_OBSTACLE 8.f
+#define SDF_RANGE_SH_OBSTACLE 20.f
+//moved obstacles update the field incrementally, every n-th update it is baked from scratch
+#define OBSTACLE_REBAKE_INTERVAL 60
+//the incremental update covers the nodes within this many cells around the old and new placement
+//of a moved obstacle, the repulsion further out is left for the next bake
+#define OBSTACLE_UPDATE_RANGE 4
+//moving obstacle demo of the SH obstacle model (key m): the middle column moves back and forth
+//amplitude in cells along the x axis and period in seconds
+#define MOVING_OBSTACLE_AMPLITUDE 3.0f
+#define MOVING_OBSTACLE_PERIOD 8.0f
+
+//SH basis of the wayfinding model from a lookup table indexed by the relative cell offset
+//instead of evaluating it for every boid and cell (default of the model constructor). Used by
+//farFieldSH with SH_FAR_FIELD_INTERVAL > 0 and by the per boid useSH with 0. Both bases are timed
+//on the far field once after the first projection and logged
+#define SH_BASIS_LOOKUP TRUE
+
+//long range SH term of the SH way following 2 model against per cell aggregates instead
+//of every single boid (boids of the 27 surrounding cells are still taken one by one)
+#define SH_WAY2_CELL_AGGREGATE TRUE
+//every n-th step the per boid kernel runs as reference to measure the deviation (0 = off)
+#define SH_WAY2_VALIDATE_INTERVAL 120
+//SH channels per cell of the SH way following 2 model, boids of group g are projected into
+//channel min(g, n - 1) so opposing groups in a cell do not cancel out (1 = all groups merged).
+//Way following 1 caches its far field per cell and applies it to all boids of the cell, so it
+//has no channels: the own group weight would need a cached correction per cell and channel
+#define SH_WAY2_GROUP_CHANNELS 4
+//weight of the SH contributions of the own group and of the other groups
+#define SH_WAY2_WEIGHT_OWN_GROUP 1.0f
+#define SH_WAY2_WEIGHT_OTHER_GROUP 1.0f
+//boids slower than this fraction of the maximum velocity count as congested
+#define SH_WAY2_CONGESTION_SPEED 0.25f
+
+//level of detail tiers of the SH way following 2 model, boids of cells outside the region of
+//interest move with the mean velocity of their cell and the SH field only
+#define LOD_TIERS FALSE
+//cells farther away from the camera than this (world units) are outside the region of interest
+#define LOD_DISTANCE 200.0f
+//cells with at least this many boids always run the full rules
+#define LOD_DENSE_COUNT 64
+//the tiers are assigned again every n steps
+#define LOD_UPDATE_INTERVAL 10
+//maximum number of region of interest boxes
+#define LOD_MAX_BOXES 4
+
+//the simulation runs in its own thread with a GL context shared with the window, FALSE to simulate in the render loop.
+//The thread is only started if the driver reports its GL context on the device of the CL context
+#define SIM_THREAD TRUE
+//fixed time step of the simulation in seconds
+#define SIM_FIXED_DT (1.0 / 120.0)
+//maximum number of fixed steps to catch up with the real time, the remaining time is dropped
+#define SIM_MAX_SUBSTEPS 8
+
 //draw triangles instead of points
 #define TRIANGLE FALSE
 
+//recorded frames advance the simulation by this time in seconds, independent of how long they take
+#define RECORD_FRAME_DT (1.0 / 60.0)
+//pixel buffer objects in flight, a frame is read back this many frames after it was drawn
+#define RECORD_PBO_COUNT 4
+//threads which encode and write the recorded frames
+#define RECORD_WRITER_THREADS 4
+//frames waiting for a writer before the render loop waits for them
+#define RECORD_MAX_QUEUE 16
+
+//draw the boids instanced with frustum culling and level of detail on the GPU, needs OpenGL 4.3.
+//FALSE or an older context draws them with the geometry shader of the model
+#define INSTANCED_RENDERING TRUE
+//boids whose glyph is shorter than this on screen (pixels) are drawn as points
+#define INSTANCE_LOD_PIXELS 3.0f
+//size of the points of far boids in pixels
+#define INSTANCE_POINT_SIZE 2.0f
+
 //path for the folder where log files are stored
 #define LOG_PATH_WIN ".\\logs"
+//format of the log file: LogFile::FORMAT_TEXT, FORMAT_JSON (one object per line) or FORMAT_BINARY
+#define LOG_FORMAT LogFile::FORMAT_TEXT
+//entries below this severity are dropped by the producer (LogFile::LOG_DEBUG .. LOG_ERROR)
+#define LOG_LEVEL LogFile::LOG_INFO
+//entries the log buffers before the flusher writes them, a power of two. Entries of a full buffer are dropped and counted
+#define LOG_RING_SIZE 4096
+//time the flusher sleeps when there is nothing to write in ms
+#define LOG_FLUSH_INTERVAL 5
+
+//trace every OpenCL command and the host phases, key P writes the timeline (Chrome trace JSON)
+#define TRACE_ENABLED TRUE
+//path for the folder where traces are stored
+#define TRACE_PATH_WIN ".\\traces"
+//frames the trace keeps, older records are dropped
+#define TRACE_FRAMES 300
+//frames written by key P
+#define TRACE_DUMP_FRAMES 120
+//upper bound of kept and of uncollected records, protects the memory if the frames stall
+#define TRACE_MAX_RECORDS 200000
+
+//serve the metrics in the Prometheus text format on http://127.0.0.1:METRICS_PORT/metrics
+#define METRICS_ENABLED TRUE
+#define METRICS_PORT 9464
+//buckets per power of two of the latency histograms, 2^-METRICS_SUB_BITS relative error of the quantiles
+#define METRICS_SUB_BITS 4
+//latencies up to 2^METRICS_MAX_BITS ns (about 18 minutes), longer ones go into the last bucket
+#define METRICS_MAX_BITS 40
+
+//largest k of the nearest neighbour queries, private memory of the query kernel grows with it
+#define QUERY_MAX_K 32
+//query points of each batch of the query benchmark (key B)
+#define QUERY_BENCH_POINTS 16384
+//radius of the benchmark radius queries in cells and k of the benchmark nearest queries
+#define QUERY_BENCH_RADIUS 1.0f
+#define QUERY_BENCH_K 8
+
+//the entrance of the entrance and exit demo (key E) spawns as many boids as were alive at its start in this many seconds
+#define POPULATION_DEMO_SECONDS 10.0f
+
+//rebuild changed kernel sources and apply the parameter file while the model runs, see LiveTuning
+#define LIVE_TUNING_ENABLED TRUE
+//time between two looks at the kernel sources and the parameter file in ms
+#define LIVE_TUNING_POLL_MS 250
+//file with "name value" lines for the tunable simulation parameters
+#define LIVE_PARAMS_FILE "../../liveParams.txt"
 
 //edge size of skybox
 #define SKYBOX_SIZE 1200.f
@@ -90,9 +250,12 @@
 #define NUM_BOIDS_SH_2D 65536
 #define NUM_BOIDS_GRID_2D 65536
 
-//minimum number of boids user can set the simulation too
+//minimum and maximum number of boids user can set the simulation too. Counts stay powers of two for
+//the bitonic sort, which merges in global memory above LOCAL_SIZE_LIMIT and has no upper bound of its
+//own. 2^22 boids take 64 MB per float4 buffer (32 MB per float2 buffer of the 2D models), below the
+//smallest CL_DEVICE_MAX_MEM_ALLOC_SIZE of the targeted GPUs
 #define NUM_BOIDS_MIN 2048
-#define NUM_BOIDS_MAX 524288
+#define NUM_BOIDS_MAX 4194304
 
 //OCL local memory usage sizes
 
@@ -191,6 +354,11 @@
 #define MODEL_INIT_PLACEMENT 0
 #define MODEL_INIT_PLACEMENT_MAX 5
 
+//the placements 0, 1, 3 and 4 give every boid its own goal like the test cases of the paper. TRUE:
+//the boids of the way following, combined and tunnel models seek the common goal of their group
+//instead and carry no goal
+#define GROUP_SHARED_GOALS FALSE
+
 //GFX Camera preset positions
 //0 - standard Camera Position
 //1 - Camera Position for SH
@@ -22,20 +22,48 @@ Simulation::Simulation() {
 	simParams.localSize = LOCAL_SIZE_VEC4;
 	simParams.maxVel = MAX_VEL_SIMPLE;
 	simParams.maxVelCor = MAX_VEL_COR_SIMPLE;
+	simParams.factorSDF = FACTOR_SDF_SH_OBSTACLE;
+	simParams.sdfRange = SDF_RANGE_SH_OBSTACLE;
 
 	pos.resize(simParams.numBodies);
 	vel.resize(simParams.numBodies);
 	goal.resize(simParams.numBodies);
-	color.resize(simParams.numBodies);
+	group.resize(simParams.numBodies);
 
 	currentInitPlacement = MODEL_INIT_PLACEMENT;
-	createData(&pos, &vel, &goal, &color);
+	createData(&pos, &vel, &goal, &group, &groups);
 
 	logFile = new LogFile("OCL Boid ");
 	clHelper = new CLHelper(logFile);
 
 	currentModel = BOID_SIMPLE;
 	boidModel = new BoidModelSimple(clHelper, pos, vel, &simParams);
+	obstacleModel = NULL;
+	movingObstacle = false;
+	obstacleTime = 0.0f;
+
+	timeDiff = 0.0f;
+	timeAccumulator = 0.0;
+	stepsCounted = 0;
+	stepRate = 0.0f;
+	simRunning = false;
+	simDC = NULL;
+	simContext = NULL;
+	frameTime = 0.0;
+	timeFrames = 0.0;
+	stepsTotal = 0;
+	frameStepsStart = 0;
+	framesOverlapped = 0;
+	framesCounted = 0;
+	frameOverlap = 0.0f;
+	roiPending = false;
+
+	agentsGauge = Metrics::getInstance().gauge("boids_agents", "Boids of the current model");
+	occupiedCellsGauge = Metrics::getInstance().gauge("boids_occupied_cells", "Grid cells with at least one boid, 0 for models without a grid");
+	maxOccupancyGauge = Metrics::getInstance().gauge("boids_max_cell_occupancy", "Boids in the fullest grid cell, 0 for models without a grid");
+
+	liveTuning = new LiveTuning(clHelper);
+	liveTuning->watch(boidModel->getPrograms());
 	
 	worldBox = new WorldBox(simParams.gridSize.x, TRUE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 	worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
@@ -49,8 +77,11 @@ Simulation::Simulation() {
 	tunnel = new Tunnel(false, simParams.cellSize.x, simParams.cellSize.y, simParams.cellSize.z, 3, 3, 5, 5);
 
 	renderList = std::vector<Renderable*>(9);
+	renderRing = new RenderRing(clHelper);
+	renderRing->reset(boidModel);
+
 	renderList[0] = worldBox;
-	renderList[1] = boidModel;
+	renderList[1] = renderRing;
 	renderList[2] = overlayText;
 	renderList[3] = worldGround;
 	renderList[4] = skybox;
@@ -84,19 +115,24 @@ void Simulation::init() {
 }
 
 void Simulation::restart(int modelNum){
+	TraceSpan span("Simulation::restart");
 	delete boidModel;
 	delete worldBox;
 	delete worldGround;
 	std::vector<Vec4> cor(3 *(10 * 12 + 2 * 5)); std::vector<unsigned int> start(3 * 42); std::vector<unsigned int> end(3 * 42); std::vector<Vec4> posObst(3 * 42);
 	std::vector<Vec4> cor2(406); std::vector<unsigned int> start2(208); std::vector<unsigned int> end2(208); std::vector<Vec4> posObst2(208);
+
+	obstacleModel = NULL;
+	obstacleTime = 0.0f;
+	column2->setTranslation(0.0f, 0.0f, 0.0f);
 	
 	switch (modelNum){
 		case BOID_SIMPLE:
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -111,8 +147,8 @@ void Simulation::restart(int modelNum){
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -127,8 +163,8 @@ void Simulation::restart(int modelNum){
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -143,8 +179,8 @@ void Simulation::restart(int modelNum){
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -159,8 +195,8 @@ void Simulation::restart(int modelNum){
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -174,38 +210,38 @@ void Simulation::restart(int modelNum){
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
 			column3->setVisibility(false);
 			tunnel->setVisibility(false);
 
-			boidModel = new BoidModelSHWay1(clHelper, pos, vel, goal, color, &simParams);
+			boidModel = new BoidModelSHWay1(clHelper, pos, vel, group, groups, goalsShared ? std::vector<Vec4>() : goal, &simParams);
 			worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 			break;
 		case BOID_SH_WAY2:
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
 			column3->setVisibility(false);
 			tunnel->setVisibility(false);
 
-			boidModel = new BoidModelSHWay2(clHelper, pos, vel, goal, color, &simParams);
+			boidModel = new BoidModelSHWay2(clHelper, pos, vel, group, groups, goalsShared ? std::vector<Vec4>() : goal, &simParams);
 			worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 			break;
 		case BOID_SH_OBSTACLE:
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(true);
 			column2->setVisibility(true);
@@ -215,15 +251,20 @@ void Simulation::restart(int modelNum){
 			column1->getObstacleForce(&cor, &start, &end, &posObst, 0);
 			column2->getObstacleForce(&cor, &start, &end, &posObst, 42);
 			column3->getObstacleForce(&cor, &start, &end, &posObst, 84);
-			boidModel = new BoidModelSHObstacle(clHelper, pos, vel, goal, &simParams, cor, start, end, posObst);
+			obstacleModel = new BoidModelSHObstacle(clHelper, pos, vel, goal, &simParams, cor, start, end, posObst);
+			//every column is a rigid obstacle which can be moved without a restart
+			obstacleModel->addObstacle(0, 42);
+			obstacleModel->addObstacle(42, 42);
+			obstacleModel->addObstacle(84, 42);
+			boidModel = obstacleModel;
 			worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 			break;
 		case BOID_SH_OBSTACLE_COMBINED:
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(true);
 			column2->setVisibility(true);
@@ -233,15 +274,15 @@ void Simulation::restart(int modelNum){
 			column1->getObstacleForce(&cor, &start, &end, &posObst, 0);
 			column2->getObstacleForce(&cor, &start, &end, &posObst, 42);
 			column3->getObstacleForce(&cor, &start, &end, &posObst, 84);
-			boidModel = new BoidModelSHCombined(clHelper, pos, vel, goal, color, &simParams, cor, start, end, posObst);
+			boidModel = new BoidModelSHCombined(clHelper, pos, vel, group, groups, goalsShared ? std::vector<Vec4>() : goal, &simParams, cor, start, end, posObst);
 			worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 			break;
 		case BOID_SH_OBSTACLE_TUNNEL:
 			pos.resize(simParams.numBodies);
 			vel.resize(simParams.numBodies);
 			goal.resize(simParams.numBodies);
-			color.resize(simParams.numBodies);
-			createData(&pos, &vel, &goal, &color);
+			group.resize(simParams.numBodies);
+			createData(&pos, &vel, &goal, &group, &groups);
 
 			column1->setVisibility(false);
 			column2->setVisibility(false);
@@ -249,42 +290,233 @@ void Simulation::restart(int modelNum){
 			tunnel->setVisibility(true);
 
 			tunnel->getObstacleForce(&cor2, &start2, &end2, &posObst2, 0);
-			boidModel = new BoidModelSHObstacleTunnel(clHelper, pos, vel, goal, color, &simParams, cor2, start2, end2, posObst2);
+			boidModel = new BoidModelSHObstacleTunnel(clHelper, pos, vel, group, groups, goalsShared ? std::vector<Vec4>() : goal, &simParams, cor2, start2, end2, posObst2);
 			worldGround = new WorldGround(FALSE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 			break;
 	}
 
 	worldBox = new WorldBox(simParams.gridSize.x, TRUE, simParams.gridSize.x, simParams.gridSize.y, simParams.gridSize.z);
 	renderList[3] = worldGround;
-	renderList[1] = boidModel;
 	renderList[0] = worldBox;
+	renderRing->reset(boidModel);
+	boidModel->setProbes(probes);
+	boidModel->setSources(emitters, sinks);
+	liveTuning->watch(boidModel->getPrograms());
+
+	//the simulation thread uses the new VBOs from its own context
+	glFinish();
+	timeAccumulator = 0.0;
 }
 
 
 void Simulation::start(){
+	//a GL driver without a CL device to share with (e.g. software GL) leaves the VBOs empty
+	if (initOk && GFX::getInstance().isRecording() && !clHelper->sharesWithCurrentGL()){
+		clHelper->log("ERROR: the CL device does not share the GL context, nothing can be recorded");
+		initOk = false;
+	}
+
 	if (initOk){
-		timeLast = GetTickCount64();
+		//recorded frames advance the simulation by a fixed time each, however long they take
+		if (GFX::getInstance().isRecording())
+			frameTime = RECORD_FRAME_DT;
+
+		timeLast = getTime();
+		timeRateStart = timeLast;
+		Tracer::getInstance().setThreadName("render");
+
+		if (METRICS_ENABLED){
+			if (Metrics::getInstance().start())
+				clHelper->log("metrics served on http://127.0.0.1:" + std::to_string(METRICS_PORT) + "/metrics");
+			else
+				clHelper->log("metrics endpoint could not bind port " + std::to_string(METRICS_PORT));
+		}
+
+		if (LIVE_TUNING_ENABLED)
+			liveTuning->start();
+
+#if SIM_THREAD
+		//the simulation thread gets its own GL context which shares the VBOs with the window
+		simDC = wglGetCurrentDC();
+		if (frameTime > 0.0)
+			clHelper->log("recording frames, simulating in the render loop");
+		else if ((simContext = wglCreateContext(simDC)) != NULL && wglShareLists(wglGetCurrentContext(), simContext)){
+			//the CL context was created with the window context, the simulation thread acquires the
+			//VBOs while its own context is current. cl_khr_gl_sharing allows this within one share
+			//group, drivers only do it right if both contexts are served by the device of the CL context
+			HGLRC windowContext = wglGetCurrentContext();
+			wglMakeCurrent(simDC, simContext);
+			bool shared = clHelper->sharesWithCurrentGL();
+			wglMakeCurrent(simDC, windowContext);
+
+			if (shared){
+				simRunning = true;
+				simThread = std::thread(&Simulation::simulationLoop, this);
+			}
+			else{
+				clHelper->log("the GL context of the simulation thread is not on the CL device, simulating in the render loop");
+				wglDeleteContext(simContext);
+				simContext = NULL;
+			}
+		}
+		else
+			clHelper->log("no shared GL context for the simulation thread, simulating in the render loop");
+#endif
+
 		GFX::getInstance().startRendering();
+		stop();
+		liveTuning->stop();
+		Metrics::getInstance().stop();
 	}
+
+	//the entries still in the log buffer are written before the program ends
+	logFile->close();
+}
+
+void Simulation::stop(){
+	if (!simRunning)
+		return;
+
+	simRunning = false;
+	simThread.join();
+	wglDeleteContext(simContext);
+	simContext = NULL;
 }
 
-void Simulation::simulationStep(){
-	timeDiff = getTimeDiff();
-	boidModel->simulate(timeDiff);
+void Simulation::simulationLoop(){
+	wglMakeCurrent(simDC, simContext);
+	Tracer::getInstance().setThreadName("simulation");
+	double timeLastStep = getTime();
+
+	while (simRunning){
+		double timeNow = getTime();
+
+		stateMutex.lock();
+		advance(timeNow - timeLastStep);
+		double timeLeft = SIM_FIXED_DT - timeAccumulator;
+		stateMutex.unlock();
+
+		timeLastStep = timeNow;
+
+		//sleep until the next step is due, the sleep of the OS is not finer than about a millisecond
+		if (timeLeft > 0.002)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		else
+			std::this_thread::yield();
+	}
+
+	wglMakeCurrent(NULL, NULL);
+}
+
+void Simulation::advance(double frameTime){
+	unsigned int steps = 0;
+	timeAccumulator += frameTime;
+
+	while (timeAccumulator >= SIM_FIXED_DT && steps < SIM_MAX_SUBSTEPS){
+		simulationStep(SIM_FIXED_DT);
+		timeAccumulator -= SIM_FIXED_DT;
+		steps++;
+	}
+
+	//the simulation can not keep up, the time is dropped instead of falling further behind
+	if (timeAccumulator >= SIM_FIXED_DT)
+		timeAccumulator = fmod(timeAccumulator, SIM_FIXED_DT);
+
+	stepsCounted += steps;
+	stepsTotal += steps;
+
+	//the newest state goes to the render thread, it belongs to the time before the remaining accumulator
+	if (steps > 0)
+		renderRing->publish(getTime() - timeAccumulator);
 }
 
-float Simulation::getTimeDiff(){
-	unsigned long long timeNow = GetTickCount64();
-	float timeReturn = ((float)(timeNow - timeLast) / 1000.f);
+void Simulation::beginFrame(){
+	timeFrames += frameTime;
+	double timeNow = getTime();
+	timeDiff = (float)(timeNow - timeLast);
 	timeLast = timeNow;
 
-	if (timeReturn > 1.f)
-		return 1.f;
-	else
-		return timeReturn;
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (!simRunning)
+			advance(timeDiff);
+
+		if (timeNow - timeRateStart >= 1.0){
+			stepRate = (float)(stepsCounted / (timeNow - timeRateStart));
+			stepsCounted = 0;
+			frameOverlap = framesCounted > 0 ? (float)framesOverlapped / framesCounted : 0.0f;
+			framesOverlapped = 0;
+			framesCounted = 0;
+			timeRateStart = timeNow;
+		}
+	}
+
+	//the frame draws from the ring, the simulation thread goes on with the next step meanwhile
+	renderRing->setRenderTime(timeNow);
+	frameStepsStart = stepsTotal;
+}
+
+void Simulation::endFrame(){
+	//a step finished while this frame was drawn
+	if (stepsTotal != frameStepsStart)
+		framesOverlapped++;
+	framesCounted++;
+}
+
+double Simulation::getTime(){
+	if (frameTime > 0.0)
+		return timeFrames;
+
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+void Simulation::simulationStep(float dt){
+	TraceSpan span("Simulation::simulationStep");
+	//rebuilt kernels and tuned parameters take effect between two steps
+	liveTuning->apply(boidModel, &simParams);
+
+	//camera of the newest frame for the level of detail tiers, the model writes it to the device outside the lock
+	bool roiChanged;
+	glm::mat4 viewProjection;
+	glm::vec3 eye;
+	{
+		std::lock_guard<std::mutex> lock(roiMutex);
+		roiChanged = roiPending;
+		viewProjection = roiViewProjection;
+		eye = roiEye;
+		roiPending = false;
+	}
+	if (roiChanged)
+		boidModel->setRegionOfInterest(viewProjection, eye, roiBoxes);
+
+	//moving obstacle demo, the middle column moves back and forth along the x axis
+	if (obstacleModel != NULL && movingObstacle){
+		obstacleTime += dt;
+		float offset = MOVING_OBSTACLE_AMPLITUDE * simParams.cellSize.x * sin(2.0f * (float)CL_M_PI * obstacleTime / MOVING_OBSTACLE_PERIOD);
+
+		column2->setTranslation(offset, 0.0f, 0.0f);
+		obstacleModel->setObstacleTransform(1, glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f, 0.0f)));
+	}
+
+	boidModel->simulate(dt);
+
+	//the grid is read back only for a scrape of the metrics
+	if (Metrics::getInstance().sampleRequested()){
+		unsigned int occupied = 0, maxCount = 0;
+		boidModel->getCellOccupancy(&occupied, &maxCount);
+		agentsGauge->set(boidModel->getNumBoid());
+		occupiedCellsGauge->set(occupied);
+		maxOccupancyGauge->set(maxCount);
+	}
 }
 
 void Simulation::keyPress(unsigned char key){
+	//models are replaced and changed only between two simulation steps
+	std::lock_guard<std::mutex> lock(stateMutex);
+
 	switch (key)
 	{
 	case '1':	
@@ -414,6 +646,8 @@ void Simulation::keyPress(unsigned char key){
 		simParams.gridSize = make_uint3(GRID_SIZE_X_SH_OBSTACLE, GRID_SIZE_Y_SH_OBSTACLE, GRID_SIZE_Z_SH_OBSTACLE);
 		simParams.numCells = GRID_SIZE_X_SH_OBSTACLE * GRID_SIZE_Y_SH_OBSTACLE * GRID_SIZE_Z_SH_OBSTACLE;
 		simParams.wPath = WEIGHT_GOAL_SH_OBSTACLE;
+		simParams.factorSDF = FACTOR_SDF_SH_OBSTACLE;
+		simParams.sdfRange = SDF_RANGE_SH_OBSTACLE;
 
 		restart(currentModel);
 		GFX::getInstance().setCam(CAMERA_PRESET_SH);
@@ -457,14 +691,64 @@ void Simulation::keyPress(unsigned char key){
 		restart(currentModel);
 		break;
 	case '+':	//increase number of boids
-		simParams.numBodies = simParams.numBodies * 2;
-		restart(currentModel);
+		{
+			//spawned into the free slots, a restart with larger buffers only if they do not fit
+			unsigned int live = boidModel->getNumBoid();
+			if (2 * live > NUM_BOIDS_MAX){
+				clHelper->log("number of boids is at NUM_BOIDS_MAX");
+				break;
+			}
+			if (live > 0 && boidModel->getCapacity() >= 2 * live)
+				boidModel->spawn(createWorldEmitter(), live);
+			else{
+				//after spawns and despawns live is any number, the buffers stay a power of two for
+				//the bitonic sort and the boids beyond 2 * live are despawned again
+				unsigned int capacity = NUM_BOIDS_MIN;
+				while (capacity < 2 * live)
+					capacity <<= 1;
+				simParams.numBodies = capacity;
+				restart(currentModel);
+				if (live > 0 && 2 * live < capacity)
+					boidModel->despawnTo(2 * live);
+			}
+		}
 		break;
 	case '-':	//decrease number of boids
-		simParams.numBodies = simParams.numBodies / 2;
-		if (simParams.numBodies <= NUM_BOIDS_MIN)
-			simParams.numBodies = NUM_BOIDS_MIN;
-		restart(currentModel);
+		{
+			unsigned int live = boidModel->getNumBoid() / 2;
+			if (live <= NUM_BOIDS_MIN)
+				live = NUM_BOIDS_MIN;
+			if (boidModel->getCapacity() > 0)
+				boidModel->despawnTo(live);
+			else{
+				simParams.numBodies = live;
+				restart(currentModel);
+			}
+		}
+		break;
+	case 'e':
+	case 'E':	//toggle an entrance at the low x side of the world and an exit at the high x side
+		if (sinks.empty()){
+			float3 lo = simParams.worldOrigin;
+			float3 size = make_float3(simParams.cellSize.x * simParams.gridSize.x, simParams.cellSize.y * simParams.gridSize.y, simParams.cellSize.z * simParams.gridSize.z);
+			emitter_t entrance;
+			entrance.boxMin = Vec4(lo.x + simParams.cellSize.x, lo.y + 2.f * simParams.cellSize.y, lo.z + 2.f * simParams.cellSize.z, 0.0f);
+			entrance.boxMax = Vec4(lo.x + 2.f * simParams.cellSize.x, lo.y + size.y - 2.f * simParams.cellSize.y, lo.z + size.z - 2.f * simParams.cellSize.z, 0.0f);
+			entrance.velocity = Vec4(simParams.maxVel, 0.0f, 0.0f, 0.0f);
+			entrance.jitter = simParams.maxVel / 4;
+			entrance.rate = boidModel->getNumBoid() / POPULATION_DEMO_SECONDS;
+			//the new boids head for the exit
+			entrance.group = 0;
+			entrance.goal = Vec4(lo.x + size.x - simParams.cellSize.x, lo.y + size.y / 2, lo.z + size.z / 2, 0.0f);
+			emitters.push_back(entrance);
+			sinks.push_back(Vec4(lo.x + size.x - 2.f * simParams.cellSize.x, lo.y, lo.z, 0.0f));
+			sinks.push_back(Vec4(lo.x + size.x, lo.y + size.y, lo.z + size.z, 0.0f));
+		}
+		else{
+			emitters.clear();
+			sinks.clear();
+		}
+		boidModel->setSources(emitters, sinks);
 		break;
 	case 'V':
 	case 'v':	//toggle visibility of world box
@@ -483,6 +767,39 @@ void Simulation::keyPress(unsigned char key){
 	case 'S':
 		skybox->toggleVisibility();
 		break;
+	case 'm':
+	case 'M':	//toggle the moving obstacle demo of the SH obstacle model
+		movingObstacle = !movingObstacle;
+		break;
+	case 'l':
+	case 'L':	//toggle a region of interest box around the center of the world where the groups meet
+		if (roiBoxes.empty()){
+			Vec4 center(simParams.worldOrigin.x + simParams.cellSize.x * simParams.gridSize.x / 2, simParams.worldOrigin.y + simParams.cellSize.y * simParams.gridSize.y / 2, simParams.worldOrigin.z + simParams.cellSize.z * simParams.gridSize.z / 2, 0.0f);
+			Vec4 extent(simParams.cellSize.x * 2, simParams.cellSize.y * 2, simParams.cellSize.z * 2, 0.0f);
+			roiBoxes.push_back(Vec4(center.x - extent.x, center.y - extent.y, center.z - extent.z, 0.0f));
+			roiBoxes.push_back(Vec4(center.x + extent.x, center.y + extent.y, center.z + extent.z, 0.0f));
+		}
+		else
+			roiBoxes.clear();
+		break;
+	case 'p':
+	case 'P':	//write the timeline of the last frames for chrome://tracing or Perfetto
+		clHelper->log("trace written to " + Tracer::getInstance().dump(TRACE_DUMP_FRAMES));
+		break;
+	case 'b':
+	case 'B':	//benchmark the radius and nearest queries on the grid of the current model, written to the log
+		boidModel->benchmarkQueries();
+		break;
+	case 'x':
+	case 'X':	//the first two groups swap their goals, one group table entry each (shared goals only)
+		if (groups.size() >= 2){
+			Vec4 goal0 = groups[0].goal;
+			groups[0].goal = groups[1].goal;
+			groups[1].goal = goal0;
+			boidModel->setGroup(0, groups[0]);
+			boidModel->setGroup(1, groups[1]);
+		}
+		break;
 	case '\033': // escape quits
 	case '\015': // Enter quits
 	case 'Q': // Q quits
@@ -492,15 +809,37 @@ void Simulation::keyPress(unsigned char key){
 	}
 }
 
+void Simulation::setRegionOfInterest(const glm::mat4 &viewProjection, glm::vec3 eye){
+	//called by the render thread, the model takes the camera over in the next step
+	{
+		std::lock_guard<std::mutex> lock(roiMutex);
+		roiViewProjection = viewProjection;
+		roiEye = eye;
+		roiPending = true;
+	}
+	renderRing->setView(viewProjection);
+}
+
 std::vector<Renderable*> Simulation::getRenderList(){
 	return renderList;
 }
 
-void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std::vector<Vec4> *goal, std::vector<Vec4> *color){
+void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std::vector<Vec4> *goal, std::vector<unsigned char> *group, std::vector<group_t> *groups){
 	Vec4 goalT; int j = 0;
+	float sizeX = CELL_SIZE_X * simParams.gridSize.x;
+	float sizeY = CELL_SIZE_Y * simParams.gridSize.y;
+	float sizeZ = CELL_SIZE_Z * simParams.gridSize.z;
+
+	groups->clear();
+	goalsShared = GROUP_SHARED_GOALS;
 
 	switch(currentInitPlacement){
 	case 0:
+		//every boid seeks its start position, with shared goals the group has none and seeks nothing
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ / 2, 0.0f), BOID_COLOR));
+		if (goalsShared)
+			(*groups)[0].wPath = 0.0f;
+
 		for (int i = 0; i < simParams.numBodies; i++)
 		{
 			float x = randFloat(2.f * CELL_SIZE_X, simParams.gridSize.x * CELL_SIZE_X - CELL_SIZE_X * 2.f);
@@ -510,10 +849,14 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i] = Vec4(x, y, z, w);
 			(*vel)[i] = Vec4(randFloat(-simParams.maxVel, simParams.maxVel), randFloat(-simParams.maxVel, simParams.maxVel), randFloat(-simParams.maxVel, simParams.maxVel), 0.f);
 			(*goal)[i] = Vec4(x, y, z, 0.0f);
-			(*color)[i] = BOID_COLOR;
+			(*group)[i] = 0;
 		}
 		break;
 	case 1:
+		//every boid heads for a point in the sphere of the other group, with shared goals for its center
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ * 3 / 4, 0.0f), Vec4(0.17f, 0.37f, 0.21f, 1.f)));
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ / 4, 0.0f), Vec4(0.69f, 0.12f, 0.12f, 1.0f)));
+
 		for (int i = 0; i < simParams.numBodies; i += 2)
 		{
 			float theta = randFloat(0.0f, CL_M_PI);
@@ -527,7 +870,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i] = Vec4(x, y, z, w);
 			(*vel)[i] = Vec4(0.0f, 0.0f, randFloat(0.0f, simParams.maxVel), 0.0f);
 			(*goal)[i + 1] = Vec4(x, y, z, 0.0f);
-			(*color)[i] = Vec4(0.17f, 0.37f, 0.21f, 1.f);
+			(*group)[i] = 0;
 
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
@@ -539,11 +882,14 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i + 1] = Vec4(x, y, z, w);
 			(*vel)[i + 1] = Vec4(0.0f, 0.0f, randFloat(-simParams.maxVel, 0.0f), 0.0f);
 			(*goal)[i] = Vec4(x, y, z, 0.0f);
-			(*color)[i + 1] = Vec4(0.69f, 0.12f, 0.12f, 1.0f);
+			(*group)[i + 1] = 1;
 		}
 		break;
 	case 2:
+		//the boids of a group share their goal anyway
+		goalsShared = true;
 		goalT = Vec4(CELL_SIZE_X * simParams.gridSize.x / 2, CELL_SIZE_Y * simParams.gridSize.y / 2, CELL_SIZE_Z * simParams.gridSize.z * 3 / 4, 0.0f);
+		groups->push_back(createGroup(goalT, Vec4(0.17f, 0.37f, 0.21f, 1.f)));
 
 		for (j; j < simParams.numBodies / 8; j++)
 		{
@@ -558,10 +904,11 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[j] = Vec4(x, y, z, w);
 			(*vel)[j] = Vec4(0.0f, 0.0f, randFloat(0.0f, simParams.maxVel), 0.0f);
 			(*goal)[j] = Vec4(goalT.x, goalT.y, goalT.z, goalT.w);
-			(*color)[j] = Vec4(0.17f, 0.37f, 0.21f, 1.f);
+			(*group)[j] = 0;
 		}
 
 		goalT = Vec4(CELL_SIZE_X * simParams.gridSize.x / 2, CELL_SIZE_Y * simParams.gridSize.y / 2, CELL_SIZE_Z * simParams.gridSize.z / 4, 0.0f);
+		groups->push_back(createGroup(goalT, Vec4(0.69f, 0.12f, 0.12f, 1.0f)));
 
 		for (j; j < simParams.numBodies; j++){
 			float theta = randFloat(0.0f, CL_M_PI);
@@ -575,11 +922,18 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[j] = Vec4(x, y, z, w);
 			(*vel)[j] = Vec4(0.0f, 0.0f, randFloat(-simParams.maxVel, 0.0f), 0.0f);
 			(*goal)[j] = Vec4(goalT.x, goalT.y, goalT.z, goalT.w);
-			(*color)[j] = Vec4(0.69f, 0.12f, 0.12f, 1.0f);
+			(*group)[j] = 1;
 		}
 		break;
 
 	case 3:
+		//two pairs of groups, every boid heads for a point in the sphere of the partner group, with
+		//shared goals for its center
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ * 3 / 4, 0.0f), Vec4(0.69f, 0.12f, 0.12f, 1.0f)));
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ / 4, 0.0f), Vec4(0.17f, 0.37f, 0.21f, 1.f)));
+		groups->push_back(createGroup(Vec4(sizeX * 3 / 4, sizeY / 2, sizeZ / 2, 0.0f), Vec4(.77f, 0.59f, 0.09f, 1.0f)));
+		groups->push_back(createGroup(Vec4(sizeX / 4, sizeY / 2, sizeZ / 2, 0.0f), Vec4(0.09f, 0.59f, .77f, 1.0f)));
+
 		for (int i = 0; i < simParams.numBodies; i += 4)
 		{
 			float theta = randFloat(0.0f, CL_M_PI);
@@ -593,7 +947,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i] = Vec4(x, y, z, w);
 			(*vel)[i] = Vec4(0.0f, 0.0f, randFloat(0.0f, simParams.maxVel), 0.0f);
 			(*goal)[i + 1] = Vec4(x, y, z, 0.0f);
-			(*color)[i] = Vec4(0.69f, 0.12f, 0.12f, 1.0f);
+			(*group)[i] = 0;
 
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
@@ -605,7 +959,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i + 1] = Vec4(x, y, z, w);
 			(*vel)[i + 1] = Vec4(0.0f, 0.0f, randFloat(-simParams.maxVel, 0.0f), 0.0f);
 			(*goal)[i] = Vec4(x, y, z, 0.0f);
-			(*color)[i + 1] = Vec4(0.17f, 0.37f, 0.21f, 1.f);
+			(*group)[i + 1] = 1;
 
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
@@ -617,7 +971,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i + 2] = Vec4(x, y, z, w);
 			(*vel)[i + 2] = Vec4(randFloat( 0.0f, simParams.maxVel), 0.0f, 0.0f, 0.0f);
 			(*goal)[i + 3] = Vec4(x, y, z, 0.0f);
-			(*color)[i + 2] = Vec4(.77f, 0.59f, 0.09f, 1.0f);
+			(*group)[i + 2] = 2;
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
 
@@ -628,10 +982,15 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			(*pos)[i + 3] = Vec4(x, y, z, w);
 			(*vel)[i + 3] = Vec4(randFloat(-simParams.maxVel, 0.0f), 0.0f, 0.0f , 0.0f);
 			(*goal)[i + 2] = Vec4(x, y, z, 0.0f);
-			(*color)[i + 3] = Vec4(0.09f, 0.59f, .77f, 1.0f);
+			(*group)[i + 3] = 3;
 		}
 		break;
 	case 4:
+		//crossing groups, every boid heads for a point in a sphere on the opposite side of the world,
+		//with shared goals for its center
+		groups->push_back(createGroup(Vec4(sizeX / 2, sizeY / 2, sizeZ * 3 / 4, 0.0f), Vec4(0.17f, 0.37f, 0.21f, 1.f)));
+		groups->push_back(createGroup(Vec4(sizeX / 4, sizeY / 2, sizeZ / 2, 0.0f), Vec4(0.69f, 0.12f, 0.12f, 1.0f)));
+
 		for (int i = 0; i < simParams.numBodies; i += 2)
 		{
 			float theta = randFloat(0.0f, CL_M_PI);
@@ -644,7 +1003,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			float w = 1.f;
 			(*pos)[i] = Vec4(x, y, z, w);
 			(*vel)[i] = Vec4(0.0f, 0.0f, randFloat(0.0f, simParams.maxVel), 0.0f);
-			(*color)[i] = Vec4(0.17f, 0.37f, 0.21f, 1.f);
+			(*group)[i] = 0;
 
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
@@ -665,7 +1024,7 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 			w = 1.f;
 			(*pos)[i + 1] = Vec4(x, y, z, w);
 			(*vel)[i + 1] = Vec4(randFloat(-simParams.maxVel,0.0f), 0.0f, 0.0f, 0.0f);
-			(*color)[i + 1] = Vec4(0.69f, 0.12f, 0.12f, 1.0f);
+			(*group)[i + 1] = 1;
 
 			theta = randFloat(0.0f, CL_M_PI);
 			phi = randFloat(0.0f, 2 * CL_M_PI);
@@ -680,6 +1039,28 @@ void Simulation::createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std:
 	}
 }
 
+emitter_t Simulation::createWorldEmitter(){
+	emitter_t emitter;
+	emitter.boxMin = Vec4(simParams.worldOrigin.x + 2.f * simParams.cellSize.x, simParams.worldOrigin.y + 2.f * simParams.cellSize.y, simParams.worldOrigin.z + 2.f * simParams.cellSize.z, 0.0f);
+	emitter.boxMax = Vec4(simParams.worldOrigin.x + (simParams.gridSize.x - 2) * simParams.cellSize.x, simParams.worldOrigin.y + (simParams.gridSize.y - 2) * simParams.cellSize.y, simParams.worldOrigin.z + (simParams.gridSize.z - 2) * simParams.cellSize.z, 0.0f);
+	emitter.velocity = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	emitter.jitter = simParams.maxVel;
+	emitter.rate = 0.0f;
+	emitter.group = 0;
+	emitter.goal = groups.empty() ? Vec4(0.0f, 0.0f, 0.0f, 0.0f) : groups[0].goal;
+	return emitter;
+}
+
+group_t Simulation::createGroup(Vec4 goal, Vec4 color){
+	group_t group;
+	group.goal = goal;
+	group.color = color;
+	group.wPath = simParams.wPath;
+	group.wSeparation = simParams.wSeparation;
+	group.maxVel = simParams.maxVel;
+	group.pad = 0.0f;
+	return group;
+}
 
 float Simulation::randFloat(float mn, float mx)
 {
@@ -693,7 +1074,7 @@ long Simulation::getBoidModelSimulationTime(){
 }
 
 int Simulation::getBoidModelNumberOfBoids(){
-	return simParams.numBodies;
+	return boidModel->getNumBoid();
 }
 
 
@@ -707,18 +1088,75 @@ std::vector<const char*> Simulation::getSimTimeDescriptions(){
 	simTimeAll = strstream.str();
 	text[3] = simTimeAll.c_str();
 
+	strstream.str(std::string());
+	strstream << "Simulation: " << stepRate << " steps/s, dt " << SIM_FIXED_DT * 1000 << "ms" << (simRunning ? " (own thread)" : " (render loop)");
+	simRate = strstream.str();
+	text.push_back(simRate.c_str());
+
+	strstream.str(std::string());
+	strstream << "Handoff: publish " << renderRing->getPublishTime() << "ms, acquire " << renderRing->getAcquireTime() << "ms, overlapped " << (int)(100.0f * frameOverlap) << "% of frames" << (renderRing->hasGLEvent() ? " (cl_khr_gl_event)" : " (CL finish)");
+	simHandoff = strstream.str();
+	text.push_back(simHandoff.c_str());
+
+	strstream.str(std::string());
+	strstream << "Render: " << renderRing->getDrawTime() << "ms GPU";
+	if (renderRing->getInstancer() != NULL)
+		strstream << ", " << renderRing->getInstancer()->getNearCount() << " glyphs, " << renderRing->getInstancer()->getFarCount() << " points (instanced)";
+	else
+		strstream << " (geometry shader)";
+	simRender = strstream.str();
+	text.push_back(simRender.c_str());
+
 	return text;
 }
 
-void Simulation::getPosVelOfBoid(unsigned int* boidIndex, float* posX, float* posY, float* posZ, float* velX, float* velY, float* velZ){
-	Vec4 pos, vel;
-	boidModel->getFollowedBoid(boidIndex, &pos, &vel);
+void Simulation::setProbes(const std::vector<unsigned int> &ids){
+	std::lock_guard<std::mutex> lock(stateMutex);
+	probes = ids;
+	boidModel->setProbes(probes);
+}
+
+bool Simulation::getProbes(std::vector<unsigned int>* ids, std::vector<Vec4>* pos, std::vector<Vec4>* vel, std::vector<bool>* alive){
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return boidModel->getProbes(ids, pos, vel, alive);
+}
 
-	*posX = pos.x;
-	*posY = pos.y;
-	*posZ = pos.z;
+unsigned int Simulation::submitRadiusQuery(const std::vector<Vec4> &points, float radius){
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return boidModel->submitRadiusQuery(points, radius);
+}
 
-	*velX = vel.x;
-	*velY = vel.y;
-	*velZ = vel.z;
+unsigned int Simulation::submitNearestQuery(const std::vector<Vec4> &points, unsigned int k){
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return boidModel->submitNearestQuery(points, k);
+}
+
+bool Simulation::getQueryResult(unsigned int ticket, SpatialQuery::result_t* result){
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return boidModel->getQueryResult(ticket, result);
+}
+
+bool Simulation::getPosVelOfBoid(unsigned int boidIndex, float* posX, float* posY, float* posZ, float* velX, float* velY, float* velZ){
+	std::vector<unsigned int> ids;
+	std::vector<Vec4> pos, vel;
+	std::vector<bool> alive;
+	if (!getProbes(&ids, &pos, &vel, &alive))
+		return false;
+
+	for (size_t i = 0; i < ids.size(); i++){
+		if (ids[i] != boidIndex)
+			continue;
+		if (!alive[i])
+			return false;
+
+		*posX = pos[i].x;
+		*posY = pos[i].y;
+		*posZ = pos[i].z;
+
+		*velX = vel[i].x;
+		*velY = vel[i].y;
+		*velZ = vel[i].z;
+		return true;
+	}
+	return false;
 }
\ No newline at end of file
@@ -21,6 +21,10 @@
 #include "skyBox.h"
 #include "column.h"
 #include "tunnel.h"
+#include "renderRing.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "liveTuning.h"
 
 /*
 	Boid simulation controler. Handles interaction between view and model.
@@ -51,26 +55,97 @@ private:
 	std::vector<Vec4> vel;
 	//goal position which is used in some models
 	std::vector<Vec4> goal;
-	//color of boids which is used in some models
-	std::vector<Vec4> color;
+	//group id of boids and the group table (goal, color, weights) which are used in some models
+	std::vector<unsigned char> group;
+	std::vector<group_t> groups;
+	//the boids seek the goal of their group instead of their own goal
+	bool goalsShared;
 
 	//string for complete simulation step time
 	std::string simTimeAll;
 
 	bool initOk;
-	//timestamp when simulation step was done 
-	unsigned long long timeLast;
-	//time difference between two simulation steps
+	//timestamp of the last frame in seconds
+	double timeLast;
+	//time difference between the last two frames
 	float timeDiff;
+	//real time in seconds which is not simulated yet, less than SIM_FIXED_DT after every frame
+	double timeAccumulator;
+	//fixed steps since timeRateStart and the resulting steps per second
+	unsigned int stepsCounted;
+	double timeRateStart;
+	float stepRate;
+	//string for the simulation step rate
+	std::string simRate;
+
+	//time every recorded frame advances the simulation by, 0 if the frames run in real time
+	double frameTime;
+	//time of the recorded frames since the start
+	double timeFrames;
+
+	//serializes the simulation steps against model changes, key presses and the read back of boids
+	std::mutex stateMutex;
+	//the simulation thread runs the fixed steps, false if the render loop runs them
+	std::thread simThread;
+	std::atomic<bool> simRunning;
+	//GL context of the simulation thread, shares all objects with the context of the window
+	HDC simDC;
+	HGLRC simContext;
+	//copies of the latest simulation state the boids are drawn from while the next state is simulated
+	RenderRing* renderRing;
+	//all fixed steps done, frames which overlapped with a step and all frames since timeRateStart
+	std::atomic<unsigned int> stepsTotal;
+	unsigned int frameStepsStart;
+	unsigned int framesOverlapped;
+	unsigned int framesCounted;
+	float frameOverlap;
+	//string for the hand off between simulation and rendering
+	std::string simHandoff;
+	//string for the time and the level of detail of drawing the boids
+	std::string simRender;
+	//gauges of the metrics endpoint, set on the first step after a scrape
+	Metrics::Gauge* agentsGauge;
+	Metrics::Gauge* occupiedCellsGauge;
+	Metrics::Gauge* maxOccupancyGauge;
+	//rebuilds changed kernels and reads the parameter file, both are applied between two steps
+	LiveTuning* liveTuning;
 	//index of current active boid model
 	int currentModel;
 	//index of initial placement of boids
 	int currentInitPlacement;
+	//current model if it is the SH obstacle model with movable obstacles, otherwise NULL
+	BoidModelSHObstacle* obstacleModel;
+	//true to move the middle column in the SH obstacle model
+	bool movingObstacle;
+	//time the obstacle moved since the restart of the model
+	float obstacleTime;
+	//region of interest boxes (min, max pairs) which always run the full rules in models with level of detail tiers
+	std::vector<Vec4> roiBoxes;
+	//camera of the newest frame, handed from the render thread to the next step
+	std::mutex roiMutex;
+	glm::mat4 roiViewProjection;
+	glm::vec3 roiEye;
+	bool roiPending;
+	//boids probed by their index at creation, handed to every new model
+	std::vector<unsigned int> probes;
+	//emitters and sink boxes of the entrance and exit demo, handed to every new model
+	std::vector<emitter_t> emitters;
+	std::vector<Vec4> sinks;
 
 	//create position and velocity data for boids dependend on currentInitPlacement
-	void createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std::vector<Vec4> *goal, std::vector<Vec4> *color);
+	void createData(std::vector<Vec4> *pos, std::vector<Vec4> *vel, std::vector<Vec4> *goal, std::vector<unsigned char> *group, std::vector<group_t> *groups);
+	//emitter over the inside of the world with random velocities up to the maximum velocity
+	emitter_t createWorldEmitter();
+	//group with the weights and maximum velocity of the current simulation parameters
+	group_t createGroup(Vec4 goal, Vec4 color);
 	//restart the simulation
 	void restart(int modelNum);
+	//run as many fixed steps as fit into the not simulated time plus frameTime, at most SIM_MAX_SUBSTEPS
+	void advance(double frameTime);
+	//loop of the simulation thread
+	void simulationLoop();
+	//high resolution time in seconds, the time of the recorded frames while recording
+	double getTime();
 	//create random float between minimum mn and maximum mx
 	float randFloat(float mn, float mx);
 
@@ -82,23 +157,39 @@ public:
 	void init();
 	//start simulation
 	void start();
-	//do a simulation step
-	void simulationStep();
+	//stop the simulation thread
+	void stop();
+	//do a simulation step of dt seconds
+	void simulationStep(float dt);
+	//start a frame, runs the simulation if there is no simulation thread
+	void beginFrame();
+	//end a frame
+	void endFrame();
 	//return complete simulation time
 	long getBoidModelSimulationTime();
 	//return number of boids used in the model
 	int getBoidModelNumberOfBoids();
 	//vector with all strings to be displayed in the overlay
 	std::vector<const char*> getSimTimeDescriptions();
-	//return time difference between to simulation steps
-	float getTimeDiff();
 	//handle key press
 	void keyPress(unsigned char key);
 	//returns vector with all objects to be rendered
 	std::vector<Renderable*> getRenderList();
 
-	//get the velocity and position of a specific boid
-	void getPosVelOfBoid(unsigned int* boidIndex, float* posX, float* posY, float* posZ, float* velX, float* velY, float* velZ);
+	//camera of the current frame, used as region of interest for the level of detail tiers from the next step on
+	void setRegionOfInterest(const glm::mat4 &viewProjection, glm::vec3 eye);
+
+	//boids whose position and velocity are read back after every step, kept over restarts
+	void setProbes(const std::vector<unsigned int> &ids);
+	//position and velocity of the probed boids of a recent step and whether they are alive, false if none arrived yet
+	bool getProbes(std::vector<unsigned int>* ids, std::vector<Vec4>* pos, std::vector<Vec4>* vel, std::vector<bool>* alive);
+	//queue a batch of radius or k nearest queries on the grid of the current model, returns its ticket (0 without grid)
+	unsigned int submitRadiusQuery(const std::vector<Vec4> &points, float radius);
+	unsigned int submitNearestQuery(const std::vector<Vec4> &points, unsigned int k);
+	//result of a query batch, false until it arrived
+	bool getQueryResult(unsigned int ticket, SpatialQuery::result_t* result);
+	//get the velocity and position of a probed boid, false if it is not probed, did not arrive yet or is despawned
+	bool getPosVelOfBoid(unsigned int boidIndex, float* posX, float* posY, float* posZ, float* velX, float* velY, float* velZ);
 
 	//instance of the simulation. Singleton pattern
 	static Simulation *pInstance;
@@ -0,0 +1,308 @@
+#include "stdafx.h"
+#include "spatialQuery.h"
+
+//work items of the single work group of the prefix sum
+#define QUERY_SCAN_LOCAL 256
+//radius results per query point the first batch is sized for
+#define QUERY_RADIUS_RESULTS 16
+
+SpatialQuery::SpatialQuery(CLHelper* clHlpr, uint3 gSize, float3 cSize, float3 origin, unsigned int components){
+	clHelper = clHlpr;
+	context = clHelper->getContext();
+	queue = clHelper->getCmdQueue();
+	devices = clHelper->getDevices();
+
+	planar = components == 2 ? 1 : 0;
+	gridSize.s[0] = gSize.x;
+	gridSize.s[1] = planar || gSize.y == 0 ? 1 : gSize.y;
+	gridSize.s[2] = gSize.z;
+	gridSize.s[3] = 1;
+	cellSize.s[0] = cSize.x;
+	cellSize.s[1] = cSize.y;
+	cellSize.s[2] = cSize.z;
+	cellSize.s[3] = 1.0f;
+	worldOrigin.s[0] = origin.x;
+	worldOrigin.s[1] = origin.y;
+	worldOrigin.s[2] = origin.z;
+	worldOrigin.s[3] = 0.0f;
+
+	nextTicket = 1;
+	radiusResults = QUERY_RADIUS_RESULTS;
+
+	Metrics &metrics = Metrics::getInstance();
+	radiusTime = metrics.histogram("boids_query_seconds", "Device time of the spatial query batches", "type=\"radius\"");
+	nearestTime = metrics.histogram("boids_query_seconds", "Device time of the spatial query batches", "type=\"nearest\"");
+	radiusQueries = metrics.counter("boids_query_points_total", "Query points of the completed spatial query batches", "type=\"radius\"");
+	nearestQueries = metrics.counter("boids_query_points_total", "Query points of the completed spatial query batches", "type=\"nearest\"");
+
+	loadProgram(kernel_path + "spatialQuery_kernel.cl");
+
+	try
+	{
+		kernel_radiusCount = cl::Kernel(program, "radiusCount", &err);
+		kernel_radiusFill = cl::Kernel(program, "radiusFill", &err);
+		kernel_nearest = cl::Kernel(program, "nearest", &err);
+		kernel_nearestCompact = cl::Kernel(program, "nearestCompact", &err);
+		kernel_scanCounts = cl::Kernel(program, "scanCounts", &err);
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+}
+
+SpatialQuery::~SpatialQuery(){
+	//pending readbacks write into the results of the batches
+	queue.finish();
+}
+
+unsigned int SpatialQuery::submitRadius(const std::vector<Vec4> &points, float radius){
+	return submit(QUERY_RADIUS, points, radius, 0, false);
+}
+
+unsigned int SpatialQuery::submitNearest(const std::vector<Vec4> &points, unsigned int k){
+	if (k == 0 || k > QUERY_MAX_K)
+		return 0;
+	return submit(QUERY_NEAREST, points, 0.0f, k, false);
+}
+
+void SpatialQuery::benchmark(){
+	std::vector<Vec4> points(QUERY_BENCH_POINTS);
+	for (size_t i = 0; i < points.size(); i++){
+		float x = (float)rand() / RAND_MAX, y = (float)rand() / RAND_MAX, z = (float)rand() / RAND_MAX;
+		points[i].set(worldOrigin.s[0] + x * gridSize.s[0] * cellSize.s[0], worldOrigin.s[1] + y * gridSize.s[1] * cellSize.s[1], worldOrigin.s[2] + z * gridSize.s[2] * cellSize.s[2], 0.0f);
+	}
+
+	float minCell = cellSize.s[0] < cellSize.s[2] ? cellSize.s[0] : cellSize.s[2];
+	if (!planar && cellSize.s[1] < minCell)
+		minCell = cellSize.s[1];
+	submit(QUERY_RADIUS, points, QUERY_BENCH_RADIUS * minCell, 0, true);
+	submit(QUERY_NEAREST, points, 0.0f, QUERY_BENCH_K, true);
+}
+
+unsigned int SpatialQuery::submit(type_t type, const std::vector<Vec4> &points, float radius, unsigned int k, bool benchmark){
+	if (points.empty())
+		return 0;
+
+	batches.push_back(batch_t());
+	batch_t &batch = batches.back();
+	batch.ticket = nextTicket++;
+	batch.state = BATCH_QUEUED;
+	batch.benchmark = benchmark;
+	batch.points = points;
+	batch.radius = radius;
+	batch.k = k;
+	batch.capacity = 0;
+	batch.result.type = type;
+	batch.result.deviceTime = 0.0;
+	return batch.ticket;
+}
+
+void SpatialQuery::run(const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds){
+	for (std::list<batch_t>::iterator it = batches.begin(); it != batches.end();){
+		batch_t &batch = *it;
+
+		if (batch.state == BATCH_COUNTING && isComplete(batch.readOffsets)){
+			unsigned int total = batch.result.offsets.back();
+			if (total > batch.capacity){
+				//did not fit, run again with room for all results and some more
+				unsigned int perPoint = (unsigned int)(total / batch.points.size()) + 1;
+				radiusResults = perPoint + perPoint / 4 > radiusResults ? perPoint + perPoint / 4 : radiusResults;
+				batch.capacity = total + total / 4;
+				batch.state = BATCH_QUEUED;
+			}
+			else{
+				batch.result.ids.resize(total);
+				if (total > 0)
+					err = queue.enqueueReadBuffer(batch.cl_ids, CL_FALSE, 0, total * sizeof(unsigned int), batch.result.ids.data(), NULL, &batch.readIds);
+				batch.state = BATCH_READING;
+			}
+		}
+
+		if (batch.state == BATCH_QUEUED)
+			enqueue(batch, pos, cellStart, cellEnd, agentIds);
+		else if (batch.state == BATCH_READING && (batch.result.ids.empty() || isComplete(batch.readIds)))
+			finish(batch);
+
+		//nobody asks for the benchmark results
+		if (batch.benchmark && batch.state == BATCH_DONE)
+			it = batches.erase(it);
+		else
+			++it;
+	}
+}
+
+void SpatialQuery::setGridArgs(cl::Kernel &kernel, const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds){
+	err = kernel.setArg(2, pos);
+	err = kernel.setArg(3, cellStart);
+	err = kernel.setArg(4, cellEnd);
+	err = kernel.setArg(5, agentIds);
+	err = kernel.setArg(6, gridSize);
+	err = kernel.setArg(7, cellSize);
+	err = kernel.setArg(8, worldOrigin);
+	err = kernel.setArg(9, planar);
+}
+
+void SpatialQuery::enqueue(batch_t &batch, const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds){
+	unsigned int count = (unsigned int)batch.points.size();
+	if (batch.result.type == QUERY_NEAREST)
+		batch.capacity = count * batch.k;
+	else if (batch.capacity == 0)
+		batch.capacity = count * radiusResults;
+
+	try
+	{
+		//the buffers of a batch which runs again are replaced, the ids buffer is larger
+		if (batch.cl_points() == NULL){
+			batch.cl_points = clHelper->createBuffer(CL_MEM_READ_ONLY, count * sizeof(Vec4), NULL, &err);
+			batch.cl_counts = clHelper->createBuffer(CL_MEM_READ_WRITE, count * sizeof(unsigned int), NULL, &err);
+			batch.cl_offsets = clHelper->createBuffer(CL_MEM_READ_WRITE, (count + 1) * sizeof(unsigned int), NULL, &err);
+			if (batch.result.type == QUERY_NEAREST)
+				batch.cl_candidates = clHelper->createBuffer(CL_MEM_READ_WRITE, count * batch.k * sizeof(unsigned int), NULL, &err);
+			err = queue.enqueueWriteBuffer(batch.cl_points, CL_FALSE, 0, count * sizeof(Vec4), batch.points.data());
+		}
+		batch.cl_ids = clHelper->createBuffer(CL_MEM_READ_WRITE, (batch.capacity > 0 ? batch.capacity : 1) * sizeof(unsigned int), NULL, &err);
+
+		if (batch.result.type == QUERY_RADIUS){
+			err = kernel_radiusCount.setArg(0, batch.cl_points);
+			err = kernel_radiusCount.setArg(1, batch.radius);
+			setGridArgs(kernel_radiusCount, pos, cellStart, cellEnd, agentIds);
+			err = kernel_radiusCount.setArg(10, batch.cl_counts);
+			err = kernel_radiusCount.setArg(11, count);
+			err = queue.enqueueNDRangeKernel(kernel_radiusCount, cl::NullRange, cl::NDRange(count), cl::NullRange, NULL, &batch.first);
+		}
+		else{
+			err = kernel_nearest.setArg(0, batch.cl_points);
+			err = kernel_nearest.setArg(1, batch.k);
+			setGridArgs(kernel_nearest, pos, cellStart, cellEnd, agentIds);
+			err = kernel_nearest.setArg(10, batch.cl_candidates);
+			err = kernel_nearest.setArg(11, batch.cl_counts);
+			err = kernel_nearest.setArg(12, count);
+			err = queue.enqueueNDRangeKernel(kernel_nearest, cl::NullRange, cl::NDRange(count), cl::NullRange, NULL, &batch.first);
+		}
+
+		err = kernel_scanCounts.setArg(0, batch.cl_counts);
+		err = kernel_scanCounts.setArg(1, batch.cl_offsets);
+		err = kernel_scanCounts.setArg(2, cl::__local(sizeof(cl_uint) * QUERY_SCAN_LOCAL));
+		err = kernel_scanCounts.setArg(3, count);
+		err = queue.enqueueNDRangeKernel(kernel_scanCounts, cl::NullRange, cl::NDRange(QUERY_SCAN_LOCAL), cl::NDRange(QUERY_SCAN_LOCAL));
+
+		if (batch.result.type == QUERY_RADIUS){
+			err = kernel_radiusFill.setArg(0, batch.cl_points);
+			err = kernel_radiusFill.setArg(1, batch.radius);
+			setGridArgs(kernel_radiusFill, pos, cellStart, cellEnd, agentIds);
+			err = kernel_radiusFill.setArg(10, batch.cl_offsets);
+			err = kernel_radiusFill.setArg(11, batch.cl_ids);
+			err = kernel_radiusFill.setArg(12, batch.capacity);
+			err = kernel_radiusFill.setArg(13, count);
+			err = queue.enqueueNDRangeKernel(kernel_radiusFill, cl::NullRange, cl::NDRange(count), cl::NullRange, NULL, &batch.last);
+		}
+		else{
+			err = kernel_nearestCompact.setArg(0, batch.cl_candidates);
+			err = kernel_nearestCompact.setArg(1, batch.cl_counts);
+			err = kernel_nearestCompact.setArg(2, batch.cl_offsets);
+			err = kernel_nearestCompact.setArg(3, batch.cl_ids);
+			err = kernel_nearestCompact.setArg(4, batch.k);
+			err = kernel_nearestCompact.setArg(5, count);
+			err = queue.enqueueNDRangeKernel(kernel_nearestCompact, cl::NullRange, cl::NDRange(count), cl::NullRange, NULL, &batch.last);
+		}
+
+		batch.result.offsets.resize(count + 1);
+		err = queue.enqueueReadBuffer(batch.cl_offsets, CL_FALSE, 0, (count + 1) * sizeof(unsigned int), batch.result.offsets.data(), NULL, &batch.readOffsets);
+		batch.state = BATCH_COUNTING;
+	}
+	catch (cl::Error er) {
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		//an empty result instead of a batch which never completes
+		batch.result.offsets.assign(count + 1, 0);
+		batch.result.ids.clear();
+		batch.state = BATCH_DONE;
+	}
+}
+
+void SpatialQuery::finish(batch_t &batch){
+	cl_ulong startTime = 0, endTime = 0;
+	try
+	{
+		batch.first.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+		batch.last.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	}
+	catch (cl::Error){
+		startTime = endTime = 0;
+	}
+	batch.result.deviceTime = endTime > startTime ? (endTime - startTime) / 1000.0 : 0.0;
+	batch.state = BATCH_DONE;
+
+	size_t count = batch.points.size();
+	bool radius = batch.result.type == QUERY_RADIUS;
+	(radius ? radiusTime : nearestTime)->record(batch.result.deviceTime);
+	(radius ? radiusQueries : nearestQueries)->add(count);
+
+	if (batch.benchmark){
+		std::ostringstream line;
+		line << "query benchmark " << (radius ? "radius" : "nearest") << ": " << count << " points, "
+			<< batch.result.ids.size() << " results, " << batch.result.deviceTime << " us on the device, "
+			<< (batch.result.deviceTime > 0.0 ? count / batch.result.deviceTime : 0.0) << " M queries/s";
+		clHelper->log(line.str());
+	}
+}
+
+bool SpatialQuery::getResult(unsigned int ticket, result_t* result){
+	for (std::list<batch_t>::iterator it = batches.begin(); it != batches.end(); ++it){
+		if (it->ticket != ticket)
+			continue;
+		if (it->state != BATCH_DONE)
+			return false;
+
+		*result = std::move(it->result);
+		batches.erase(it);
+		return true;
+	}
+	return false;
+}
+
+bool SpatialQuery::isComplete(const cl::Event &event){
+	return event() != NULL && event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE;
+}
+
+void SpatialQuery::loadProgram(const std::string &filename){
+	std::string kernelSource;
+
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (in)
+	{
+		in.seekg(0, std::ios::end);
+		kernelSource.resize(in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&kernelSource[0], kernelSource.size());
+		in.close();
+	}
+	else
+	{
+		clHelper->log("could not open " + filename);
+		throw(errno);
+	}
+
+	try
+	{
+		cl::Program::Sources source(1, std::make_pair(kernelSource.c_str(), kernelSource.size()));
+		program = cl::Program(context, source);
+	}
+	catch (cl::Error er)
+	{
+		clHelper->log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	try
+	{
+		//the private candidate lists of the nearest queries have QUERY_MAX_K entries
+		std::string options = "-D QUERY_MAX_K=" + std::to_string(QUERY_MAX_K);
+		err = program.build(devices, options.c_str());
+	}
+	catch (cl::Error er) {
+		clHelper->log("program build: " + clHelper->oclErrorString(er.err()));
+		clHelper->log("\n----------------------buildLog start--------------------\n");
+		std::string buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(devices[0]);
+		clHelper->log(buildLog);
+		clHelper->log("\n----------------------buildLog end--------------------\n");
+	}
+}
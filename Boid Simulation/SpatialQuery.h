@@ -0,0 +1,128 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _SPATIALQUERY_H_
+#define _SPATIALQUERY_H_
+
+#include "stdafx.h"
+#include "clHelper.h"
+#include "simParam.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "vector_types.h"
+#include "vectorTypes.h"
+
+/*
+	Batched radius and k nearest neighbour queries against the cell grid of a model
+	(kernels/spatialQuery_kernel.cl). A batch is queued on the host and run by the model in its
+	next step, against the cell ranges and the sorted positions of that step. The result is a
+	compact list of agent ids with the offsets of every query point, read back without waiting:
+	the offsets one step after the run, the ids the step after that.
+
+	The radius results are counted, prefix summed and then written; if they do not fit into the
+	ids buffer of the batch it runs again the next step with a larger one.
+*/
+class SpatialQuery
+{
+public:
+	typedef enum { QUERY_RADIUS, QUERY_NEAREST } type_t;
+
+	typedef struct{
+		type_t type;
+		// ids of query point i are ids[offsets[i]] to ids[offsets[i + 1] - 1], one offset more than points
+		std::vector<unsigned int> offsets;
+		// agent ids (index at creation), nearest first for the nearest queries
+		std::vector<unsigned int> ids;
+		// time of the query kernels on the device in us
+		double deviceTime;
+	} result_t;
+
+	// components of the positions are 4 or 2, the planar models use x and z of the query points
+	SpatialQuery(CLHelper* clHlpr, uint3 gridSize, float3 cellSize, float3 worldOrigin, unsigned int components = 4);
+	~SpatialQuery();
+
+	// queue a batch for the next step and return its ticket, k is at most QUERY_MAX_K
+	unsigned int submitRadius(const std::vector<Vec4> &points, float radius);
+	unsigned int submitNearest(const std::vector<Vec4> &points, unsigned int k);
+	// queue a radius and a nearest batch of QUERY_BENCH_POINTS random points, their throughput is logged
+	void benchmark();
+
+	// run the queued batches and advance the readbacks of the running ones. pos holds the agents in
+	// the sorted order of the grid, agentIds the id of the agent in every slot
+	void run(const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds);
+
+	// result of the batch once it is on the host, the batch is forgotten then
+	bool getResult(unsigned int ticket, result_t* result);
+
+private:
+	typedef enum { BATCH_QUEUED, BATCH_COUNTING, BATCH_READING, BATCH_DONE } state_t;
+
+	typedef struct{
+		unsigned int ticket;
+		state_t state;
+		bool benchmark;
+		std::vector<Vec4> points;
+		float radius;
+		unsigned int k;
+		// entries of the ids buffer
+		unsigned int capacity;
+
+		cl::Buffer cl_points;
+		cl::Buffer cl_counts;
+		cl::Buffer cl_offsets;
+		cl::Buffer cl_ids;
+		cl::Buffer cl_candidates;
+
+		// first and last query kernel, the readbacks
+		cl::Event first;
+		cl::Event last;
+		cl::Event readOffsets;
+		cl::Event readIds;
+
+		result_t result;
+	} batch_t;
+
+	unsigned int submit(type_t type, const std::vector<Vec4> &points, float radius, unsigned int k, bool benchmark);
+	// enqueue the kernels of a queued batch and the readback of its offsets
+	void enqueue(batch_t &batch, const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds);
+	// the batch is on the host, record and log its times
+	void finish(batch_t &batch);
+	void setGridArgs(cl::Kernel &kernel, const cl::Memory &pos, const cl::Buffer &cellStart, const cl::Buffer &cellEnd, const cl::Buffer &agentIds);
+	void loadProgram(const std::string &filename);
+	static bool isComplete(const cl::Event &event);
+
+	CLHelper* clHelper;
+	cl::Context context;
+	TracedQueue queue;
+	std::vector<cl::Device> devices;
+	cl::Program program;
+	cl_int err;
+
+	cl::Kernel kernel_radiusCount;
+	cl::Kernel kernel_radiusFill;
+	cl::Kernel kernel_nearest;
+	cl::Kernel kernel_nearestCompact;
+	cl::Kernel kernel_scanCounts;
+
+	cl_uint4 gridSize;
+	cl_float4 cellSize;
+	cl_float4 worldOrigin;
+	unsigned int planar;
+
+	// stable addresses, the readbacks write into the results of the batches
+	std::list<batch_t> batches;
+	unsigned int nextTicket;
+	// expected radius results per query point, raised when a batch did not fit
+	unsigned int radiusResults;
+
+	Metrics::Histogram* radiusTime;
+	Metrics::Histogram* nearestTime;
+	Metrics::Counter* radiusQueries;
+	Metrics::Counter* nearestQueries;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "stdafx.h"
+#include "tracer.h"
+#include <iomanip>
+#include <float.h>
+
+Tracer* Tracer::pInstance = NULL;
+
+static long long ticksNow(){
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+Tracer::Tracer(){
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	tickFrequency = (double)frequency.QuadPart;
+	ticksStart = ticksNow();
+
+	frame = 0;
+	dropped = 0;
+}
+
+double Tracer::now(){
+	return (double)(ticksNow() - ticksStart) * 1000000.0 / tickFrequency;
+}
+
+void Tracer::addCommand(std::string name, const cl::Event &event, size_t size){
+	pending_t command;
+	command.name = std::move(name);
+	command.event = event;
+	command.enqueued = now();
+	command.size = size;
+	command.frame = frame;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	//nobody collects them, the simulation runs without frames
+	if (pending.size() >= TRACE_MAX_RECORDS){
+		pending.pop_front();
+		dropped++;
+	}
+	pending.push_back(std::move(command));
+}
+
+void Tracer::addSpan(const char* name, double begin, double end){
+	record_t span;
+	span.name = name;
+	span.frame = frame;
+	span.queue = -1;
+	span.thread = GetCurrentThreadId();
+	span.begin = begin;
+	span.end = end;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	histogramFor(phaseHistograms, span.name, false)->record(end - begin);
+	records.push_back(std::move(span));
+}
+
+void Tracer::setThreadName(std::string name){
+	std::lock_guard<std::mutex> lock(mutex);
+	threadNames.push_back(std::make_pair(GetCurrentThreadId(), std::move(name)));
+}
+
+void Tracer::nextFrame(){
+	std::lock_guard<std::mutex> lock(mutex);
+	frame++;
+	resolve();
+
+	while (!records.empty() && (records.front().frame + TRACE_FRAMES <= frame || records.size() > TRACE_MAX_RECORDS))
+		records.pop_front();
+}
+
+void Tracer::resolve(){
+	while (!pending.empty()){
+		pending_t &command = pending.front();
+		cl_int status = command.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>();
+		//the queue is in order, the commands behind are not complete either
+		if (status > CL_COMPLETE)
+			break;
+
+		record_t record;
+		record.name = std::move(command.name);
+		record.frame = command.frame;
+		record.thread = 0;
+		record.begin = 0.0;
+		record.end = 0.0;
+		record.enqueued = command.enqueued;
+		record.size = command.size;
+
+		try
+		{
+			record.queue = queueIndex(command.event.getInfo<CL_EVENT_COMMAND_QUEUE>()());
+			command.event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_QUEUED, &record.queued);
+			command.event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_SUBMIT, &record.submit);
+			command.event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &record.start);
+			command.event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &record.stop);
+		}
+		catch (cl::Error){
+			//failed commands and drivers without counters for some commands (GL objects)
+			status = -1;
+		}
+
+		if (status == CL_COMPLETE){
+			histogramFor(commandHistograms, record.name, true)->record((record.stop - record.start) / 1000.0);
+			records.push_back(std::move(record));
+		}
+		else
+			dropped++;
+		pending.pop_front();
+	}
+}
+
+int Tracer::queueIndex(cl_command_queue queue){
+	for (size_t i = 0; i < queues.size(); i++)
+		if (queues[i] == queue)
+			return (int)i;
+	queues.push_back(queue);
+	return (int)queues.size() - 1;
+}
+
+Metrics::Histogram* Tracer::histogramFor(std::vector<std::pair<std::string, Metrics::Histogram*> > &histograms, const std::string &name, bool command){
+	for (size_t i = 0; i < histograms.size(); i++)
+		if (histograms[i].first == name)
+			return histograms[i].second;
+
+	Metrics::Histogram* histogram;
+	if (command)
+		histogram = Metrics::getInstance().histogram("boids_cl_command_seconds", "Device execution time of the OpenCL commands", "command=\"" + name + "\"");
+	else
+		histogram = Metrics::getInstance().histogram("boids_host_phase_seconds", "Duration of the host phases", "phase=\"" + name + "\"");
+	histograms.push_back(std::make_pair(name, histogram));
+	return histogram;
+}
+
+std::string Tracer::dump(unsigned int frames){
+	std::vector<record_t> dumped;
+	std::vector<std::pair<DWORD, std::string> > names;
+	size_t queueCount;
+	unsigned int droppedCommands;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		resolve();
+		for (size_t i = 0; i < records.size(); i++)
+			if (records[i].frame + frames > frame)
+				dumped.push_back(records[i]);
+		names = threadNames;
+		queueCount = queues.size();
+		droppedCommands = dropped;
+	}
+
+	//offset of the device clock of every queue in us
+	std::vector<double> offset(queueCount, DBL_MAX);
+	for (size_t i = 0; i < dumped.size(); i++){
+		if (dumped[i].queue < 0)
+			continue;
+		double difference = dumped[i].enqueued - dumped[i].queued / 1000.0;
+		if (difference < offset[dumped[i].queue])
+			offset[dumped[i].queue] = difference;
+	}
+
+	CreateDirectory(TRACE_PATH_WIN, NULL);
+	char timeStamp[32];
+	time_t t = time(0);
+	struct tm local;
+	localtime_s(&local, &t);
+	strftime(timeStamp, sizeof(timeStamp), "%Y-%m-%d_%H-%M-%S", &local);
+	std::string fileName = std::string(TRACE_PATH_WIN) + "\\trace_" + timeStamp + ".json";
+
+	std::ofstream file(fileName, std::ios::out | std::ios::binary);
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedCommands\":" << droppedCommands << "},\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Host\"}},\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"OpenCL\"}}";
+	for (size_t i = 0; i < names.size(); i++)
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << names[i].first << ",\"args\":{\"name\":\"" << names[i].second << "\"}}";
+	for (size_t i = 0; i < queueCount; i++)
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":" << i << ",\"args\":{\"name\":\"queue " << i << "\"}}";
+
+	for (size_t i = 0; i < dumped.size(); i++){
+		const record_t &r = dumped[i];
+		if (r.queue < 0){
+			file << ",\n{\"name\":\"" << r.name << "\",\"cat\":\"host\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r.thread
+				<< ",\"ts\":" << r.begin << ",\"dur\":" << r.end - r.begin << ",\"args\":{\"frame\":" << r.frame << "}}";
+		}
+		else{
+			//waiting in the queue and for the device go into the arguments, the slice is the execution
+			double start = r.start / 1000.0 + offset[r.queue];
+			file << ",\n{\"name\":\"" << r.name << "\",\"cat\":\"cl\",\"ph\":\"X\",\"pid\":2,\"tid\":" << r.queue
+				<< ",\"ts\":" << start << ",\"dur\":" << (r.stop - r.start) / 1000.0
+				<< ",\"args\":{\"frame\":" << r.frame << ",\"size\":" << r.size
+				<< ",\"enqueued\":" << r.enqueued << ",\"queuedToSubmit\":" << (r.submit - r.queued) / 1000.0
+				<< ",\"submitToStart\":" << (r.start - r.submit) / 1000.0 << "}}";
+		}
+	}
+	file << "\n]}\n";
+
+	return fileName;
+}
@@ -0,0 +1,200 @@
+// Copyright (c) 2015, Biagio Cosenza.
+// Technische Universitaet Berlin. All rights reserved.
+//
+// This program is provided under a BSD Simplified license. For full
+// license terms please see the LICENSE file distributed with this
+// source code.
+
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include "stdafx.h"
+#include "simParam.h"
+#include "metrics.h"
+
+/*
+	Timeline of the OpenCL commands and the host phases, written as Chrome trace event JSON
+	(chrome://tracing, ui.perfetto.dev). Commands go through TracedQueue, which hands the event of
+	every enqueue to the tracer; their QUEUED / SUBMIT / START / END profiling counters are read once
+	the device completed them. Host phases are TraceSpan scopes. The last TRACE_FRAMES frames are
+	kept in a ring, so tracing can run all the time and a dump shows the frames before it.
+
+	Device counters are moved onto the host clock by the smallest difference between the host time
+	right after an enqueue and the QUEUED counter of that command, per queue.
+
+	Every span and every completed command is also recorded in a latency histogram of the metrics,
+	per phase and per command name.
+*/
+class Tracer
+{
+public:
+	static inline Tracer &getInstance() {
+		if (NULL == pInstance) { pInstance = new Tracer(); }
+		return *pInstance;
+	}
+
+	// host time in us since the tracer was created, from the performance counter
+	double now();
+
+	// trace an enqueued command, size is the global work size, bytes or number of GL objects
+	void addCommand(std::string name, const cl::Event &event, size_t size);
+	// trace a host phase of the calling thread between begin and end (see now)
+	void addSpan(const char* name, double begin, double end);
+	// name of the track of the calling thread
+	void setThreadName(std::string name);
+
+	// the render loop finished a frame, records of frames which left the ring are dropped
+	void nextFrame();
+	// write the last frames into TRACE_PATH_WIN and return the file name
+	std::string dump(unsigned int frames);
+
+private:
+	typedef struct{
+		std::string name;
+		cl::Event event;
+		double enqueued;
+		size_t size;
+		unsigned int frame;
+	} pending_t;
+
+	typedef struct{
+		std::string name;
+		unsigned int frame;
+		// index of the queue for commands, -1 for host spans
+		int queue;
+		DWORD thread;
+		// host spans
+		double begin;
+		double end;
+		// commands, host time after the enqueue and device counters in ns
+		double enqueued;
+		cl_ulong queued;
+		cl_ulong submit;
+		cl_ulong start;
+		cl_ulong stop;
+		size_t size;
+	} record_t;
+
+	Tracer();
+	static Tracer* pInstance;
+
+	// move the completed commands from pending to records, needs the lock
+	void resolve();
+	// index of the track of queue, needs the lock
+	int queueIndex(cl_command_queue queue);
+	// latency histogram of a host phase or a command, needs the lock
+	Metrics::Histogram* histogramFor(std::vector<std::pair<std::string, Metrics::Histogram*> > &histograms, const std::string &name, bool command);
+
+	std::mutex mutex;
+	std::deque<pending_t> pending;
+	std::deque<record_t> records;
+	std::vector<cl_command_queue> queues;
+	std::vector<std::pair<DWORD, std::string> > threadNames;
+	std::atomic<unsigned int> frame;
+	unsigned int dropped;
+
+	std::vector<std::pair<std::string, Metrics::Histogram*> > phaseHistograms;
+	std::vector<std::pair<std::string, Metrics::Histogram*> > commandHistograms;
+
+	long long ticksStart;
+	double tickFrequency;
+};
+
+/*
+	Host phase from construction to the end of the scope.
+*/
+class TraceSpan
+{
+public:
+	TraceSpan(const char* name) : name(name) {
+		begin = TRACE_ENABLED ? Tracer::getInstance().now() : 0.0;
+	}
+	~TraceSpan() {
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addSpan(name, begin, Tracer::getInstance().now());
+	}
+
+private:
+	const char* name;
+	double begin;
+};
+
+/*
+	Command queue which traces every command it enqueues. Hides the enqueue calls of
+	cl::CommandQueue used by the models, commands enqueued without an event get one.
+*/
+class TracedQueue : public cl::CommandQueue
+{
+public:
+	TracedQueue() {}
+	TracedQueue& operator=(const cl::CommandQueue &queue) {
+		cl::CommandQueue::operator=(queue);
+		return *this;
+	}
+
+	cl_int enqueueNDRangeKernel(const cl::Kernel &kernel, const cl::NDRange &offset, const cl::NDRange &global, const cl::NDRange &local = cl::NullRange,
+		const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueNDRangeKernel(kernel, offset, global, local, events, eventFor(event, traced));
+		if (TRACE_ENABLED){
+			size_t size = global.dimensions() > 0 ? ((const size_t*)global)[0] : 0;
+			for (size_t i = 1; i < global.dimensions(); i++)
+				size *= ((const size_t*)global)[i];
+			Tracer::getInstance().addCommand(kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(), *eventFor(event, traced), size);
+		}
+		return err;
+	}
+
+	cl_int enqueueReadBuffer(const cl::Buffer &buffer, cl_bool blocking, size_t offset, size_t size, void* ptr,
+		const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueReadBuffer(buffer, blocking, offset, size, ptr, events, eventFor(event, traced));
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addCommand("readBuffer", *eventFor(event, traced), size);
+		return err;
+	}
+
+	cl_int enqueueWriteBuffer(const cl::Buffer &buffer, cl_bool blocking, size_t offset, size_t size, const void* ptr,
+		const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueWriteBuffer(buffer, blocking, offset, size, ptr, events, eventFor(event, traced));
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addCommand("writeBuffer", *eventFor(event, traced), size);
+		return err;
+	}
+
+	cl_int enqueueCopyBuffer(const cl::Buffer &src, const cl::Buffer &dst, size_t srcOffset, size_t dstOffset, size_t size,
+		const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueCopyBuffer(src, dst, srcOffset, dstOffset, size, events, eventFor(event, traced));
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addCommand("copyBuffer", *eventFor(event, traced), size);
+		return err;
+	}
+
+	cl_int enqueueAcquireGLObjects(const std::vector<cl::Memory>* objects = NULL, const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueAcquireGLObjects(objects, events, eventFor(event, traced));
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addCommand("acquireGLObjects", *eventFor(event, traced), objects != NULL ? objects->size() : 0);
+		return err;
+	}
+
+	cl_int enqueueReleaseGLObjects(const std::vector<cl::Memory>* objects = NULL, const std::vector<cl::Event>* events = NULL, cl::Event* event = NULL) const {
+		cl::Event traced;
+		cl_int err = cl::CommandQueue::enqueueReleaseGLObjects(objects, events, eventFor(event, traced));
+		if (TRACE_ENABLED)
+			Tracer::getInstance().addCommand("releaseGLObjects", *eventFor(event, traced), objects != NULL ? objects->size() : 0);
+		return err;
+	}
+
+private:
+	// the event of the caller, or traced if the caller did not ask for one and tracing is on
+	static cl::Event* eventFor(cl::Event* event, cl::Event &traced) {
+		if (event != NULL || !TRACE_ENABLED)
+			return event;
+		return &traced;
+	}
+};
+
+#endif
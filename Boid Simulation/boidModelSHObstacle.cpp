@@ -1,9 +1,11 @@
 #include "stdafx.h"
 #include "boidModel.h"
+#include "obstacleSDF.h"
+#include <float.h>
 
 BoidModelSHObstacle::BoidModelSHObstacle(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, simParams_t* simP, std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst) : BoidModel(clHlpr)
 {
-	simTimeDisc = std::vector<const char*>(10);
+	simTimeDisc = std::vector<const char*>(13);
 	simTimeDisc[0] = "SH obstacle avoidance";
 	simTimeDisc[1] = "OpenCL Simulation Times:";
 	simTimeDisc[2] = "";
@@ -14,6 +16,9 @@ BoidModelSHObstacle::BoidModelSHObstacle(CLHelper* clHlpr, std::vector<Vec4> pos
 	simTimeDisc[7] = "";
 	simTimeDisc[8] = "";
 	simTimeDisc[9] = "";
+	simTimeDisc[10] = "";
+	simTimeDisc[11] = "";
+	simTimeDisc[12] = "";
 
 	context = clHelper->getContext();
 	queue = clHelper->getCmdQueue();
@@ -23,16 +28,30 @@ BoidModelSHObstacle::BoidModelSHObstacle(CLHelper* clHlpr, std::vector<Vec4> pos
 
 	num = simParams.numBodies;
 
+	//goal id in goal.w selects the flow field of the agent
+	std::vector<Vec4> flowGoals = FlowField::assignGoalIds(&goal, FLOW_FIELD_MAX_GOALS);
+
 	createBuffer(pos, vel, goal);
 	loadData(goal);
 
-	programBoid =    loadProgram(kernel_path + "BoidModelSHObstacle_kernel_v1.cl");
+	programBoid =    loadProgram(kernel_path + "BoidModelSHObstacle_kernel_v1.cl", clHelper->getSHBasisSource(SH_ORDER_SH_OBSTACLE));
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "BoidModelSHObstacle_kernel_v1.cl", SH_ORDER_SH_OBSTACLE);
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
 
 	createAndLoadObstacleSH(cor, start, end, posObst);
+	loadObstacleSDF(OBSTACLE_MESH);
+
+	flowField = new FlowField(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin, flowGoals);
+	updateBlockedCells();
 
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -45,12 +64,13 @@ BoidModelSHObstacle::~BoidModelSHObstacle(){
 	glDeleteVertexArrays(1, pos_vao);
 
 	delete shader;
+	delete flowField;
 }
 
 void BoidModelSHObstacle::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -95,12 +115,15 @@ void BoidModelSHObstacle::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -108,26 +131,26 @@ void BoidModelSHObstacle::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -171,12 +194,16 @@ void BoidModelSHObstacle::simulate(float dt){
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
 
 	try
 	{
@@ -206,6 +233,7 @@ void BoidModelSHObstacle::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[4] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REDUCE, (endTime - startTime) / 1000.0);
 
 	//		std::vector<Vec4> C(2 * simParams.numCells);
 	//		queue.enqueueReadBuffer(cl_shEval, CL_TRUE, 0, (size_t)2 * simParams.numCells * sizeof(Vec4), C.data());
@@ -232,7 +260,8 @@ void BoidModelSHObstacle::simulate(float dt){
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
 		err = kernel_simulate.setArg(7, cl_simParams);
 		err = kernel_simulate.setArg(8, cl_range);
-		err = kernel_simulate.setArg(9, dt);
+		err = kernel_simulate.setArg(9, flowField->getFlowDir());
+		err = kernel_simulate.setArg(10, dt);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -258,7 +287,12 @@ void BoidModelSHObstacle::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
-	unsigned int numObst = 126;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
+
+	//only moved obstacles are projected again, the field is only baked again if it is due
+	updateMovedObstacles();
+	if (obstacleFieldDirty)
+		bakeObstacleField();
 
 	try
 	{
@@ -281,24 +315,18 @@ void BoidModelSHObstacle::simulate(float dt){
 		err = kernel_useSH.setArg(5, cl_shEvalY);
 		err = kernel_useSH.setArg(6, cl_shEvalZ);
 		err = kernel_useSH.setArg(7, cl_simParams);
-		err = kernel_useSH.setArg(10, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(11, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(12, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(13, cl_coef0X);
 		err = kernel_useSH.setArg(14, cl_coef0Y);
 		err = kernel_useSH.setArg(15, cl_coef0Z);
 		err = kernel_useSH.setArg(16, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(17, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(18, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(19, cl_shEvalOX);
-		err = kernel_useSH.setArg(20, cl_shEvalOY);
-		err = kernel_useSH.setArg(21, cl_shEvalOZ);
-		err = kernel_useSH.setArg(22, cl_coef0OX);
-		err = kernel_useSH.setArg(23, cl_coef0OY);
-		err = kernel_useSH.setArg(24, cl_coef0OZ);
-		err = kernel_useSH.setArg(25, cl_posObst);
-		err = kernel_useSH.setArg(26, numObst);
-		err = kernel_useSH.setArg(27, dt);
+		err = kernel_useSH.setArg(19, cl_obstField);
+		err = kernel_useSH.setArg(20, (unsigned int)OBSTACLE_FIELD_RES);
+		err = kernel_useSH.setArg(21, dt);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -313,6 +341,7 @@ void BoidModelSHObstacle::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -324,6 +353,12 @@ void BoidModelSHObstacle::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state, they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
@@ -353,22 +388,23 @@ GLuint BoidModelSHObstacle::getPosVAO(){
 }
 
 int BoidModelSHObstacle::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
 
-cl::Program BoidModelSHObstacle::loadProgram(const std::string &filename){
+cl::Program BoidModelSHObstacle::loadProgram(const std::string &filename, const std::string &header){
 	log("load program");
-	std::string kernelSource;
+	std::string kernelSource = header;
+	size_t headerSize = header.size();
 
 	std::ifstream in(filename, std::ios::in | std::ios::binary);
 	if (in)
 	{
 		in.seekg(0, std::ios::end);
-		kernelSource.resize(in.tellg());
+		kernelSource.resize(headerSize + (size_t)in.tellg());
 		in.seekg(0, std::ios::beg);
-		in.read(&kernelSource[0], kernelSource.size());
+		in.read(&kernelSource[headerSize], kernelSource.size() - headerSize);
 		in.close();
 	}
 	else
@@ -421,6 +457,9 @@ void BoidModelSHObstacle::loadKernel(){
 		kernel_memSet = cl::Kernel(programBoid, "memSet", &err);
 		kernel_evalSH = cl::Kernel(programBoid, "evalSH", &err);
 		kernel_obstacle = cl::Kernel(programBoid, "obstacleSH", &err);
+		kernel_bakeObstacleField = cl::Kernel(programBoid, "bakeObstacleField", &err);
+		kernel_transformObstacle = cl::Kernel(programBoid, "transformObstacle", &err);
+		kernel_updateObstacleField = cl::Kernel(programBoid, "updateObstacleField", &err);
 
 #if USE_SH_FOR_PATH
 		kernel_useSH = cl::Kernel(programBoid, "useSH", &err);
@@ -439,38 +478,39 @@ void BoidModelSHObstacle::createBuffer(std::vector<Vec4> pos, std::vector<Vec4>
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
-	size_t array_size_fp8 = 2 * num * sizeof(Vec4);
+	size_t array_size_fp8 = num * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE);
 	size_t array_size_fp = num * sizeof(float);
 
 	createVboBindShader(pos, vel);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
 
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 	//create the OpenCL only arrays
 	try
 	{
-		cl_coef0X = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Y = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Z = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_goal_in = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_goal_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-		cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_coef0X = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Y = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Z = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_goal_in = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_goal_out = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -478,7 +518,7 @@ void BoidModelSHObstacle::createBuffer(std::vector<Vec4> pos, std::vector<Vec4>
 }
 
 void BoidModelSHObstacle::createAndLoadObstacleSH(std::vector<Vec4> cor, std::vector<unsigned int> start, std::vector<unsigned int> end, std::vector<Vec4> posObst){
-	size_t array_size_fp8 = 2 * posObst.size() * sizeof(Vec4);
+	size_t array_size_fp8 = posObst.size() * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE);
 	size_t array_size_fp = posObst.size() * sizeof(float);
 	size_t array_size_index = start.size() * sizeof(unsigned int);
 	size_t array_size_cor = cor.size() * sizeof(Vec4);
@@ -486,16 +526,25 @@ void BoidModelSHObstacle::createAndLoadObstacleSH(std::vector<Vec4> cor, std::ve
 	
 	try
 	{
-		cl_coef0OX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0OY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0OZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalOX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalOY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalOZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_startCor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_index, NULL, &err);
-		cl_endCor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_index, NULL, &err);
-		cl_posObst = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_pos, NULL, &err);
-		cl_cor = cl::Buffer(context, CL_MEM_READ_ONLY, array_size_cor, NULL, &err);
+		cl_coef0OX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalOX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_startCor = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_index, NULL, &err);
+		cl_endCor = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_index, NULL, &err);
+		cl_posObst = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_pos, NULL, &err);
+		cl_cor = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_cor, NULL, &err);
+		cl_posObstLocal = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_pos, NULL, &err);
+		cl_corLocal = clHelper->createBuffer(CL_MEM_READ_ONLY, array_size_cor, NULL, &err);
+		cl_coef0OldX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OldY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0OldZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalOldX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOldY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalOldZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_posObstOld = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_pos, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -505,6 +554,8 @@ void BoidModelSHObstacle::createAndLoadObstacleSH(std::vector<Vec4> cor, std::ve
 	err = queue.enqueueWriteBuffer(cl_endCor, CL_TRUE, 0, array_size_index, &end[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_posObst, CL_TRUE, 0, array_size_pos, &posObst[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_cor, CL_TRUE, 0, array_size_cor, &cor[0], NULL, &event);
+	err = queue.enqueueWriteBuffer(cl_posObstLocal, CL_TRUE, 0, array_size_pos, &posObst[0], NULL, &event);
+	err = queue.enqueueWriteBuffer(cl_corLocal, CL_TRUE, 0, array_size_cor, &cor[0], NULL, &event);
 	queue.finish();
 
 	try
@@ -528,16 +579,312 @@ void BoidModelSHObstacle::createAndLoadObstacleSH(std::vector<Vec4> cor, std::ve
 	err = queue.enqueueNDRangeKernel(kernel_obstacle, cl::NullRange, cl::NDRange(globalWorkSize), cl::NullRange, NULL, &event);
 	queue.finish();
 
-	
-	std::vector<Vec4> X(126);
-	queue.enqueueReadBuffer(cl_posObst, CL_TRUE, 0, (size_t)126 * sizeof(Vec4), X.data());
+	numObstacle = posObst.size();
+	posObstHost = posObst;
+	obstacleFieldDirty = true;
+}
+
+unsigned int BoidModelSHObstacle::addObstacle(unsigned int first, unsigned int count){
+	obstacle_t obstacle;
+	obstacle.first = first;
+	obstacle.count = count;
+	obstacle.transform = glm::mat4(1.0f);
+	obstacle.fieldTransform = glm::mat4(1.0f);
+	obstacle.moved = false;
+
+	obstacles.push_back(obstacle);
+	return (unsigned int)obstacles.size() - 1;
+}
+
+void BoidModelSHObstacle::setObstacleTransform(unsigned int id, glm::mat4 transform){
+	if (id >= obstacles.size()){
+		log("WARNING: transform of unknown obstacle ignored");
+		return;
+	}
+
+	obstacles[id].transform = transform;
+	obstacles[id].moved = true;
+}
+
+void BoidModelSHObstacle::updateMovedObstacles(){
+	cl_ulong startTime, endTime;
+	unsigned int res = OBSTACLE_FIELD_RES;
+
+	timeUpdate = 0;
+	numMovedPoints = 0;
+
+	bool moved = false;
+	for (size_t i = 0; i < obstacles.size(); i++)
+		moved = moved || obstacles[i].moved;
+
+	if (!moved)
+		return;
+
+	//the field is baked from scratch every n-th update to drop the accumulated rounding error
+	bool incremental = !obstacleFieldDirty && updatesSinceBake < OBSTACLE_REBAKE_INTERVAL;
+
+	for (size_t i = 0; i < obstacles.size(); i++){
+		obstacle_t* obstacle = &obstacles[i];
+		if (!obstacle->moved)
+			continue;
+
+		if (incremental){
+			//keep the previous placement to remove its repulsion from the field
+			size_t offset_fp = obstacle->first * sizeof(float);
+			size_t offset_fp8 = obstacle->first * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE);
+			size_t offset_pos = obstacle->first * sizeof(Vec4);
+
+			err = queue.enqueueCopyBuffer(cl_coef0OX, cl_coef0OldX, offset_fp, offset_fp, obstacle->count * sizeof(float));
+			err = queue.enqueueCopyBuffer(cl_coef0OY, cl_coef0OldY, offset_fp, offset_fp, obstacle->count * sizeof(float));
+			err = queue.enqueueCopyBuffer(cl_coef0OZ, cl_coef0OldZ, offset_fp, offset_fp, obstacle->count * sizeof(float));
+			err = queue.enqueueCopyBuffer(cl_shEvalOX, cl_shEvalOldX, offset_fp8, offset_fp8, obstacle->count * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE));
+			err = queue.enqueueCopyBuffer(cl_shEvalOY, cl_shEvalOldY, offset_fp8, offset_fp8, obstacle->count * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE));
+			err = queue.enqueueCopyBuffer(cl_shEvalOZ, cl_shEvalOldZ, offset_fp8, offset_fp8, obstacle->count * CLHelper::getSHVecSize(SH_ORDER_SH_OBSTACLE));
+			err = queue.enqueueCopyBuffer(cl_posObst, cl_posObstOld, offset_pos, offset_pos, obstacle->count * sizeof(Vec4));
+		}
+
+		//rows of the affine transform, glm matrices are column major
+		glm::mat4 m = obstacle->transform;
+		Vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		Vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		Vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+
+		try
+		{
+			err = kernel_transformObstacle.setArg(0, cl_corLocal);
+			err = kernel_transformObstacle.setArg(1, cl_posObstLocal);
+			err = kernel_transformObstacle.setArg(2, cl_startCor);
+			err = kernel_transformObstacle.setArg(3, cl_endCor);
+			err = kernel_transformObstacle.setArg(4, r0);
+			err = kernel_transformObstacle.setArg(5, r1);
+			err = kernel_transformObstacle.setArg(6, r2);
+			err = kernel_transformObstacle.setArg(7, cl_cor);
+			err = kernel_transformObstacle.setArg(8, cl_posObst);
+		}
+		catch (cl::Error er){
+			log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		}
+
+		//only the points of this obstacle, the global offset is its first point
+		err = queue.enqueueNDRangeKernel(kernel_transformObstacle, cl::NDRange(obstacle->first), cl::NDRange(obstacle->count), cl::NullRange, NULL, NULL);
+		//set again, the kernel may have been created anew by a reload since createAndLoadObstacleSH
+		try
+		{
+			err = kernel_obstacle.setArg(0, cl_cor);
+			err = kernel_obstacle.setArg(1, cl_startCor);
+			err = kernel_obstacle.setArg(2, cl_endCor);
+			err = kernel_obstacle.setArg(3, cl_shEvalOX);
+			err = kernel_obstacle.setArg(4, cl_shEvalOY);
+			err = kernel_obstacle.setArg(5, cl_shEvalOZ);
+			err = kernel_obstacle.setArg(6, cl_coef0OX);
+			err = kernel_obstacle.setArg(7, cl_coef0OY);
+			err = kernel_obstacle.setArg(8, cl_coef0OZ);
+		}
+		catch (cl::Error er){
+			log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		}
+		err = queue.enqueueNDRangeKernel(kernel_obstacle, cl::NDRange(obstacle->first), cl::NDRange(obstacle->count), cl::NullRange, NULL, NULL);
+
+		cl_uint4 boxMin, boxSize;
+		if (incremental && obstacleNodeBox(*obstacle, &boxMin, &boxSize)){
+			try
+			{
+				err = kernel_updateObstacleField.setArg(0, cl_shEvalOX);
+				err = kernel_updateObstacleField.setArg(1, cl_shEvalOY);
+				err = kernel_updateObstacleField.setArg(2, cl_shEvalOZ);
+				err = kernel_updateObstacleField.setArg(3, cl_coef0OX);
+				err = kernel_updateObstacleField.setArg(4, cl_coef0OY);
+				err = kernel_updateObstacleField.setArg(5, cl_coef0OZ);
+				err = kernel_updateObstacleField.setArg(6, cl_posObst);
+				err = kernel_updateObstacleField.setArg(7, cl_shEvalOldX);
+				err = kernel_updateObstacleField.setArg(8, cl_shEvalOldY);
+				err = kernel_updateObstacleField.setArg(9, cl_shEvalOldZ);
+				err = kernel_updateObstacleField.setArg(10, cl_coef0OldX);
+				err = kernel_updateObstacleField.setArg(11, cl_coef0OldY);
+				err = kernel_updateObstacleField.setArg(12, cl_coef0OldZ);
+				err = kernel_updateObstacleField.setArg(13, cl_posObstOld);
+				err = kernel_updateObstacleField.setArg(14, obstacle->first);
+				err = kernel_updateObstacleField.setArg(15, obstacle->count);
+				err = kernel_updateObstacleField.setArg(16, cl_simParams);
+				err = kernel_updateObstacleField.setArg(17, cl_obstField);
+				err = kernel_updateObstacleField.setArg(18, res);
+				err = kernel_updateObstacleField.setArg(19, boxMin);
+				err = kernel_updateObstacleField.setArg(20, boxSize);
+			}
+			catch (cl::Error er){
+				log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+			}
+
+			unsigned int boxNodes = boxSize.s[0] * boxSize.s[1] * boxSize.s[2];
+			int globalWorkSize = ((boxNodes + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+			err = queue.enqueueNDRangeKernel(kernel_updateObstacleField, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+
+			event.wait();
+			event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+			event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+			timeUpdate += (endTime - startTime) / 1000000;
+		}
+
+		numMovedPoints += obstacle->count;
+		obstacle->fieldTransform = obstacle->transform;
+		obstacle->moved = false;
+	}
 	queue.finish();
-	
-	std::vector<Vec4> Y(2*126);
-	queue.enqueueReadBuffer(cl_shEvalOX, CL_TRUE, 0, (size_t)2*126 * sizeof(Vec4), Y.data());
+
+	if (incremental)
+		updatesSinceBake++;
+	else
+		obstacleFieldDirty = true;
+
+	updateBlockedCells();
+}
+
+bool BoidModelSHObstacle::obstacleNodeBox(const obstacle_t &obstacle, cl_uint4* boxMin, cl_uint4* boxSize){
+	unsigned int res = OBSTACLE_FIELD_RES;
+	unsigned int n[3] = { simParams.gridSize.x * res + 1, simParams.gridSize.y * res + 1, simParams.gridSize.z * res + 1 };
+	float origin[3] = { simParams.worldOrigin.x, simParams.worldOrigin.y, simParams.worldOrigin.z };
+	float spacing[3] = { simParams.cellSize.x / res, simParams.cellSize.y / res, simParams.cellSize.z / res };
+
+	//bounds of the points at the placement in the field and at the new one
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (unsigned int i = obstacle.first; i < obstacle.first + obstacle.count && i < posObstHost.size(); i++){
+		glm::vec4 p(posObstHost[i].x, posObstHost[i].y, posObstHost[i].z, 1.0f);
+		glm::vec3 before = glm::vec3(obstacle.fieldTransform * p);
+		glm::vec3 after = glm::vec3(obstacle.transform * p);
+		lo = glm::min(lo, glm::min(before, after));
+		hi = glm::max(hi, glm::max(before, after));
+	}
+	if (lo.x > hi.x)
+		return false;
+
+	unsigned int* bMin = boxMin->s;
+	unsigned int* bSize = boxSize->s;
+	for (int a = 0; a < 3; a++){
+		float range = OBSTACLE_UPDATE_RANGE * res;
+		int first = (int)floor((lo[a] - origin[a]) / spacing[a] - range);
+		int last = (int)ceil((hi[a] - origin[a]) / spacing[a] + range);
+		first = first < 0 ? 0 : first;
+		last = last > (int)n[a] - 1 ? (int)n[a] - 1 : last;
+		if (first > last)
+			return false;
+		bMin[a] = first;
+		bSize[a] = last - first + 1;
+	}
+	bMin[3] = 0;
+	bSize[3] = 0;
+	return true;
+}
+
+void BoidModelSHObstacle::updateBlockedCells(){
+	std::vector<unsigned char> blocked(simParams.numCells, 0);
+	if (sdfBlockedCells.size() == blocked.size())
+		blocked = sdfBlockedCells;
+
+	//points which do not belong to a registered obstacle stay at their initial placement
+	std::vector<glm::mat4> transform(posObstHost.size(), glm::mat4(1.0f));
+	for (size_t i = 0; i < obstacles.size(); i++){
+		for (unsigned int j = obstacles[i].first; j < obstacles[i].first + obstacles[i].count && j < transform.size(); j++)
+			transform[j] = obstacles[i].transform;
+	}
+
+	for (size_t i = 0; i < posObstHost.size(); i++){
+		glm::vec4 p = transform[i] * glm::vec4(posObstHost[i].x, posObstHost[i].y, posObstHost[i].z, 1.0f);
+		int x = (int)floor((p.x - simParams.worldOrigin.x) / simParams.cellSize.x);
+		int y = (int)floor((p.y - simParams.worldOrigin.y) / simParams.cellSize.y);
+		int z = (int)floor((p.z - simParams.worldOrigin.z) / simParams.cellSize.z);
+
+		if (x >= 0 && x < (int)simParams.gridSize.x && y >= 0 && y < (int)simParams.gridSize.y && z >= 0 && z < (int)simParams.gridSize.z)
+			blocked[x + simParams.gridSize.x * z + simParams.gridSize.x * simParams.gridSize.z * y] = 1;
+	}
+
+	//the flow fields only change if an obstacle moved into another cell
+	if (blocked != blockedCells){
+		blockedCells = blocked;
+		flowField->build(blockedCells);
+	}
+}
+
+void BoidModelSHObstacle::loadObstacleSDF(const std::string &objFile){
+	std::vector<Vec4> nodes(1, Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+	useSDF = 0;
+
+	if (!objFile.empty()){
+		ObstacleSDF sdf(clHelper, objFile, simParams.worldOrigin, simParams.cellSize, simParams.gridSize, OBSTACLE_FIELD_RES);
+		if (sdf.isValid()){
+			nodes = sdf.getNodes();
+			useSDF = 1;
+
+			//cells with their center inside the mesh are blocked for the flow fields
+			unsigned int res = OBSTACLE_FIELD_RES;
+			unsigned int nx = simParams.gridSize.x * res + 1;
+			unsigned int nz = simParams.gridSize.z * res + 1;
+			sdfBlockedCells.assign(simParams.numCells, 0);
+
+			for (unsigned int y = 0; y < simParams.gridSize.y; y++){
+				for (unsigned int z = 0; z < simParams.gridSize.z; z++){
+					for (unsigned int x = 0; x < simParams.gridSize.x; x++){
+						unsigned int node = (x * res + res / 2) + nx * ((z * res + res / 2) + nz * (y * res + res / 2));
+						if (nodes[node].w < 0.0f)
+							sdfBlockedCells[x + simParams.gridSize.x * z + simParams.gridSize.x * simParams.gridSize.z * y] = 1;
+					}
+				}
+			}
+		}
+	}
+
+	//without a mesh a single node is uploaded, the bake kernel needs a valid buffer
+	try
+	{
+		cl_obstSDF = clHelper->createBuffer(CL_MEM_READ_ONLY, nodes.size() * sizeof(Vec4), NULL, &err);
+	}
+	catch (cl::Error er) {
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueWriteBuffer(cl_obstSDF, CL_TRUE, 0, nodes.size() * sizeof(Vec4), &nodes[0], NULL, &event);
 	queue.finish();
-	
 
+	obstacleFieldDirty = true;
+}
+
+void BoidModelSHObstacle::bakeObstacleField(){
+	cl_ulong startTime, endTime;
+	unsigned int res = OBSTACLE_FIELD_RES;
+	unsigned int numNodes = (simParams.gridSize.x * res + 1) * (simParams.gridSize.y * res + 1) * (simParams.gridSize.z * res + 1);
+
+	try
+	{
+		if (cl_obstField() == NULL)
+			cl_obstField = clHelper->createBuffer(CL_MEM_READ_WRITE, numNodes * sizeof(Vec4), NULL, &err);
+
+		err = kernel_bakeObstacleField.setArg(0, cl_shEvalOX);
+		err = kernel_bakeObstacleField.setArg(1, cl_shEvalOY);
+		err = kernel_bakeObstacleField.setArg(2, cl_shEvalOZ);
+		err = kernel_bakeObstacleField.setArg(3, cl_coef0OX);
+		err = kernel_bakeObstacleField.setArg(4, cl_coef0OY);
+		err = kernel_bakeObstacleField.setArg(5, cl_coef0OZ);
+		err = kernel_bakeObstacleField.setArg(6, cl_posObst);
+		err = kernel_bakeObstacleField.setArg(7, numObstacle);
+		err = kernel_bakeObstacleField.setArg(8, cl_simParams);
+		err = kernel_bakeObstacleField.setArg(9, cl_obstField);
+		err = kernel_bakeObstacleField.setArg(10, res);
+		err = kernel_bakeObstacleField.setArg(11, cl_obstSDF);
+		err = kernel_bakeObstacleField.setArg(12, useSDF);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int globalWorkSize = ((numNodes + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_bakeObstacleField, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+
+	event.wait();
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	timeBake = (endTime - startTime) / 1000000;
+
+	obstacleFieldDirty = false;
+	updatesSinceBake = 0;
 }
 
 void BoidModelSHObstacle::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel){
@@ -613,6 +960,10 @@ void BoidModelSHObstacle::createVboBindShader(std::vector<Vec4> pos, std::vector
 	log("GL VBO Buffer created");
 }
 
+void BoidModelSHObstacle::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
+
 void BoidModelSHObstacle::loadData(std::vector<Vec4> goal){
 	num = (int)goal.size();
 	size_t array_size_fp4 = num * sizeof(Vec4);
@@ -648,7 +999,7 @@ void BoidModelSHObstacle::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -669,6 +1020,7 @@ void BoidModelSHObstacle::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -687,6 +1039,7 @@ void BoidModelSHObstacle::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -716,6 +1069,7 @@ void BoidModelSHObstacle::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -742,13 +1096,16 @@ void BoidModelSHObstacle::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSHObstacle::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -782,12 +1139,12 @@ std::vector<const char*> BoidModelSHObstacle::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -811,39 +1168,29 @@ std::vector<const char*> BoidModelSHObstacle::getSimTimeDescriptions(){
 	stringSHTime = strstream.str();
 	simTimeDisc[9] = stringSHTime.c_str();
 
-	return simTimeDisc;
-}
-
-void BoidModelSHObstacle::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
-
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
-
-
+	strstream.str(std::string());
+	strstream << "Obstacle field bake time: " << timeBake << "ms";
+	stringBakeTime = strstream.str();
+	simTimeDisc[10] = stringBakeTime.c_str();
 
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	strstream.str(std::string());
+	strstream << "Obstacle update time: " << timeUpdate << "ms (" << numMovedPoints << " points moved)";
+	stringUpdateTime = strstream.str();
+	simTimeDisc[11] = stringUpdateTime.c_str();
 
-	(*vel).set(v.x, v.y, v.z, 0.0);
+	strstream.str(std::string());
+	if (flowField->getNumGoals() > 0)
+		strstream << "Flow fields: " << flowField->getNumGoals() << " goals, build " << flowField->getBuildTime() << "ms (" << flowField->getIterations() << " steps)";
+	else
+		strstream << "Flow fields: off (straight path to the goal)";
+	stringFlowField = strstream.str();
+	simTimeDisc[12] = stringFlowField.c_str();
 
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return simTimeDisc;
+}
 
-	(*pos).set(p.x, p.y, p.z, 0.0);
+bool BoidModelSHObstacle::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
 }
 
 
@@ -1,9 +1,9 @@
 #include "stdafx.h"
 #include "boidModel.h"
 
-BoidModelSHWay1::BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color, simParams_t* simP) : BoidModel(clHlpr)
+BoidModelSHWay1::BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<group_t> groups, std::vector<Vec4> goal, simParams_t* simP, bool shLookup) : BoidModel(clHlpr)
 {
-	simTimeDisc = std::vector<const char*>(10);
+	simTimeDisc = std::vector<const char*>(16);
 	simTimeDisc[0] = "Boid Model SH way following";
 	simTimeDisc[1] = "OpenCL Simulation Times:";
 	simTimeDisc[2] = "";
@@ -14,6 +14,16 @@ BoidModelSHWay1::BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::v
 	simTimeDisc[7] = "";
 	simTimeDisc[8] = "";
 	simTimeDisc[9] = "";
+	simTimeDisc[10] = "";
+	simTimeDisc[11] = "";
+	simTimeDisc[12] = "";
+	simTimeDisc[13] = "";
+	simTimeDisc[14] = "";
+	simTimeDisc[15] = "";
+
+	useSHLookup = shLookup;
+	shBasisTimed = false;
+	shBasisTime[0] = shBasisTime[1] = 0.0f;
 
 	context = clHelper->getContext();
 	queue = clHelper->getCmdQueue();
@@ -22,14 +32,27 @@ BoidModelSHWay1::BoidModelSHWay1(CLHelper* clHlpr, std::vector<Vec4> pos, std::v
 	simParams = *simP;
 
 	num = simParams.numBodies;
+	goalPerBoid = goal.empty() ? 0 : 1;
+
+	groupTable = groups;
+	flowField = NULL;
+	buildFlowField();
 
-	createBuffer(pos, vel, goal, color);
-	loadData(goal);
+	createBuffer(pos, vel, group, goal);
+	loadData(groupTable);
 
-	programBoid    = loadProgram(kernel_path + "BoidModelSHWay1_kernel_v1.cl");
+	programBoid    = loadProgram(kernel_path + "BoidModelSHWay1_kernel_v1.cl", clHelper->getSHBasisSource(SH_ORDER_SH_WAY1));
 	programBitonic = loadProgram(kernel_path + "bitonic_sort.cl");
+	//the programs are rebuilt while the model runs when their source changes
+	watchProgram(&programBoid, kernel_path + "BoidModelSHWay1_kernel_v1.cl", SH_ORDER_SH_WAY1);
+	watchProgram(&programBitonic, kernel_path + "bitonic_sort.cl");
 
 	loadKernel();
+	buildSHLookup();
+	tracker = new AgentTracker(clHelper, num);
+	spatialQuery = new SpatialQuery(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin);
+	population = new Population(clHelper, num, simParams.numCells);
+	tracker->setAlive(population->getAlive());
 	log("setup complete - simulation is runable");
 }
 
@@ -42,12 +65,13 @@ BoidModelSHWay1::~BoidModelSHWay1(){
 	glDeleteVertexArrays(1, pos_vao);
 
 	delete shader;
+	delete flowField;
 }
 
 void BoidModelSHWay1::render(){
 	shader->bind();
 	glBindVertexArray(getPosVAO());
-	glDrawArrays(GL_POINTS, 0, num);
+	glDrawArrays(GL_POINTS, 0, getNumBoid());
 	glBindVertexArray(0);
 	shader->unbind();
 }
@@ -69,8 +93,8 @@ void BoidModelSHWay1::simulate(float dt){
 	err = queue.enqueueAcquireGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueAcquireGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueAcquireGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueAcquireGLObjects(&cl_group_vbos_out, NULL, &event);
 	queue.finish();
 
 	//Get grid hash value for every boid
@@ -94,12 +118,15 @@ void BoidModelSHWay1::simulate(float dt){
 
 	//create gridHash
 	err = queue.enqueueNDRangeKernel(kernel_getGridHash, cl::NullRange, cl::NDRange(num), cl::NullRange, NULL, &event);
+	//dead agents are sorted behind the living ones
+	population->markDead(cl_gridHash_unsorted);
 	queue.finish();
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[0] = (endTime - startTime) / 1000;
+	recordStage(STAGE_HASH, (endTime - startTime) / 1000.0);
 
 	//set start and end index to 0
 	unsigned int val = 0;
@@ -107,26 +134,26 @@ void BoidModelSHWay1::simulate(float dt){
 	{
 		err = kernel_memSet.setArg(0, cl_gridStartIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	try
 	{
 		err = kernel_memSet.setArg(0, cl_gridEndIndex);
 		err = kernel_memSet.setArg(1, val);
-		err = kernel_memSet.setArg(2, simParams.numCells);
+		err = kernel_memSet.setArg(2, simParams.numCells + 1);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_memSet, cl::NullRange, cl::NDRange(simParams.numCells + 1), cl::NullRange, NULL, &event);
 	queue.finish();
 
 	//sort gridHash
@@ -146,78 +173,100 @@ void BoidModelSHWay1::simulate(float dt){
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos_out[0]);	//vel out ordered
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos[0]);		//pos in unordered
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos[0]);		//vel in unordered
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal_out);
 		}
 		else {
 			err = kernel_findGridEdgeAndReorder.setArg(6, cl_pos_vbos_out[0]);	//pos in
 			err = kernel_findGridEdgeAndReorder.setArg(7, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_findGridEdgeAndReorder.setArg(2, cl_pos_vbos[0]);		//pos out
 			err = kernel_findGridEdgeAndReorder.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_findGridEdgeAndReorder.setArg(9, cl_goal_in);
-			err = kernel_findGridEdgeAndReorder.setArg(8, cl_goal_out);
-			err = kernel_findGridEdgeAndReorder.setArg(10, cl_color_vbos[0]);
-			err = kernel_findGridEdgeAndReorder.setArg(11, cl_color_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(8, cl_group_vbos[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(12, cl_goal);
+			err = kernel_findGridEdgeAndReorder.setArg(9, cl_group_vbos_out[0]);
+			err = kernel_findGridEdgeAndReorder.setArg(13, cl_goal_out);
 		}
 
 		err = kernel_findGridEdgeAndReorder.setArg(0, cl_gridStartIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(1, cl_gridEndIndex);
 		err = kernel_findGridEdgeAndReorder.setArg(4, cl_gridHash_sorted);
 		err = kernel_findGridEdgeAndReorder.setArg(5, cl_gridIndex_sorted);
-		err = kernel_findGridEdgeAndReorder.setArg(12, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
-		err = kernel_findGridEdgeAndReorder.setArg(13, num);
+		err = kernel_findGridEdgeAndReorder.setArg(10, cl::__local(sizeof(cl_uint)*(LOCAL_PREF + 1)));
+		err = kernel_findGridEdgeAndReorder.setArg(11, num);
+		err = kernel_findGridEdgeAndReorder.setArg(14, goalPerBoid);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
 	err = queue.enqueueNDRangeKernel(kernel_findGridEdgeAndReorder, cl::NullRange, cl::NDRange(num), cl::NDRange(LOCAL_PREF), NULL, &event);
+	//the ids follow their agents into the sorted slots
+	tracker->permute(cl_gridIndex_sorted);
+	population->compact(cl_gridHash_sorted);
 
 	queue.finish();
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[2] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_REORDER, (endTime - startTime) / 1000.0);
+
+#if LAZY_SH_UPDATE
+	//collect the cells whose signature moved since their last projection
+	numDirtyCells = 0;
+	err = queue.enqueueWriteBuffer(cl_dirtyCount, CL_TRUE, 0, sizeof(unsigned int), &numDirtyCells, NULL, &event);
 
 	try
 	{
 		if (counter)
-			err = kernel_evalSH.setArg(0, cl_vel_vbos_out[0]);
+			err = kernel_markDirtySH.setArg(0, cl_vel_vbos_out[0]);
 		else
-			err = kernel_evalSH.setArg(0, cl_vel_vbos[0]);
-
-		err = kernel_evalSH.setArg(1, cl_shEvalX);
-		err = kernel_evalSH.setArg(2, cl_shEvalY);
-		err = kernel_evalSH.setArg(3, cl_shEvalZ);
-		err = kernel_evalSH.setArg(4, cl_coef0X);
-		err = kernel_evalSH.setArg(5, cl_coef0Y);
-		err = kernel_evalSH.setArg(6, cl_coef0Z);
-		err = kernel_evalSH.setArg(7, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(8, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(9, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(10, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(11, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(12, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_evalSH.setArg(13, cl_gridStartIndex);
-		err = kernel_evalSH.setArg(14, cl_gridEndIndex);
+			err = kernel_markDirtySH.setArg(0, cl_vel_vbos[0]);
+
+		err = kernel_markDirtySH.setArg(1, cl_gridStartIndex);
+		err = kernel_markDirtySH.setArg(2, cl_gridEndIndex);
+		err = kernel_markDirtySH.setArg(3, cl_sigCount);
+		err = kernel_markDirtySH.setArg(4, cl_sigVel);
+		err = kernel_markDirtySH.setArg(5, cl_dirtyList);
+		err = kernel_markDirtySH.setArg(6, cl_dirtyCount);
+		err = kernel_markDirtySH.setArg(7, cl::__local(sizeof(Vec4)*(LOCAL_PREF)));
+		err = kernel_markDirtySH.setArg(8, LAZY_SH_TOLERANCE);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
 
-
-
-
-	int localWorkSize = LOCAL_PREF;
-	int globalWorkSize = simParams.numCells * LOCAL_PREF;
-	err = queue.enqueueNDRangeKernel(kernel_evalSH, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &event);
+	err = queue.enqueueNDRangeKernel(kernel_markDirtySH, cl::NullRange, cl::NDRange(simParams.numCells * LOCAL_PREF), cl::NDRange(LOCAL_PREF), NULL, &event);
 
 	event.wait();
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
-	times[4] = (endTime - startTime) / 1000000;
+	double reduceTime = (endTime - startTime) / 1000.0;
+
+	err = queue.enqueueReadBuffer(cl_dirtyCount, CL_TRUE, 0, sizeof(unsigned int), &numDirtyCells);
+
+	//only the dirty cells are projected, all others keep their cached coefficients
+	if (numDirtyCells > 0)
+		reduceTime += evalSH(numDirtyCells, true);
+
+	#if LAZY_SH_VALIDATE_INTERVAL > 0
+	if (++stepCount % LAZY_SH_VALIDATE_INTERVAL == 0)
+		validateSH();
+	#endif
+#else
+	double reduceTime = evalSH(simParams.numCells, false);
+	numDirtyCells = simParams.numCells;
+#endif
+	times[4] = (long)(reduceTime / 1000.0);
+	recordStage(STAGE_REDUCE, reduceTime);
+
+	//the first projection is done, both SH bases are timed on it once
+	if (!shBasisTimed){
+		shBasisTimed = true;
+		timeSHBasis();
+	}
 
 	std::vector<Vec4> C(2 * simParams.numCells);
 	queue.enqueueReadBuffer(cl_shEvalX, CL_TRUE, 0, (size_t)2 * simParams.numCells * sizeof(Vec4), C.data());
@@ -238,21 +287,26 @@ void BoidModelSHWay1::simulate(float dt){
 			err = kernel_simulate.setArg(1, cl_pos_vbos[0]);		//pos out
 			err = kernel_simulate.setArg(2, cl_vel_vbos_out[0]);	//vel in
 			err = kernel_simulate.setArg(3, cl_vel_vbos[0]);		//vel out
-			err = kernel_simulate.setArg(6, cl_goal_out);
+			err = kernel_simulate.setArg(6, cl_group_vbos[0]);		//group ids
+			err = kernel_simulate.setArg(12, cl_goal);		//goals
 		}
 		else{
 			err = kernel_simulate.setArg(1, cl_pos_vbos_out[0]);	//pos out
 			err = kernel_simulate.setArg(0, cl_pos_vbos[0]);		//pos in
 			err = kernel_simulate.setArg(3, cl_vel_vbos_out[0]);	//vel out
 			err = kernel_simulate.setArg(2, cl_vel_vbos[0]);		//vel in
-			err = kernel_simulate.setArg(6, cl_goal_in);
+			err = kernel_simulate.setArg(6, cl_group_vbos_out[0]);	//group ids
+			err = kernel_simulate.setArg(12, cl_goal_out);	//goals
 		}
 
 		err = kernel_simulate.setArg(4, cl_gridStartIndex);
 		err = kernel_simulate.setArg(5, cl_gridEndIndex);
 		err = kernel_simulate.setArg(7, cl_simParams);
 		err = kernel_simulate.setArg(8, cl_range);
-		err = kernel_simulate.setArg(9, dt);
+		err = kernel_simulate.setArg(9, flowField->getFlowDir());
+		err = kernel_simulate.setArg(10, cl_groups);
+		err = kernel_simulate.setArg(11, dt);
+		err = kernel_simulate.setArg(13, goalPerBoid);
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
@@ -271,8 +325,8 @@ void BoidModelSHWay1::simulate(float dt){
 	queue.finish();
 
 	//globalWorkSize = LOCAL_PREF * (simParams.numCells);
-	localWorkSize = LOCAL_PREF;
-	globalWorkSize = simParams.numBodies;
+	int localWorkSize = LOCAL_PREF;
+	int globalWorkSize = simParams.numBodies;
 
 	err = queue.enqueueNDRangeKernel(kernel_simulate, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &eventSim);
 
@@ -280,7 +334,43 @@ void BoidModelSHWay1::simulate(float dt){
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	eventSim.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[3] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SIMULATE, (endTime - startTime) / 1000.0);
+
+#if USE_SH_FOR_PATH && !USE_LOOKAHEAD && SH_FAR_FIELD_INTERVAL > 0
+	//far field is refreshed at a lower rate, the cached correction is applied every step
+	timeFarField = farFieldSH();
+	#if SH_FAR_FIELD_VALIDATE_INTERVAL > 0
+	if (++farFieldValidateStep >= SH_FAR_FIELD_VALIDATE_INTERVAL && farFieldStep % SH_FAR_FIELD_INTERVAL == 0){
+		farFieldValidateStep = 0;
+		validateFarField();
+	}
+	#endif
+
+	try
+	{
+		if (counter){
+			err = kernel_useSH.setArg(0, cl_vel_vbos[0]);		//vel in
+			err = kernel_useSH.setArg(1, cl_vel_vbos_out[0]);	//vel out
+			err = kernel_useSH.setArg(4, cl_pos_vbos[0]);		//pos in
+			err = kernel_useSH.setArg(5, cl_pos_vbos_out[0]);	//pos out
+		}
+		else {
+			err = kernel_useSH.setArg(1, cl_vel_vbos[0]);		//vel out
+			err = kernel_useSH.setArg(0, cl_vel_vbos_out[0]);	//vel in
+			err = kernel_useSH.setArg(5, cl_pos_vbos[0]);		//pos out
+			err = kernel_useSH.setArg(4, cl_pos_vbos_out[0]);	//pos in
+		}
 
+		err = kernel_useSH.setArg(2, cl_shCor);
+		err = kernel_useSH.setArg(3, cl_simParams);
+		err = kernel_useSH.setArg(6, dt);
+		err = kernel_useSH.setArg(7, counter ? cl_group_vbos[0] : cl_group_vbos_out[0]);	//group ids
+		err = kernel_useSH.setArg(8, cl_groups);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+#else
 	try
 	{
 		if (counter){
@@ -302,9 +392,9 @@ void BoidModelSHWay1::simulate(float dt){
 		err = kernel_useSH.setArg(5, cl_shEvalY);
 		err = kernel_useSH.setArg(6, cl_shEvalZ);
 		err = kernel_useSH.setArg(7, cl_simParams);
-		err = kernel_useSH.setArg(10, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(11, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
-		err = kernel_useSH.setArg(12, cl::__local(sizeof(cl_float8)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
+		err = kernel_useSH.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(13, cl_coef0X);
 		err = kernel_useSH.setArg(14, cl_coef0Y);
 		err = kernel_useSH.setArg(15, cl_coef0Z);
@@ -312,10 +402,17 @@ void BoidModelSHWay1::simulate(float dt){
 		err = kernel_useSH.setArg(17, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(18, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
 		err = kernel_useSH.setArg(19, dt);
+	#if USE_SH_FOR_PATH && !USE_LOOKAHEAD
+		err = kernel_useSH.setArg(20, cl_shLookup);
+		err = kernel_useSH.setArg(21, (unsigned int)(useSHLookup ? 1 : 0));
+		err = kernel_useSH.setArg(22, counter ? cl_group_vbos[0] : cl_group_vbos_out[0]);	//group ids
+		err = kernel_useSH.setArg(23, cl_groups);
+	#endif
 	}
 	catch (cl::Error er){
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
+#endif
 
 	localWorkSize = LOCAL_PREF;
 	globalWorkSize = simParams.numBodies;
@@ -326,6 +423,7 @@ void BoidModelSHWay1::simulate(float dt){
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
 	event.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
 	times[5] = (endTime - startTime) / 1000000;
+	recordStage(STAGE_SH, (endTime - startTime) / 1000.0);
 
 	/*
 	unsigned int A[8000];
@@ -337,13 +435,340 @@ void BoidModelSHWay1::simulate(float dt){
 	queue.finish();
 	*/
 
+	tracker->gather(counter ? cl_pos_vbos[0] : cl_pos_vbos_out[0], counter ? cl_vel_vbos[0] : cl_vel_vbos_out[0]);
+	//queries see the grid and the sorted positions of this step
+	spatialQuery->run(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], cl_gridStartIndex, cl_gridEndIndex, tracker->getAgentIds());
+	//despawn and spawn in the newest state (useSH output, group ids and goals of the reorder), they take part from the next sort on
+	population->update(counter ? cl_pos_vbos_out[0] : cl_pos_vbos[0], counter ? cl_vel_vbos_out[0] : cl_vel_vbos[0], dt,
+		counter ? &cl_group_vbos[0] : &cl_group_vbos_out[0], goalPerBoid ? (counter ? &cl_goal : &cl_goal_out) : NULL);
+
 	//Release the VBOs so OpenGL can play with them
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_pos_vbos_out, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos, NULL, &event);
 	err = queue.enqueueReleaseGLObjects(&cl_vel_vbos_out, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos, NULL, &event);
-	err = queue.enqueueReleaseGLObjects(&cl_color_vbos_out, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos, NULL, &event);
+	err = queue.enqueueReleaseGLObjects(&cl_group_vbos_out, NULL, &event);
+}
+
+double BoidModelSHWay1::evalSH(unsigned int numGroups, bool useList){
+	cl_ulong startTime, endTime;
+	cl::Event eventEval;
+
+	try
+	{
+		if (counter)
+			err = kernel_evalSH.setArg(0, cl_vel_vbos_out[0]);
+		else
+			err = kernel_evalSH.setArg(0, cl_vel_vbos[0]);
+
+		err = kernel_evalSH.setArg(1, cl_shEvalX);
+		err = kernel_evalSH.setArg(2, cl_shEvalY);
+		err = kernel_evalSH.setArg(3, cl_shEvalZ);
+		err = kernel_evalSH.setArg(4, cl_coef0X);
+		err = kernel_evalSH.setArg(5, cl_coef0Y);
+		err = kernel_evalSH.setArg(6, cl_coef0Z);
+		err = kernel_evalSH.setArg(7, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(8, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(9, cl::__local(sizeof(cl_float)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(10, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(11, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(12, cl::__local(CLHelper::getSHVecSize(SH_ORDER_SH_WAY1)*(LOCAL_PREF)));
+		err = kernel_evalSH.setArg(13, cl_gridStartIndex);
+		err = kernel_evalSH.setArg(14, cl_gridEndIndex);
+		err = kernel_evalSH.setArg(15, cl_dirtyList);
+		err = kernel_evalSH.setArg(16, (unsigned int)(useList ? 1 : 0));
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int localWorkSize = LOCAL_PREF;
+	int globalWorkSize = numGroups * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_evalSH, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, &eventEval);
+
+	eventEval.wait();
+	eventEval.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	eventEval.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+	return (endTime - startTime) / 1000.0;
+}
+
+long BoidModelSHWay1::farFieldSH(){
+	cl_ulong startTime, endTime;
+	cl::Event eventFar;
+
+	unsigned int k = SH_FAR_FIELD_INTERVAL;
+	unsigned int phase = farFieldStep % k;
+	farFieldStep++;
+
+#if SH_FAR_FIELD_ROUND_ROBIN
+	//cells phase, phase + k, phase + 2k, ...
+	unsigned int stride = k;
+	unsigned int offset = phase;
+	unsigned int numGroups = (simParams.numCells - phase + k - 1) / k;
+#else
+	if (phase != 0)
+		return 0;
+
+	unsigned int stride = 1;
+	unsigned int offset = 0;
+	unsigned int numGroups = simParams.numCells;
+#endif
+
+	try
+	{
+		err = kernel_farFieldSH.setArg(0, cl_shEvalX);
+		err = kernel_farFieldSH.setArg(1, cl_shEvalY);
+		err = kernel_farFieldSH.setArg(2, cl_shEvalZ);
+		err = kernel_farFieldSH.setArg(3, cl_coef0X);
+		err = kernel_farFieldSH.setArg(4, cl_coef0Y);
+		err = kernel_farFieldSH.setArg(5, cl_coef0Z);
+		err = kernel_farFieldSH.setArg(6, cl_simParams);
+		err = kernel_farFieldSH.setArg(7, cl_shCor);
+		err = kernel_farFieldSH.setArg(8, cl_farFieldChange);
+		err = kernel_farFieldSH.setArg(9, cl::__local(sizeof(Vec4)*(LOCAL_PREF)));
+		err = kernel_farFieldSH.setArg(10, stride);
+		err = kernel_farFieldSH.setArg(11, offset);
+		err = kernel_farFieldSH.setArg(12, cl_shLookup);
+		err = kernel_farFieldSH.setArg(13, (unsigned int)(useSHLookup ? 1 : 0));
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_farFieldSH, cl::NullRange, cl::NDRange(numGroups * LOCAL_PREF), cl::NDRange(LOCAL_PREF), NULL, &eventFar);
+
+	eventFar.wait();
+	eventFar.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+	eventFar.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+
+	return (long)((endTime - startTime) / 1000000);
+}
+
+void BoidModelSHWay1::validateFarField(){
+	//the full evaluation runs on a copy of the cache, its change output is the error per cell
+	err = queue.enqueueCopyBuffer(cl_shCor, cl_shCorRef, 0, 0, simParams.numCells * sizeof(Vec4));
+
+	try
+	{
+		err = kernel_farFieldSH.setArg(0, cl_shEvalX);
+		err = kernel_farFieldSH.setArg(1, cl_shEvalY);
+		err = kernel_farFieldSH.setArg(2, cl_shEvalZ);
+		err = kernel_farFieldSH.setArg(3, cl_coef0X);
+		err = kernel_farFieldSH.setArg(4, cl_coef0Y);
+		err = kernel_farFieldSH.setArg(5, cl_coef0Z);
+		err = kernel_farFieldSH.setArg(6, cl_simParams);
+		err = kernel_farFieldSH.setArg(7, cl_shCorRef);
+		err = kernel_farFieldSH.setArg(8, cl_farFieldChange);
+		err = kernel_farFieldSH.setArg(9, cl::__local(sizeof(Vec4)*(LOCAL_PREF)));
+		err = kernel_farFieldSH.setArg(10, (unsigned int)1);
+		err = kernel_farFieldSH.setArg(11, (unsigned int)0);
+		err = kernel_farFieldSH.setArg(12, cl_shLookup);
+		err = kernel_farFieldSH.setArg(13, (unsigned int)(useSHLookup ? 1 : 0));
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_farFieldSH, cl::NullRange, cl::NDRange(simParams.numCells * LOCAL_PREF), cl::NDRange(LOCAL_PREF), NULL, &event);
+
+	std::vector<float> error(simParams.numCells);
+	std::vector<Vec4> reference(simParams.numCells);
+	queue.enqueueReadBuffer(cl_farFieldChange, CL_TRUE, 0, simParams.numCells * sizeof(float), error.data());
+	queue.enqueueReadBuffer(cl_shCorRef, CL_TRUE, 0, simParams.numCells * sizeof(Vec4), reference.data());
+
+	farFieldErrorMax = 0.0f;
+	double sumError = 0.0;
+	double sumReference = 0.0;
+	for (unsigned int i = 0; i < simParams.numCells; i++){
+		if (error[i] > farFieldErrorMax)
+			farFieldErrorMax = error[i];
+		sumError += error[i];
+		sumReference += sqrt(reference[i].x * reference[i].x + reference[i].y * reference[i].y + reference[i].z * reference[i].z);
+	}
+	//error relative to the mean magnitude of the full correction
+	farFieldErrorRel = sumReference > 0.0 ? (float)(sumError / sumReference) : 0.0f;
+}
+
+void BoidModelSHWay1::buildSHLookup(){
+	int gx = simParams.gridSize.x;
+	int gy = simParams.gridSize.y;
+	int gz = simParams.gridSize.z;
+	unsigned int numOffsets = (2 * gx - 1) * (2 * gy - 1) * (2 * gz - 1);
+
+	try
+	{
+		cl_shLookup = clHelper->createBuffer(CL_MEM_READ_WRITE, numOffsets * CLHelper::getSHVecSize(SH_ORDER_SH_WAY1), NULL, &err);
+		err = kernel_buildSHLookup.setArg(0, cl_shLookup);
+		err = kernel_buildSHLookup.setArg(1, cl_simParams);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	int globalWorkSize = ((numOffsets + LOCAL_PREF - 1) / LOCAL_PREF) * LOCAL_PREF;
+	err = queue.enqueueNDRangeKernel(kernel_buildSHLookup, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(LOCAL_PREF), NULL, &event);
+	queue.finish();
+
+	//the table uses the direction between cell centers, the analytic basis the one from the boid
+	//position. Worst case per offset is a boid in a corner of its cell.
+	float cx = simParams.cellSize.x;
+	float cy = simParams.cellSize.y;
+	float cz = simParams.cellSize.z;
+	double sumAngle = 0.0;
+	shLookupAngleMax = 0.0f;
+
+	for (int oy = 1 - gy; oy < gy; oy++){
+		for (int oz = 1 - gz; oz < gz; oz++){
+			for (int ox = 1 - gx; ox < gx; ox++){
+				if (ox == 0 && oy == 0 && oz == 0)
+					continue;
+
+				float dx = ox * cx;
+				float dy = oy * cy;
+				float dz = oz * cz;
+				float len = sqrtf(dx * dx + dy * dy + dz * dz);
+				float angleMax = 0.0f;
+
+				for (int c = 0; c < 8; c++){
+					float ax = dx + ((c & 1) ? cx : -cx) / 2;
+					float ay = dy + ((c & 2) ? cy : -cy) / 2;
+					float az = dz + ((c & 4) ? cz : -cz) / 2;
+					float lenC = sqrtf(ax * ax + ay * ay + az * az);
+					float cosA = (dx * ax + dy * ay + dz * az) / (len * lenC);
+
+					if (cosA > 1.0f)
+						cosA = 1.0f;
+
+					float angle = acosf(cosA) * 180.0f / 3.14159265f;
+					if (angle > angleMax)
+						angleMax = angle;
+				}
+
+				sumAngle += angleMax;
+				if (angleMax > shLookupAngleMax)
+					shLookupAngleMax = angleMax;
+			}
+		}
+	}
+
+	shLookupAngleMean = (float)(sumAngle / (numOffsets - 1));
+
+	std::stringstream strstream;
+	strstream << "SH lookup table: " << numOffsets << " offsets, angular error max. " << shLookupAngleMax << " deg, mean " << shLookupAngleMean << " deg";
+	log(strstream.str());
+}
+
+void BoidModelSHWay1::timeSHBasis(){
+	cl_ulong startTime, endTime;
+	cl::Event eventBasis;
+
+	//scratch output, the cached far field correction stays as it is
+	cl::Buffer shCor, change;
+	try
+	{
+		shCor = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * sizeof(Vec4), NULL, &err);
+		change = clHelper->createBuffer(CL_MEM_READ_WRITE, simParams.numCells * sizeof(float), NULL, &err);
+	}
+	catch (cl::Error er) {
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		return;
+	}
+
+	for (unsigned int lookup = 0; lookup < 2; lookup++){
+		try
+		{
+			err = kernel_farFieldSH.setArg(0, cl_shEvalX);
+			err = kernel_farFieldSH.setArg(1, cl_shEvalY);
+			err = kernel_farFieldSH.setArg(2, cl_shEvalZ);
+			err = kernel_farFieldSH.setArg(3, cl_coef0X);
+			err = kernel_farFieldSH.setArg(4, cl_coef0Y);
+			err = kernel_farFieldSH.setArg(5, cl_coef0Z);
+			err = kernel_farFieldSH.setArg(6, cl_simParams);
+			err = kernel_farFieldSH.setArg(7, shCor);
+			err = kernel_farFieldSH.setArg(8, change);
+			err = kernel_farFieldSH.setArg(9, cl::__local(sizeof(Vec4)*(LOCAL_PREF)));
+			err = kernel_farFieldSH.setArg(10, (unsigned int)1);
+			err = kernel_farFieldSH.setArg(11, (unsigned int)0);
+			err = kernel_farFieldSH.setArg(12, cl_shLookup);
+			err = kernel_farFieldSH.setArg(13, lookup);
+		}
+		catch (cl::Error er){
+			log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+		}
+
+		err = queue.enqueueNDRangeKernel(kernel_farFieldSH, cl::NullRange, cl::NDRange(simParams.numCells * LOCAL_PREF), cl::NDRange(LOCAL_PREF), NULL, &eventBasis);
+
+		eventBasis.wait();
+		eventBasis.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &startTime);
+		eventBasis.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &endTime);
+		shBasisTime[lookup] = (endTime - startTime) / 1000000.0f;
+	}
+
+	std::stringstream strstream;
+	strstream << "SH basis, far field of all cells: analytic " << shBasisTime[0] << "ms, lookup " << shBasisTime[1] << "ms (" << (useSHLookup ? "lookup" : "analytic") << " selected)";
+	log(strstream.str());
+}
+
+void BoidModelSHWay1::validateSH(){
+	size_t array_size_fp8 = simParams.numCells * CLHelper::getSHVecSize(SH_ORDER_SH_WAY1);
+	size_t array_size_fp = simParams.numCells * sizeof(float);
+
+	//keep the lazy field and overwrite the live one with a full projection
+	err = queue.enqueueCopyBuffer(cl_shEvalX, cl_shEvalRefX, 0, 0, array_size_fp8);
+	err = queue.enqueueCopyBuffer(cl_shEvalY, cl_shEvalRefY, 0, 0, array_size_fp8);
+	err = queue.enqueueCopyBuffer(cl_shEvalZ, cl_shEvalRefZ, 0, 0, array_size_fp8);
+	err = queue.enqueueCopyBuffer(cl_coef0X, cl_coef0RefX, 0, 0, array_size_fp);
+	err = queue.enqueueCopyBuffer(cl_coef0Y, cl_coef0RefY, 0, 0, array_size_fp);
+	err = queue.enqueueCopyBuffer(cl_coef0Z, cl_coef0RefZ, 0, 0, array_size_fp);
+	queue.finish();
+
+	evalSH(simParams.numCells, false);
+
+	//the live field is a full projection now, its signatures are those of the current cells.
+	//markDirtySH still holds the arguments of this step, a negative tolerance marks every cell
+	try
+	{
+		err = kernel_markDirtySH.setArg(8, -1.0f);
+		err = queue.enqueueNDRangeKernel(kernel_markDirtySH, cl::NullRange, cl::NDRange(simParams.numCells * LOCAL_PREF), cl::NDRange(LOCAL_PREF));
+		err = kernel_markDirtySH.setArg(8, LAZY_SH_TOLERANCE);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	try
+	{
+		err = kernel_compareSH.setArg(0, cl_shEvalRefX);
+		err = kernel_compareSH.setArg(1, cl_shEvalRefY);
+		err = kernel_compareSH.setArg(2, cl_shEvalRefZ);
+		err = kernel_compareSH.setArg(3, cl_coef0RefX);
+		err = kernel_compareSH.setArg(4, cl_coef0RefY);
+		err = kernel_compareSH.setArg(5, cl_coef0RefZ);
+		err = kernel_compareSH.setArg(6, cl_shEvalX);
+		err = kernel_compareSH.setArg(7, cl_shEvalY);
+		err = kernel_compareSH.setArg(8, cl_shEvalZ);
+		err = kernel_compareSH.setArg(9, cl_coef0X);
+		err = kernel_compareSH.setArg(10, cl_coef0Y);
+		err = kernel_compareSH.setArg(11, cl_coef0Z);
+		err = kernel_compareSH.setArg(12, cl_shError);
+		err = kernel_compareSH.setArg(13, simParams.numCells);
+	}
+	catch (cl::Error er){
+		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
+	}
+
+	err = queue.enqueueNDRangeKernel(kernel_compareSH, cl::NullRange, cl::NDRange(simParams.numCells), cl::NullRange, NULL, &event);
+	queue.finish();
+
+	std::vector<float> error(simParams.numCells);
+	queue.enqueueReadBuffer(cl_shError, CL_TRUE, 0, array_size_fp, error.data());
+
+	shErrorMax = 0.0f;
+	for (unsigned int i = 0; i < simParams.numCells; i++){
+		if (error[i] > shErrorMax)
+			shErrorMax = error[i];
+	}
 }
 
 GLuint BoidModelSHWay1::getPosVBO(){
@@ -368,22 +793,23 @@ GLuint BoidModelSHWay1::getPosVAO(){
 }
 
 int BoidModelSHWay1::getNumBoid(){
-	return num;
+	return population->getLive();
 }
 
 //Private Methods
 
-cl::Program BoidModelSHWay1::loadProgram(const std::string &filename){
+cl::Program BoidModelSHWay1::loadProgram(const std::string &filename, const std::string &header){
 	log("load program");
-	std::string kernelSource;
+	std::string kernelSource = header;
+	size_t headerSize = header.size();
 
 	std::ifstream in(filename, std::ios::in | std::ios::binary);
 	if (in)
 	{
 		in.seekg(0, std::ios::end);
-		kernelSource.resize(in.tellg());
+		kernelSource.resize(headerSize + (size_t)in.tellg());
 		in.seekg(0, std::ios::beg);
-		in.read(&kernelSource[0], kernelSource.size());
+		in.read(&kernelSource[headerSize], kernelSource.size() - headerSize);
 		in.close();
 	}
 	else
@@ -435,10 +861,17 @@ void BoidModelSHWay1::loadKernel(){
 		kernel_bitonicMergeLocal = cl::Kernel(programBitonic, "bitonicMergeLocal", &err);
 		kernel_memSet = cl::Kernel(programBoid, "memSet", &err);
 		kernel_evalSH = cl::Kernel(programBoid, "evalSH", &err);
+		kernel_markDirtySH = cl::Kernel(programBoid, "markDirtySH", &err);
+		kernel_compareSH = cl::Kernel(programBoid, "compareSH", &err);
+
+		kernel_farFieldSH = cl::Kernel(programBoid, "farFieldSH", &err);
+		kernel_buildSHLookup = cl::Kernel(programBoid, "buildSHLookup", &err);
 
 #if USE_SH_FOR_PATH
 	#if USE_LOOKAHEAD
 			kernel_useSH = cl::Kernel(programBoid, "useSHLookahead", &err);
+	#elif SH_FAR_FIELD_INTERVAL > 0
+			kernel_useSH = cl::Kernel(programBoid, "useSHFarField", &err);
 	#else
 			kernel_useSH = cl::Kernel(programBoid, "useSH", &err);
 	#endif
@@ -452,53 +885,75 @@ void BoidModelSHWay1::loadKernel(){
 
 }
 
-void BoidModelSHWay1::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> goal, std::vector<Vec4> color){
+void BoidModelSHWay1::createBuffer(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group, std::vector<Vec4> goal){
 	log("Create buffer for usage");
 
 	size_t array_size_fp4 = num * sizeof(Vec4);
 	size_t array_size_simple = num * sizeof(unsigned int);
-	size_t array_size_edges = simParams.numCells * sizeof(unsigned int);
+	//one more cell behind the grid collects the dead agents
+	size_t array_size_edges = (simParams.numCells + 1) * sizeof(unsigned int);
 	size_t array_size_fp4_cells = simParams.numCells * sizeof(Vec4);
-	size_t array_size_fp8 = 2 * simParams.numCells * sizeof(Vec4);
+	size_t array_size_fp8 = simParams.numCells * CLHelper::getSHVecSize(SH_ORDER_SH_WAY1);
 	size_t array_size_fp = simParams.numCells * sizeof(float);
 
-	createVboBindShader(pos, vel, color);
+	createVboBindShader(pos, vel, group);
 	// create OpenCL buffer from GL VBO
-	cl_pos_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo[0], &err));
-	cl_pos_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
+	cl_pos_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo[0], &err));
+	cl_pos_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, pos_vbo_out[0], &err));
 
-	cl_vel_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo[0], &err));
-	cl_vel_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
+	cl_vel_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo[0], &err));
+	cl_vel_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, vel_vbo_out[0], &err));
 
-	cl_color_vbos.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo[0], &err));
-	cl_color_vbos_out.push_back(cl::BufferGL(context, CL_MEM_READ_WRITE, color_vbo_out[0], &err));
+	cl_group_vbos.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo[0], &err));
+	cl_group_vbos_out.push_back(clHelper->createBufferGL(CL_MEM_READ_WRITE, group_vbo_out[0], &err));
 	//create the OpenCL only arrays
 	try
 	{
-		cl_coef0X = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Y = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_coef0Z = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
-		cl_shEvalX = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalY = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_shEvalZ = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
-		cl_goal_in = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_goal_out = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4, NULL, &err);
-		cl_gridHash_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridHash_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_sorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridIndex_unsorted = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
-		cl_gridStartIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_gridEndIndex = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_range = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
-		cl_simParams = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
-		cl_sumVel = cl::Buffer(context, CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_coef0X = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Y = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0Z = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shEvalX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_groups = clHelper->createBuffer(CL_MEM_READ_ONLY, NUM_GROUPS_MAX * sizeof(group_t), NULL, &err);
+		cl_goal = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_goal_out = clHelper->createBuffer(CL_MEM_READ_WRITE, goalPerBoid ? array_size_fp4 : sizeof(Vec4), NULL, &err);
+		cl_gridHash_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridHash_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_sorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridIndex_unsorted = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_simple, NULL, &err);
+		cl_gridStartIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_gridEndIndex = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_range = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_simParams = clHelper->createBuffer(CL_MEM_READ_ONLY, sizeof(simParams_t), NULL, &err);
+		cl_sumVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_sigCount = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_sigVel = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_dirtyList = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_edges, NULL, &err);
+		cl_dirtyCount = clHelper->createBuffer(CL_MEM_READ_WRITE, sizeof(unsigned int), NULL, &err);
+		cl_shEvalRefX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalRefY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_shEvalRefZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp8, NULL, &err);
+		cl_coef0RefX = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0RefY = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_coef0RefZ = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shError = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shCor = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
+		cl_farFieldChange = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp, NULL, &err);
+		cl_shCorRef = clHelper->createBuffer(CL_MEM_READ_WRITE, array_size_fp4_cells, NULL, &err);
 	}
 	catch (cl::Error er) {
 		log("ERROR: " + std::string(er.what()) + clHelper->oclErrorString(er.err()));
 	}
+
+	//both buffers hold the goals, the first reorder reads either of them
+	if (goalPerBoid){
+		err = queue.enqueueWriteBuffer(cl_goal, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+		err = queue.enqueueWriteBuffer(cl_goal_out, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+	}
 }
 
-void BoidModelSHWay1::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<Vec4> color){
+void BoidModelSHWay1::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec4> vel, std::vector<unsigned char> group){
 	std::vector<Vec4> newDataColor(num);
 
 	for (int i = 0; i < num; i++){
@@ -509,9 +964,9 @@ void BoidModelSHWay1::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	size_t array_size = num * sizeof(Vec4);
 
 	//create shader
-	shader = new Shader("boidTri.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
+	shader = new Shader("boidTriGroup.v.glsl", "boidTri.f.glsl", "boidTri.g.glsl");
 	GLint vertLoc = glGetAttribLocation(shader->id(), "coord3d");
-	GLint colorLoc = glGetAttribLocation(shader->id(), "color");
+	GLint groupLoc = glGetAttribLocation(shader->id(), "group");
 	GLint velLoc = glGetAttribLocation(shader->id(), "vel3d");
 
 	//------VBO 1--------- (in)
@@ -531,10 +986,10 @@ void BoidModelSHWay1::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
@@ -556,22 +1011,40 @@ void BoidModelSHWay1::createVboBindShader(std::vector<Vec4> pos, std::vector<Vec
 	glVertexAttribPointer(velLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our velocity attributes pointer
 	glEnableVertexAttribArray(velLoc);
 
-	color_vbo_out[0] = clHelper->createVBO(&color[0], array_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
+	group_vbo_out[0] = clHelper->createVBO(&group[0], num * sizeof(unsigned char), GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
 
-	glVertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, 0, 0); // Set up our vertex attributes pointer  
-	glEnableVertexAttribArray(colorLoc);
+	glVertexAttribPointer(groupLoc, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0); // Set up our group id attributes pointer
+	glEnableVertexAttribArray(groupLoc);
 
 	glEnableVertexAttribArray(0); // Disable our Vertex Array Object  
 	glBindVertexArray(0);
 
 	log("GL VBO Buffer created");
 }
-void BoidModelSHWay1::loadData(std::vector<Vec4> goal){
-	num = (int)goal.size();
-	size_t array_size_fp4 = num * sizeof(Vec4);
+void BoidModelSHWay1::loadSimParams(){
+	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+}
 
-	err = queue.enqueueWriteBuffer(cl_goal_in, CL_TRUE, 0, array_size_fp4, &goal[0], NULL, &event);
+void BoidModelSHWay1::loadData(std::vector<group_t> groups){
+	err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, 0, groups.size() * sizeof(group_t), &groups[0], NULL, &event);
 	err = queue.enqueueWriteBuffer(cl_simParams, CL_TRUE, 0, sizeof(simParams_t), &simParams, NULL, &event);
+
+	//group colors are uniforms of the shader, the group id attribute selects one of them
+	std::vector<Vec4> groupColor(NUM_GROUPS_MAX, BOID_COLOR);
+	for (size_t i = 0; i < groups.size() && i < NUM_GROUPS_MAX; i++)
+		groupColor[i] = groups[i].color;
+
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), "groupColor"), NUM_GROUPS_MAX, &groupColor[0].x);
+	shader->unbind();
+
+	//invalid signature, every cell is projected in the first step
+	std::vector<unsigned int> sigCount(simParams.numCells, 0xFFFFFFFF);
+	err = queue.enqueueWriteBuffer(cl_sigCount, CL_TRUE, 0, simParams.numCells * sizeof(unsigned int), sigCount.data(), NULL, &event);
+
+	//no far field correction until the cells are refreshed the first time
+	std::vector<Vec4> shCor(simParams.numCells, Vec4(0.0f, 0.0f, 0.0f, 0.0f));
+	err = queue.enqueueWriteBuffer(cl_shCor, CL_TRUE, 0, simParams.numCells * sizeof(Vec4), shCor.data(), NULL, &event);
 	queue.finish();
 }
 
@@ -601,7 +1074,7 @@ void BoidModelSHWay1::bitonicSort(
 
 	size_t localWorkSize, globalWorkSize;
 
-	unsigned long long timeNow = GetTickCount64();
+	double timeNow = Tracer::getInstance().now();
 
 	if (arrayLength <= LOCAL_SIZE_LIMIT)
 	{
@@ -622,6 +1095,7 @@ void BoidModelSHWay1::bitonicSort(
 		globalWorkSize = batch * arrayLength / 2;
 
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 		queue.finish();
 	}
 	else
@@ -640,6 +1114,7 @@ void BoidModelSHWay1::bitonicSort(
 		localWorkSize = LOCAL_SIZE_LIMIT / 2;
 		globalWorkSize = batch * arrayLength / 2;
 		err = queue.enqueueNDRangeKernel(kernel_bitonicSortLocal1, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+		sortPasses->add();
 
 		queue.finish();
 
@@ -669,6 +1144,7 @@ void BoidModelSHWay1::bitonicSort(
 					}
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeGlobal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 				}
 				else
@@ -695,13 +1171,16 @@ void BoidModelSHWay1::bitonicSort(
 
 
 					err = queue.enqueueNDRangeKernel(kernel_bitonicMergeLocal, cl::NullRange, cl::NDRange(globalWorkSize), cl::NDRange(localWorkSize), NULL, NULL);
+					sortPasses->add();
 					queue.finish();
 					break;
 				}
 			}
 		}
 	}
-	times[1] = GetTickCount64() - timeNow;
+	double sortTime = Tracer::getInstance().now() - timeNow;
+	times[1] = (long)sortTime;
+	recordStage(STAGE_SORT, sortTime);
 }
 
 cl_uint BoidModelSHWay1::factorRadix2(cl_uint& log2L, cl_uint L){
@@ -735,12 +1214,12 @@ std::vector<const char*> BoidModelSHWay1::getSimTimeDescriptions(){
 	std::stringstream strstream;
 
 	strstream.str(std::string());
-	strstream << "Calculate Grid Hash time: " << times[0] << "ns";
+	strstream << "Calculate Grid Hash time: " << times[0] << "us";
 	stringHashTime = strstream.str();
 	simTimeDisc[4] = stringHashTime.c_str();
 
 	strstream.str(std::string());
-	strstream << "Sorting time: " << times[1] << "ms";
+	strstream << "Sorting time: " << times[1] << "us";
 	stringSortTime = strstream.str();
 	simTimeDisc[5] = stringSortTime.c_str();
 
@@ -764,39 +1243,95 @@ std::vector<const char*> BoidModelSHWay1::getSimTimeDescriptions(){
 	stringSHTime = strstream.str();
 	simTimeDisc[9] = stringSHTime.c_str();
 
+	strstream.str(std::string());
+	strstream << "SH cells projected: " << (100.f * numDirtyCells) / simParams.numCells << "%";
+	stringDirtyCells = strstream.str();
+	simTimeDisc[10] = stringDirtyCells.c_str();
+
+	strstream.str(std::string());
+	strstream << "SH lazy max. error: " << shErrorMax;
+	stringSHError = strstream.str();
+	simTimeDisc[11] = stringSHError.c_str();
+
+	strstream.str(std::string());
+#if SH_FAR_FIELD_ROUND_ROBIN
+	strstream << "Far field time (1/" << SH_FAR_FIELD_INTERVAL << " cells): " << timeFarField << "ms";
+#else
+	strstream << "Far field time (every " << SH_FAR_FIELD_INTERVAL << " steps): " << timeFarField << "ms";
+#endif
+	stringFarFieldTime = strstream.str();
+	simTimeDisc[12] = stringFarFieldTime.c_str();
+
+	strstream.str(std::string());
+	strstream << "Far field error vs. full evaluation max.: " << farFieldErrorMax << ", mean " << 100.0f * farFieldErrorRel << "%";
+	stringFarFieldChange = strstream.str();
+	simTimeDisc[13] = stringFarFieldChange.c_str();
+
+	strstream.str(std::string());
+	if (useSHLookup)
+		strstream << "SH basis: lookup (max. " << shLookupAngleMax << " deg, mean " << shLookupAngleMean << " deg)";
+	else
+		strstream << "SH basis: analytic";
+	strstream << ", far field analytic/lookup: " << shBasisTime[0] << "/" << shBasisTime[1] << "ms";
+	stringSHBasis = strstream.str();
+	simTimeDisc[14] = stringSHBasis.c_str();
+
+	strstream.str(std::string());
+	if (flowField->getNumGoals() > 0)
+		strstream << "Flow fields: " << flowField->getNumGoals() << " goals, build " << flowField->getBuildTime() << "ms (" << flowField->getIterations() << " steps)";
+	else
+		strstream << "Flow fields: off (straight path to the goal)";
+	stringFlowField = strstream.str();
+	simTimeDisc[15] = stringFlowField.c_str();
+
 	return simTimeDisc;
 }
 
-void BoidModelSHWay1::getFollowedBoid(unsigned int* boidIndex, Vec4* pos, Vec4* vel){
-	size_t size = sizeof(unsigned int)* num;
-	std::vector<unsigned int> sortedHash(num);
-	queue.enqueueReadBuffer(cl_gridIndex_sorted, CL_TRUE, 0, size, sortedHash.data());
-	queue.finish();
+bool BoidModelSHWay1::getCellOccupancy(unsigned int* occupied, unsigned int* maxCount){
+	return readCellOccupancy(queue, cl_gridStartIndex, cl_gridEndIndex, occupied, maxCount);
+}
 
-	for (int i = 0; i < num; i++){
-		if (sortedHash[i] == *boidIndex){
-			*boidIndex = i;
-			break;
-		}
-	}
+void BoidModelSHWay1::setGroup(unsigned int id, group_t group){
+	if (id >= groupTable.size())
+		return;
 
+	Vec4 goal = groupTable[id].goal;
+	groupTable[id] = group;
 
+	//a moved goal needs new flow fields, the flow field ids of all groups may change
+	if (goal.x != group.goal.x || goal.y != group.goal.y || goal.z != group.goal.z){
+		buildFlowField();
+		err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, 0, groupTable.size() * sizeof(group_t), &groupTable[0], NULL, &event);
+	}
+	else{
+		groupTable[id].goal.w = goal.w;
+		err = queue.enqueueWriteBuffer(cl_groups, CL_TRUE, id * sizeof(group_t), sizeof(group_t), &groupTable[id], NULL, &event);
+	}
 
-	Vec4 v;
-	GLuint vbo = getVelVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &v);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	std::string name = "groupColor[" + std::to_string(id) + "]";
+	shader->bind();
+	glUniform4fv(glGetUniformLocation(shader->id(), name.c_str()), 1, &group.color.x);
+	shader->unbind();
+}
 
-	(*vel).set(v.x, v.y, v.z, 0.0);
+void BoidModelSHWay1::buildFlowField(){
+	std::vector<Vec4> goal(groupTable.size());
+	for (size_t i = 0; i < groupTable.size(); i++)
+		goal[i] = groupTable[i].goal;
 
-	Vec4 p;
-	vbo = getPosVBO();
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(Vec4)* *boidIndex, sizeof(Vec4), &p);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//boids with their own goals walk the straight path, the groups need no flow fields
+	std::vector<Vec4> flowGoals = FlowField::assignGoalIds(&goal, goalPerBoid ? 0 : FLOW_FIELD_MAX_GOALS);
+	for (size_t i = 0; i < groupTable.size(); i++)
+		groupTable[i].goal.w = goal[i].w;
+
+	//the program of the flow fields is built once, later goals only solve the fields again
+	if (flowField == NULL)
+		flowField = new FlowField(clHelper, simParams.gridSize, simParams.cellSize, simParams.worldOrigin, flowGoals);
+	else
+		flowField->setGoals(flowGoals);
 
-	(*pos).set(p.x, p.y, p.z, 0.0);
+	//no obstacles in this model, every cell can be entered
+	flowField->build(std::vector<unsigned char>(simParams.numCells, 0));
 }
 
 
@@ -26,6 +26,9 @@ GFX::GFX(){
 	deltaY = 0.f;
 
 	follow = false;
+
+	recorder = NULL;
+	recording = false;
 }
 
 GFX::~GFX(){}
@@ -37,6 +40,9 @@ bool GFX::initOpenGL(){
 	glutInitDisplayMode(GLUT_RGBA | GLUT_ALPHA | GLUT_DOUBLE | GLUT_DEPTH);
 	glutInitWindowSize(windowWidth, windowHeight);
 	glutCreateWindow("Behavioural Spherical Harmonic - Agent-based Simulation");
+	//the window only provides the GL context (shared with CL), the frames go into the offscreen framebuffer
+	if (recording && recordOptions.headless)
+		glutHideWindow();
 	
 	GLenum glew_status = glewInit();
 	if (glew_status != GLEW_OK) {
@@ -49,6 +55,11 @@ bool GFX::initOpenGL(){
 		return FALSE;
 	}
 
+	if (recording && !GLEW_VERSION_3_2) {
+		fprintf(stderr, "Error: recording needs OpenGL 3.2 (framebuffer, pixel buffer and sync objects)\n");
+		return FALSE;
+	}
+
 	//setup callbacks
 	setupRenderCallback();
 	setupIdleCallback();
@@ -64,17 +75,47 @@ bool GFX::initOpenGL(){
 	glEnable(GL_DEPTH_TEST);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	
+	if (recording){
+		recorder = new FrameRecorder(recordOptions);
+		if (!recorder->isReady()){
+			delete recorder;
+			recorder = NULL;
+			return FALSE;
+		}
+	}
 
 	return TRUE;
 }
 
+void GFX::setRecording(const FrameRecorder::options_t &options){
+	recordOptions = options;
+	recording = true;
+
+	//everything is laid out for the size of the recorded frames
+	windowWidth = options.width;
+	windowHeight = options.height;
+	aspectRatio = (float)windowWidth / (float)windowHeight;
+	projection = glm::perspective(fov, aspectRatio, nearClip, farClip);
+}
+
+bool GFX::isRecording(){
+	return recording;
+}
+
 void GFX::startRendering(){
 	glutMainLoop();
 }
 
 void GFX::render(){
-	//make a simulation step
-	Simulation::getInstance().simulationStep();
+	//everything from here to the next call belongs to the new frame of the trace
+	Tracer::getInstance().nextFrame();
+	TraceSpan span("GFX::render");
+
+	//simulates first without the simulation thread, the boids are drawn from the newest published state
+	Simulation::getInstance().beginFrame();
+
+	if (recorder != NULL)
+		recorder->bind();
 
 	glViewport(0, 0, windowWidth, windowHeight);
 	glClearColor(1.0, 1.0, 1.0, 1.0);
@@ -88,6 +129,17 @@ void GFX::render(){
 
 	//worldBox->render();
 
+	Simulation::getInstance().endFrame();
+
+	if (recorder != NULL){
+		recorder->capture();
+		recorder->present(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+		if (recorder->isDone()){
+			appDestroyHandler();
+			return;
+		}
+	}
+
 	glutSwapBuffers();
 }
 
@@ -206,11 +258,18 @@ void GFX::keyboardHandler(unsigned char key, int x, int y){
 	case 'G':
 	case 's':	//make skybox invisible/visible
 	case 'S':	
+	case 'p':	//write the trace of the last frames
+	case 'P':
+	case 'b':	//benchmark the spatial queries
+	case 'B':
+	case 'e':	//toggle the entrance and exit of boids
+	case 'E':
 		Simulation::getInstance().keyPress(key); //handled by controller
 		break;
 	case '+':	//increase boids
 	case '-':	//decrease boids
 		follow = false;
+		Simulation::getInstance().setProbes(std::vector<unsigned int>());
 		setCam(currentCamPos);
 		Simulation::getInstance().keyPress(key); //handled by controller
 		break;
@@ -222,12 +281,14 @@ void GFX::keyboardHandler(unsigned char key, int x, int y){
 	case 'F':
 		if (follow){
 			follow = false;
+			Simulation::getInstance().setProbes(std::vector<unsigned int>());
 			setCam(currentCamPos);
 		}
 		else
 		{
 			follow = true;
 			boidFollowed = rand() % Simulation::getInstance().getBoidModelNumberOfBoids();
+			Simulation::getInstance().setProbes(std::vector<unsigned int>(1, boidFollowed));
 		}
 		break;
 	case 'c':
@@ -349,6 +410,10 @@ void GFX::windowResizeHandler(int w, int h){
 	if (h == 0)
 		h = 1;
 
+	//the recorded frames keep their size, the window only shows them scaled
+	if (recording)
+		return;
+
 	windowWidth = w;
 	windowHeight = h;
 	
@@ -359,6 +424,13 @@ void GFX::windowResizeHandler(int w, int h){
 }
 
 void GFX::appDestroyHandler(){
+	Simulation::getInstance().stop();
+
+	//the frames still in flight are written before the context goes away
+	if (recorder != NULL){
+		delete recorder;
+		recorder = NULL;
+	}
 	glutLeaveMainLoop();
 }
 
@@ -371,18 +443,22 @@ void GFX::idleHandler(){
 
 	if (follow){
 		float posX, posY, posZ, velX, velY, velZ;
-		Simulation::getInstance().getPosVelOfBoid(&boidFollowed, &posX, &posY, &posZ, &velX, &velY, &velZ);
-		camCenter = glm::vec3(posX, posY, posZ);
-		glm::vec3 vel = glm::vec3(velX, velY, velZ);
-		vel = glm::normalize(vel);
-		eye = camCenter - CAM_FOLLOW_DISTANCE_FACTOR * vel + 1.5f * glm::vec3(-vel.z, 0.0f, vel.x);
-		eyeToCam = camCenter - eye;
-		eyeOrtho = glm::vec3(eyeToCam.z, 0.0, -eyeToCam.x);
+		//the camera stays where it is until the first readback of the boid arrived
+		if (Simulation::getInstance().getPosVelOfBoid(boidFollowed, &posX, &posY, &posZ, &velX, &velY, &velZ)){
+			camCenter = glm::vec3(posX, posY, posZ);
+			glm::vec3 vel = glm::vec3(velX, velY, velZ);
+			vel = glm::normalize(vel);
+			eye = camCenter - CAM_FOLLOW_DISTANCE_FACTOR * vel + 1.5f * glm::vec3(-vel.z, 0.0f, vel.x);
+			eyeToCam = camCenter - eye;
+			eyeOrtho = glm::vec3(eyeToCam.z, 0.0, -eyeToCam.x);
+		}
 	}
 
 	glm::mat4 view = glm::lookAt(eye, camCenter, camPitch);
 	glm::mat4 mvp = projection * view * model;
 	
+	//the boids are drawn with the identity model matrix, the camera decides their level of detail
+	Simulation::getInstance().setRegionOfInterest(projection * view, eye);
 
 	std::vector<Renderable*> renderList = Simulation::getInstance().getRenderList();
 
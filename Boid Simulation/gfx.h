@@ -6,6 +6,7 @@
 #include "worldBox.h"
 #include "simulation.h"
 #include "overlayText.h"
+#include "frameRecorder.h"
 
 /* 
   Display class for the simulation (singleton usage).
@@ -48,6 +49,11 @@ class GFX {
 		// holds the current camera preset position
 		unsigned int currentCamPos;
 
+		// records the frames into an image sequence, NULL if not recording
+		FrameRecorder* recorder;
+		FrameRecorder::options_t recordOptions;
+		bool recording;
+
 		// angle for the camera, calculated by mouse movement
 		float angleX;
 		float angleY;
@@ -87,6 +93,11 @@ class GFX {
 		bool initOpenGL();
 		void startRendering();
 
+		//record the frames offscreen at the size of options, call before initOpenGL
+		void setRecording(const FrameRecorder::options_t &options);
+		//frames are recorded, the simulation advances by RECORD_FRAME_DT per frame
+		bool isRecording();
+
 		//set camera to preset camera positions
 		void setCam(unsigned int camPos);
 		//draw output
@@ -0,0 +1,59 @@
+/*
+	Tracking of agents through the reordering of the grid models. The models move the agent of
+	slot gridIndex[i] into slot i every step, permuteAgents applies the same move to the id of
+	the agent in every slot and writes the inverse, the slot of every id. gatherProbes then
+	looks up a set of tracked ids in one step and copies their position and velocity into a
+	small buffer for the host.
+*/
+
+/*agentIdOut[i] = agentIdIn[gridIndex[i]] and agentSlot[agentIdOut[i]] = i*/
+__kernel void permuteAgents(
+	__global const uint *gridIndex,		//input: old slot of the agent now in slot i
+	__global const uint *agentIdIn,		//input: id of the agent in every slot before the step
+	__global uint *agentIdOut,			//output: id of the agent in every slot after the step
+	__global uint *agentSlot,			//output: slot of every id after the step
+	uint num
+){
+	uint i = get_global_id(0);
+	if (i >= num)
+		return;
+
+	uint id = agentIdIn[gridIndex[i]];
+	agentIdOut[i] = id;
+	agentSlot[id] = i;
+}
+
+/*probes[2 * p] is the position, probes[2 * p + 1] the velocity of agent probeIds[p]. The w of
+the position is 1 if the agent is alive, 0 if it was despawned and its slot is free.
+Two component models store x and z, y is filled in with yPos and yVel*/
+__kernel void gatherProbes(
+	__global const uint *probeIds,
+	__global const uint *agentSlot,
+	__global const float *pos,
+	__global const float *vel,
+	__global const uchar *alive,
+	__global float4 *probes,
+	uint components,
+	float yPos,
+	float yVel,
+	uint count
+){
+	uint p = get_global_id(0);
+	if (p >= count)
+		return;
+
+	uint slot = agentSlot[probeIds[p]];
+	float living = alive[slot] ? 1.0f : 0.0f;
+	if (components == 2){
+		float2 ps = vload2(slot, pos);
+		float2 vs = vload2(slot, vel);
+		probes[2 * p] = (float4)(ps.x, yPos, ps.y, living);
+		probes[2 * p + 1] = (float4)(vs.x, yVel, vs.y, 0.0f);
+	}
+	else{
+		float4 ps = vload4(slot, pos);
+		float4 vs = vload4(slot, vel);
+		probes[2 * p] = (float4)(ps.xyz, living);
+		probes[2 * p + 1] = (float4)(vs.xyz, 0.0f);
+	}
+}
@@ -0,0 +1,240 @@
+/*
+	Native 2D version of boidModelGrid_2D_kernel. Boids live in the x/z plane of the world,
+	position and velocity are float2 (x, z) and the grid is hashed with 2D cell keys.
+	One work item per boid, neighbours are taken from the 9 surrounding cells.
+*/
+
+#define boundingBoxFactor 2
+
+typedef struct{
+    float x;
+    float y;
+    float z;
+} Float3;
+
+typedef struct{
+    uint x;
+    uint y;
+    uint z;
+}Uint3;
+
+typedef struct{
+    Uint3 gridSize;
+    uint numCells;
+    Float3 worldOrigin;
+    Float3 cellSize;
+
+    uint numBodies;
+	uint localSize;
+
+	float wSeparation;
+	float wAlignment;
+	float wCohesion;
+	float wOwn;
+	float wPath;
+
+	float maxVel;
+	float maxVelCor
+} simParams_t;
+
+__kernel void memSet(
+    __global uint *d_Data,
+    uint val,
+    uint N
+){
+    if(get_global_id(0) < N)
+        d_Data[get_global_id(0)] = val;
+}
+
+/*cell of a position in the plane, pos.y is the z axis of the world*/
+int2 getGridPos(
+	float2 pos, 
+	__constant simParams_t* params)
+{
+	 int2 gridPos;
+	 gridPos.x = (int) floor((pos.x - params->worldOrigin.x)/params->cellSize.x);
+	 gridPos.y = (int) floor((pos.y - params->worldOrigin.z)/params->cellSize.z);
+	 return gridPos;
+}
+
+/*correction velocity for boids in the border cells*/
+float2 checkAndCorrectBoundaries(int2 gridPos, __constant simParams_t* params)
+{
+	float2 cor = (float2)(0.0f, 0.0f);
+
+	if(gridPos.x < boundingBoxFactor)
+		cor.x = params->maxVelCor;
+	else if(gridPos.x >= (int)params->gridSize.x - boundingBoxFactor)
+		cor.x = -params->maxVelCor;
+
+	if(gridPos.y < boundingBoxFactor)
+		cor.y = params->maxVelCor;
+	else if(gridPos.y >= (int)params->gridSize.z - boundingBoxFactor)
+		cor.y = -params->maxVelCor;
+
+	return cor;
+}
+
+__kernel void getGridHash(
+	__global const float2* posUnsorted, 
+	__global int* gridHashUnsorted, 
+	__global int* gridIndexUnsorted, 
+	__constant simParams_t* params)
+{
+	int id = get_global_id(0);
+	int2 gridPos = getGridPos(posUnsorted[id], params);
+	gridPos = clamp(gridPos, (int2)(0, 0), (int2)(params->gridSize.x - 1, params->gridSize.z - 1));
+
+	gridHashUnsorted[id] = gridPos.x + (params->gridSize.x) * gridPos.y;
+	gridIndexUnsorted[id] = id;
+}
+
+__kernel void findGridEdgeAndReorder(
+    __global uint   *cellStart,     //output: cell start index
+    __global uint   *cellEnd,       //output: cell end index
+    __global float2 *reorderedPos,  //output: reordered by cell hash positions
+    __global float2 *reorderedVel,  //output: reordered by cell hash velocities
+
+    __global const uint   *gridHash,    //input: sorted grid hashes
+    __global const uint   *gridIndex,   //input: particle indices sorted by hash
+    __global const float2 *unsortedPos,     //input: positions array sorted by hash
+    __global const float2 *unsortedVel,     //input: velocity array sorted by hash
+    __local uint *localHash,          //get_group_size(0) + 1 elements
+    uint    numParticles
+){
+    uint hash;
+    const uint index = get_global_id(0);
+
+    //Handle case when no. of particles not multiple of block size
+    if(index < numParticles){
+        hash = gridHash[index];
+
+        //Load hash data into local memory so that we can look 
+        //at neighboring particle's hash value without loading
+        //two hash values per thread
+        localHash[get_local_id(0) + 1] = hash;
+
+        //First thread in block must load neighbor particle hash
+        if(index > 0 && get_local_id(0) == 0)
+            localHash[0] = gridHash[index - 1];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(index < numParticles){
+        //Border case
+        if(index == 0)
+            cellStart[hash] = 0;
+
+        //Main case
+        else{
+            if(hash != localHash[get_local_id(0)])
+                cellEnd[localHash[get_local_id(0)]]  = cellStart[hash] = index;
+        };
+
+        //Another border case
+        if(index == numParticles - 1)
+            cellEnd[hash] = numParticles;
+
+
+        //Now use the sorted index to reorder the pos and vel arrays
+        uint sortedIndex = gridIndex[index];
+
+        reorderedPos[index] = unsortedPos[sortedIndex];
+        reorderedVel[index] = unsortedVel[sortedIndex];
+	}  
+}
+
+/*flocking rules of one boid against the boids of the 9 cells around it.
+  Same rules as the 3D grid models, a boid is visible if it is not within 45 degrees behind*/
+float2 flock(
+	uint id,
+	__global const float2* pos,
+	__global const float2* vel,
+	__global const uint *cellStart,
+	__global const uint *cellEnd,
+	__constant simParams_t* simParams)
+{
+	float2 posOwn = pos[id];
+	float2 velOwn = vel[id];
+	float2 perceivedPos = (float2)(0.0f, 0.0f);
+	float2 perceivedVel = (float2)(0.0f, 0.0f);
+	float2 separation = (float2)(0.0f, 0.0f);
+	int flockMatesVisible = 0;
+
+	int2 gridPos = getGridPos(posOwn, simParams);
+	int2 gridMax = (int2)(simParams->gridSize.x - 1, simParams->gridSize.z - 1);
+
+	for(int z = max(gridPos.y - 1, 0); z <= min(gridPos.y + 1, gridMax.y); z++){
+		for(int x = max(gridPos.x - 1, 0); x <= min(gridPos.x + 1, gridMax.x); x++){
+			uint cell = x + simParams->gridSize.x * z;
+			uint end = cellEnd[cell];
+
+			for(uint i = cellStart[cell]; i < end; i++){
+				if(i == id)
+					continue;
+
+				float2 p = pos[i];
+				float2 distance = p - posOwn;					//distance vector to other boid
+
+				float dotP = dot(-velOwn, distance);
+				float lenD = fast_length(distance);
+				float angle = dotP / (fast_length(velOwn) * lenD);	//calculate acute angle between self and other boid
+
+				if((dotP < 0.f) || ((acospi(angle) * 180) > 45)){	//check if other boid is visible
+					flockMatesVisible++;
+					perceivedPos += p;
+					perceivedVel += vel[i];
+
+					if(lenD < 2.5f)								//check if other boid is near enough to separate
+						separation -= distance;
+				}
+			}
+		}
+	}
+
+	//if other boids are visible calculate perceived steering to center of mass / alignment of velocities
+	if(flockMatesVisible >= 1){
+		perceivedPos = (perceivedPos / flockMatesVisible) - posOwn;
+		perceivedVel = (perceivedVel / flockMatesVisible) - velOwn;
+	}
+
+	return velOwn * simParams->wOwn + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * simParams->wSeparation;
+}
+
+/*truncate velocity to max velocity, using the magnitude is nicer than clamping it*/
+float2 truncateVel(float2 vel, float maxVel)
+{
+	float len = fast_length(vel);
+
+	if(len > maxVel)
+		vel = (vel / len) * maxVel;
+
+	return vel;
+}
+
+/*simulation step, one work item per boid*/
+__kernel void simulate( __global const float2* pos,
+						__global float2* pos_out, 
+						__global const float2* vel, 
+						__global float2* vel_out, 
+						__global const uint *cellStart, 
+						__global const uint *cellEnd,
+						__constant simParams_t* simParams,
+						float dt)
+{
+	uint id = get_global_id(0);
+	if(id >= simParams->numBodies)
+		return;
+
+	float2 posOwn = pos[id];
+	float2 velOwn = flock(id, pos, vel, cellStart, cellEnd, simParams);
+	velOwn = truncateVel(velOwn, simParams->maxVel);
+
+	//add correction velocity if boid in border cell
+	velOwn += checkAndCorrectBoundaries(getGridPos(posOwn, simParams), simParams);
+
+	//write back velocity and new position
+	vel_out[id] = velOwn;
+	pos_out[id] = posOwn + velOwn * dt;
+}
@@ -45,6 +45,16 @@ typedef struct{
 	float maxVelCor
 } simParams_t;
 
+//attributes shared by all agents of a group, indexed by the per-agent group id
+typedef struct{
+	float4 goal;
+	float4 color;
+	float wPath;
+	float wSeparation;
+	float maxVel;
+	float pad;
+} group_t;
+
 __kernel void memSet(
 	__global uint *d_Data,
 	uint val,
@@ -142,12 +152,13 @@ __kernel void findGridEdgeAndReorder(
 	__global const uint   *gridIndex,   //input: particle indices sorted by hash
 	__global const float4 *unsortedPos,     //input: positions array sorted by hash
 	__global const float4 *unsortedVel,     //input: velocity array sorted by hash
-	__global const float4 *unsortedGoal,
-	__global float4 *reorderedGoal,
-	__global const float4 *unsortedColor,
-	__global float4 *reorderedColor,
+	__global const uchar  *unsortedGroup,   //input: group id per particle
+	__global uchar  *reorderedGroup,  //output: reordered by cell hash group ids
 	__local uint *localHash,          //get_group_size(0) + 1 elements
-	uint    numParticles
+	uint    numParticles,
+	__global const float4 *unsortedGoal,    //input: own goal per particle, only read with goalPerBoid
+	__global float4 *reorderedGoal,  //output: reordered by cell hash goals
+	uint    goalPerBoid
 	){
 	uint hash;
 	const uint index = get_global_id(0);
@@ -188,13 +199,13 @@ __kernel void findGridEdgeAndReorder(
 		uint sortedIndex = gridIndex[index];
 		float4 pos = unsortedPos[sortedIndex];
 		float4 vel = unsortedVel[sortedIndex];
-		float4 goal = unsortedGoal[sortedIndex];
-		float4 color = unsortedColor[sortedIndex];
+		uchar group = unsortedGroup[sortedIndex];
 
 		reorderedPos[index] = pos;
 		reorderedVel[index] = vel;
-		reorderedGoal[index] = goal;
-		reorderedColor[index] = color;
+		reorderedGroup[index] = group;
+		if (goalPerBoid)
+			reorderedGoal[index] = unsortedGoal[sortedIndex];
 	}
 }
 
@@ -208,10 +219,14 @@ __kernel void simulate(
 	__global float4* vel_out,
 	__global const uint *cellStart,
 	__global const uint *cellEnd,
-	__global const float4 *goal,
+	__global const uchar *group,
 	__constant simParams_t* simParams,
 	__global uint *range_out,
-	float dt)
+	__global const float4 *flowDir,
+	__constant group_t *groups,
+	float dt,
+	__global const float4 *goal,
+	uint goalPerBoid)
 {
 	uint id = get_global_id(0);
 
@@ -293,16 +308,33 @@ __kernel void simulate(
 		perceivedVel = (perceivedVel / flockMatesVisible) - velOwn;
 	}
 
-	//calculate straight path to goal
-	float4 g = goal[id];
-	g.w = 0.0f;
+	//steer along the flow field of the goal id in goal.w of the group. Straight path to the goal
+	//without a flow field (id < 0), in the goal cell and in cells which can not reach the goal.
+	group_t grp = groups[group[id]];
+	float4 g = grp.goal;
+	float4 path = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	//the own goal of the boid has no flow field
+	if (goalPerBoid){
+		g = goal[id];
+		g.w = -1.0f;
+	}
 
-	float4 path = g - posOwn;
-	path.w = 0.0f;
-	path = fast_normalize(path);
+	if (g.w >= 0.0f){
+		int4 cellPos = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(simParams->gridSize.x - 1, simParams->gridSize.y - 1, simParams->gridSize.z - 1, 0));
+		uint cell = cellPos.x + simParams->gridSize.x * cellPos.z + simParams->gridSize.x * simParams->gridSize.z * cellPos.y;
+		path = flowDir[(uint)g.w * simParams->numCells + cell];
+	}
+
+	if (path.x == 0.0f && path.y == 0.0f && path.z == 0.0f){
+		g.w = 0.0f;
+		path = g - posOwn;
+		path.w = 0.0f;
+		path = fast_normalize(path);
+	}
 
 	//calculate new velocities 
-	velOwn = velOwn * simParams->wOwn + path * simParams->wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * simParams->wSeparation;
+	velOwn = velOwn * simParams->wOwn + path * grp.wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * grp.wSeparation;
 	velOwn.w = 0.0;
 
 	//truncate velocity to max velocity
@@ -311,10 +343,10 @@ __kernel void simulate(
 
 	float len = fast_length(velOwn);
 
-	if (len > simParams->maxVel){
-		velOwn.x = (velOwn.x / len) * simParams->maxVel;
-		velOwn.z = (velOwn.z / len) * simParams->maxVel;
-		velOwn.y = (velOwn.y / len) * simParams->maxVel;
+	if (len > grp.maxVel){
+		velOwn.x = (velOwn.x / len) * grp.maxVel;
+		velOwn.z = (velOwn.z / len) * grp.maxVel;
+		velOwn.y = (velOwn.y / len) * grp.maxVel;
 	}
 
 
@@ -327,45 +359,16 @@ __kernel void simulate(
 }
 
 
-/*Evaluete 3. order SH. Numerical implementation from P.P. Sloan
-float8 is used to store the 9 coefficients because coefficient 0 is
-constant it is just added at the reconstruction.
+/*SHEval, SHDot and SHProduct of the band order SH_ORDER come from kernels/sh_basis.cl,
+  which the host puts in front of this file.
 */
-float8 SHEval3(float4 vel_in)
-{
-	float4 vel = vel_in;
-	float8 pSH;
-	float fC0, fC1, fS0, fS1, fTmpA, fTmpB, fTmpC;
-	float fZ2 = vel.z*vel.z;
-
-	//pSH.0 = 0.2820947917738781f;
-	pSH.s1 = 0.4886025119029199f*vel.z;
-	pSH.s5 = 0.9461746957575601f*fZ2 + -0.3153915652525201f;
-	fC0 = vel.x;
-	fS0 = vel.y;
-
-	fTmpA = -0.48860251190292f;
-	pSH.s2 = fTmpA*fC0;
-	pSH.s0 = fTmpA*fS0;
-	fTmpB = -1.092548430592079f*vel.z;
-	pSH.s6 = fTmpB*fC0;
-	pSH.s4 = fTmpB*fS0;
-	fC1 = vel.x*fC0 - vel.y*fS0;
-	fS1 = vel.x*fS0 + vel.y*fC0;
-
-	fTmpC = 0.5462742152960395f;
-	pSH.s7 = fTmpC*fC1;
-	pSH.s3 = fTmpC*fS1;
-
-	return pSH;
-}
 
 __kernel void obstacleSH(__global float4* cor,
 	__global uint* startI,
 	__global uint* endI,
-	__global float8* sh_evalX,
-	__global float8* sh_evalY,
-	__global float8* sh_evalZ,
+	__global shvec_t* sh_evalX,
+	__global shvec_t* sh_evalY,
+	__global shvec_t* sh_evalZ,
 	__global float* sh_coef0X,
 	__global float* sh_coef0Y,
 	__global float* sh_coef0Z)
@@ -374,9 +377,9 @@ __kernel void obstacleSH(__global float4* cor,
 	uint start = startI[id];
 	uint end = endI[id];
 
-	sh_evalX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_evalY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_evalZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_evalX[id] = SH_ZERO;
+	sh_evalY[id] = SH_ZERO;
+	sh_evalZ[id] = SH_ZERO;
 
 	sh_coef0X[id] = 0.f;
 	sh_coef0Y[id] = 0.f;
@@ -385,15 +388,15 @@ __kernel void obstacleSH(__global float4* cor,
 	while (start < end){
 		float4 c = cor[start];
 
-		float8 sh = SHEval3(fast_normalize(c));
+		shvec_t sh = SHEval(fast_normalize(c));
 
 		sh_evalX[id] += sh * c.x;
 		sh_evalY[id] += sh * c.y;
 		sh_evalZ[id] += sh * c.z;
 
-		sh_coef0X[id] += 0.2820947917738781f * c.x;
-		sh_coef0Y[id] += 0.2820947917738781f * c.y;
-		sh_coef0Z[id] += 0.2820947917738781f * c.z;
+		sh_coef0X[id] += SH_C0 * c.x;
+		sh_coef0Y[id] += SH_C0 * c.y;
+		sh_coef0Z[id] += SH_C0 * c.z;
 		start++;
 	}
 
@@ -401,23 +404,23 @@ __kernel void obstacleSH(__global float4* cor,
 
 /*simple reduction kernel to sum up the velocities of all boids in a cell*/
 __kernel void evalSH(__global float4* vel,
-	__global float8* sh_evalX,
-	__global float8* sh_evalY,
-	__global float8* sh_evalZ,
+	__global shvec_t* sh_evalX,
+	__global shvec_t* sh_evalY,
+	__global shvec_t* sh_evalZ,
 	__global float* coef0X,
 	__global float* coef0Y,
 	__global float* coef0Z){
 	uint id = get_global_id(0);
 	float4 v = vel[id];
 	v.w = 0.0f;
-	float8 sh = SHEval3(fast_normalize(v));
+	shvec_t sh = SHEval(fast_normalize(v));
 	sh_evalX[id] = sh * v.x;
 	sh_evalY[id] = sh * v.y;
 	sh_evalZ[id] = sh * v.z;
 
-	coef0X[id] = 0.2820947917738781f * v.x;
-	coef0Y[id] = 0.2820947917738781f * v.y;
-	coef0Z[id] = 0.2820947917738781f * v.z;
+	coef0X[id] = SH_C0 * v.x;
+	coef0Y[id] = SH_C0 * v.y;
+	coef0Z[id] = SH_C0 * v.z;
 }
 
 /*kernel to use the SH calculations on boids*/
@@ -425,24 +428,24 @@ __kernel void useSH(__global const float4* vel,
 	__global float4* vel_out,
 	__global const uint* startIndex,
 	__global const uint* endIndex,
-	__global const float8* sh_evalX,
-	__global const float8* sh_evalY,
-	__global const float8* sh_evalZ,
+	__global const shvec_t* sh_evalX,
+	__global const shvec_t* sh_evalY,
+	__global const shvec_t* sh_evalZ,
 	__constant simParams_t* simParams,
 	__global const float4* pos,
 	__global float4* pos_out,
-	__local float8* sh_eval_localX,
-	__local float8* sh_eval_localY,
-	__local float8* sh_eval_localZ,
+	__local shvec_t* sh_eval_localX,
+	__local shvec_t* sh_eval_localY,
+	__local shvec_t* sh_eval_localZ,
 	__global const float* coef0X,
 	__global const float* coef0Y,
 	__global const float* coef0Z,
 	__local float* sh_c0_localX,
 	__local float* sh_c0_localY,
 	__local float* sh_c0_localZ,
-	__global const float8* sh_evalOX,
-	__global const float8* sh_evalOY,
-	__global const float8* sh_evalOZ,
+	__global const shvec_t* sh_evalOX,
+	__global const shvec_t* sh_evalOY,
+	__global const shvec_t* sh_evalOZ,
 	__global const float* coef0OX,
 	__global const float* coef0OY,
 	__global const float* coef0OZ,
@@ -455,13 +458,13 @@ __kernel void useSH(__global const float4* vel,
 	uint lSize = get_local_size(0);
 	uint lId = get_local_id(0);
 
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
+	shvec_t sumSHX;
+	shvec_t sumSHY;
+	shvec_t sumSHZ;
 
 	float4 velOwn = vel[id];
 	float4 posOwn = pos[id];
-	float8 SHSelf = SHEval3(normalize(velOwn));
+	shvec_t SHSelf = SHEval(normalize(velOwn));
 	posOwn.w = 0.0f;
 	velOwn.w = 0.0f;
 
@@ -469,9 +472,9 @@ __kernel void useSH(__global const float4* vel,
 	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
 	float4 velCor = checkAndCorrectBoundaries(cell, simParams);
 
-	sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[lId] = SH_ZERO;
+	sh_eval_localY[lId] = SH_ZERO;
+	sh_eval_localZ[lId] = SH_ZERO;
 	sh_c0_localX[lId] = 0.0f;
 	sh_c0_localY[lId] = 0.0f;
 	sh_c0_localZ[lId] = 0.0f;
@@ -502,45 +505,24 @@ __kernel void useSH(__global const float4* vel,
 			float factor2 = 1.0f;
 			float dotP = dot(distV, velOwn);
 
-			SHSelf = SHEval3(normalize(distV));
+			SHSelf = SHEval(normalize(distV));
 
 			if(dotP < 0.0)
 				factor = FACTOR_NO;
 
-			float8 SHOtherX = (1.f / (dist + 0.01)) * sh_eval_localX[j];
-			float8 SHOtherY = (1.f / (dist + 0.01)) * sh_eval_localY[j];
-			float8 SHOtherZ = (1.f / (dist + 0.01)) * sh_eval_localZ[j];
-
-			float sumAllSHX = (1.f / (dist + 0.01)) * sh_c0_localX[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHY = (1.f / (dist + 0.01)) * sh_c0_localY[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHZ = (1.f / (dist + 0.01)) * sh_c0_localZ[j] * 0.2820947917738781f * M_PI_F;
-
-			sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-			sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-			sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
+			shvec_t SHOtherX = (1.f / (dist + 0.01)) * sh_eval_localX[j];
+			shvec_t SHOtherY = (1.f / (dist + 0.01)) * sh_eval_localY[j];
+			shvec_t SHOtherZ = (1.f / (dist + 0.01)) * sh_eval_localZ[j];
+
+			float sumAllSHX = (1.f / (dist + 0.01)) * sh_c0_localX[j] * SH_C0 * SH_W0;
+			float sumAllSHY = (1.f / (dist + 0.01)) * sh_c0_localY[j] * SH_C0 * SH_W0;
+			float sumAllSHZ = (1.f / (dist + 0.01)) * sh_c0_localZ[j] * SH_C0 * SH_W0;
+
+			sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+			sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+			sumAllSHZ += SHDot(SHSelf, SHOtherZ);
 
 			float4 shCor = (float4)(-sumAllSHZ, sumAllSHY, sumAllSHX, 0.0f);
 			shCor += (float4)(sumAllSHY, -sumAllSHX, sumAllSHZ, 0.0f);
@@ -573,13 +555,13 @@ __kernel void useSH(__global const float4* vel,
 	for (uint i = 0; i < numObstacle; i++){
 		float4 p = lPos[i];
 
-		float8 SHSelf = SHEval3(normalize(posOwn - p));
+		shvec_t SHSelf = SHEval(normalize(posOwn - p));
 		float4 d = posOwn - p;
 		float dist = (float)length(d);
 
-		float8 sumSHOX = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-		float8 sumSHOY = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-		float8 sumSHOZ = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		shvec_t sumSHOX = SH_ZERO;
+		shvec_t sumSHOY = SH_ZERO;
+		shvec_t sumSHOZ = SH_ZERO;
 
 		sumSHOX = (1.f / (dist* dist)) * sh_eval_localX[i];
 		sumSHOY = (1.f / (dist* dist)) * sh_eval_localY[i];
@@ -590,41 +572,20 @@ __kernel void useSH(__global const float4* vel,
 		sumC0OZ = (1.f / (dist* dist)) * sh_c0_localZ[i];
 
 
-		float8 SHOtherX = sumSHOX;
-		float8 SHOtherY = sumSHOY;
-		float8 SHOtherZ = sumSHOZ;
-
-		float sumAllSHX = sumC0OX * 0.2820947917738781f * M_PI_F;
-		float sumAllSHY = sumC0OY * 0.2820947917738781f * M_PI_F;
-		float sumAllSHZ = sumC0OZ * 0.2820947917738781f * M_PI_F;
-
-
-		sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-		sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-		sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-		sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-		sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-		sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-		sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-		sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-		sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-		sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-		sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-		sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-		sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-		sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-		sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-		sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
+		shvec_t SHOtherX = sumSHOX;
+		shvec_t SHOtherY = sumSHOY;
+		shvec_t SHOtherZ = sumSHOZ;
+
+		float sumAllSHX = sumC0OX * SH_C0 * SH_W0;
+		float sumAllSHY = sumC0OY * SH_C0 * SH_W0;
+		float sumAllSHZ = sumC0OZ * SH_C0 * SH_W0;
+
+
+		sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+		sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+		sumAllSHZ += SHDot(SHSelf, SHOtherZ);
 
 		float4 shCor = (float4)(sumAllSHX, sumAllSHY, sumAllSHZ, 0.0f);
 
@@ -657,11 +618,11 @@ __kernel void dontUseSH(__global float4* vel,
 	__global float4* vel_out,
 	__global uint* startIndex,
 	__global uint* endIndex,
-	__global float8* sh_eval,
+	__global shvec_t* sh_eval,
 	__constant simParams_t* simParams,
 	__global float4* pos,
 	__global float4* pos_out,
-	__local float8* sh_eval_local,
+	__local shvec_t* sh_eval_local,
 	float dt)
 {
 	uint id = get_local_id(0);
@@ -40,7 +40,10 @@ typedef struct{
 	float wPath;
 
 	float maxVel;
-	float maxVelCor
+	float maxVelCor;
+
+	float factorSDF;
+	float sdfRange;
 } simParams_t;
 
 __kernel void memSet(
@@ -205,6 +208,7 @@ __kernel void simulate(
 	__global const float4 *goal,
 	__constant simParams_t* simParams,
 	__global uint *range_out,
+	__global const float4 *flowDir,
 	float dt)
 {
 	uint id = get_global_id(0);
@@ -287,13 +291,23 @@ __kernel void simulate(
 		perceivedVel = (perceivedVel / flockMatesVisible) - velOwn;
 	}
 
-	//calculate straight path to goal
+	//steer along the flow field of the goal id in goal.w. Straight path to the goal without a
+	//flow field (id < 0), in the goal cell and in cells which can not reach the goal.
 	float4 g = goal[id];
-	g.w = 0.0f;
+	float4 path = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
 
-	float4 path = g - posOwn;
-	path.w = 0.0f;
-	path = fast_normalize(path);
+	if (g.w >= 0.0f){
+		int4 cellPos = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(simParams->gridSize.x - 1, simParams->gridSize.y - 1, simParams->gridSize.z - 1, 0));
+		uint cell = cellPos.x + simParams->gridSize.x * cellPos.z + simParams->gridSize.x * simParams->gridSize.z * cellPos.y;
+		path = flowDir[(uint)g.w * simParams->numCells + cell];
+	}
+
+	if (path.x == 0.0f && path.y == 0.0f && path.z == 0.0f){
+		g.w = 0.0f;
+		path = g - posOwn;
+		path.w = 0.0f;
+		path = fast_normalize(path);
+	}
 
 	//calculate new velocities 
 	velOwn = velOwn * simParams->wOwn + path * simParams->wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * simParams->wSeparation;
@@ -321,45 +335,16 @@ __kernel void simulate(
 }
 
 
-/*Evaluete 3. order SH. Numerical implementation from P.P. Sloan
-  float8 is used to store the 9 coefficients because coefficient 0 is
-  constant it is just added at the reconstruction.
+/*SHEval, SHDot and SHProduct of the band order SH_ORDER come from kernels/sh_basis.cl,
+  which the host puts in front of this file.
 */
-float8 SHEval3(float4 vel_in)
-{
-   float4 vel = vel_in;
-   float8 pSH;
-   float fC0,fC1,fS0,fS1,fTmpA,fTmpB,fTmpC;
-   float fZ2 = vel.z*vel.z;
-
-   //pSH.0 = 0.2820947917738781f;
-   pSH.s1 = 0.4886025119029199f*vel.z;
-   pSH.s5 = 0.9461746957575601f*fZ2 + -0.3153915652525201f;
-   fC0 = vel.x;
-   fS0 = vel.y;
-
-   fTmpA = -0.48860251190292f;
-   pSH.s2 = fTmpA*fC0;
-   pSH.s0 = fTmpA*fS0;
-   fTmpB = -1.092548430592079f*vel.z;
-   pSH.s6 = fTmpB*fC0;
-   pSH.s4 = fTmpB*fS0;
-   fC1 = vel.x*fC0 - vel.y*fS0;
-   fS1 = vel.x*fS0 + vel.y*fC0;
-
-   fTmpC = 0.5462742152960395f;
-   pSH.s7 = fTmpC*fC1;
-   pSH.s3 = fTmpC*fS1;
-
-   return pSH;
-}
 
 __kernel void obstacleSH(__global float4* cor,
 						 __global uint* startI,
 						 __global uint* endI,
-						 __global float8* sh_evalX,
-						 __global float8* sh_evalY,
-						 __global float8* sh_evalZ,
+						 __global shvec_t* sh_evalX,
+						 __global shvec_t* sh_evalY,
+						 __global shvec_t* sh_evalZ,
 						 __global float* sh_coef0X,
 						 __global float* sh_coef0Y,
 						 __global float* sh_coef0Z)
@@ -368,9 +353,9 @@ __kernel void obstacleSH(__global float4* cor,
 	uint start = startI[id];
 	uint end = endI[id];
 
-	sh_evalX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_evalY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_evalZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_evalX[id] = SH_ZERO;
+	sh_evalY[id] = SH_ZERO;
+	sh_evalZ[id] = SH_ZERO;
 
 	sh_coef0X[id] = 0.f;
 	sh_coef0Y[id] = 0.f;
@@ -379,15 +364,15 @@ __kernel void obstacleSH(__global float4* cor,
 	while(start < end){
 		float4 c = cor[start];
 
-		float8 sh = SHEval3(fast_normalize(c));
+		shvec_t sh = SHEval(fast_normalize(c));
 
 		sh_evalX[id] += sh * c.x;
 		sh_evalY[id] += sh * c.y;
 		sh_evalZ[id] += sh * c.z;
 
-		sh_coef0X[id] += 0.2820947917738781f * c.x;
-		sh_coef0Y[id] += 0.2820947917738781f * c.y;
-		sh_coef0Z[id] += 0.2820947917738781f * c.z;
+		sh_coef0X[id] += SH_C0 * c.x;
+		sh_coef0Y[id] += SH_C0 * c.y;
+		sh_coef0Z[id] += SH_C0 * c.z;
 		start++;
 	}
 
@@ -395,23 +380,216 @@ __kernel void obstacleSH(__global float4* cor,
 
 /*simple reduction kernel to sum up the velocities of all boids in a cell*/
 __kernel void evalSH(__global float4* vel,
-					 __global float8* sh_evalX, 
-					 __global float8* sh_evalY, 
-					 __global float8* sh_evalZ, 
+					 __global shvec_t* sh_evalX, 
+					 __global shvec_t* sh_evalY, 
+					 __global shvec_t* sh_evalZ, 
 					 __global float* coef0X, 
 					 __global float* coef0Y, 
 					 __global float* coef0Z){
 	uint id = get_global_id(0);
 	float4 v = vel[id];
 	v.w = 0.0f;
-	float8 sh = SHEval3(fast_normalize(v));
+	shvec_t sh = SHEval(fast_normalize(v));
 	sh_evalX[id] = sh * v.x;
 	sh_evalY[id] = sh * v.y;
 	sh_evalZ[id] = sh * v.z;
 
-	coef0X[id] = 0.2820947917738781f * v.x;
-	coef0Y[id] = 0.2820947917738781f * v.y;
-	coef0Z[id] = 0.2820947917738781f * v.z;
+	coef0X[id] = SH_C0 * v.x;
+	coef0Y[id] = SH_C0 * v.y;
+	coef0Z[id] = SH_C0 * v.z;
+}
+
+/*repulsion of the single obstacle point p with the SH coefficients sh, c0 at position posNode*/
+float4 obstacleRepulsion(float4 posNode, float4 p, shvec_t shX, shvec_t shY, shvec_t shZ, float c0X, float c0Y, float c0Z, __constant simParams_t* simParams)
+{
+	p.w = 0.0f;
+	float4 d = posNode - p;
+	float len = (float)length(d);
+	//a node on or next to an obstacle point would get an infinite weight, the distance is clamped
+	//to half a cell and a node right on the point has no direction
+	float dist = fmax(len, 0.5f * fmin(simParams->cellSize.x, fmin(simParams->cellSize.y, simParams->cellSize.z)));
+	float w = 1.f / (dist * dist);
+
+	shvec_t SHSelf = SHEval(len > 0.0f ? d / len : (float4)(0.0f, 0.0f, 0.0f, 0.0f));
+	shvec_t SHOtherX = w * shX;
+	shvec_t SHOtherY = w * shY;
+	shvec_t SHOtherZ = w * shZ;
+
+	float sumAllSHX = w * c0X * SH_C0 * SH_W0;
+	float sumAllSHY = w * c0Y * SH_C0 * SH_W0;
+	float sumAllSHZ = w * c0Z * SH_C0 * SH_W0;
+
+	sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+	sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+	sumAllSHZ += SHDot(SHSelf, SHOtherZ);
+
+	return (float4)(sumAllSHX, sumAllSHY, sumAllSHZ, 0.0f) * FACTOR_OBST;
+}
+
+/*position of field node id, the field has gridSize * fieldRes + 1 nodes per axis*/
+float4 obstacleFieldNode(uint id, __constant simParams_t* simParams, uint fieldRes)
+{
+	uint nx = simParams->gridSize.x * fieldRes + 1;
+	uint nz = simParams->gridSize.z * fieldRes + 1;
+
+	return (float4)(simParams->worldOrigin.x + (id % nx) * simParams->cellSize.x / fieldRes,
+					simParams->worldOrigin.y + (id / (nx * nz)) * simParams->cellSize.y / fieldRes,
+					simParams->worldOrigin.z + ((id / nx) % nz) * simParams->cellSize.z / fieldRes,
+					0.0f);
+}
+
+/*places the obstacle points of one rigid obstacle (global offset = its first point) from their
+  initial placement with the affine transform given by its rows r0..r2. Correction vectors are
+  only rotated, the positions are rotated and translated.*/
+__kernel void transformObstacle(__global const float4* corLocal,
+								__global const float4* posObstLocal,
+								__global const uint* startI,
+								__global const uint* endI,
+								float4 r0,
+								float4 r1,
+								float4 r2,
+								__global float4* cor,
+								__global float4* posObst)
+{
+	uint id = get_global_id(0);
+
+	float4 p = posObstLocal[id];
+	float4 p1 = (float4)(p.x, p.y, p.z, 1.0f);
+	posObst[id] = (float4)(dot(r0, p1), dot(r1, p1), dot(r2, p1), p.w);
+
+	for (uint i = startI[id]; i < endI[id]; i++){
+		float4 c = corLocal[i];
+		c.w = 0.0f;
+		cor[i] = (float4)(dot(r0, c), dot(r1, c), dot(r2, c), corLocal[i].w);
+	}
+}
+
+/*incremental update of the baked field for the moved obstacle points [first, first + count):
+  removes their repulsion at the previous placement (..Old) and adds it at the new one. Runs on
+  the box of boxSize nodes from node boxMin around both placements only*/
+__kernel void updateObstacleField(__global const shvec_t* sh_evalOX,
+								  __global const shvec_t* sh_evalOY,
+								  __global const shvec_t* sh_evalOZ,
+								  __global const float* coef0OX,
+								  __global const float* coef0OY,
+								  __global const float* coef0OZ,
+								  __global const float4* posObst,
+								  __global const shvec_t* sh_evalOldX,
+								  __global const shvec_t* sh_evalOldY,
+								  __global const shvec_t* sh_evalOldZ,
+								  __global const float* coef0OldX,
+								  __global const float* coef0OldY,
+								  __global const float* coef0OldZ,
+								  __global const float4* posObstOld,
+								  uint first,
+								  uint count,
+								  __constant simParams_t* simParams,
+								  __global float4* obstField,
+								  uint fieldRes,
+								  uint4 boxMin,
+								  uint4 boxSize)
+{
+	uint b = get_global_id(0);
+	if (b >= boxSize.x * boxSize.y * boxSize.z)
+		return;
+
+	uint nx = simParams->gridSize.x * fieldRes + 1;
+	uint nz = simParams->gridSize.z * fieldRes + 1;
+
+	uint x = boxMin.x + b % boxSize.x;
+	uint z = boxMin.z + (b / boxSize.x) % boxSize.z;
+	uint y = boxMin.y + b / (boxSize.x * boxSize.z);
+	uint id = x + nx * (z + nz * y);
+
+	float4 posNode = obstacleFieldNode(id, simParams, fieldRes);
+	float4 cor = obstField[id];
+
+	for (uint i = first; i < first + count; i++){
+		cor -= obstacleRepulsion(posNode, posObstOld[i], sh_evalOldX[i], sh_evalOldY[i], sh_evalOldZ[i], coef0OldX[i], coef0OldY[i], coef0OldZ[i], simParams);
+		cor += obstacleRepulsion(posNode, posObst[i], sh_evalOX[i], sh_evalOY[i], sh_evalOZ[i], coef0OX[i], coef0OY[i], coef0OZ[i], simParams);
+	}
+
+	obstField[id] = cor;
+}
+
+/*obstacle repulsion at every node of the baked field. Node spacing is cellSize / fieldRes,
+  the field has gridSize * fieldRes + 1 nodes per axis. Same sum over all obstacles as it
+  was done per boid, it only depends on the position.*/
+__kernel void bakeObstacleField(__global const shvec_t* sh_evalOX,
+								__global const shvec_t* sh_evalOY,
+								__global const shvec_t* sh_evalOZ,
+								__global const float* coef0OX,
+								__global const float* coef0OY,
+								__global const float* coef0OZ,
+								__global const float4* posObst,
+								uint numObstacle,
+								__constant simParams_t* simParams,
+								__global float4* obstField,
+								uint fieldRes,
+								__global const float4* obstSDF,
+								uint useSDF)
+{
+	uint id = get_global_id(0);
+
+	uint nx = simParams->gridSize.x * fieldRes + 1;
+	uint ny = simParams->gridSize.y * fieldRes + 1;
+	uint nz = simParams->gridSize.z * fieldRes + 1;
+
+	if (id >= nx * ny * nz)
+		return;
+
+	float4 posNode = obstacleFieldNode(id, simParams, fieldRes);
+	float4 cor = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	for (uint i = 0; i < numObstacle; i++)
+		cor += obstacleRepulsion(posNode, posObst[i], sh_evalOX[i], sh_evalOY[i], sh_evalOZ[i], coef0OX[i], coef0OY[i], coef0OZ[i], simParams);
+
+	//mesh obstacles, the distance field has the same nodes (gradient in xyz, signed distance in w)
+	if (useSDF){
+		float4 sdf = obstSDF[id];
+		//repulsion of the mesh along its distance field gradient, starts at distance sdfRange
+		float f = clamp(1.0f - sdf.w / simParams->sdfRange, 0.0f, 2.0f);
+		cor += (float4)(sdf.x, sdf.y, sdf.z, 0.0f) * f * f * simParams->factorSDF;
+	}
+
+	obstField[id] = cor;
+}
+
+/*trilinear sample of the baked obstacle field at position pos*/
+float4 sampleObstacleField(__global const float4* obstField, float4 pos, __constant simParams_t* simParams, uint fieldRes)
+{
+	uint nx = simParams->gridSize.x * fieldRes + 1;
+	uint ny = simParams->gridSize.y * fieldRes + 1;
+	uint nz = simParams->gridSize.z * fieldRes + 1;
+
+	float gx = clamp((pos.x - simParams->worldOrigin.x) * fieldRes / simParams->cellSize.x, 0.0f, nx - 1.001f);
+	float gy = clamp((pos.y - simParams->worldOrigin.y) * fieldRes / simParams->cellSize.y, 0.0f, ny - 1.001f);
+	float gz = clamp((pos.z - simParams->worldOrigin.z) * fieldRes / simParams->cellSize.z, 0.0f, nz - 1.001f);
+
+	uint x = (uint)gx;
+	uint y = (uint)gy;
+	uint z = (uint)gz;
+	float fx = gx - x;
+	float fy = gy - y;
+	float fz = gz - z;
+
+	uint i000 = x + nx * (z + nz * y);
+	uint i100 = i000 + 1;
+	uint i001 = i000 + nx;
+	uint i101 = i001 + 1;
+	uint i010 = i000 + nx * nz;
+	uint i110 = i010 + 1;
+	uint i011 = i010 + nx;
+	uint i111 = i011 + 1;
+
+	float4 c00 = mix(obstField[i000], obstField[i100], fx);
+	float4 c01 = mix(obstField[i001], obstField[i101], fx);
+	float4 c10 = mix(obstField[i010], obstField[i110], fx);
+	float4 c11 = mix(obstField[i011], obstField[i111], fx);
+
+	return mix(mix(c00, c01, fz), mix(c10, c11, fz), fy);
 }
 
 /*kernel to use the SH calculations on boids*/
@@ -419,29 +597,23 @@ __kernel void useSH(__global const float4* vel,
 					__global float4* vel_out,
 					__global const uint* startIndex,
 					__global const uint* endIndex,
-					__global const float8* sh_evalX,
-					__global const float8* sh_evalY,
-					__global const float8* sh_evalZ,
+					__global const shvec_t* sh_evalX,
+					__global const shvec_t* sh_evalY,
+					__global const shvec_t* sh_evalZ,
 					__constant simParams_t* simParams, 
 					__global const float4* pos,
 					__global float4* pos_out,
-					__local float8* sh_eval_localX,
-					__local float8* sh_eval_localY,
-					__local float8* sh_eval_localZ,
+					__local shvec_t* sh_eval_localX,
+					__local shvec_t* sh_eval_localY,
+					__local shvec_t* sh_eval_localZ,
 					__global const float* coef0X,
 					__global const float* coef0Y,
 					__global const float* coef0Z,
 					__local float* sh_c0_localX,
 					__local float* sh_c0_localY,
 					__local float* sh_c0_localZ,
-					__global const float8* sh_evalOX,
-					__global const float8* sh_evalOY,
-					__global const float8* sh_evalOZ,
-					__global const float* coef0OX,
-					__global const float* coef0OY,
-					__global const float* coef0OZ,
-					__global float4* posObst,
-					uint numObstacle,
+					__global const float4* obstField,
+					uint fieldRes,
 					float dt)
 {
 	uint id = get_local_id(0);
@@ -458,201 +630,16 @@ __kernel void useSH(__global const float4* vel,
 
 	float4 velCor = checkAndCorrectBoundaries(cell, simParams);
 
-	
-	uint plane = simParams->gridSize.x * simParams->gridSize.z;
-
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
-
-	__local float8 lsh_evalOX[126];
-	__local float8 lsh_evalOY[126];
-	__local float8 lsh_evalOZ[126];
-
-	__local float lcoef0OX[126];
-	__local float lcoef0OY[126];
-	__local float lcoef0OZ[126];
-	__local float4 lposObst[126];
-
-	float4 velOwn;
-	float4 posOwn = pos[start];
-	posOwn.w = 0.0f;
-
-	uint j = id;
-	while (j < numObstacle){
-		lsh_evalOX[j] = sh_evalOX[j];
-		lsh_evalOY[j] = sh_evalOY[j];
-		lsh_evalOZ[j] = sh_evalOZ[j];
-
-		lcoef0OX[j] = coef0OX[j];
-		lcoef0OY[j] = coef0OY[j];
-		lcoef0OZ[j] = coef0OZ[j];
-		lposObst[j] = posObst[j];
-		j += lSize;
-	}
-
-	/*sh_eval_localX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_c0_localX[id] = 0.0f;
-	sh_c0_localY[id] = 0.0f;
-	sh_c0_localZ[id] = 0.0f;*/
-	barrier(CLK_LOCAL_MEM_FENCE);
-
-	/*
-	for(uint i = id; i < (simParams->numCells - range); i += lSize){
-		uint index = (i + end) % simParams->numCells;
-
-		float4 p = pos[index];
-		float4 v = vel[index];
-		p.w = 0.0f;
-		v.w = 0.0f;
-
-		float4 distV = posOwn - p;
-		float dist = fast_distance(p, posOwn);//fabs(fast_length(distV));
-		float lenOther = fast_length(v);
-
-		float factor = 1.0f;
-		float dotP = dot(distV, v);
-		float angle = dotP / (dist * lenOther);
-
-		//if(45.f > degrees(acos(angle)))
-		//	factor = -.01f;
-
-		sh_eval_localX[id] += (factor / dist) * sh_evalX[index];
-		sh_eval_localY[id] += (factor / dist) * sh_evalY[index];
-		sh_eval_localZ[id] += (factor / dist) * sh_evalZ[index];
-		sh_c0_localX[id] += (factor / dist) * coef0X[index];
-		sh_c0_localY[id] += (factor / dist) * coef0Y[index];
-		sh_c0_localZ[id] += (factor / dist) * coef0Z[index];
-	}*/
-
-	/*uint k = lSize / 2;
-	while(id < k){
-		sh_eval_localX[id] += sh_eval_localX[id + k];
-		sh_eval_localY[id] += sh_eval_localY[id + k];
-		sh_eval_localZ[id] += sh_eval_localZ[id + k];
-		sh_c0_localX[id] += sh_c0_localX[id + k];
-		sh_c0_localY[id] += sh_c0_localY[id + k];
-		sh_c0_localZ[id] += sh_c0_localZ[id + k];
-		k = k / 2;
-	}*/
-	barrier(CLK_LOCAL_MEM_FENCE);
-
 	uint index = start + id;
 	while (index < end){
-		velOwn = vel[index];
-		posOwn = pos[index];
+		float4 velOwn = vel[index];
+		float4 posOwn = pos[index];
 		posOwn.w = 0.0f;
 		velOwn.w = 0.0f;
 
-		float8 SHSelf = SHEval3(normalize(velOwn));
-		//sumSHX = sh_eval_localX[0];
-		//sumSHY = sh_eval_localY[0];
-		//sumSHZ = sh_eval_localZ[0];
-
-
-
-		float sumC0OX = 0.0f;
-		float sumC0OY = 0.0f;
-		float sumC0OZ = 0.0f;
-
-		for (uint i = 0; i < 126; i++){
-			float4 p = lposObst[i];
-			float8 SHSelf = SHEval3(normalize(posOwn - p));
-			float4 d = posOwn - p;
-			float dist = (float)length(d);
-			float8 sumSHOX = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			float8 sumSHOY = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			float8 sumSHOZ = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-
-			sumSHOX = (1.f / (dist* dist)) * lsh_evalOX[i];
-			sumSHOY = (1.f / (dist* dist)) * lsh_evalOY[i];
-			sumSHOZ = (1.f / (dist* dist)) * lsh_evalOZ[i];
-
-			sumC0OX = (1.f / (dist* dist)) * lcoef0OX[i];
-			sumC0OY = (1.f / (dist* dist)) * lcoef0OY[i];
-			sumC0OZ = (1.f / (dist* dist)) * lcoef0OZ[i];
-
-
-			/*
-			float8 SHOtherX = sumSHX;
-			float8 SHOtherY = sumSHY;
-			float8 SHOtherZ = sumSHZ;
-
-			float sumAllSHX = sh_c0_localX[0] * 0.2820947917738781f ;
-			float sumAllSHY = sh_c0_localY[0] * 0.2820947917738781f ;
-			float sumAllSHZ = sh_c0_localZ[0] * 0.2820947917738781f ;
-			*/
-
-
-			float8 SHOtherX = sumSHOX;
-			float8 SHOtherY = sumSHOY;
-			float8 SHOtherZ = sumSHOZ;
-
-			float sumAllSHX = sumC0OX * 0.2820947917738781f * M_PI_F;
-			float sumAllSHY = sumC0OY * 0.2820947917738781f * M_PI_F;
-			float sumAllSHZ = sumC0OZ * 0.2820947917738781f * M_PI_F;
-
-
-			sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-			sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-			sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
-
-			float4 shCor = (float4)(sumAllSHX, sumAllSHY, sumAllSHZ, 0.0f);
-
-			/*
-			if(len > simParams->maxVel){
-			shCor.x = (shCor.x / len) * simParams->maxVel;
-			shCor.y = (shCor.y / len) * simParams->maxVel;
-			shCor.z = (shCor.z / len) * simParams->maxVel;
-			}
-
-			len = length(velOwn);
-
-			if(len > simParams->maxVel){
-			velOwn.x = (velOwn.x / len) * simParams->maxVel;
-			velOwn.y = (velOwn.y / len) * simParams->maxVel;
-			velOwn.z = (velOwn.z / len) * simParams->maxVel;
-			}*/
-
-			//float lenOwn = fast_length(shCor);
-			//float lenOther = fast_length(velOwn);
-
-			float factor = FACTOR_OBST;
-			//float dotP = dot(shCor, velOwn);
-			//float angle = dotP / (lenOwn * lenOther);
-
-			//if( dotP < 0.0)
-			//	factor = 2.05f;
-
-
-			velOwn += shCor * factor;//(1.f / (simParams->numBodies - range) );
-			velOwn.w = 0.0f;
-		}
+		//repulsion of all static obstacles from the baked field
+		velOwn += sampleObstacleField(obstField, posOwn, simParams, fieldRes);
+		velOwn.w = 0.0f;
 
 		//truncate velocity to max velocity
 		//velOwn = clamp(velOwn, -mVel, mVel);
@@ -681,11 +668,11 @@ __kernel void dontUseSH(__global float4* vel,
 					__global float4* vel_out,
 					__global uint* startIndex, 
 					__global uint* endIndex, 
-					__global float8* sh_eval, 
+					__global shvec_t* sh_eval, 
 					__constant simParams_t* simParams, 
 					__global float4* pos,
 					__global float4* pos_out,
-					__local float8* sh_eval_local,
+					__local shvec_t* sh_eval_local,
 					 float dt)
 {
 	uint id = get_local_id(0);
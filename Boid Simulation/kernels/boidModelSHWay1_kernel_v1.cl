@@ -42,6 +42,16 @@ typedef struct{
 	float maxVelCor
 } simParams_t;
 
+//attributes shared by all agents of a group, indexed by the per-agent group id
+typedef struct{
+	float4 goal;
+	float4 color;
+	float wPath;
+	float wSeparation;
+	float maxVel;
+	float pad;
+} group_t;
+
 __kernel void memSet(
     __global uint *d_Data,
     uint val,
@@ -139,12 +149,13 @@ __kernel void findGridEdgeAndReorder(
 	__global const uint   *gridIndex,   //input: particle indices sorted by hash
 	__global const float4 *unsortedPos,     //input: positions array sorted by hash
 	__global const float4 *unsortedVel,     //input: velocity array sorted by hash
-	__global const float4 *unsortedGoal,
-	__global float4 *reorderedGoal,
-	__global const float4 *unsortedColor,
-	__global float4 *reorderedColor,
+	__global const uchar  *unsortedGroup,   //input: group id per particle
+	__global uchar  *reorderedGroup,  //output: reordered by cell hash group ids
 	__local uint *localHash,          //get_group_size(0) + 1 elements
-	uint    numParticles
+	uint    numParticles,
+	__global const float4 *unsortedGoal,    //input: own goal per particle, only read with goalPerBoid
+	__global float4 *reorderedGoal,  //output: reordered by cell hash goals
+	uint    goalPerBoid
 	){
 	uint hash;
 	const uint index = get_global_id(0);
@@ -185,13 +196,13 @@ __kernel void findGridEdgeAndReorder(
 		uint sortedIndex = gridIndex[index];
 		float4 pos = unsortedPos[sortedIndex];
 		float4 vel = unsortedVel[sortedIndex];
-		float4 goal = unsortedGoal[sortedIndex];
-		float4 color = unsortedColor[sortedIndex];
+		uchar group = unsortedGroup[sortedIndex];
 
 		reorderedPos[index] = pos;
 		reorderedVel[index] = vel;
-		reorderedGoal[index] = goal;
-		reorderedColor[index] = color;
+		reorderedGroup[index] = group;
+		if (goalPerBoid)
+			reorderedGoal[index] = unsortedGoal[sortedIndex];
 	}
 }
 
@@ -202,10 +213,14 @@ __kernel void simulate(
 	__global float4* vel_out,
 	__global const uint *cellStart,
 	__global const uint *cellEnd,
-	__global const float4 *goal,
+	__global const uchar *group,
 	__constant simParams_t* simParams,
 	__global uint *range_out,
-	float dt)
+	__global const float4 *flowDir,
+	__constant group_t *groups,
+	float dt,
+	__global const float4 *goal,
+	uint goalPerBoid)
 {
 	uint id = get_global_id(0);
 
@@ -287,16 +302,33 @@ __kernel void simulate(
 		perceivedVel = (perceivedVel / flockMatesVisible) - velOwn;
 	}
 
-	//calculate straight path to goal
-	float4 g = goal[id];
-	g.w = 0.0f;
+	//steer along the flow field of the goal id in goal.w of the group. Straight path to the goal
+	//without a flow field (id < 0), in the goal cell and in cells which can not reach the goal.
+	group_t grp = groups[group[id]];
+	float4 g = grp.goal;
+	float4 path = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
 
-	float4 path = g - posOwn;
-	path.w = 0.0f;
-	path = fast_normalize(path);
+	//the own goal of the boid has no flow field
+	if (goalPerBoid){
+		g = goal[id];
+		g.w = -1.0f;
+	}
+
+	if (g.w >= 0.0f){
+		int4 cellPos = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(simParams->gridSize.x - 1, simParams->gridSize.y - 1, simParams->gridSize.z - 1, 0));
+		uint cell = cellPos.x + simParams->gridSize.x * cellPos.z + simParams->gridSize.x * simParams->gridSize.z * cellPos.y;
+		path = flowDir[(uint)g.w * simParams->numCells + cell];
+	}
+
+	if (path.x == 0.0f && path.y == 0.0f && path.z == 0.0f){
+		g.w = 0.0f;
+		path = g - posOwn;
+		path.w = 0.0f;
+		path = fast_normalize(path);
+	}
 
 	//calculate new velocities 
-	velOwn = velOwn * simParams->wOwn + path * simParams->wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * simParams->wSeparation;
+	velOwn = velOwn * simParams->wOwn + path * grp.wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * grp.wSeparation;
 	velOwn.w = 0.0;
 
 	//truncate velocity to max velocity
@@ -305,10 +337,10 @@ __kernel void simulate(
 
 	float len = fast_length(velOwn);
 
-	if (len > simParams->maxVel){
-		velOwn.x = (velOwn.x / len) * simParams->maxVel;
-		velOwn.z = (velOwn.z / len) * simParams->maxVel;
-		velOwn.y = (velOwn.y / len) * simParams->maxVel;
+	if (len > grp.maxVel){
+		velOwn.x = (velOwn.x / len) * grp.maxVel;
+		velOwn.z = (velOwn.z / len) * grp.maxVel;
+		velOwn.y = (velOwn.y / len) * grp.maxVel;
 	}
 
 
@@ -322,59 +354,71 @@ __kernel void simulate(
 
 
 
-/*Evaluete 3. order SH. Numerical implementation from P.P. Sloan
-  float8 is used to store the 9 coefficients because coefficient 0 is
-  constant it is just added at the reconstruction.
-*/
-float8 SHEval3(float4 vel_in)
+/*SH basis of order SH_ORDER (sh_basis.cl) for this model, y is the polar axis*/
+shvec_t SHEvalDir(float4 dir)
+{
+   return SHEval(dir.xzyw);
+}
+
+/*index of the relative cell offset (ox, oy, oz) in the SH lookup table (2 * gridSize - 1 entries per axis)*/
+uint SHLookupIndex(int ox, int oy, int oz, __constant simParams_t* simParams)
 {
-   float4 vel = vel_in;
-   float8 pSH;
-   float fC0,fC1,fS0,fS1,fTmpA,fTmpB,fTmpC;
-   float fZ2 = vel.y*vel.y;
-
-   //pSH.0 = 0.2820947917738781f;
-   pSH.s1 = 0.4886025119029199f*vel.y;
-   pSH.s5 = 0.9461746957575601f*fZ2 + -0.3153915652525201f;
-   fC0 = vel.x;
-   fS0 = vel.z;
-
-   fTmpA = -0.48860251190292f;
-   pSH.s2 = fTmpA*fC0;
-   pSH.s0 = fTmpA*fS0;
-   fTmpB = -1.092548430592079f*vel.y;
-   pSH.s6 = fTmpB*fC0;
-   pSH.s4 = fTmpB*fS0;
-   fC1 = vel.x*fC0 - vel.z*fS0;
-   fS1 = vel.x*fS0 + vel.z*fC0;
-
-   fTmpC = 0.5462742152960395f;
-   pSH.s7 = fTmpC*fC1;
-   pSH.s3 = fTmpC*fS1;
-
-   return pSH;
+	int gx = (int)simParams->gridSize.x;
+	int gy = (int)simParams->gridSize.y;
+	int gz = (int)simParams->gridSize.z;
+
+	return (ox + gx - 1) + (2 * gx - 1) * ((oz + gz - 1) + (2 * gz - 1) * (oy + gy - 1));
+}
+
+/*SH basis of the direction between two cell centers for every relative cell offset*/
+__kernel void buildSHLookup(
+	__global shvec_t* shLookup,
+	__constant simParams_t* simParams
+){
+	uint id = get_global_id(0);
+
+	int lx = 2 * (int)simParams->gridSize.x - 1;
+	int ly = 2 * (int)simParams->gridSize.y - 1;
+	int lz = 2 * (int)simParams->gridSize.z - 1;
+
+	if (id >= (uint)(lx * ly * lz))
+		return;
+
+	int ox = (int)(id % lx) - ((int)simParams->gridSize.x - 1);
+	int oz = (int)((id / lx) % lz) - ((int)simParams->gridSize.z - 1);
+	int oy = (int)(id / (lx * lz)) - ((int)simParams->gridSize.y - 1);
+
+	if (ox == 0 && oy == 0 && oz == 0){
+		shLookup[id] = SH_ZERO;
+		return;
+	}
+
+	float4 d = (float4)(ox * simParams->cellSize.x, oy * simParams->cellSize.y, oz * simParams->cellSize.z, 0.0f);
+	shLookup[id] = SHEvalDir(normalize(d));
 }
 
 __kernel void evalSH(
 	__global float4* vel,
-	__global float8* sh_evalX,
-	__global float8* sh_evalY,
-	__global float8* sh_evalZ,
+	__global shvec_t* sh_evalX,
+	__global shvec_t* sh_evalY,
+	__global shvec_t* sh_evalZ,
 	__global float* coef0X,
 	__global float* coef0Y,
 	__global float* coef0Z,
 	__local float* sh_c0_localX,
 	__local float* sh_c0_localY,
 	__local float* sh_c0_localZ, 
-	__local float8* sh_eval_localX,
-	__local float8* sh_eval_localY,
-	__local float8* sh_eval_localZ, 
+	__local shvec_t* sh_eval_localX,
+	__local shvec_t* sh_eval_localY,
+	__local shvec_t* sh_eval_localZ, 
 	__global uint* startIndex,
-	__global uint* endIndex
+	__global uint* endIndex,
+	__global const uint* cellList,	//dirty cells, only used if useList is set
+	const uint useList
 ){
 
 	uint id = get_local_id(0);
-	uint cell = get_group_id(0);
+	uint cell = useList ? cellList[get_group_id(0)] : get_group_id(0);
 	uint lSize = get_local_size(0);
 
 	uint start = startIndex[cell];
@@ -383,9 +427,9 @@ __kernel void evalSH(
 	uint index = start + id;
 	uint range = end - start;
 
-	sh_eval_localX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[id] = SH_ZERO;
+	sh_eval_localY[id] = SH_ZERO;
+	sh_eval_localZ[id] = SH_ZERO;
 	sh_c0_localX[id] = 0.0f;
 	sh_c0_localY[id] = 0.0f;
 	sh_c0_localZ[id] = 0.0f;
@@ -395,7 +439,7 @@ __kernel void evalSH(
 		float4 v = vel[index];
 		v.w = 0.0f;
 
-		float8 sh = SHEval3(fast_normalize(v));
+		shvec_t sh = SHEvalDir(fast_normalize(v));
 		//sh.s0 *= v.y;
 		//sh.s1 *= v.z;
 		//sh.s2 *= v.x;
@@ -408,9 +452,9 @@ __kernel void evalSH(
 		sh_eval_localY[id] += sh * v.y;
 		sh_eval_localZ[id] += sh * v.z;
 
-		sh_c0_localX[id] += 0.2820947917738781f * v.x;
-		sh_c0_localY[id] += 0.2820947917738781f * v.y;
-		sh_c0_localZ[id] += 0.2820947917738781f * v.z;
+		sh_c0_localX[id] += SH_C0 * v.x;
+		sh_c0_localY[id] += SH_C0 * v.y;
+		sh_c0_localZ[id] += SH_C0 * v.z;
 
 		index += lSize;
 	}
@@ -448,36 +492,126 @@ __kernel void evalSH(
 	}
 }
 
+/*compare the signature (boid count, sum of velocities) of every cell with the
+  signature of its last projection and append the changed cells to the dirty list*/
+__kernel void markDirtySH(
+	__global const float4* vel,
+	__global const uint* startIndex,
+	__global const uint* endIndex,
+	__global uint* sigCount,
+	__global float4* sigVel,
+	__global uint* dirtyList,
+	__global uint* dirtyCount,
+	__local float4* sum_local,
+	const float tolerance
+){
+	uint id = get_local_id(0);
+	uint cell = get_group_id(0);
+	uint lSize = get_local_size(0);
+
+	uint start = startIndex[cell];
+	uint end = endIndex[cell];
+	uint range = end - start;
+
+	sum_local[id] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	uint index = start + id;
+	while (index < end){
+		float4 v = vel[index];
+		v.w = 0.0f;
+		sum_local[id] += v;
+		index += lSize;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint k = lSize / 2; k > 0; k = k / 2){
+		if (id < k)
+			sum_local[id] += sum_local[id + k];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (id == 0){
+		float4 sum = sum_local[0];
+		bool dirty = sigCount[cell] != range;
+
+		//the signature only moves on projection, so slow drift is caught as well
+		if (!dirty && range > 0)
+			dirty = fast_length(sum - sigVel[cell]) > tolerance * range;
+
+		if (dirty){
+			dirtyList[atomic_inc(dirtyCount)] = cell;
+			sigCount[cell] = range;
+			sigVel[cell] = sum;
+		}
+	}
+}
+
+/*maximum absolute difference between the cached and the fully projected coefficients of a cell*/
+__kernel void compareSH(
+	__global const shvec_t* sh_evalX,
+	__global const shvec_t* sh_evalY,
+	__global const shvec_t* sh_evalZ,
+	__global const float* coef0X,
+	__global const float* coef0Y,
+	__global const float* coef0Z,
+	__global const shvec_t* sh_evalRefX,
+	__global const shvec_t* sh_evalRefY,
+	__global const shvec_t* sh_evalRefZ,
+	__global const float* coef0RefX,
+	__global const float* coef0RefY,
+	__global const float* coef0RefZ,
+	__global float* error,
+	const uint numCells
+){
+	uint cell = get_global_id(0);
+	if (cell >= numCells)
+		return;
+
+	shvec_t d = fmax(fabs(sh_evalX[cell] - sh_evalRefX[cell]), fabs(sh_evalY[cell] - sh_evalRefY[cell]));
+	d = fmax(d, fabs(sh_evalZ[cell] - sh_evalRefZ[cell]));
+
+	float e = SHMax(d);
+	e = fmax(e, fabs(coef0X[cell] - coef0RefX[cell]));
+	e = fmax(e, fabs(coef0Y[cell] - coef0RefY[cell]));
+	e = fmax(e, fabs(coef0Z[cell] - coef0RefZ[cell]));
+
+	error[cell] = e;
+}
+
 /*kernel to use the SH calculations on boids*/
 __kernel void useSH(
 	__global const float4* vel,
 	__global float4* vel_out,
 	__global const uint* startIndex,
 	__global const uint* endIndex,
-	__global const float8* sh_evalX,
-	__global const float8* sh_evalY,
-	__global const float8* sh_evalZ,
+	__global const shvec_t* sh_evalX,
+	__global const shvec_t* sh_evalY,
+	__global const shvec_t* sh_evalZ,
 	__constant simParams_t* simParams,
 	__global const float4* pos,
 	__global float4* pos_out,
-	__local float8* sh_eval_localX,
-	__local float8* sh_eval_localY,
-	__local float8* sh_eval_localZ,
+	__local shvec_t* sh_eval_localX,
+	__local shvec_t* sh_eval_localY,
+	__local shvec_t* sh_eval_localZ,
 	__global const float* coef0X,
 	__global const float* coef0Y,
 	__global const float* coef0Z,
 	__local float* sh_c0_localX,
 	__local float* sh_c0_localY,
 	__local float* sh_c0_localZ,
-	const float dt)
+	const float dt,
+	__global const shvec_t* shLookup,	//SH basis per relative cell offset, only used if useLookup is set
+	const uint useLookup,
+	__global const uchar *group,
+	__constant group_t *groups)
 {
 	uint id = get_global_id(0);
 	uint lSize = get_local_size(0);
 	uint lId = get_local_id(0);
 
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
+	shvec_t sumSHX;
+	shvec_t sumSHY;
+	shvec_t sumSHZ;
 
 	__local float4 posCell[256];
 	float4 shCor = (float4)(0.0f,0.0f,0.0f,0.0f);
@@ -486,16 +620,18 @@ __kernel void useSH(
 	posOwn.w = 0.0f;
 	velOwn.w = 0.0f;
 
-	float8 SHSelf = SHEval3(normalize(velOwn));
+	shvec_t SHSelf = SHEvalDir(normalize(velOwn));
 
 	int4 gridPos = getGridPos(posOwn, simParams);
 	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
 	uint plane = simParams->gridSize.x * simParams->gridSize.z;
 	float4 velCor = checkAndCorrectBoundariesWithPos(gridPos, simParams);
+	//own cell of the lookup, boids outside the grid take the nearest cell (the grid hash does not clamp)
+	int4 lookupPos = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(simParams->gridSize.x - 1, simParams->gridSize.y - 1, simParams->gridSize.z - 1, 0));
 
-	sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[lId] = SH_ZERO;
+	sh_eval_localY[lId] = SH_ZERO;
+	sh_eval_localZ[lId] = SH_ZERO;
 	sh_c0_localX[lId] = 0.0f;
 	sh_c0_localY[lId] = 0.0f;
 	sh_c0_localZ[lId] = 0.0f;
@@ -510,10 +646,10 @@ __kernel void useSH(
 		float4 distV = posOwn - p;
 		float dist = fast_distance(p, posOwn);
 
-		if (i == cell){
-			sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		if (x == cell){
+			sh_eval_localX[lId] = SH_ZERO;
+			sh_eval_localY[lId] = SH_ZERO;
+			sh_eval_localZ[lId] = SH_ZERO;
 			sh_c0_localX[lId] = 0.0f;
 			sh_c0_localY[lId] = 0.0f;
 			sh_c0_localZ[lId] = 0.0f;
@@ -535,42 +671,30 @@ __kernel void useSH(
 			float4 d = posOther - posOwn;
 			d.w = 0.f;
 
-			SHSelf = SHEval3(normalize(d));
-
-			float8 SHOtherX = sh_eval_localX[j];
-			float8 SHOtherY = sh_eval_localY[j];
-			float8 SHOtherZ = sh_eval_localZ[j];
-
-			float sumAllSHX = sh_c0_localX[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHY = sh_c0_localY[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHZ = sh_c0_localZ[j] * 0.2820947917738781f * M_PI_F;
-
-			sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-			sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-			sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
+			if (useLookup){
+				//direction from the own cell center instead of the boid position
+				uint x = lSize * i + j;
+				int ox = (int)((x % plane) % simParams->gridSize.x) - lookupPos.x;
+				int oy = (int)(x / plane) - lookupPos.y;
+				int oz = (int)((x % plane) / simParams->gridSize.x) - lookupPos.z;
+				SHSelf = shLookup[SHLookupIndex(ox, oy, oz, simParams)];
+			}
+			else
+				SHSelf = SHEvalDir(normalize(d));
+
+			shvec_t SHOtherX = sh_eval_localX[j];
+			shvec_t SHOtherY = sh_eval_localY[j];
+			shvec_t SHOtherZ = sh_eval_localZ[j];
+
+			float sumAllSHX = sh_c0_localX[j] * SH_C0 * SH_W0;
+			float sumAllSHY = sh_c0_localY[j] * SH_C0 * SH_W0;
+			float sumAllSHZ = sh_c0_localZ[j] * SH_C0 * SH_W0;
+
+			sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+			sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+			sumAllSHZ += SHDot(SHSelf, SHOtherZ);
 
 			shCor += (float4)(-sumAllSHZ, sumAllSHY, sumAllSHX, 0.0f) * FACTOR;
 			//shCor += (float4)(sumAllSHY, -sumAllSHX, sumAllSHZ, 0.0f);
@@ -586,11 +710,12 @@ __kernel void useSH(
 	velOwn.w = 0.0f;
 
 	len = length(velOwn);
+	float maxVel = groups[group[id]].maxVel;
 
-	if (len > simParams->maxVel){
-		velOwn.x = (velOwn.x / len) * simParams->maxVel;
-		velOwn.y = (velOwn.y / len) * simParams->maxVel;
-		velOwn.z = (velOwn.z / len) * simParams->maxVel;
+	if (len > maxVel){
+		velOwn.x = (velOwn.x / len) * maxVel;
+		velOwn.y = (velOwn.y / len) * maxVel;
+		velOwn.z = (velOwn.z / len) * maxVel;
 	}
 
 	//apply correction velocity dependend on boid cell position (border case)
@@ -601,20 +726,145 @@ __kernel void useSH(
 	pos_out[id] = posOwn + velOwn * dt;
 }
 
+/*far field correction at the center of a cell from the SH coefficients of all other cells.
+  Every work group handles one cell: cell = group * stride + offset, so stride k and
+  offset = step % k refresh 1/k of the cells per step.*/
+__kernel void farFieldSH(
+	__global const shvec_t* sh_evalX,
+	__global const shvec_t* sh_evalY,
+	__global const shvec_t* sh_evalZ,
+	__global const float* coef0X,
+	__global const float* coef0Y,
+	__global const float* coef0Z,
+	__constant simParams_t* simParams,
+	__global float4* shCor,
+	__global float* change,
+	__local float4* cor_local,
+	const uint stride,
+	const uint offset,
+	__global const shvec_t* shLookup,
+	const uint useLookup
+){
+	uint lId = get_local_id(0);
+	uint lSize = get_local_size(0);
+	uint cell = get_group_id(0) * stride + offset;
+
+	if (cell >= simParams->numCells)
+		return;
+
+	uint plane = simParams->gridSize.x * simParams->gridSize.z;
+	float4 posOwn = (float4)(((cell % plane) % simParams->gridSize.x) * simParams->cellSize.x + simParams->cellSize.x / 2, (cell / plane)   * simParams->cellSize.y + simParams->cellSize.y / 2, ((cell % plane) / simParams->gridSize.x) * simParams->cellSize.z + simParams->cellSize.z / 2, 0.0f);
+
+	float4 cor = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	for (uint x = lId; x < simParams->numCells; x += lSize){
+		if (x == cell)
+			continue;
+
+		float4 p = (float4)(((x % plane) % simParams->gridSize.x) * simParams->cellSize.x + simParams->cellSize.x / 2, (x / plane)   * simParams->cellSize.y + simParams->cellSize.y / 2, ((x % plane) / simParams->gridSize.x) * simParams->cellSize.z + simParams->cellSize.z / 2, 0.0f);
+		float4 d = p - posOwn;
+		float w = 1.f / fast_length(d);
+
+		shvec_t SHSelf;
+		if (useLookup){
+			int ox = (int)((x % plane) % simParams->gridSize.x) - (int)((cell % plane) % simParams->gridSize.x);
+			int oy = (int)(x / plane) - (int)(cell / plane);
+			int oz = (int)((x % plane) / simParams->gridSize.x) - (int)((cell % plane) / simParams->gridSize.x);
+			SHSelf = shLookup[SHLookupIndex(ox, oy, oz, simParams)];
+		}
+		else
+			SHSelf = SHEvalDir(normalize(d));
+		shvec_t SHOtherX = w * sh_evalX[x];
+		shvec_t SHOtherY = w * sh_evalY[x];
+		shvec_t SHOtherZ = w * sh_evalZ[x];
+
+		float sumAllSHX = w * coef0X[x] * SH_C0 * SH_W0;
+		float sumAllSHY = w * coef0Y[x] * SH_C0 * SH_W0;
+		float sumAllSHZ = w * coef0Z[x] * SH_C0 * SH_W0;
+
+		sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+		sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+		sumAllSHZ += SHDot(SHSelf, SHOtherZ);
+
+		cor += (float4)(-sumAllSHZ, sumAllSHY, sumAllSHX, 0.0f) * FACTOR;
+	}
+
+	cor_local[lId] = cor;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint k = lSize / 2; k > 0; k = k / 2){
+		if (lId < k)
+			cor_local[lId] += cor_local[lId + k];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (lId == 0){
+		//how far the correction moved since its last refresh
+		change[cell] = fast_length(cor_local[0] - shCor[cell]);
+		shCor[cell] = cor_local[0];
+	}
+}
+
+/*apply the cached per cell far field correction to the boids of the cell*/
+__kernel void useSHFarField(
+	__global const float4* vel,
+	__global float4* vel_out,
+	__global const float4* shCor,
+	__constant simParams_t* simParams,
+	__global const float4* pos,
+	__global float4* pos_out,
+	const float dt,
+	__global const uchar *group,
+	__constant group_t *groups)
+{
+	uint id = get_global_id(0);
+
+	float4 velOwn = vel[id];
+	float4 posOwn = pos[id];
+	posOwn.w = 0.0f;
+	velOwn.w = 0.0f;
+
+	int4 gridPos = getGridPos(posOwn, simParams);
+	float4 velCor = checkAndCorrectBoundariesWithPos(gridPos, simParams);
+	//boids outside the grid take the correction of the nearest cell
+	gridPos = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(simParams->gridSize.x - 1, simParams->gridSize.y - 1, simParams->gridSize.z - 1, 0));
+	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
+
+	velOwn += shCor[cell];
+	velOwn.w = 0.0f;
+
+	float len = length(velOwn);
+	float maxVel = groups[group[id]].maxVel;
+
+	if (len > maxVel){
+		velOwn.x = (velOwn.x / len) * maxVel;
+		velOwn.y = (velOwn.y / len) * maxVel;
+		velOwn.z = (velOwn.z / len) * maxVel;
+	}
+
+	//apply correction velocity dependend on boid cell position (border case)
+	velOwn += velCor;
+	posOwn.w = 1.0;
+
+	vel_out[id] = velOwn;
+	pos_out[id] = posOwn + velOwn * dt;
+}
 
 __kernel void useSHLookahead(__global const float4* vel,
 	__global float4* vel_out,
 	__global const uint* startIndex,
 	__global const uint* endIndex,
-	__global const float8* sh_evalX,
-	__global const float8* sh_evalY,
-	__global const float8* sh_evalZ,
+	__global const shvec_t* sh_evalX,
+	__global const shvec_t* sh_evalY,
+	__global const shvec_t* sh_evalZ,
 	__constant simParams_t* simParams,
 	__global const float4* pos,
 	__global float4* pos_out,
-	__local float8* sh_eval_localX,
-	__local float8* sh_eval_localY,
-	__local float8* sh_eval_localZ,
+	__local shvec_t* sh_eval_localX,
+	__local shvec_t* sh_eval_localY,
+	__local shvec_t* sh_eval_localZ,
 	__global const float* coef0X,
 	__global const float* coef0Y,
 	__global const float* coef0Z,
@@ -627,9 +877,9 @@ __kernel void useSHLookahead(__global const float4* vel,
 	uint lSize = get_local_size(0);
 	uint lId = get_local_id(0);
 
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
+	shvec_t sumSHX;
+	shvec_t sumSHY;
+	shvec_t sumSHZ;
 
 	__local float4 posCell[256];
 	float4 shCor = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
@@ -641,16 +891,16 @@ __kernel void useSHLookahead(__global const float4* vel,
 	float test1 = 10000.f;
 	float4 pX = posOwn;
 
-	float8 SHSelf = SHEval3(normalize(velOwn));
+	shvec_t SHSelf = SHEvalDir(normalize(velOwn));
 
 	int4 gridPos = getGridPos(posOwn, simParams);
 	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
 	uint plane = simParams->gridSize.x * simParams->gridSize.z;
 	float4 velCor = checkAndCorrectBoundariesWithPos(gridPos, simParams);
 
-	sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[lId] = SH_ZERO;
+	sh_eval_localY[lId] = SH_ZERO;
+	sh_eval_localZ[lId] = SH_ZERO;
 	sh_c0_localX[lId] = 0.0f;
 	sh_c0_localY[lId] = 0.0f;
 	sh_c0_localZ[lId] = 0.0f;
@@ -665,10 +915,10 @@ __kernel void useSHLookahead(__global const float4* vel,
 		float4 distV = posOwn - p;
 		float dist = fast_distance(p, posOwn);
 
-		if (i == cell){
-			sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-			sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+		if (x == cell){
+			sh_eval_localX[lId] = SH_ZERO;
+			sh_eval_localY[lId] = SH_ZERO;
+			sh_eval_localZ[lId] = SH_ZERO;
 			sh_c0_localX[lId] = 0.0f;
 			sh_c0_localY[lId] = 0.0f;
 			sh_c0_localZ[lId] = 0.0f;
@@ -699,42 +949,21 @@ __kernel void useSHLookahead(__global const float4* vel,
 				angle += 90;
 			}
 
-			SHSelf = SHEval3(normalize(d));
-
-			float8 SHOtherX = sh_eval_localX[j];
-			float8 SHOtherY = sh_eval_localY[j];
-			float8 SHOtherZ = sh_eval_localZ[j];
-
-			float sumAllSHX = sh_c0_localX[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHY = sh_c0_localY[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHZ = sh_c0_localZ[j] * 0.2820947917738781f * M_PI_F;
-
-			sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-			sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-			sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
+			SHSelf = SHEvalDir(normalize(d));
+
+			shvec_t SHOtherX = sh_eval_localX[j];
+			shvec_t SHOtherY = sh_eval_localY[j];
+			shvec_t SHOtherZ = sh_eval_localZ[j];
+
+			float sumAllSHX = sh_c0_localX[j] * SH_C0 * SH_W0;
+			float sumAllSHY = sh_c0_localY[j] * SH_C0 * SH_W0;
+			float sumAllSHZ = sh_c0_localZ[j] * SH_C0 * SH_W0;
+
+			sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+			sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+			sumAllSHZ += SHDot(SHSelf, SHOtherZ);
 
 			float4 test = (float4)(sumAllSHX, sumAllSHY, sumAllSHZ, 0.0f);
 
@@ -805,15 +1034,15 @@ __kernel void dontUseSH(__global float4* vel,
 						__global float4* vel_out,
 						__global uint* startIndex,
 						__global uint* endIndex,
-						__global float8* sh_evalX,
-						__global float8* sh_evalY,
-						__global float8* sh_evalZ,
+						__global shvec_t* sh_evalX,
+						__global shvec_t* sh_evalY,
+						__global shvec_t* sh_evalZ,
 						__constant simParams_t* simParams,
 						__global float4* pos,
 						__global float4* pos_out,
-						__local float8* sh_eval_localX,
-						__local float8* sh_eval_localY,
-						__local float8* sh_eval_localZ,
+						__local shvec_t* sh_eval_localX,
+						__local shvec_t* sh_eval_localY,
+						__local shvec_t* sh_eval_localZ,
 						__global float* coef0X,
 						__global float* coef0Y,
 						__global float* coef0Z,
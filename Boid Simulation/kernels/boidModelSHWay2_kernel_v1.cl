@@ -43,6 +43,16 @@ typedef struct{
 	float maxVelCor
 } simParams_t;
 
+//attributes shared by all agents of a group, indexed by the per-agent group id
+typedef struct{
+	float4 goal;
+	float4 color;
+	float wPath;
+	float wSeparation;
+	float maxVel;
+	float pad;
+} group_t;
+
 __kernel void memSet(
     __global uint *d_Data,
     uint val,
@@ -141,12 +151,13 @@ __kernel void findGridEdgeAndReorder(
     __global const uint   *gridIndex,   //input: particle indices sorted by hash
     __global const float4 *unsortedPos,     //input: positions array sorted by hash
     __global const float4 *unsortedVel,     //input: velocity array sorted by hash
-	__global const float4 *unsortedGoal,
-	__global float4 *reorderedGoal,
-	__global const float4 *unsortedColor,
-	__global float4 *reorderedColor,
+	__global const uchar  *unsortedGroup,   //input: group id per particle
+	__global uchar  *reorderedGroup,  //output: reordered by cell hash group ids
     __local uint *localHash,          //get_group_size(0) + 1 elements
-    uint    numParticles
+    uint    numParticles,
+    __global const float4 *unsortedGoal,    //input: own goal per particle, only read with goalPerBoid
+    __global float4 *reorderedGoal,  //output: reordered by cell hash goals
+    uint    goalPerBoid
 ){
     uint hash;
     const uint index = get_global_id(0);
@@ -187,18 +198,144 @@ __kernel void findGridEdgeAndReorder(
         uint sortedIndex = gridIndex[index];
         float4 pos = unsortedPos[sortedIndex];
         float4 vel = unsortedVel[sortedIndex];
-		float4 goal = unsortedGoal[sortedIndex];
-		float4 color = unsortedColor[sortedIndex];
+		uchar group = unsortedGroup[sortedIndex];
 
         reorderedPos[index] = pos;
         reorderedVel[index] = vel;
-		reorderedGoal[index] = goal;
-		reorderedColor[index] = color;
+		reorderedGroup[index] = group;
+		if (goalPerBoid)
+			reorderedGoal[index] = unsortedGoal[sortedIndex];
 	}  
 }
 
 
 
+#define LOD_FULL 0
+#define LOD_COARSE 1
+
+/*cell of a grid position, clamped into the grid*/
+uint lodCell(int4 gridPos, __constant simParams_t* params)
+{
+	int4 c = clamp(gridPos, (int4)(0, 0, 0, 0), (int4)(params->gridSize.x - 1, params->gridSize.y - 1, params->gridSize.z - 1, 0));
+	return c.x + params->gridSize.x * c.z + params->gridSize.x * params->gridSize.z * c.y;
+}
+
+/*
+	Level of detail tier of every cell. A cell runs the full rules if its bounding sphere is inside the
+	view frustum and closer than lodDistance to the eye, if it overlaps one of the boxes (min, max pairs)
+	or if it holds at least denseCount boids. tierCount gets the number of boids per tier.
+*/
+__kernel void assignLOD(
+	__global const uint* cellStart,
+	__global const uint* cellEnd,
+	__constant simParams_t* simParams,
+	const float16 viewProjection,
+	const float4 eye,
+	const float lodDistance,
+	const uint denseCount,
+	__constant float4* roiBoxes,
+	const uint numBoxes,
+	__global uchar* cellTier,
+	__global uint* tierCount)
+{
+	uint cell = get_global_id(0);
+	if (cell >= simParams->numCells)
+		return;
+
+	uint x = cell % simParams->gridSize.x;
+	uint z = (cell / simParams->gridSize.x) % simParams->gridSize.z;
+	uint y = cell / (simParams->gridSize.x * simParams->gridSize.z);
+
+	float4 size = (float4)(simParams->cellSize.x, simParams->cellSize.y, simParams->cellSize.z, 0.0f);
+	float4 cellMin = (float4)(simParams->worldOrigin.x, simParams->worldOrigin.y, simParams->worldOrigin.z, 0.0f) + (float4)(x, y, z, 0.0f) * size;
+	float4 cellMax = cellMin + size;
+	float4 center = 0.5f * (cellMin + cellMax);
+	float radius = 0.5f * length(size);
+
+	//frustum planes from the rows of the column major matrix (Gribb and Hartmann)
+	float4 r0 = viewProjection.s048c;
+	float4 r1 = viewProjection.s159d;
+	float4 r2 = viewProjection.s26ae;
+	float4 r3 = viewProjection.s37bf;
+	float4 planes[6] = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2 };
+
+	bool inside = distance(center.xyz, eye.xyz) - radius < lodDistance;
+	for (int i = 0; i < 6 && inside; i++)
+		inside = dot(planes[i].xyz, center.xyz) + planes[i].w >= -radius * length(planes[i].xyz);
+
+	for (uint i = 0; i < numBoxes && !inside; i++)
+		inside = all(isless(cellMin.xyz, roiBoxes[2 * i + 1].xyz)) && all(isgreater(cellMax.xyz, roiBoxes[2 * i].xyz));
+
+	uint range = cellEnd[cell] - cellStart[cell];
+	uchar tier = (inside || range >= denseCount) ? LOD_FULL : LOD_COARSE;
+
+	cellTier[cell] = tier;
+	if (range > 0)
+		atomic_add(&tierCount[tier], range);
+}
+
+/*mean velocity of the boids of every coarse cell*/
+__kernel void cellMeanVelocity(
+	__global const float4* vel,
+	__global const uint* cellStart,
+	__global const uint* cellEnd,
+	__global const uchar* cellTier,
+	__global float4* meanVel,
+	const uint numCells)
+{
+	uint cell = get_global_id(0);
+	if (cell >= numCells || cellTier[cell] == LOD_FULL)
+		return;
+
+	uint start = cellStart[cell];
+	uint end = cellEnd[cell];
+	float4 sum = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	for (uint i = start; i < end; i++)
+		sum += vel[i];
+
+	sum.w = 0.0f;
+	meanVel[cell] = end > start ? sum / (float)(end - start) : sum;
+}
+
+/*boids of coarse cells take the mean velocity of their cell instead of the neighbour rules,
+  the SH field is added afterwards by useSH like for all boids*/
+__kernel void simulateCoarse(
+	__global const float4* pos,
+	__global float4* pos_out,
+	__global float4* vel_out,
+	__global const uchar *group,
+	__constant simParams_t* simParams,
+	__constant group_t *groups,
+	__global const uchar *cellTier,
+	__global const float4* meanVel,
+	const uint numBodies)
+{
+	uint id = get_global_id(0);
+	if (id >= numBodies)
+		return;
+
+	float4 posOwn = pos[id];
+	int4 gridPos = getGridPos(posOwn, simParams);
+	uint cell = lodCell(gridPos, simParams);
+
+	if (cellTier[cell] == LOD_FULL)
+		return;
+
+	float4 velOwn = meanVel[cell];
+	velOwn.w = 0.0f;
+
+	float maxVel = groups[group[id]].maxVel;
+	float len = fast_length(velOwn);
+	if (len > maxVel)
+		velOwn = (velOwn / len) * maxVel;
+
+	velOwn += checkAndCorrectBoundariesWithPos(gridPos, simParams);
+
+	vel_out[id] = velOwn;
+	pos_out[id] = posOwn;
+}
+
 __kernel void simulate(
 	__global const float4* pos,
 	__global float4* pos_out,
@@ -206,10 +343,14 @@ __kernel void simulate(
 	__global float4* vel_out,
 	__global const uint *cellStart,
 	__global const uint *cellEnd,
-	__global const float4 *goal,
+	__global const uchar *group,
 	__constant simParams_t* simParams,
 	__global uint *range_out,
-	float dt)
+	__constant group_t *groups,
+	__global const uchar *cellTier,
+	float dt,
+	__global const float4 *goal,
+	uint goalPerBoid)
 {
 	uint id = get_global_id(0);
 
@@ -227,6 +368,10 @@ __kernel void simulate(
 	float4 posOwn = pos[id];
 	int4 gridPos = getGridPos(posOwn, simParams);
 
+	//boids of coarse cells are moved by simulateCoarse
+	if (cellTier[lodCell(gridPos, simParams)] != LOD_FULL)
+		return;
+
 	float4 velCor = checkAndCorrectBoundariesWithPos(gridPos, simParams);
 
 	//accumulate data from sourrounding cells
@@ -291,8 +436,9 @@ __kernel void simulate(
 		perceivedVel = (perceivedVel / flockMatesVisible) - velOwn;
 	}
 
-	//calculate straight path to goal
-	float4 g = goal[id];
+	//calculate straight path to the goal of the group or to the own goal of the boid
+	group_t grp = groups[group[id]];
+	float4 g = goalPerBoid ? goal[id] : grp.goal;
 	g.w = 0.0f;
 
 	float4 path = g - posOwn;
@@ -300,7 +446,7 @@ __kernel void simulate(
 	path = fast_normalize(path);
 
 	//calculate new velocities 
-	velOwn = velOwn * simParams->wOwn + path * simParams->wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * simParams->wSeparation;
+	velOwn = velOwn * simParams->wOwn + path * grp.wPath + perceivedPos * simParams->wCohesion + perceivedVel * simParams->wAlignment + separation * grp.wSeparation;
 	velOwn.w = 0.0;
 
 	//truncate velocity to max velocity
@@ -309,10 +455,10 @@ __kernel void simulate(
 
 	float len = fast_length(velOwn);
 
-	if (len > simParams->maxVel){
-		velOwn.x = (velOwn.x / len) * simParams->maxVel;
-		velOwn.z = (velOwn.z / len) * simParams->maxVel;
-		velOwn.y = (velOwn.y / len) * simParams->maxVel;
+	if (len > grp.maxVel){
+		velOwn.x = (velOwn.x / len) * grp.maxVel;
+		velOwn.z = (velOwn.z / len) * grp.maxVel;
+		velOwn.y = (velOwn.y / len) * grp.maxVel;
 	}
 
 
@@ -325,59 +471,35 @@ __kernel void simulate(
 }
 
 
-/*
-	Evaluate 3. order SH. Numerical implementation from P.P. Sloan
-	float8 is used to store the 9 coefficients because coefficient 0 is
-	constant it is just added at the reconstruction.
+/*SHEval, SHDot and SHProduct of the band order SH_ORDER come from kernels/sh_basis.cl,
+  which the host puts in front of this file.
 */
-float8 SHEval3(float4 vel_in)
-{
-   float4 vel = vel_in;
-   float8 pSH;
-   float fC0,fC1,fS0,fS1,fTmpA,fTmpB,fTmpC;
-   float fZ2 = vel.z*vel.z;
-
-   //pSH.0 = 0.2820947917738781f;
-   pSH.s1 = 0.4886025119029199f*vel.z;
-   pSH.s5 = 0.9461746957575601f*fZ2 + -0.3153915652525201f;
-   fC0 = vel.x;
-   fS0 = vel.y;
-
-   fTmpA = -0.48860251190292f;
-   pSH.s2 = fTmpA*fC0;
-   pSH.s0 = fTmpA*fS0;
-   fTmpB = -1.092548430592079f*vel.z;
-   pSH.s6 = fTmpB*fC0;
-   pSH.s4 = fTmpB*fS0;
-   fC1 = vel.x*fC0 - vel.y*fS0;
-   fS1 = vel.x*fS0 + vel.y*fC0;
-
-   fTmpC = 0.5462742152960395f;
-   pSH.s7 = fTmpC*fC1;
-   pSH.s3 = fTmpC*fS1;
-
-   return pSH;
-}
 
 /*simple reduction kernel to sum up the velocities of all boids in a cell*/
 __kernel void evalSH(__global float4* vel,
-					 __global float8* sh_evalX, 
-					 __global float8* sh_evalY, 
-					 __global float8* sh_evalZ, 
+					 __global shvec_t* sh_evalX, 
+					 __global shvec_t* sh_evalY, 
+					 __global shvec_t* sh_evalZ, 
 					 __global float* coef0X, 
 					 __global float* coef0Y, 
 					 __global float* coef0Z){
 	uint id = get_global_id(0);
 	float4 v = vel[id];
 	v.w = 0.0f;
-	float8 sh = SHEval3(fast_normalize(v));
+	shvec_t sh = SHEval(fast_normalize(v));
 	sh_evalX[id] = sh * v.x;
 	sh_evalY[id] = sh * v.y;
 	sh_evalZ[id] = sh * v.z;
 
-	coef0X[id] = 0.2820947917738781f * v.x;
-	coef0Y[id] = 0.2820947917738781f * v.y;
-	coef0Z[id] = 0.2820947917738781f * v.z;
+	coef0X[id] = SH_C0 * v.x;
+	coef0Y[id] = SH_C0 * v.y;
+	coef0Z[id] = SH_C0 * v.z;
+}
+
+/*SH channel of a group, groups beyond the last channel share it*/
+uint groupChannel(uchar g, uint numChannels)
+{
+	return min((uint)g, numChannels - 1);
 }
 
 /*kernel to use the SH calculations on boids*/
@@ -385,15 +507,15 @@ __kernel void useSH(__global const float4* vel,
 					__global float4* vel_out,
 					__global const uint* startIndex, 
 					__global const uint* endIndex, 
-					__global const float8* sh_evalX, 
-					__global const float8* sh_evalY, 
-					__global const float8* sh_evalZ,
+					__global const shvec_t* sh_evalX, 
+					__global const shvec_t* sh_evalY, 
+					__global const shvec_t* sh_evalZ,
 					__constant simParams_t* simParams, 
 					__global const float4* pos,
 					__global float4* pos_out,
-					__local float8* sh_eval_localX,
-					__local float8* sh_eval_localY,
-					__local float8* sh_eval_localZ,
+					__local shvec_t* sh_eval_localX,
+					__local shvec_t* sh_eval_localY,
+					__local shvec_t* sh_eval_localZ,
 					__global const float* coef0X,
 					__global const float* coef0Y,
 					__global const float* coef0Z,
@@ -402,29 +524,34 @@ __kernel void useSH(__global const float4* vel,
 					__local float* sh_c0_localZ,
 					__local float4* lPos,
 					__local float4* lVel,
+					__global const uchar* group,
+					const uint numChannels,
+					const float wOwnGroup,
+					const float wOtherGroup,
 					 float dt)
 {
 	uint id = get_global_id(0);
 	uint lSize = get_local_size(0);
 	uint lId = get_local_id(0);
 
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
+	shvec_t sumSHX;
+	shvec_t sumSHY;
+	shvec_t sumSHZ;
 
 	float4 velOwn = vel[id];
 	float4 posOwn = pos[id];
-	float8 SHSelf = SHEval3(normalize(velOwn));
+	shvec_t SHSelf = SHEval(normalize(velOwn));
 	posOwn.w = 0.0f;
 	velOwn.w = 0.0f;
 
 	int4 gridPos = getGridPos(posOwn, simParams);
 	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
 	float4 velCor = checkAndCorrectBoundaries(cell, simParams);
+	uint channel = groupChannel(group[id], numChannels);
 
-	sh_eval_localX[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[lId] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[lId] = SH_ZERO;
+	sh_eval_localY[lId] = SH_ZERO;
+	sh_eval_localZ[lId] = SH_ZERO;
 	sh_c0_localX[lId] = 0.0f;
 	sh_c0_localY[lId] = 0.0f;
 	sh_c0_localZ[lId] = 0.0f;
@@ -458,46 +585,30 @@ __kernel void useSH(__global const float4* vel,
 			float factor = FACTOR_NO;
 			float dotP = dot(distV, velOwn);
 
-			SHSelf = SHEval3(normalize(distV));
+			SHSelf = SHEval(normalize(distV));
 
 			if (dotP < 0.0){
 				factor = FACTOR;
 			}
 
-			float8 SHOtherX = (1.f / (dist + 0.01)) * sh_eval_localX[j];
-			float8 SHOtherY = (1.f / (dist + 0.01)) * sh_eval_localY[j];
-			float8 SHOtherZ = (1.f / (dist + 0.01)) * sh_eval_localZ[j];
-
-			float sumAllSHX = (1.f / (dist + 0.01)) * sh_c0_localX[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHY = (1.f / (dist + 0.01)) * sh_c0_localY[j] * 0.2820947917738781f * M_PI_F;
-			float sumAllSHZ = (1.f / (dist + 0.01)) * sh_c0_localZ[j] * 0.2820947917738781f * M_PI_F;
-
-			sumAllSHX += SHSelf.s0 * SHOtherX.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s1 * SHOtherX.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s2 * SHOtherX.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHX += SHSelf.s3 * SHOtherX.s3 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s4 * SHOtherX.s4 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s5 * SHOtherX.s5 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s6 * SHOtherX.s6 * M_PI_F / 4.0f;
-			sumAllSHX += SHSelf.s7 * SHOtherX.s7 * M_PI_F / 4.0f;
-
-			sumAllSHY += SHSelf.s0 * SHOtherY.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s1 * SHOtherY.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s2 * SHOtherY.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHY += SHSelf.s3 * SHOtherY.s3 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s4 * SHOtherY.s4 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s5 * SHOtherY.s5 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s6 * SHOtherY.s6 * M_PI_F / 4.0f;
-			sumAllSHY += SHSelf.s7 * SHOtherY.s7 * M_PI_F / 4.0f;
-
-			sumAllSHZ += SHSelf.s0 * SHOtherZ.s0 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s1 * SHOtherZ.s1 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s2 * SHOtherZ.s2 * M_PI_F * 2.0f / 3.0f;
-			sumAllSHZ += SHSelf.s3 * SHOtherZ.s3 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s4 * SHOtherZ.s4 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s5 * SHOtherZ.s5 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s6 * SHOtherZ.s6 * M_PI_F / 4.0f;
-			sumAllSHZ += SHSelf.s7 * SHOtherZ.s7 * M_PI_F / 4.0f;
+			if (groupChannel(group[lSize * i + j], numChannels) == channel)
+				factor *= wOwnGroup;
+			else
+				factor *= wOtherGroup;
+
+			shvec_t SHOtherX = (1.f / (dist + 0.01)) * sh_eval_localX[j];
+			shvec_t SHOtherY = (1.f / (dist + 0.01)) * sh_eval_localY[j];
+			shvec_t SHOtherZ = (1.f / (dist + 0.01)) * sh_eval_localZ[j];
+
+			float sumAllSHX = (1.f / (dist + 0.01)) * sh_c0_localX[j] * SH_C0 * SH_W0;
+			float sumAllSHY = (1.f / (dist + 0.01)) * sh_c0_localY[j] * SH_C0 * SH_W0;
+			float sumAllSHZ = (1.f / (dist + 0.01)) * sh_c0_localZ[j] * SH_C0 * SH_W0;
+
+			sumAllSHX += SHDot(SHSelf, SHOtherX);
+
+			sumAllSHY += SHDot(SHSelf, SHOtherY);
+
+			sumAllSHZ += SHDot(SHSelf, SHOtherZ);
 
 			float4 shCor = (float4)(-sumAllSHZ, sumAllSHY, sumAllSHX, 0.0f);
 			shCor += (float4)(sumAllSHY, -sumAllSHX, sumAllSHZ, 0.0f);
@@ -525,16 +636,281 @@ __kernel void useSH(__global const float4* vel,
 }
 
 
+/*SH avoidance correction of a boid or a cell aggregate at position p, same weighting as useSH.
+  weight is the own or other group weight of the contribution*/
+float4 addSHContribution(float4 velOwn,
+						 float4 posOwn,
+						 float4 p,
+						 shvec_t shX,
+						 shvec_t shY,
+						 shvec_t shZ,
+						 float c0X,
+						 float c0Y,
+						 float c0Z,
+						 float weight)
+{
+	float4 distV = posOwn - p;
+	float dist = fast_distance(p, posOwn);
+	float w = 1.f / (dist + 0.01);
+
+	float factor = FACTOR_NO;
+	if (dot(distV, velOwn) < 0.0)
+		factor = FACTOR;
+
+	shvec_t SHSelf = SHEval(normalize(distV));
+
+	float sumAllSHX = w * (c0X * SH_C0 * SH_W0 + SHDot(SHSelf, shX));
+	float sumAllSHY = w * (c0Y * SH_C0 * SH_W0 + SHDot(SHSelf, shY));
+	float sumAllSHZ = w * (c0Z * SH_C0 * SH_W0 + SHDot(SHSelf, shZ));
+
+	float4 shCor = (float4)(-sumAllSHZ, sumAllSHY, sumAllSHX, 0.0f);
+	shCor += (float4)(sumAllSHY, -sumAllSHX, sumAllSHZ, 0.0f);
+	shCor += (float4)(sumAllSHX, sumAllSHZ, -sumAllSHY, 0.0f);
+
+	velOwn += shCor * factor * weight;
+	velOwn.w = 0.0f;
+	return velOwn;
+}
+
+/*sum of the per boid SH coefficients of every cell and group channel, one work item per
+  entry cell * numChannels + channel so the channels of a cell are contiguous.
+  cellPos is the mean position of the boids of the channel in the cell, w holds their number*/
+__kernel void aggregateSH(__global const uint* startIndex,
+						  __global const uint* endIndex,
+						  __global const float4* pos,
+						  __global const shvec_t* sh_evalX,
+						  __global const shvec_t* sh_evalY,
+						  __global const shvec_t* sh_evalZ,
+						  __global const float* coef0X,
+						  __global const float* coef0Y,
+						  __global const float* coef0Z,
+						  __global shvec_t* cellSHX,
+						  __global shvec_t* cellSHY,
+						  __global shvec_t* cellSHZ,
+						  __global float* cellC0X,
+						  __global float* cellC0Y,
+						  __global float* cellC0Z,
+						  __global float4* cellPos,
+						  uint numCells,
+						  __global const uchar* group,
+						  uint numChannels)
+{
+	uint entry = get_global_id(0);
+	if (entry >= numCells * numChannels)
+		return;
+
+	uint cell = entry / numChannels;
+	uint channel = entry % numChannels;
+	uint start = startIndex[cell];
+	uint end = endIndex[cell];
+
+	shvec_t sumX = SH_ZERO;
+	shvec_t sumY = SH_ZERO;
+	shvec_t sumZ = SH_ZERO;
+	float c0X = 0.0f;
+	float c0Y = 0.0f;
+	float c0Z = 0.0f;
+	float4 sumPos = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+	uint count = 0;
+
+	for (uint i = start; i < end; i++){
+		if (groupChannel(group[i], numChannels) != channel)
+			continue;
+
+		count++;
+		sumX += sh_evalX[i];
+		sumY += sh_evalY[i];
+		sumZ += sh_evalZ[i];
+		c0X += coef0X[i];
+		c0Y += coef0Y[i];
+		c0Z += coef0Z[i];
+		sumPos += pos[i];
+	}
+
+	if (count > 0)
+		sumPos /= (float)count;
+	sumPos.w = (float)count;
+
+	cellSHX[entry] = sumX;
+	cellSHY[entry] = sumY;
+	cellSHZ[entry] = sumZ;
+	cellC0X[entry] = c0X;
+	cellC0Y[entry] = c0Y;
+	cellC0Z[entry] = c0Z;
+	cellPos[entry] = sumPos;
+}
+
+/*useSH against per cell aggregates: boids in the 27 cells around the own cell are taken
+  one by one, every other cell as the sums of its group channels at the mean boid position
+  of the channel. Contributions of the own group are weighted by wOwnGroup, the others by
+  wOtherGroup so opposing groups in a cell do not cancel out.
+  Arguments 0-19 are the same as in useSH*/
+__kernel void useSHCells(__global const float4* vel,
+						 __global float4* vel_out,
+						 __global const uint* startIndex,
+						 __global const uint* endIndex,
+						 __global const shvec_t* sh_evalX,
+						 __global const shvec_t* sh_evalY,
+						 __global const shvec_t* sh_evalZ,
+						 __constant simParams_t* simParams,
+						 __global const float4* pos,
+						 __global float4* pos_out,
+						 __local shvec_t* sh_eval_localX,
+						 __local shvec_t* sh_eval_localY,
+						 __local shvec_t* sh_eval_localZ,
+						 __global const float* coef0X,
+						 __global const float* coef0Y,
+						 __global const float* coef0Z,
+						 __local float* sh_c0_localX,
+						 __local float* sh_c0_localY,
+						 __local float* sh_c0_localZ,
+						 __local float4* lCellPos,
+						 __global const shvec_t* cellSHX,
+						 __global const shvec_t* cellSHY,
+						 __global const shvec_t* cellSHZ,
+						 __global const float* cellC0X,
+						 __global const float* cellC0Y,
+						 __global const float* cellC0Z,
+						 __global const float4* cellPos,
+						 __global const uchar* group,
+						 const uint numChannels,
+						 const float wOwnGroup,
+						 const float wOtherGroup,
+						 float dt)
+{
+	uint id = get_global_id(0);
+	uint lSize = get_local_size(0);
+	uint lId = get_local_id(0);
+
+	float4 velOwn = vel[id];
+	float4 posOwn = pos[id];
+	posOwn.w = 0.0f;
+	velOwn.w = 0.0f;
+
+	int4 gridPos = getGridPos(posOwn, simParams);
+	int cell = gridPos.x + (simParams->gridSize.x) * gridPos.z + (simParams->gridSize.z) * (simParams->gridSize.x) * gridPos.y;
+	float4 velCor = checkAndCorrectBoundaries(cell, simParams);
+	uint channel = groupChannel(group[id], numChannels);
+
+	int4 gridSize = (int4)(simParams->gridSize.x, simParams->gridSize.y, simParams->gridSize.z, 1);
+	gridPos = clamp(gridPos, (int4)(0, 0, 0, 0), gridSize - (int4)(1, 1, 1, 1));
+
+	//near field, every boid on its own
+	for (int y = max(gridPos.y - 1, 0); y <= min(gridPos.y + 1, gridSize.y - 1); y++){
+		for (int z = max(gridPos.z - 1, 0); z <= min(gridPos.z + 1, gridSize.z - 1); z++){
+			for (int x = max(gridPos.x - 1, 0); x <= min(gridPos.x + 1, gridSize.x - 1); x++){
+				uint n = x + gridSize.x * z + gridSize.z * gridSize.x * y;
+				uint end = endIndex[n];
+
+				for (uint j = startIndex[n]; j < end; j++){
+					float4 p = pos[j];
+					p.w = 0.0f;
+					float w = groupChannel(group[j], numChannels) == channel ? wOwnGroup : wOtherGroup;
+					velOwn = addSHContribution(velOwn, posOwn, p, sh_evalX[j], sh_evalY[j], sh_evalZ[j], coef0X[j], coef0Y[j], coef0Z[j], w);
+				}
+			}
+		}
+	}
+
+	//far field, one aggregate per cell and group channel
+	uint numEntries = simParams->numCells * numChannels;
+	uint numTiles = (numEntries + lSize - 1) / lSize;
+	for (uint i = 0; i < numTiles; i++){
+		uint c = lSize * i + lId;
+
+		if (c < numEntries){
+			sh_eval_localX[lId] = cellSHX[c];
+			sh_eval_localY[lId] = cellSHY[c];
+			sh_eval_localZ[lId] = cellSHZ[c];
+			sh_c0_localX[lId] = cellC0X[c];
+			sh_c0_localY[lId] = cellC0Y[c];
+			sh_c0_localZ[lId] = cellC0Z[c];
+			lCellPos[lId] = cellPos[c];
+		}
+		else
+			lCellPos[lId] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (uint j = 0; j < lSize; j++){
+			float4 p = lCellPos[j];
+			if (p.w == 0.0f)
+				continue;
+
+			int e = lSize * i + j;
+			int n = e / numChannels;
+			int4 offset = (int4)(n % gridSize.x, n / (gridSize.x * gridSize.z), (n / gridSize.x) % gridSize.z, 0) - gridPos;
+			if (abs(offset.x) <= 1 && abs(offset.y) <= 1 && abs(offset.z) <= 1)
+				continue;
+
+			p.w = 0.0f;
+			float w = (e % numChannels) == channel ? wOwnGroup : wOtherGroup;
+			velOwn = addSHContribution(velOwn, posOwn, p, sh_eval_localX[j], sh_eval_localY[j], sh_eval_localZ[j], sh_c0_localX[j], sh_c0_localY[j], sh_c0_localZ[j], w);
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	float len = length(velOwn);
+
+	if (len > simParams->maxVel){
+		velOwn.x = (velOwn.x / len) * simParams->maxVel;
+		velOwn.y = (velOwn.y / len) * simParams->maxVel;
+		velOwn.z = (velOwn.z / len) * simParams->maxVel;
+	}
+
+	//apply correction velocity dependend on boid cell position (border case)
+	velOwn += velCor;
+	posOwn.w = 1.0;
+
+	vel_out[id] = velOwn;
+	pos_out[id] = posOwn + velOwn * dt;
+}
+
+/*length of the difference between the velocities of useSHCells and the per boid reference*/
+__kernel void compareVel(
+	__global const float4* vel,
+	__global const float4* velRef,
+	__global float* deviation,
+	const uint numBodies
+){
+	uint id = get_global_id(0);
+	if (id >= numBodies)
+		return;
+
+	float4 d = vel[id] - velRef[id];
+	d.w = 0.0f;
+	deviation[id] = length(d);
+}
+
+/*count the boids slower than minSpeed into congested[slot], e.g. stuck between opposing groups*/
+__kernel void countCongested(
+	__global const float4* vel,
+	__global uint* congested,
+	const float minSpeed,
+	const uint numBodies,
+	const uint slot
+){
+	uint id = get_global_id(0);
+	if (id >= numBodies)
+		return;
+
+	float4 v = vel[id];
+	v.w = 0.0f;
+	if (length(v) < minSpeed)
+		atomic_inc(congested + slot);
+}
+
 /*kernel to use the SH calculations on boids*/
 __kernel void dontUseSH(__global float4* vel,
 					__global float4* vel_out,
 					__global uint* startIndex, 
 					__global uint* endIndex, 
-					__global float8* sh_eval, 
+					__global shvec_t* sh_eval, 
 					__constant simParams_t* simParams, 
 					__global float4* pos,
 					__global float4* pos_out,
-					__local float8* sh_eval_local,
+					__local shvec_t* sh_eval_local,
 					 float dt)
 {
 	uint id = get_local_id(0);
@@ -581,15 +957,15 @@ __kernel void useSH(__global float4* vel,
 	__global float4* vel_out,
 	__global uint* startIndex,
 	__global uint* endIndex,
-	__global float8* sh_evalX,
-	__global float8* sh_evalY,
-	__global float8* sh_evalZ,
+	__global shvec_t* sh_evalX,
+	__global shvec_t* sh_evalY,
+	__global shvec_t* sh_evalZ,
 	__constant simParams_t* simParams,
 	__global float4* pos,
 	__global float4* pos_out,
-	__local float8* sh_eval_localX,
-	__local float8* sh_eval_localY,
-	__local float8* sh_eval_localZ,
+	__local shvec_t* sh_eval_localX,
+	__local shvec_t* sh_eval_localY,
+	__local shvec_t* sh_eval_localZ,
 	__global float* coef0X,
 	__global float* coef0Y,
 	__global float* coef0Z,
@@ -615,17 +991,17 @@ __kernel void useSH(__global float4* vel,
 
 	uint plane = simParams->gridSize.x * simParams->gridSize.z;
 
-	float8 sumSHX;
-	float8 sumSHY;
-	float8 sumSHZ;
+	shvec_t sumSHX;
+	shvec_t sumSHY;
+	shvec_t sumSHZ;
 
 	float4 velOwn;
 	float4 posOwn = pos[start];
 	posOwn.w = 0.0f;
 
-	sh_eval_localX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[id] = SH_ZERO;
+	sh_eval_localY[id] = SH_ZERO;
+	sh_eval_localZ[id] = SH_ZERO;
 	sh_c0_localX[id] = 0.0f;
 	sh_c0_localY[id] = 0.0f;
 	sh_c0_localZ[id] = 0.0f;
@@ -693,15 +1069,15 @@ __kernel void useSH(__global float4* vel,
 		sumSHZ += (1.f / (1.f)) * sh_evalZ[index];
 		}*//*
 
-		float8 SHSelf = SHEval3(normalize(velOwn));
+		shvec_t SHSelf = SHEval(normalize(velOwn));
 
-		float8 SHOtherX = sumSHX;
-		float8 SHOtherY = sumSHY;
-		float8 SHOtherZ = sumSHZ;
+		shvec_t SHOtherX = sumSHX;
+		shvec_t SHOtherY = sumSHY;
+		shvec_t SHOtherZ = sumSHZ;
 
-		float sumAllSHX = sh_c0_localX[0] * 0.2820947917738781f;
-		float sumAllSHY = sh_c0_localY[0] * 0.2820947917738781f;
-		float sumAllSHZ = sh_c0_localZ[0] * 0.2820947917738781f;
+		float sumAllSHX = sh_c0_localX[0] * SH_C0;
+		float sumAllSHY = sh_c0_localY[0] * SH_C0;
+		float sumAllSHZ = sh_c0_localZ[0] * SH_C0;
 
 		sumAllSHX += SHSelf.s0 * SHOtherX.s0;
 		sumAllSHX += SHSelf.s1 * SHOtherX.s1;
@@ -363,38 +363,9 @@ __kernel void simulate( __global float4* pos,
 }
 
 
-/*Evaluete 3. order SH. Numerical implementation from P.P. Sloan
-  float8 is used to store the 9 coefficients because coefficient 0 is
-  constant it is just added at the reconstruction.
+/*SHEval, SHDot and SHProduct of the band order SH_ORDER come from kernels/sh_basis.cl,
+  which the host puts in front of this file.
 */
-float8 SHEval3(float4 vel_in)
-{
-   float4 vel = vel_in;
-   float8 pSH;
-   float fC0,fC1,fS0,fS1,fTmpA,fTmpB,fTmpC;
-   float fZ2 = vel.z*vel.z;
-
-   //pSH.0 = 0.2820947917738781f;
-   pSH.s1 = 0.4886025119029199f*vel.z;
-   pSH.s5 = 0.9461746957575601f*fZ2 + -0.3153915652525201f;
-   fC0 = vel.x;
-   fS0 = vel.y;
-
-   fTmpA = -0.48860251190292f;
-   pSH.s2 = fTmpA*fC0;
-   pSH.s0 = fTmpA*fS0;
-   fTmpB = -1.092548430592079f*vel.z;
-   pSH.s6 = fTmpB*fC0;
-   pSH.s4 = fTmpB*fS0;
-   fC1 = vel.x*fC0 - vel.y*fS0;
-   fS1 = vel.x*fS0 + vel.y*fC0;
-
-   fTmpC = 0.5462742152960395f;
-   pSH.s7 = fTmpC*fC1;
-   pSH.s3 = fTmpC*fS1;
-
-   return pSH;
-}
 
 /*simple reduction kernel to sum up the velocities of all boids in a cell*/
 __kernel void sumVelSH(__global float4* vel, __global uint* startIndex, __global uint* endIndex, __global float4* vel_sum, __local float4* sumArray){
@@ -409,9 +380,9 @@ __kernel void sumVelSH(__global float4* vel, __global uint* startIndex, __global
 
 	uint index = start + id;
 
-	sh_eval_localX[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localY[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	sh_eval_localZ[id] = (float8)(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	sh_eval_localX[id] = SH_ZERO;
+	sh_eval_localY[id] = SH_ZERO;
+	sh_eval_localZ[id] = SH_ZERO;
 	sh_c0_localX[id] = 0.0f;
 	sh_c0_localY[id] = 0.0f;
 	sh_c0_localZ[id] = 0.0f;
@@ -421,14 +392,14 @@ __kernel void sumVelSH(__global float4* vel, __global uint* startIndex, __global
 		float4 v = vel[index];
 		v.w = 0.0f;
 
-		float8 sh = SHEval3(fast_normalize(v));
+		shvec_t sh = SHEval(fast_normalize(v));
 		sh_evalX[id] += sh * v.x;
 		sh_evalY[id] += sh * v.y;
 		sh_evalZ[id] += sh * v.z;
 
-		coef0X[id] += 0.2820947917738781f * v.x;
-		coef0Y[id] += 0.2820947917738781f * v.y;
-		coef0Z[id] += 0.2820947917738781f * v.z;
+		coef0X[id] += SH_C0 * v.x;
+		coef0Y[id] += SH_C0 * v.y;
+		coef0Z[id] += SH_C0 * v.z;
 
 		index += lSize ;
 	}
@@ -489,8 +460,8 @@ __kernel void useSH(__global float4* vel,
 	float4 shVelSum;
 
 	float4 velOwn = vel_sum[cell];
-	float8 SHSelf = SHEval3(normalize(velOwn));
-	float8 SHOther;
+	shvec_t SHSelf = SHEval(normalize(velOwn));
+	shvec_t SHOther;
 	float sumSH;
 
 	float3 posOwn = (float3)((cell / plane), ((cell % plane) / simParams->gridSize.x), ((cell % plane) % simParams->gridSize.x));
@@ -516,18 +487,11 @@ __kernel void useSH(__global float4* vel,
 			if(dotP < 0.0f)
 				factor = 0.01;
 
-			SHOther = SHEval3(normalize(velOther));	
+			SHOther = SHEval(normalize(velOther));	
 
-			sumSH = 0.2820947917738781f * 0.2820947917738781f;
+			sumSH = SH_C0 * SH_C0;
 
-			sumSH += SHSelf.s0 * SHOther.s0;
-			sumSH += SHSelf.s1 * SHOther.s1;
-			sumSH += SHSelf.s2 * SHOther.s2;
-			sumSH += SHSelf.s3 * SHOther.s3;
-			sumSH += SHSelf.s4 * SHOther.s4;
-			sumSH += SHSelf.s5 * SHOther.s5;
-			sumSH += SHSelf.s6 * SHOther.s6;
-			sumSH += SHSelf.s7 * SHOther.s7;
+			sumSH += SHProduct(SHSelf, SHOther);
 
 			
 			float fu = fast_distance(posOwn, posOther);
@@ -637,8 +601,8 @@ __kernel void useSH(__global float4* vel,
 	float4 shVelSum;
 
 	float4 velOwn = vel_sum[cell];
-	float8 SHSelf = SHEval3(normalize(velOwn));
-	float8 SHOther;
+	shvec_t SHSelf = SHEval(normalize(velOwn));
+	shvec_t SHOther;
 	float sumSH;
 
 	float3 posOwn = (float3)(cell / plane, (cell % plane) / simParams->gridSize.x, ((cell % plane) % simParams->gridSize.x));
@@ -650,18 +614,11 @@ __kernel void useSH(__global float4* vel,
 	for(uint i = id; i < simParams->numCells; i += lSize){
 		if(i != cell){
 			float4 velOther = vel_sum[i];
-			SHOther = SHEval3(normalize(velOther));	
+			SHOther = SHEval(normalize(velOther));	
 
-			sumSH = 0.0f;//0.2820947917738781f * 0.2820947917738781f * M_PI_F;
+			sumSH = 0.0f;//SH_C0 * SH_C0 * SH_W0;
 
-			sumSH += SHSelf.s0 * SHOther.s0 * 2.0f/3.0f;
-			sumSH += SHSelf.s1 * SHOther.s1 * 2.0f * M_PI_F/3.0f;
-			sumSH += SHSelf.s2 * SHOther.s2 * 2.0f * M_PI_F/3.0f;
-			sumSH += SHSelf.s3 * SHOther.s3 * M_PI_F/4.0f;
-			sumSH += SHSelf.s4 * SHOther.s4 * M_PI_F/4.0f;
-			sumSH += SHSelf.s5 * SHOther.s5 * M_PI_F/4.0f;
-			sumSH += SHSelf.s6 * SHOther.s6 * M_PI_F/4.0f;
-			sumSH += SHSelf.s7 * SHOther.s7 * M_PI_F/4.0f;
+			sumSH += SHDot(SHSelf, SHOther);
 
 			posOther = (float3)((i) / plane, ((i) % plane) / simParams->gridSize.x, (((i) % plane) % simParams->gridSize.x));
 			float fu = fast_distance(posOwn, posOther);
@@ -727,8 +684,8 @@ __kernel void useSH(__global float4* vel,
 	float4 shVelSum;
 
 	float4 velOwn = vel_sum[cell];
-	float8 SHSelf = SHEval3(normalize(velOwn));
-	float8 SHOther;
+	shvec_t SHSelf = SHEval(normalize(velOwn));
+	shvec_t SHOther;
 	float sumSH;
 
 	float3 posOwn = (float3)(cell / plane, (cell % plane) / simParams->gridSize.x, ((cell % plane) % simParams->gridSize.x));
@@ -740,18 +697,11 @@ __kernel void useSH(__global float4* vel,
 	for(uint i = id; i < simParams->numCells; i += lSize){
 		if(i != cell){
 			float4 velOther = vel_sum[i];
-			SHOther = SHEval3(normalize(velOther));	
+			SHOther = SHEval(normalize(velOther));	
 
-			sumSH = 0.2820947917738781f * 0.2820947917738781f;
+			sumSH = SH_C0 * SH_C0;
 
-			sumSH += SHSelf.s0 * SHOther.s0;
-			sumSH += SHSelf.s1 * SHOther.s1;
-			sumSH += SHSelf.s2 * SHOther.s2;
-			sumSH += SHSelf.s3 * SHOther.s3;
-			sumSH += SHSelf.s4 * SHOther.s4;
-			sumSH += SHSelf.s5 * SHOther.s5;
-			sumSH += SHSelf.s6 * SHOther.s6;
-			sumSH += SHSelf.s7 * SHOther.s7;
+			sumSH += SHProduct(SHSelf, SHOther);
 
 			posOther = (float3)((i) / plane, ((i) % plane) / simParams->gridSize.x, (((i) % plane) % simParams->gridSize.x));
 			float fu = fast_distance(posOwn, posOther);
@@ -813,8 +763,8 @@ __kernel void useSH(__global float4* vel,
 	__local float4 shSum[LOCAL_SUM];
 	float4 shVelSum;
 
-	float8 SHSelf = SHEval3(vel_sum[cell]);
-	float8 SHOther;
+	shvec_t SHSelf = SHEval(vel_sum[cell]);
+	shvec_t SHOther;
 	float sumSH;
 
 	float3 posOwn = (float3)(cell / plane, (cell % plane) / simParams->gridSize.x, ((cell % plane) % simParams->gridSize.x));
@@ -826,18 +776,11 @@ __kernel void useSH(__global float4* vel,
 	for(int i = id; i < simParams->numCells; i += LOCAL_SUM){
 		if(i != cell){
 			float4 velOther = vel_sum[i];
-			SHOther = SHEval3(velOther);	
+			SHOther = SHEval(velOther);	
 
-			sumSH = 0.2820947917738781f * 0.2820947917738781f;
+			sumSH = SH_C0 * SH_C0;
 
-			sumSH += SHSelf.s0 * SHOther.s0;
-			sumSH += SHSelf.s1 * SHOther.s1;
-			sumSH += SHSelf.s2 * SHOther.s2;
-			sumSH += SHSelf.s3 * SHOther.s3;
-			sumSH += SHSelf.s4 * SHOther.s4;
-			sumSH += SHSelf.s5 * SHOther.s5;
-			sumSH += SHSelf.s6 * SHOther.s6;
-			sumSH += SHSelf.s7 * SHOther.s7;
+			sumSH += SHProduct(SHSelf, SHOther);
 
 			//posOther = (float3)((i+id) / plane, ((i+id) % plane) / simParams->gridSize.x, (((i+id) % plane) % simParams->gridSize.x));
 			//float fu = fast_distance(posOwn, posOther);
@@ -900,18 +843,11 @@ __kernel void useSH(__global float4* vel,
 
 		for(int i = 0; i < numCells; i++){
 				if(vel_sum[i].x > 0.0f && vel_sum[i].y > 0.0f && vel_sum[i].z > 0.0f){
-					float8 SHSelf = SHEval3(vel[index]);
-					float8 SHOther = SHEval3(vel_sum[i]);
-					float sumSH = 0.2820947917738781f * 0.2820947917738781f;
-
-					sumSH += SHSelf.s0 * SHOther.s0;
-					sumSH += SHSelf.s1 * SHOther.s1;
-					sumSH += SHSelf.s2 * SHOther.s2;
-					sumSH += SHSelf.s3 * SHOther.s3;
-					sumSH += SHSelf.s4 * SHOther.s4;
-					sumSH += SHSelf.s5 * SHOther.s5;
-					sumSH += SHSelf.s6 * SHOther.s6;
-					sumSH += SHSelf.s7 * SHOther.s7;
+					shvec_t SHSelf = SHEval(vel[index]);
+					shvec_t SHOther = SHEval(vel_sum[i]);
+					float sumSH = SH_C0 * SH_C0;
+
+					sumSH += SHProduct(SHSelf, SHOther);
 
 					//float3 posOther = (float3)(i / plane, (i % plane) / simParams->gridSize.x, ((i % plane) % simParams->gridSize.x));
 					//velSum += sumSH * vel_sum[i] / (10 * fast_distance(posOwn, posOther));
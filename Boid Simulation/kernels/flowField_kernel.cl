@@ -0,0 +1,137 @@
+/*
+	Navigation flow fields on the cell grid, one field of numCells entries per goal.
+	The distance to the goal cell is relaxed in wavefronts with chamfer costs 10 / 14 / 17 for
+	face / edge / corner neighbours, blocked cells are never entered and diagonal steps do not
+	cut the corner of a blocked cell. Afterwards every cell points to its neighbour closest
+	to the goal. Cell index is x + gridSize.x * z + gridSize.x * gridSize.z * y like the grid
+	hash of the boid models.
+*/
+
+#define FLOW_INF 0xffffffff
+
+uint flowCellIndex(int4 c, uint4 gridSize)
+{
+	return c.x + gridSize.x * c.z + gridSize.x * gridSize.z * c.y;
+}
+
+int4 flowCellPos(uint cell, uint4 gridSize)
+{
+	return (int4)(cell % gridSize.x, cell / (gridSize.x * gridSize.z), (cell / gridSize.x) % gridSize.z, 0);
+}
+
+/*true if an agent can step from cell c to its neighbour c + o*/
+bool canStep(__global const uchar* blocked, int4 c, int4 o, uint4 gridSize)
+{
+	int4 n = c + o;
+	if (n.x < 0 || n.x >= gridSize.x || n.y < 0 || n.y >= gridSize.y || n.z < 0 || n.z >= gridSize.z)
+		return false;
+
+	if (blocked[flowCellIndex(n, gridSize)])
+		return false;
+
+	//no diagonal step past the corner of a blocked cell
+	if (o.x != 0 && blocked[flowCellIndex(c + (int4)(o.x, 0, 0, 0), gridSize)])
+		return false;
+	if (o.y != 0 && blocked[flowCellIndex(c + (int4)(0, o.y, 0, 0), gridSize)])
+		return false;
+	if (o.z != 0 && blocked[flowCellIndex(c + (int4)(0, 0, o.z, 0), gridSize)])
+		return false;
+
+	return true;
+}
+
+/*distance 0 in the goal cell, everything else is not reached yet. One work item per goal and cell.*/
+__kernel void initFlowField(__global const uint* goalCell,
+							__global const uchar* blocked,
+							__global uint* dist,
+							uint4 gridSize)
+{
+	uint id = get_global_id(0);
+	uint numCells = gridSize.x * gridSize.y * gridSize.z;
+	uint goal = id / numCells;
+	uint cell = id % numCells;
+
+	dist[id] = (cell == goalCell[goal] && !blocked[cell]) ? 0 : FLOW_INF;
+}
+
+/*one wavefront step, every cell takes the shortest distance over its neighbours.
+  changed is set if any distance got shorter.*/
+__kernel void relaxFlowField(__global const uchar* blocked,
+							 __global uint* dist,
+							 uint4 gridSize,
+							 __global uint* changed)
+{
+	uint id = get_global_id(0);
+	uint numCells = gridSize.x * gridSize.y * gridSize.z;
+	uint goal = id / numCells;
+	uint cell = id % numCells;
+
+	if (blocked[cell])
+		return;
+
+	__global uint* field = dist + goal * numCells;
+	int4 c = flowCellPos(cell, gridSize);
+	uint best = dist[id];
+
+	for (int y = -1; y <= 1; y++){
+		for (int z = -1; z <= 1; z++){
+			for (int x = -1; x <= 1; x++){
+				int4 o = (int4)(x, y, z, 0);
+				if ((x == 0 && y == 0 && z == 0) || !canStep(blocked, c, o, gridSize))
+					continue;
+
+				uint d = field[flowCellIndex(c + o, gridSize)];
+				if (d == FLOW_INF)
+					continue;
+
+				uint steps = abs(x) + abs(y) + abs(z);
+				uint cost = steps == 1 ? 10 : (steps == 2 ? 14 : 17);
+				best = min(best, d + cost);
+			}
+		}
+	}
+
+	//neighbours of this cell in other work items read it concurrently, distances only decrease
+	if (best < dist[id]){
+		atomic_min(&dist[id], best);
+		*changed = 1;
+	}
+}
+
+/*normalized direction to the neighbour closest to the goal, zero in the goal cell and in cells
+  which can not reach the goal*/
+__kernel void flowDirection(__global const uchar* blocked,
+							__global const uint* dist,
+							uint4 gridSize,
+							__global float4* flowDir)
+{
+	uint id = get_global_id(0);
+	uint numCells = gridSize.x * gridSize.y * gridSize.z;
+	uint goal = id / numCells;
+	uint cell = id % numCells;
+
+	__global const uint* field = dist + goal * numCells;
+	int4 c = flowCellPos(cell, gridSize);
+	uint best = dist[id];
+	float4 dir = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+	if (best != 0 && best != FLOW_INF && !blocked[cell]){
+		for (int y = -1; y <= 1; y++){
+			for (int z = -1; z <= 1; z++){
+				for (int x = -1; x <= 1; x++){
+					int4 o = (int4)(x, y, z, 0);
+					if ((x == 0 && y == 0 && z == 0) || !canStep(blocked, c, o, gridSize))
+						continue;
+
+					uint d = field[flowCellIndex(c + o, gridSize)];
+					if (d < best){
+						best = d;
+						dir = normalize((float4)(x, y, z, 0.0f));
+					}
+				}
+			}
+		}
+	}
+
+	flowDir[id] = dir;
+}
@@ -0,0 +1,148 @@
+/*
+	Signed distance field of a triangle mesh on the nodes of the obstacle field, one work item
+	per node. Node index is x + nx * (z + nz * y) like the baked obstacle field. The triangles
+	are staged in local memory tile by tile, every node keeps the distance to the closest
+	triangle and the generalized winding number for the sign.
+*/
+
+/*distance of p to the triangle abc, closest point on triangle (Ericson, Real-Time Collision Detection 5.1.5)*/
+float distancePointTriangle(float3 p, float3 a, float3 b, float3 c)
+{
+	float3 ab = b - a;
+	float3 ac = c - a;
+	float3 ap = p - a;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return length(ap);
+
+	float3 bp = p - b;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return length(bp);
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return length(p - (a + ab * (d1 / (d1 - d3))));
+
+	float3 cp = p - c;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return length(cp);
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return length(p - (a + ac * (d2 / (d2 - d6))));
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+
+	float denom = 1.0f / (va + vb + vc);
+	return length(p - (a + ab * (vb * denom) + ac * (vc * denom)));
+}
+
+/*signed solid angle of the triangle abc seen from p (Van Oosterom and Strackee)*/
+float solidAngle(float3 p, float3 a, float3 b, float3 c)
+{
+	a -= p;
+	b -= p;
+	c -= p;
+	float la = length(a);
+	float lb = length(b);
+	float lc = length(c);
+
+	float det = dot(a, cross(b, c));
+	float div = la * lb * lc + dot(a, b) * lc + dot(b, c) * la + dot(c, a) * lb;
+
+	return 2.0f * atan2(det, div);
+}
+
+/*signed distance per node, negative inside the mesh. tri holds three corners per triangle*/
+__kernel void sdfDistance(__global const float4* tri,
+						  uint numTris,
+						  uint4 nodeCount,
+						  float4 origin,
+						  float4 spacing,
+						  __global float* dist,
+						  __local float4* tileTri)
+{
+	uint id = get_global_id(0);
+	uint lId = get_local_id(0);
+	uint lSize = get_local_size(0);
+	uint numNodes = nodeCount.x * nodeCount.y * nodeCount.z;
+
+	uint x = id % nodeCount.x;
+	uint z = (id / nodeCount.x) % nodeCount.z;
+	uint y = id / (nodeCount.x * nodeCount.z);
+	float3 p = origin.xyz + (float3)(x, y, z) * spacing.xyz;
+
+	float d = MAXFLOAT;
+	float winding = 0.0f;
+
+	//work items behind the last node still load their part of every tile
+	for (uint tile = 0; tile < numTris; tile += lSize){
+		if (tile + lId < numTris){
+			tileTri[3 * lId] = tri[3 * (tile + lId)];
+			tileTri[3 * lId + 1] = tri[3 * (tile + lId) + 1];
+			tileTri[3 * lId + 2] = tri[3 * (tile + lId) + 2];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		uint count = min(lSize, numTris - tile);
+		for (uint t = 0; t < count; t++){
+			float3 a = tileTri[3 * t].xyz;
+			float3 b = tileTri[3 * t + 1].xyz;
+			float3 c = tileTri[3 * t + 2].xyz;
+
+			d = fmin(d, distancePointTriangle(p, a, b, c));
+			winding += solidAngle(p, a, b, c);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (id >= numNodes)
+		return;
+
+	//generalized winding number, about 1 inside and 0 outside of a closed mesh
+	if (winding / (4.0f * M_PI_F) > 0.5f)
+		d = -d;
+
+	dist[id] = d;
+}
+
+/*normalized gradient of the distance by central differences in xyz, the distance in w*/
+__kernel void sdfGradient(__global const float* dist,
+						  uint4 nodeCount,
+						  float4 spacing,
+						  __global float4* nodes)
+{
+	uint id = get_global_id(0);
+	uint nx = nodeCount.x;
+	uint ny = nodeCount.y;
+	uint nz = nodeCount.z;
+	if (id >= nx * ny * nz)
+		return;
+
+	uint x = id % nx;
+	uint z = (id / nx) % nz;
+	uint y = id / (nx * nz);
+
+	uint x0 = x > 0 ? x - 1 : x, x1 = x < nx - 1 ? x + 1 : x;
+	uint y0 = y > 0 ? y - 1 : y, y1 = y < ny - 1 ? y + 1 : y;
+	uint z0 = z > 0 ? z - 1 : z, z1 = z < nz - 1 ? z + 1 : z;
+
+	float4 grad = (float4)((dist[x1 + nx * (z + nz * y)] - dist[x0 + nx * (z + nz * y)]) / ((x1 - x0) * spacing.x),
+						   (dist[x + nx * (z + nz * y1)] - dist[x + nx * (z + nz * y0)]) / ((y1 - y0) * spacing.y),
+						   (dist[x + nx * (z1 + nz * y)] - dist[x + nx * (z0 + nz * y)]) / ((z1 - z0) * spacing.z),
+						   0.0f);
+
+	float len = length(grad);
+	if (len > 0.0f)
+		grad /= len;
+
+	grad.w = dist[id];
+	nodes[id] = grad;
+}
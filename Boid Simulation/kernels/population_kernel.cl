@@ -0,0 +1,166 @@
+/*
+	Live population of the grid models. The buffers of a model hold capacity agents, an alive
+	mask in slot order tells which of them take part. Dead agents get the hash of a cell behind
+	the grid (numCells), so the sort of the step moves them behind all living agents and the
+	reorder compacts the population on the way. Afterwards the living agents are the slots
+	[0, live) and new agents are spawned into the slots from live on.
+*/
+
+/*hash of the dead agents is numCells, living agents outside the grid are kept in its last cell*/
+__kernel void markDead(
+	__global uint *gridHash,
+	__global const uchar *alive,
+	uint numCells,
+	uint capacity
+){
+	uint i = get_global_id(0);
+	if (i >= capacity)
+		return;
+
+	gridHash[i] = alive[i] ? min(gridHash[i], numCells - 1) : numCells;
+}
+
+/*alive mask and live count in the sorted order, the living agents are in front*/
+__kernel void updateAlive(
+	__global const uint *sortedHash,
+	__global uchar *alive,
+	__global uint *live,
+	uint numCells,
+	uint capacity
+){
+	uint i = get_global_id(0);
+	if (i >= capacity)
+		return;
+
+	bool living = sortedHash[i] < numCells;
+	alive[i] = living ? 1 : 0;
+
+	//the last living agent, or the first slot if none lives
+	if (living && (i + 1 == capacity || sortedHash[i + 1] >= numCells))
+		live[0] = i + 1;
+	else if (i == 0 && !living)
+		live[0] = 0;
+}
+
+bool insideBox(float4 p, float4 lo, float4 hi)
+{
+	return p.x >= lo.x && p.y >= lo.y && p.z >= lo.z && p.x <= hi.x && p.y <= hi.y && p.z <= hi.z;
+}
+
+float4 populationPos(__global const float *pos, uint slot, uint components, float yPos)
+{
+	if (components == 2){
+		float2 p = vload2(slot, pos);
+		return (float4)(p.x, yPos, p.y, 0.0f);
+	}
+	return vload4(slot, pos);
+}
+
+/*agents inside one of the sink boxes (min, max pairs) die*/
+__kernel void despawnSinks(
+	__global const float *pos,
+	__global uchar *alive,
+	__global const float4 *sinks,
+	uint numSinks,
+	uint components,
+	float yPos,
+	uint capacity
+){
+	uint i = get_global_id(0);
+	if (i >= capacity || !alive[i])
+		return;
+
+	float4 p = populationPos(pos, i, components, yPos);
+	for (uint s = 0; s < numSinks; s++){
+		if (insideBox(p, sinks[2 * s], sinks[2 * s + 1])){
+			alive[i] = 0;
+			return;
+		}
+	}
+}
+
+uint populationRandom(uint x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x = x ^ (x >> 4);
+	x *= 0x27d4eb2d;
+	x = x ^ (x >> 15);
+	return x;
+}
+
+float populationUniform(uint seed, uint slot, uint axis)
+{
+	return (float)(populationRandom(seed ^ populationRandom(slot * 4 + axis)) & 0xffffff) / (float)0x1000000;
+}
+
+/*every living agent dies if the hash of its slot is below threshold, out of 2^24. The slots are
+sorted by cell, a hash spreads the victims over the whole world instead of its last cells*/
+__kernel void despawnRandom(
+	__global uchar *alive,
+	uint threshold,
+	uint seed,
+	uint capacity
+){
+	uint i = get_global_id(0);
+	if (i >= capacity || !alive[i])
+		return;
+
+	if ((populationRandom(seed ^ populationRandom(i)) & 0xffffff) < threshold)
+		alive[i] = 0;
+}
+
+/*count new agents in the free slots from live on, uniform in the box of the emitter with its
+velocity and a random part of length jitter. Two component models use x and z. group and goal
+are NULL for models without them, otherwise the slot joins groupId and goalPos*/
+__kernel void spawn(
+	__global float *pos,
+	__global float *vel,
+	__global uchar *alive,
+	__global const uint *live,
+	float4 boxMin,
+	float4 boxMax,
+	float4 velocity,
+	float jitter,
+	uint count,
+	uint seed,
+	uint components,
+	uint capacity,
+	__global uchar *group,
+	__global float4 *goal,
+	uint groupId,
+	float4 goalPos
+){
+	uint g = get_global_id(0);
+	uint slot = live[0] + g;
+	if (g >= count || slot >= capacity)
+		return;
+
+	float4 r = (float4)(populationUniform(seed, slot, 0), populationUniform(seed, slot, 1), populationUniform(seed, slot, 2), 0.0f);
+	float4 p = boxMin + r * (boxMax - boxMin);
+	float4 j = (float4)(populationUniform(seed, slot, 3), populationUniform(seed ^ 0x9e3779b9, slot, 0), populationUniform(seed ^ 0x9e3779b9, slot, 1), 0.0f);
+	float4 v = velocity + jitter * (2.0f * j - (float4)(1.0f, 1.0f, 1.0f, 0.0f));
+
+	if (components == 2){
+		vstore2((float2)(p.x, p.z), slot, pos);
+		vstore2((float2)(v.x, v.z), slot, vel);
+	}
+	else{
+		vstore4((float4)(p.xyz, 1.0f), slot, pos);
+		vstore4((float4)(v.xyz, 0.0f), slot, vel);
+	}
+	if (group)
+		group[slot] = (uchar)groupId;
+	if (goal)
+		goal[slot] = goalPos;
+	alive[slot] = 1;
+}
+
+/*the spawned slots are taken, for the next spawn of the step*/
+__kernel void commitSpawn(
+	__global uint *live,
+	uint count,
+	uint capacity
+){
+	live[0] = min(live[0] + count, capacity);
+}
@@ -0,0 +1,108 @@
+/*
+	Spherical harmonics basis for band order SH_ORDER (L = 1..3, L*L coefficients).
+	SH_ORDER is defined by the host (CLHelper::getSHBasisSource) in front of this file.
+	Numerical implementation from P.P. Sloan, z is the polar axis.
+
+	Coefficient 0 is constant (SH_C0), it is kept in a separate float per cell and
+	just added at the reconstruction. The remaining L*L-1 coefficients are stored in
+	shvec_t, unused components are zero:
+	L = 1: float   (no coefficient)
+	L = 2: float4  (s0..s2 band 1)
+	L = 3: float8  (s0..s2 band 1, s3..s7 band 2)
+
+	There is no L = 4: the reconstruction convolves with the clamped cosine lobe, whose
+	weight is zero for every odd band above 1. Band 3 would double the bandwidth
+	(float16) and add nothing to the result.
+*/
+#ifndef SH_ORDER
+	#define SH_ORDER 3
+#endif
+
+#define SH_C0 0.2820947917738781f
+
+//weights of the reconstruction per band (clamped cosine lobe)
+#define SH_W0 M_PI_F
+#define SH_W1 (M_PI_F * 2.0f / 3.0f)
+#define SH_W2 (M_PI_F / 4.0f)
+
+#if SH_ORDER == 1
+	typedef float shvec_t;
+#elif SH_ORDER == 2
+	typedef float4 shvec_t;
+#elif SH_ORDER == 3
+	typedef float8 shvec_t;
+#else
+	#error "SH_ORDER has to be between 1 and 3"
+#endif
+
+#define SH_ZERO ((shvec_t)(0.0f))
+
+/*evaluate the non constant SH basis functions for the normalized direction dir*/
+shvec_t SHEval(float4 dir)
+{
+	shvec_t pSH = SH_ZERO;
+#if SH_ORDER > 1
+	float fC0, fC1, fS0, fS1, fTmpA, fTmpB, fTmpC;
+	float fZ2 = dir.z * dir.z;
+
+	pSH.s1 = 0.4886025119029199f * dir.z;
+	fC0 = dir.x;
+	fS0 = dir.y;
+
+	fTmpA = -0.48860251190292f;
+	pSH.s2 = fTmpA * fC0;
+	pSH.s0 = fTmpA * fS0;
+#endif
+#if SH_ORDER > 2
+	pSH.s5 = 0.9461746957575601f * fZ2 + -0.3153915652525201f;
+
+	fTmpB = -1.092548430592079f * dir.z;
+	pSH.s6 = fTmpB * fC0;
+	pSH.s4 = fTmpB * fS0;
+	fC1 = dir.x * fC0 - dir.y * fS0;
+	fS1 = dir.x * fS0 + dir.y * fC0;
+
+	fTmpC = 0.5462742152960395f;
+	pSH.s7 = fTmpC * fC1;
+	pSH.s3 = fTmpC * fS1;
+#endif
+	return pSH;
+}
+
+/*weighted product of two sets of non constant coefficients (reconstruction without band 0)*/
+float SHDot(shvec_t a, shvec_t b)
+{
+	float sum = 0.0f;
+#if SH_ORDER > 1
+	sum += (a.s0 * b.s0 + a.s1 * b.s1 + a.s2 * b.s2) * SH_W1;
+#endif
+#if SH_ORDER > 2
+	sum += (a.s3 * b.s3 + a.s4 * b.s4 + a.s5 * b.s5 + a.s6 * b.s6 + a.s7 * b.s7) * SH_W2;
+#endif
+	return sum;
+}
+
+/*unweighted product of two sets of non constant coefficients*/
+float SHProduct(shvec_t a, shvec_t b)
+{
+#if SH_ORDER == 1
+	return a * b;
+#elif SH_ORDER == 2
+	return dot(a, b);
+#else
+	return dot(a.lo, b.lo) + dot(a.hi, b.hi);
+#endif
+}
+
+/*largest component of a set of non constant coefficients*/
+float SHMax(shvec_t a)
+{
+#if SH_ORDER == 1
+	return a;
+#elif SH_ORDER == 2
+	return fmax(fmax(a.s0, a.s1), a.s2);
+#else
+	float4 m = fmax(a.lo, a.hi);
+	return fmax(fmax(m.x, m.y), fmax(m.z, m.w));
+#endif
+}
@@ -0,0 +1,268 @@
+/*
+	Radius and k nearest neighbour queries against the cell grid of the boid models. cellStart
+	and cellEnd are the ranges of the agents of every cell in the sorted order of the step, pos
+	holds the agents in that order and agentIds the id of the agent in every slot. Results are
+	written compactly: offsets[q] to offsets[q + 1] are the ids of query point q.
+
+	Planar models (2 components) store x and z and hash x + gridSize.x * z, the y of the query
+	points is ignored for them. Cell hash of the 3D models is x + gridSize.x * z + gridSize.x *
+	gridSize.z * y.
+
+	QUERY_MAX_K is passed as build option.
+*/
+
+#ifndef QUERY_MAX_K
+#define QUERY_MAX_K 32
+#endif
+
+int4 queryCell(float4 p, float4 worldOrigin, float4 cellSize, uint4 gridSize, uint planar)
+{
+	int4 c = convert_int4(floor((p - worldOrigin) / cellSize));
+	c = clamp(c, (int4)(0, 0, 0, 0), convert_int4(gridSize) - (int4)(1, 1, 1, 1));
+	c.w = 0;
+	if (planar)
+		c.y = 0;
+	return c;
+}
+
+uint queryHash(int4 c, uint4 gridSize, uint planar)
+{
+	if (planar)
+		return c.x + gridSize.x * c.z;
+	return c.x + gridSize.x * c.z + gridSize.x * gridSize.z * c.y;
+}
+
+/*position of the agent in slot, y is 0 for planar models*/
+float4 queryAgent(__global const float *pos, uint slot, uint planar)
+{
+	if (planar){
+		float2 p = vload2(slot, pos);
+		return (float4)(p.x, 0.0f, p.y, 0.0f);
+	}
+	float4 p = vload4(slot, pos);
+	return (float4)(p.xyz, 0.0f);
+}
+
+float4 queryPoint(float4 p, uint planar)
+{
+	p.w = 0.0f;
+	if (planar)
+		p.y = 0.0f;
+	return p;
+}
+
+/*agents within radius of the point, written into ids from offset on if store is set*/
+uint radiusSearch(
+	float4 p,
+	float radius,
+	__global const float *pos,
+	__global const uint *cellStart,
+	__global const uint *cellEnd,
+	__global const uint *agentIds,
+	uint4 gridSize,
+	float4 cellSize,
+	float4 worldOrigin,
+	uint planar,
+	uint store,
+	__global uint *ids,
+	uint offset,
+	uint capacity
+){
+	float4 extent = (float4)(radius, radius, radius, 0.0f);
+	int4 lo = queryCell(p - extent, worldOrigin, cellSize, gridSize, planar);
+	int4 hi = queryCell(p + extent, worldOrigin, cellSize, gridSize, planar);
+	float r2 = radius * radius;
+	uint found = 0;
+
+	for (int y = lo.y; y <= hi.y; y++)
+	for (int z = lo.z; z <= hi.z; z++)
+	for (int x = lo.x; x <= hi.x; x++){
+		uint hash = queryHash((int4)(x, y, z, 0), gridSize, planar);
+		uint end = cellEnd[hash];
+		for (uint i = cellStart[hash]; i < end; i++){
+			float4 d = queryAgent(pos, i, planar) - p;
+			if (dot(d, d) > r2)
+				continue;
+			if (store && offset + found < capacity)
+				ids[offset + found] = agentIds[i];
+			found++;
+		}
+	}
+	return found;
+}
+
+__kernel void radiusCount(
+	__global const float4 *points,
+	float radius,
+	__global const float *pos,
+	__global const uint *cellStart,
+	__global const uint *cellEnd,
+	__global const uint *agentIds,
+	uint4 gridSize,
+	float4 cellSize,
+	float4 worldOrigin,
+	uint planar,
+	__global uint *counts,
+	uint count
+){
+	uint q = get_global_id(0);
+	if (q >= count)
+		return;
+
+	float4 p = queryPoint(points[q], planar);
+	counts[q] = radiusSearch(p, radius, pos, cellStart, cellEnd, agentIds, gridSize, cellSize, worldOrigin, planar, 0, 0, 0, 0);
+}
+
+/*same search as radiusCount, the results beyond capacity are dropped and the batch runs again*/
+__kernel void radiusFill(
+	__global const float4 *points,
+	float radius,
+	__global const float *pos,
+	__global const uint *cellStart,
+	__global const uint *cellEnd,
+	__global const uint *agentIds,
+	uint4 gridSize,
+	float4 cellSize,
+	float4 worldOrigin,
+	uint planar,
+	__global const uint *offsets,
+	__global uint *ids,
+	uint capacity,
+	uint count
+){
+	uint q = get_global_id(0);
+	if (q >= count)
+		return;
+
+	float4 p = queryPoint(points[q], planar);
+	radiusSearch(p, radius, pos, cellStart, cellEnd, agentIds, gridSize, cellSize, worldOrigin, planar, 1, ids, offsets[q], capacity);
+}
+
+/*k nearest agents of every point in the order of their distance, searched in shells of cells
+around the cell of the point. Agents in shells further out than ring are at least ring cells away,
+the search stops once the k-th agent is closer than that*/
+__kernel void nearest(
+	__global const float4 *points,
+	uint k,
+	__global const float *pos,
+	__global const uint *cellStart,
+	__global const uint *cellEnd,
+	__global const uint *agentIds,
+	uint4 gridSize,
+	float4 cellSize,
+	float4 worldOrigin,
+	uint planar,
+	__global uint *candidates,		//k entries per point
+	__global uint *counts,
+	uint count
+){
+	uint q = get_global_id(0);
+	if (q >= count)
+		return;
+
+	float4 p = queryPoint(points[q], planar);
+	int4 c = queryCell(p, worldOrigin, cellSize, gridSize, planar);
+	float minCell = planar ? min(cellSize.x, cellSize.z) : min(min(cellSize.x, cellSize.y), cellSize.z);
+	int maxRing = max(max((int)gridSize.x, (int)gridSize.z), planar ? 0 : (int)gridSize.y);
+	int yRange = planar ? 0 : 1;
+
+	float bestDist[QUERY_MAX_K];
+	uint bestSlot[QUERY_MAX_K];
+	uint found = 0;
+
+	for (int ring = 0; ring <= maxRing; ring++){
+		for (int dy = -ring * yRange; dy <= ring * yRange; dy++)
+		for (int dz = -ring; dz <= ring; dz++){
+			//inside the faces of the shell only its two x ends belong to it
+			int step = (abs(dy) == ring || abs(dz) == ring || ring == 0) ? 1 : 2 * ring;
+			for (int dx = -ring; dx <= ring; dx += step){
+				int4 n = c + (int4)(dx, dy, dz, 0);
+				if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= (int)gridSize.x || n.y >= (int)gridSize.y || n.z >= (int)gridSize.z)
+					continue;
+
+				uint hash = queryHash(n, gridSize, planar);
+				uint end = cellEnd[hash];
+				for (uint i = cellStart[hash]; i < end; i++){
+					float4 d = queryAgent(pos, i, planar) - p;
+					float dist = dot(d, d);
+					if (found < k)
+						found++;
+					else if (dist >= bestDist[k - 1])
+						continue;
+
+					//insertion into the sorted list
+					int j = found - 1;
+					while (j > 0 && bestDist[j - 1] > dist){
+						bestDist[j] = bestDist[j - 1];
+						bestSlot[j] = bestSlot[j - 1];
+						j--;
+					}
+					bestDist[j] = dist;
+					bestSlot[j] = i;
+				}
+			}
+		}
+
+		float reach = ring * minCell;
+		if (found == k && bestDist[k - 1] <= reach * reach)
+			break;
+	}
+
+	for (uint j = 0; j < found; j++)
+		candidates[q * k + j] = agentIds[bestSlot[j]];
+	counts[q] = found;
+}
+
+/*candidates of the nearest queries into the compact result*/
+__kernel void nearestCompact(
+	__global const uint *candidates,
+	__global const uint *counts,
+	__global const uint *offsets,
+	__global uint *ids,
+	uint k,
+	uint count
+){
+	uint q = get_global_id(0);
+	if (q >= count)
+		return;
+
+	uint offset = offsets[q];
+	for (uint j = 0; j < counts[q]; j++)
+		ids[offset + j] = candidates[q * k + j];
+}
+
+/*exclusive prefix sum of counts into offsets, offsets[count] is the total. One work group,
+every work item sums a contiguous chunk*/
+__kernel void scanCounts(
+	__global const uint *counts,
+	__global uint *offsets,
+	__local uint *sums,
+	uint count
+){
+	uint l = get_local_id(0);
+	uint size = get_local_size(0);
+	uint chunk = (count + size - 1) / size;
+	uint begin = min(l * chunk, count);
+	uint end = min(begin + chunk, count);
+
+	uint sum = 0;
+	for (uint i = begin; i < end; i++)
+		sum += counts[i];
+	sums[l] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint d = 1; d < size; d <<= 1){
+		uint add = l >= d ? sums[l - d] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sums[l] += add;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	uint run = l > 0 ? sums[l - 1] : 0;
+	for (uint i = begin; i < end; i++){
+		offsets[i] = run;
+		run += counts[i];
+	}
+	if (l == size - 1)
+		offsets[count] = sums[size - 1];
+}
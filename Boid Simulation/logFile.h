@@ -10,18 +10,63 @@
 
 #include "stdafx.h"
 
-/* Simple logger. Logfile path is set in simParam.h */
+/*
+	Asynchronous logger. Logfile path, format and level are set in simParam.h. Producers put their
+	entries with a timestamp of the performance counter into a lock-free ring (any number of
+	producer threads, one consumer), a flusher thread formats them and writes them to the file
+	which stays open. A producer never waits for the file, if the ring is full the entry is
+	dropped and the number of dropped entries is written with the next batch.
+
+	Binary format: one record per entry, double seconds since the start of the log, uint8 level,
+	uint32 length of the text and the text itself (little endian).
+*/
 class LogFile
 {
 
 public:
+	enum level_t { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR };
+	enum format_t { FORMAT_TEXT, FORMAT_JSON, FORMAT_BINARY };
+
 	LogFile(std::string fileName);
+	// writes all entries and stops the flusher
 	~LogFile();
 
-	// write to log file
-	void writeLog(const std::string &entry);
+	// add an entry to the log file
+	void writeLog(std::string entry, level_t level = LOG_INFO);
+	// write all entries and stop the flusher, later entries are dropped
+	void close();
 
 private:
+	typedef struct{
+		// position in the ring the slot is free for (empty) or was written at plus one (full)
+		std::atomic<size_t> sequence;
+		long long ticks;
+		level_t level;
+		std::string entry;
+	} slot_t;
+
+	slot_t* ring;
+	// next position of the producers and of the flusher
+	std::atomic<size_t> head;
+	size_t tail;
+	std::atomic<unsigned int> dropped;
+
+	std::thread flusher;
+	std::atomic<bool> running;
+	std::ofstream file;
+
+	// performance counter and wall clock at the start of the log
+	long long ticksStart;
+	double tickFrequency;
+	time_t timeStart;
+
+	// write everything in the ring, flusher thread only
+	void flush();
+	// loop of the flusher thread
+	void flushLoop();
+	void writeEntry(double seconds, level_t level, const std::string &entry);
+	static const char* levelName(level_t level);
+
 	std::string fileName;
 
 	// get a timestamp when the file is created	
@@ -2,13 +2,45 @@
 #include "gfx.h"
 #include "simulation.h"
 
+/*
+	Command line for recording a run into an image sequence:
+	-record <dir> [-size <width>x<height>] [-frames <n>] [-format png|raw] [-headless]
+*/
+static void parseCommandLine(const char* cmdLine){
+	std::istringstream args(cmdLine);
+	std::string arg;
+	FrameRecorder::options_t options;
+	options.width = 1920;
+	options.height = 1080;
+	options.frames = 0;
+	options.png = true;
+	options.headless = false;
+	bool record = false;
+
+	while (args >> arg){
+		if (arg == "-record" && args >> options.dir)
+			record = true;
+		else if (arg == "-size" && args >> arg)
+			sscanf_s(arg.c_str(), "%dx%d", &options.width, &options.height);
+		else if (arg == "-frames")
+			args >> options.frames;
+		else if (arg == "-format" && args >> arg)
+			options.png = arg != "raw";
+		else if (arg == "-headless")
+			options.headless = true;
+	}
+
+	if (record && options.width > 0 && options.height > 0)
+		GFX::getInstance().setRecording(options);
+}
 
 int WINAPI WinMain(HINSTANCE hInstance,
 	HINSTANCE hPrevInstance,
 	LPSTR    lpCmdLine,
 	int       nCmdShow) {
 
+	parseCommandLine(lpCmdLine);
 	Simulation::getInstance().start();
-	
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,113 @@
+#version 430
+
+/*
+	Frustum culling and level of detail of the instanced boid rendering, one work item per boid.
+	Visible boids near the camera are written from the front of the instance buffer and drawn as
+	the triangle glyph, visible boids whose glyph is smaller than lodPixels on screen are written
+	from the back and drawn as points. The counts go straight into the indirect draw commands,
+	the finalize pass (one work item) sets the first instance of the points afterwards.
+*/
+
+layout(local_size_x = 256) in;
+
+//the buffers of the boid model, read as floats / bytes with stride and offset in their units
+layout(std430, binding = 0) readonly buffer PosBuffer { float posData[]; };
+layout(std430, binding = 1) readonly buffer VelBuffer { float velData[]; };
+layout(std430, binding = 2) readonly buffer ColorBuffer { float colorData[]; };
+layout(std430, binding = 3) readonly buffer GroupBuffer { uint groupData[]; };
+
+struct instance_t {
+	vec4 pos;
+	vec4 vel;
+	vec4 color;
+};
+layout(std430, binding = 4) writeonly buffer InstanceBuffer { instance_t instances[]; };
+
+//triangle and point command, each count / instanceCount / first / baseInstance
+layout(std430, binding = 5) buffer CommandBuffer { uint commands[8]; };
+
+uniform uint numBoids;
+uniform bool finalize;
+
+//2 for the 2D models which live in the plane y = yPlane, 4 otherwise
+uniform uint components;
+uniform float yPlane;
+uniform uvec2 posAccess;
+uniform uvec2 velAccess;
+uniform uvec2 colorAccess;
+uniform uvec2 groupAccess;
+
+//0 = color per boid, 1 = group id per boid, 2 = one color for all
+uniform int colorMode;
+uniform vec4 boidColor;
+uniform vec4 groupColor[NUM_GROUPS_MAX];
+
+uniform mat4 m_transform;
+//normalized frustum planes, a boid is visible if its glyph is not completely outside one of them
+uniform vec4 planes[6];
+uniform vec2 viewportSize;
+uniform float lodPixels;
+//seconds the drawn state is older than the frame, the boids are moved on by their velocity
+uniform float extrapolate;
+
+vec4 readVec(uint i, uvec2 access, bool isVel)
+{
+	uint b = i * access.x + access.y;
+	if (components == 2){
+		vec2 v = isVel ? vec2(velData[b], velData[b + 1]) : vec2(posData[b], posData[b + 1]);
+		return isVel ? vec4(v.x, 0.0, v.y, 0.0) : vec4(v.x, yPlane, v.y, 1.0);
+	}
+	if (isVel)
+		return vec4(velData[b], velData[b + 1], velData[b + 2], 0.0);
+	return vec4(posData[b], posData[b + 1], posData[b + 2], 1.0);
+}
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if (finalize){
+		if (i == 0)
+			commands[7] = numBoids - commands[5];
+		return;
+	}
+
+	if (i >= numBoids)
+		return;
+
+	vec4 vel = readVec(i, velAccess, true);
+	vec4 pos = readVec(i, posAccess, false) + vel * extrapolate;
+
+	//the glyph reaches one unit along the velocity from the position
+	for (int p = 0; p < 6; p++){
+		if (dot(planes[p], pos) < -1.0)
+			return;
+	}
+
+	vec4 color = boidColor;
+	if (colorMode == 0){
+		uint c = i * colorAccess.x + colorAccess.y;
+		color = vec4(colorData[c], colorData[c + 1], colorData[c + 2], colorData[c + 3]);
+	}
+	else if (colorMode == 1){
+		uint b = i * groupAccess.x + groupAccess.y;
+		uint group = (groupData[b >> 2] >> ((b & 3u) * 8u)) & 0xffu;
+		color = groupColor[min(group, uint(NUM_GROUPS_MAX - 1))];
+	}
+
+	//length of the glyph on screen in pixels
+	vec4 dir = length(vel.xyz) > 0.0 ? normalize(vel) : vec4(1.0, 0.0, 0.0, 0.0);
+	vec4 tail = m_transform * pos;
+	vec4 head = m_transform * (pos + dir);
+	float pixels = tail.w > 0.0 && head.w > 0.0 ? length((head.xy / head.w - tail.xy / tail.w) * 0.5 * viewportSize) : 0.0;
+
+	uint slot;
+	if (pixels >= lodPixels)
+		slot = atomicAdd(commands[1], 1);
+	else
+		slot = numBoids - 1 - atomicAdd(commands[5], 1);
+
+	instances[slot].pos = pos;
+	instances[slot].vel = dir;
+	instances[slot].color = color;
+}
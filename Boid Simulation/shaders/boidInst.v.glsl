@@ -0,0 +1,22 @@
+	#version 330
+
+	layout(location = 0) in vec4 instPos;
+	layout(location = 1) in vec4 instVel;
+	layout(location = 2) in vec4 instColor;
+
+	uniform mat4 m_transform;
+
+	out vec4 fColor;
+
+
+
+	//the two triangles of the glyph of boidTri.g.glsl, one instance per boid and one vertex per corner
+    void main(void) {
+		vec4 v = instVel;
+		vec4 p = vec4(-v.z, 0.0, v.x, 0.0) / 6;
+		vec4 p2 = vec4(0.0, -v.z, v.y, 0.0) / 6;
+		vec4 corner[6] = vec4[6](v, p, -p, v, p2, -p2);
+
+		gl_Position = m_transform * (instPos + corner[gl_VertexID]);
+		fColor = instColor;
+	}
@@ -0,0 +1,19 @@
+	#version 330
+
+	layout(location = 0) in vec4 instPos;
+	layout(location = 2) in vec4 instColor;
+
+	uniform mat4 m_transform;
+	//size of the point in pixels
+	uniform float pointSize;
+
+	out vec4 fColor;
+
+
+
+	//far boids, one instance per boid drawn as a single point
+    void main(void) {
+		gl_Position = m_transform * instPos;
+		gl_PointSize = pointSize;
+		fColor = instColor;
+	}
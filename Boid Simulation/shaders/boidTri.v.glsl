@@ -4,13 +4,16 @@
 	in vec4 coord3d;
     in vec4 color;
 
+	//seconds since the last simulation step, the boids are moved on by their velocity
+	uniform float extrapolate;
+
 	out vec4 gColor;
 	out vec4 gVel;
 
 
 
     void main(void) {
-		gl_Position = coord3d;
+		gl_Position = vec4(coord3d.xyz + vel3d.xyz * extrapolate, 1.0);
 		gColor = color;
 		gVel = normalize(vel3d);
 	}
\ No newline at end of file
@@ -0,0 +1,22 @@
+	#version 150
+	
+	in vec2 vel2d;
+	in vec2 coord2d;
+    in vec4 color;
+
+	//height of the plane the 2D models live in
+	uniform float y_plane;
+	//seconds since the last simulation step, the boids are moved on by their velocity
+	uniform float extrapolate;
+
+	out vec4 gColor;
+	out vec4 gVel;
+
+
+
+    void main(void) {
+		vec2 pos = coord2d + vel2d * extrapolate;
+		gl_Position = vec4(pos.x, y_plane, pos.y, 1.0);
+		gColor = color;
+		gVel = normalize(vec4(vel2d.x, 0.0, vel2d.y, 0.0));
+	}
\ No newline at end of file
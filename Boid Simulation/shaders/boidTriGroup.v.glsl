@@ -0,0 +1,22 @@
+	#version 150
+	
+	in vec4 vel3d;
+	in vec4 coord3d;
+    in float group;
+
+	//one color per group, NUM_GROUPS_MAX is defined by the host
+	uniform vec4 groupColor[NUM_GROUPS_MAX];
+
+	//seconds since the last simulation step, the boids are moved on by their velocity
+	uniform float extrapolate;
+
+	out vec4 gColor;
+	out vec4 gVel;
+
+
+
+    void main(void) {
+		gl_Position = vec4(coord3d.xyz + vel3d.xyz * extrapolate, 1.0);
+		gColor = groupColor[int(group)];
+		gVel = normalize(vel3d);
+	}
\ No newline at end of file
@@ -4,8 +4,9 @@
     uniform vec4 color;
     varying vec4 f_color;
     uniform mat4 m_transform;
+    uniform vec4 translation;
 
     void main(void) {
-		gl_Position = m_transform * coord3d;
+		gl_Position = m_transform * (coord3d + translation);
 		f_color = color;
     }
\ No newline at end of file
@@ -19,7 +19,16 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
-
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <chrono>
+
+//sockets of the metrics endpoint, before windows.h which would pull in the old winsock.h
+#include <winsock2.h>
 
 //OpenGL include
 //#include <GL/gl.h> // for gemotry shaders